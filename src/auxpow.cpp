@@ -14,8 +14,12 @@
 #include <primitives/block.h>
 #include <script/script.h>
 #include <util/strencodings.h>
+#include <util/time.h>
+#include <util/trace.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 
 namespace
 {
@@ -35,10 +39,42 @@ DecodeLE32 (const unsigned char* bytes)
   return res;
 }
 
+std::atomic<uint64_t> g_auxpow_checks{0};
+std::atomic<uint64_t> g_auxpow_check_failures{0};
+std::atomic<uint64_t> g_auxpow_check_ns{0};
+
 } // anonymous namespace
 
 util::Result<bool>
-CAuxPow::check (const uint256& hashAuxBlock, int nChainId,
+CAuxPow::check (const uint256& hashAuxBlock, const int nChainId,
+                const Consensus::Params& params) const
+{
+  const auto start = SteadyClock::now ();
+  auto res = checkBranches (hashAuxBlock, nChainId, params);
+  const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds> (
+      SteadyClock::now () - start).count ();
+
+  g_auxpow_checks.fetch_add (1, std::memory_order_relaxed);
+  g_auxpow_check_ns.fetch_add (ns, std::memory_order_relaxed);
+  if (!res)
+    g_auxpow_check_failures.fetch_add (1, std::memory_order_relaxed);
+  TRACE2 (auxpow, check, bool (res), ns);
+
+  return res;
+}
+
+AuxpowCheckStats
+CAuxPow::getCheckStats ()
+{
+  AuxpowCheckStats stats;
+  stats.checks = g_auxpow_checks.load (std::memory_order_relaxed);
+  stats.failures = g_auxpow_check_failures.load (std::memory_order_relaxed);
+  stats.total_ns = g_auxpow_check_ns.load (std::memory_order_relaxed);
+  return stats;
+}
+
+util::Result<bool>
+CAuxPow::checkBranches (const uint256& hashAuxBlock, int nChainId,
                 const Consensus::Params& params) const
 {
     if (params.fStrictChainId && parentBlock.GetChainId () == nChainId)
@@ -38,6 +38,14 @@ static const unsigned char pchMergedMiningHeader[] = { 0xfa, 0xbe, 'm', 'm' };
  * coinbase tx) and a second merkle branch to link the actual Namecoin block
  * header to the parent block header, which is mined to satisfy the PoW.
  */
+/** Process-wide counters for CAuxPow::check, reported by getpowstats.  */
+struct AuxpowCheckStats
+{
+  uint64_t checks{0};
+  uint64_t failures{0};
+  uint64_t total_ns{0};
+};
+
 class CAuxPow
 {
 
@@ -66,6 +74,10 @@ private:
                                     const std::vector<uint256>& vMerkleBranch,
                                     int nIndex);
 
+  /** Does the actual work of check, without recording statistics.  */
+  util::Result<bool> checkBranches (const uint256& hashAuxBlock, int nChainId,
+                                    const Consensus::Params& params) const;
+
   friend UniValue AuxpowToJSON(const CAuxPow& auxpow, bool verbose,
                                Chainstate& active_chainstate);
   friend class auxpow_tests::CAuxPowForTest;
@@ -117,6 +129,12 @@ public:
   util::Result<bool> check (const uint256& hashAuxBlock, int nChainId,
               const Consensus::Params& params) const;
 
+  /**
+   * Returns how many auxpows were checked so far, how many of them failed
+   * and the total time spent in check.
+   */
+  static AuxpowCheckStats getCheckStats ();
+
   /**
    * Returns the parent block hash.
    */
@@ -6,6 +6,7 @@
 
 #include <clientversion.h>
 #include <common/args.h>
+#include <crypto/flex/flex.h>
 #include <crypto/sha256.h>
 #include <util/fs.h>
 #include <util/strencodings.h>
@@ -61,14 +62,10 @@ static uint8_t parsePriorityLevel(const std::string& str) {
 
 int main(int argc, char** argv)
 {
-    /* FIXME: Re-enable benchmarking after it has been fixed for auxpow.
-       See https://github.com/namecoin/namecoin-core/issues/273.  */
-    fprintf(stderr, "bench_bitcoin is disabled in Namecoin/Auxpow\n");
-    return EXIT_SUCCESS;
-
     ArgsManager argsman;
     SetupBenchArgs(argsman);
     SHA256AutoDetect();
+    FlexAutoDetect();
     std::string error;
     if (!argsman.ParseParameters(argc, argv, error)) {
         tfm::format(std::cerr, "Error parsing command line arguments: %s\n", error);
@@ -125,6 +122,15 @@ int main(int argc, char** argv)
         return EXIT_SUCCESS;
     }
 
+    /* FIXME: Re-enable benchmarking after it has been fixed for auxpow.
+       See https://github.com/namecoin/namecoin-core/issues/273.
+       Until then, only run benchmarks that are selected explicitly, such as
+       the Flex ones, which do not depend on Bitcoin block data.  */
+    if (!argsman.IsArgSet("-filter") && !argsman.GetBoolArg("-list", false)) {
+        fprintf(stderr, "bench_bitcoin is disabled in Namecoin/Auxpow, select benchmarks with -filter (e.g. -filter='(Flex|CNFN|PoWHash|PowHash|BlockHashSHA3).*')\n");
+        return EXIT_SUCCESS;
+    }
+
     try {
         benchmark::Args args;
         args.asymptote = parseAsymptote(argsman.GetArg("-asymptote", ""));
@@ -49,4 +49,29 @@ static void CCoinsCaching(benchmark::Bench& bench)
     });
 }
 
+// Fill a cache with coins and look them all up again, the way a block's
+// outputs are added and later spent from the tip cache.
+static void CCoinsCacheFill(benchmark::Bench& bench)
+{
+    constexpr uint32_t NUM_COINS{100'000};
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(NUM_COINS);
+    for (uint32_t i{0}; i < NUM_COINS; ++i) {
+        outpoints.emplace_back(Txid::FromUint256(uint256{static_cast<uint8_t>(i)}), i);
+    }
+    CTxOut txout{COIN, CScript() << OP_0 << std::vector<unsigned char>(20, 1)};
+
+    CCoinsView coinsDummy;
+    bench.batch(NUM_COINS).unit("coin").run([&] {
+        CCoinsViewCache coins(&coinsDummy);
+        for (const auto& outpoint : outpoints) {
+            coins.AddCoin(outpoint, Coin{txout, 1, false}, /*possible_overwrite=*/false);
+        }
+        for (const auto& outpoint : outpoints) {
+            assert(coins.HaveCoinInCache(outpoint));
+        }
+    });
+}
+
 BENCHMARK(CCoinsCaching, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CCoinsCacheFill, benchmark::PriorityLevel::HIGH);
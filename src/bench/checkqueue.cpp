@@ -5,10 +5,12 @@
 #include <bench/bench.h>
 #include <checkqueue.h>
 #include <common/system.h>
+#include <hash.h>
 #include <key.h>
 #include <prevector.h>
 #include <pubkey.h>
 #include <random.h>
+#include <uint256.h>
 
 #include <vector>
 
@@ -64,3 +66,58 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     });
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, benchmark::PriorityLevel::HIGH);
+
+// Checks with roughly the cost of a cheap script check, submitted the way
+// ConnectBlock() does, one small batch per transaction. The benchmarks below
+// run them with an increasing number of worker threads to show how the queue
+// scales; counts beyond the number of cores oversubscribe the machine.
+static void CCheckQueueScaling(benchmark::Bench& bench, int worker_threads_num)
+{
+    struct HashJob {
+        uint256 data;
+        bool operator()()
+        {
+            for (int i = 0; i < 32; ++i) {
+                data = Hash(data);
+            }
+            return true;
+        }
+    };
+
+    CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE, worker_threads_num};
+
+    FastRandomContext insecure_rand(true);
+    std::vector<std::vector<HashJob>> vBatches(BATCHES);
+    for (auto& vChecks : vBatches) {
+        vChecks.resize(1 + insecure_rand.randrange(2 * BATCH_SIZE));
+        for (auto& check : vChecks) {
+            check.data = insecure_rand.rand256();
+        }
+    }
+    size_t jobs{0};
+    for (const auto& vChecks : vBatches) {
+        jobs += vChecks.size();
+    }
+
+    bench.batch(jobs).unit("job").run([&] {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (auto vChecks : vBatches) {
+            control.Add(std::move(vChecks));
+        }
+        control.Wait();
+    });
+}
+
+static void CCheckQueueScaling1(benchmark::Bench& bench) { CCheckQueueScaling(bench, 1); }
+static void CCheckQueueScaling4(benchmark::Bench& bench) { CCheckQueueScaling(bench, 4); }
+static void CCheckQueueScaling8(benchmark::Bench& bench) { CCheckQueueScaling(bench, 8); }
+static void CCheckQueueScaling16(benchmark::Bench& bench) { CCheckQueueScaling(bench, 16); }
+static void CCheckQueueScaling32(benchmark::Bench& bench) { CCheckQueueScaling(bench, 32); }
+static void CCheckQueueScaling64(benchmark::Bench& bench) { CCheckQueueScaling(bench, 64); }
+
+BENCHMARK(CCheckQueueScaling1, benchmark::PriorityLevel::LOW);
+BENCHMARK(CCheckQueueScaling4, benchmark::PriorityLevel::LOW);
+BENCHMARK(CCheckQueueScaling8, benchmark::PriorityLevel::LOW);
+BENCHMARK(CCheckQueueScaling16, benchmark::PriorityLevel::LOW);
+BENCHMARK(CCheckQueueScaling32, benchmark::PriorityLevel::LOW);
+BENCHMARK(CCheckQueueScaling64, benchmark::PriorityLevel::LOW);
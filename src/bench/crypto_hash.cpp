@@ -90,6 +90,28 @@ static void SHA3_256_1M(benchmark::Bench& bench)
     });
 }
 
+static void SHA3_256D_80b(benchmark::Bench& bench)
+{
+    uint8_t hash[SHA3_256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(80, 0);
+    bench.batch(in.size()).unit("byte").run([&] {
+        SHA3_256().Write(in).Finalize(hash);
+        SHA3_256().Write(hash).Finalize(hash);
+        in[0] = hash[0];
+    });
+}
+
+static void SHA3_256D80_1024(benchmark::Bench& bench)
+{
+    bench.name(strprintf("%s using the '%s' SHA3 implementation", __func__, SHA3AutoDetect()));
+    std::vector<uint8_t> in(80 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    bench.batch(in.size()).unit("byte").run([&] {
+        SHA3_256D80(out.data(), in.data(), 1024);
+        in[0] = out[0];
+    });
+}
+
 static void SHA256_32b_STANDARD(benchmark::Bench& bench)
 {
     bench.name(strprintf("%s using the '%s' SHA256 implementation", __func__, SHA256AutoDetect(sha256_implementation::STANDARD)));
@@ -248,6 +270,8 @@ BENCHMARK(SHA256_AVX2, benchmark::PriorityLevel::HIGH);
 BENCHMARK(SHA256_SHANI, benchmark::PriorityLevel::HIGH);
 BENCHMARK(SHA512, benchmark::PriorityLevel::HIGH);
 BENCHMARK(SHA3_256_1M, benchmark::PriorityLevel::HIGH);
+BENCHMARK(SHA3_256D_80b, benchmark::PriorityLevel::HIGH);
+BENCHMARK(SHA3_256D80_1024, benchmark::PriorityLevel::HIGH);
 
 BENCHMARK(SHA256_32b_STANDARD, benchmark::PriorityLevel::HIGH);
 BENCHMARK(SHA256_32b_SSE4, benchmark::PriorityLevel::HIGH);
@@ -0,0 +1,236 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <crypto/flex/cnfiles/cnfn.h>
+#include <crypto/flex/flex.h>
+#include <crypto/flex/sph/sph_blake.h>
+#include <crypto/flex/sph/sph_bmw.h>
+#include <crypto/flex/sph/sph_cubehash.h>
+#include <crypto/flex/sph/sph_echo.h>
+#include <crypto/flex/sph/sph_fugue.h>
+#include <crypto/flex/sph/sph_groestl.h>
+#include <crypto/flex/sph/sph_hamsi.h>
+#include <crypto/flex/sph/sph_keccak.h>
+#include <crypto/flex/sph/sph_luffa.h>
+#include <crypto/flex/sph/sph_shabal.h>
+#include <crypto/flex/sph/sph_shavite.h>
+#include <crypto/flex/sph/sph_simd.h>
+#include <crypto/flex/sph/sph_skein.h>
+#include <crypto/flex/sph/sph_whirlpool.h>
+#include <hash.h>
+#include <pow_cache.h>
+#include <primitives/pureheader.h>
+#include <random.h>
+#include <tinyformat.h>
+#include <uint256.h>
+
+#include <utility>
+#include <vector>
+
+/* Flex hashes 64-byte intermediate states everywhere but its first step. */
+static constexpr size_t FLEX_STATE_SIZE{64};
+static constexpr size_t FLEX_HEADER_SIZE{80};
+
+static CPureBlockHeader FlexHeader()
+{
+    FastRandomContext rng(true);
+    CPureBlockHeader header;
+    header.nVersion = 0x8000;
+    header.hashPrevBlock = rng.rand256();
+    header.hashMerkleRoot = rng.rand256();
+    header.nTime = 1700000000;
+    header.nBits = 0x207fffff;
+    return header;
+}
+
+template <typename Context, void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*)>
+static void SphHash(benchmark::Bench& bench)
+{
+    Context ctx;
+    unsigned char hash[64];
+    std::vector<unsigned char> in(FLEX_STATE_SIZE, 0);
+    bench.batch(in.size()).unit("byte").run([&] {
+        Init(&ctx);
+        Update(&ctx, in.data(), in.size());
+        Close(&ctx, hash);
+        in[0] = hash[0];
+    });
+}
+
+static void FlexBlake512(benchmark::Bench& bench) { SphHash<sph_blake512_context, sph_blake512_init, sph_blake512, sph_blake512_close>(bench); }
+static void FlexBMW512(benchmark::Bench& bench) { SphHash<sph_bmw512_context, sph_bmw512_init, sph_bmw512, sph_bmw512_close>(bench); }
+static void FlexGroestl512(benchmark::Bench& bench) { SphHash<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>(bench); }
+static void FlexKeccak512(benchmark::Bench& bench) { SphHash<sph_keccak512_context, sph_keccak512_init, sph_keccak512, sph_keccak512_close>(bench); }
+static void FlexSkein512(benchmark::Bench& bench) { SphHash<sph_skein512_context, sph_skein512_init, sph_skein512, sph_skein512_close>(bench); }
+static void FlexLuffa512(benchmark::Bench& bench) { SphHash<sph_luffa512_context, sph_luffa512_init, sph_luffa512, sph_luffa512_close>(bench); }
+static void FlexCubehash512(benchmark::Bench& bench) { SphHash<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>(bench); }
+static void FlexShavite512(benchmark::Bench& bench) { SphHash<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>(bench); }
+static void FlexSIMD512(benchmark::Bench& bench) { SphHash<sph_simd512_context, sph_simd512_init, sph_simd512, sph_simd512_close>(bench); }
+static void FlexEcho512(benchmark::Bench& bench) { SphHash<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>(bench); }
+static void FlexHamsi512(benchmark::Bench& bench) { SphHash<sph_hamsi512_context, sph_hamsi512_init, sph_hamsi512, sph_hamsi512_close>(bench); }
+static void FlexFugue512(benchmark::Bench& bench) { SphHash<sph_fugue512_context, sph_fugue512_init, sph_fugue512, sph_fugue512_close>(bench); }
+static void FlexShabal512(benchmark::Bench& bench) { SphHash<sph_shabal512_context, sph_shabal512_init, sph_shabal512, sph_shabal512_close>(bench); }
+static void FlexWhirlpool(benchmark::Bench& bench) { SphHash<sph_whirlpool_context, sph_whirlpool_init, sph_whirlpool, sph_whirlpool_close>(bench); }
+
+using CNFNFunc = void (*)(const char*, char*, uint32_t, int);
+
+static void CNFNHash(benchmark::Bench& bench, CNFNFunc func)
+{
+    bench.name(strprintf("%s using the '%s' Flex implementation", bench.name(), FlexAutoDetect()));
+    char hash[HASH_SIZE];
+    std::vector<char> in(FLEX_STATE_SIZE, 0);
+    bench.unit("hash").run([&] {
+        func(in.data(), hash, in.size(), 1);
+        in[0] = hash[0];
+    });
+}
+
+static void CNFNDark(benchmark::Bench& bench) { CNFNHash(bench, crypto::cnfn_dark_hash); }
+static void CNFNDarklite(benchmark::Bench& bench) { CNFNHash(bench, crypto::cnfn_darklite_hash); }
+static void CNFNFast(benchmark::Bench& bench) { CNFNHash(bench, crypto::cnfn_cnfast_hash); }
+static void CNFNLite(benchmark::Bench& bench) { CNFNHash(bench, crypto::cnfn_cnlite_hash); }
+static void CNFNTurtle(benchmark::Bench& bench) { CNFNHash(bench, crypto::cnfn_turtle_hash); }
+static void CNFNTurtlelite(benchmark::Bench& bench) { CNFNHash(bench, crypto::cnfn_turtlelite_hash); }
+
+static void CNFNTurtlelitePortable(benchmark::Bench& bench)
+{
+    bench.name(strprintf("%s using the 'portable' Flex AES implementation", __func__));
+    crypto::cnfn_use_aes_implementation(CNFN_AES_PORTABLE);
+    char hash[HASH_SIZE];
+    std::vector<char> in(FLEX_STATE_SIZE, 0);
+    bench.unit("hash").run([&] {
+        crypto::cnfn_turtlelite_hash(in.data(), hash, in.size(), 1);
+        in[0] = hash[0];
+    });
+    FlexAutoDetect();
+}
+
+static void FlexHash(benchmark::Bench& bench)
+{
+    unsigned char hash[32];
+    std::vector<char> in(FLEX_HEADER_SIZE, 0);
+    bench.unit("header").run([&] {
+        flex_hash(in.data(), in.size(), hash);
+        in[0] = hash[0];
+    });
+}
+
+static void FlexHashMulti(benchmark::Bench& bench)
+{
+    std::vector<std::vector<char>> in(FLEX_MAX_LANES, std::vector<char>(FLEX_HEADER_SIZE, 0));
+    std::vector<uint256> hashes(FLEX_MAX_LANES);
+    std::vector<const char*> inputs;
+    std::vector<unsigned char*> outputs;
+    for (size_t i = 0; i < FLEX_MAX_LANES; ++i) {
+        in[i][1] = i;
+        inputs.push_back(in[i].data());
+        outputs.push_back(hashes[i].begin());
+    }
+    bench.batch(FLEX_MAX_LANES).unit("header").run([&] {
+        flex_hash_multi(inputs.data(), FLEX_HEADER_SIZE, outputs.data(), FLEX_MAX_LANES);
+        for (size_t i = 0; i < FLEX_MAX_LANES; ++i) {
+            in[i][0] = hashes[i].data()[0];
+        }
+    });
+}
+
+static void BlockHashSHA3(benchmark::Bench& bench)
+{
+    CPureBlockHeader header{FlexHeader()};
+    bench.unit("header").run([&] {
+        ++header.nNonce;
+        ankerl::nanobench::doNotOptimizeAway((Hash3Writer{} << header).GetHash());
+    });
+}
+
+static void PoWHashWarmCache(benchmark::Bench& bench)
+{
+    const CPureBlockHeader header{FlexHeader()};
+    header.GetPoWHash();
+    bench.unit("header").run([&] {
+        ankerl::nanobench::doNotOptimizeAway(header.GetPoWHash());
+    });
+}
+
+static void PoWHashColdCache(benchmark::Bench& bench)
+{
+    CPureBlockHeader header{FlexHeader()};
+    bench.unit("header").run([&] {
+        ++header.nNonce;
+        ankerl::nanobench::doNotOptimizeAway(header.GetPoWHash());
+    });
+}
+
+static void PoWHashColdCacheBatch(benchmark::Bench& bench)
+{
+    std::vector<CPureBlockHeader> headers(FLEX_MAX_LANES, FlexHeader());
+    std::vector<std::pair<const CPureBlockHeader*, int32_t>> batch;
+    for (size_t i = 0; i < FLEX_MAX_LANES; ++i) {
+        headers[i].nNonce = i;
+        batch.emplace_back(&headers[i], headers[i].nVersion);
+    }
+    bench.batch(FLEX_MAX_LANES).unit("header").run([&] {
+        for (CPureBlockHeader& header : headers) {
+            header.nNonce += FLEX_MAX_LANES;
+        }
+        CPureBlockHeader::CachePoWHashes(batch);
+    });
+}
+
+static void PowHashCacheHit(benchmark::Bench& bench)
+{
+    FastRandomContext rng(true);
+    PowHashCache cache;
+    const uint256 key{rng.rand256()};
+    cache.Insert(key, rng.rand256(), 0);
+    bench.run([&] {
+        ankerl::nanobench::doNotOptimizeAway(cache.Get(key));
+    });
+}
+
+static void PowHashCacheMiss(benchmark::Bench& bench)
+{
+    FastRandomContext rng(true);
+    PowHashCache cache;
+    for (int i = 0; i < 1000; ++i) {
+        cache.Insert(rng.rand256(), rng.rand256(), 0);
+    }
+    const uint256 key{rng.rand256()};
+    bench.run([&] {
+        ankerl::nanobench::doNotOptimizeAway(cache.Get(key));
+    });
+}
+
+BENCHMARK(FlexBlake512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexBMW512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexGroestl512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexKeccak512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexSkein512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexLuffa512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexCubehash512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexShavite512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexSIMD512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexEcho512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexHamsi512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexFugue512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexShabal512, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexWhirlpool, benchmark::PriorityLevel::HIGH);
+
+BENCHMARK(CNFNDark, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CNFNDarklite, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CNFNFast, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CNFNLite, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CNFNTurtle, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CNFNTurtlelite, benchmark::PriorityLevel::HIGH);
+BENCHMARK(CNFNTurtlelitePortable, benchmark::PriorityLevel::HIGH);
+
+BENCHMARK(FlexHash, benchmark::PriorityLevel::HIGH);
+BENCHMARK(FlexHashMulti, benchmark::PriorityLevel::HIGH);
+BENCHMARK(BlockHashSHA3, benchmark::PriorityLevel::HIGH);
+BENCHMARK(PoWHashWarmCache, benchmark::PriorityLevel::HIGH);
+BENCHMARK(PoWHashColdCache, benchmark::PriorityLevel::HIGH);
+BENCHMARK(PoWHashColdCacheBatch, benchmark::PriorityLevel::HIGH);
+BENCHMARK(PowHashCacheHit, benchmark::PriorityLevel::HIGH);
+BENCHMARK(PowHashCacheMiss, benchmark::PriorityLevel::HIGH);
@@ -22,13 +22,9 @@ CBlockHeader CBlockIndex::GetBlockHeader(const node::BlockManager& blockman) con
     block.nVersion = nVersion;
 
     /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
+       The block manager keeps it in memory for all auxpow headers.  */
     if (block.IsAuxpow())
-    {
-        blockman.ReadBlockHeaderFromDisk(block, *this);
-        return block;
-    }
+        block.auxpow = blockman.GetAuxpow(*this);
 
     if (pprev)
         block.hashPrevBlock = pprev->GetBlockHash();
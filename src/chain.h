@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -136,6 +137,9 @@ enum BlockStatus : uint32_t {
 
     BLOCK_STATUS_RESERVED    =   256, //!< Unused flag that was previously set on assumeutxo snapshot blocks and their
                                       //!< ancestors before they were validated, and unset when they were validated.
+
+    BLOCK_POW_VERIFIED       =   512, //!< header proof of work (Flex hash or auxpow parent) passed CheckProofOfWork
+                                      //!< when the header was accepted, so reads from disk need not recompute it.
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -167,6 +171,10 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos GUARDED_BY(::cs_main){0};
 
+    //! crc32c of this block's serialized data in blk?????.dat, if it was recorded when the block was written
+    //! (-blockchecksums). Stored under its own key in the block tree database, not with the index entry.
+    std::optional<uint32_t> nDataChecksum GUARDED_BY(::cs_main);
+
     //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
     arith_uint256 nChainWork{};
 
@@ -202,6 +210,10 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax{0};
 
+    //! (memory only) nBits required of a block building on this one, once
+    //! GetNextWorkRequiredCached() computed it; 0 before.
+    mutable uint32_t m_next_work_required GUARDED_BY(::cs_main){0};
+
     explicit CBlockIndex(const CPureBlockHeader& block)
         : nVersion{block.nVersion},
           hashMerkleRoot{block.hashMerkleRoot},
@@ -10,7 +10,12 @@
 #include <util/threadnames.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iterator>
+#include <string>
+#include <thread>
 #include <vector>
 
 /**
@@ -22,39 +27,56 @@
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker, including the master, has its own deque of verifications.
+  * Added verifications are spread over the deques, a worker takes its own
+  * from the back, and once it runs out, it steals from the front of the
+  * others. Workers only share a lock to go to sleep and be woken up, so that
+  * the queue keeps scaling with many threads. Besides script checks, it can
+  * run any other kind of independent checks, like the header proof-of-work
+  * checks.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    Mutex m_mutex;
-
-    //! Worker threads block on this when out of work
-    std::condition_variable m_worker_cv;
-
-    //! Master thread blocks on this when out of work
-    std::condition_variable m_master_cv;
-
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue GUARDED_BY(m_mutex);
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle GUARDED_BY(m_mutex){0};
+    //! A worker's share of the verifications.
+    struct WorkerDeque {
+        Mutex m_mutex;
+        std::deque<T> m_checks GUARDED_BY(m_mutex);
+    };
 
-    //! The total number of workers (including the master).
-    int nTotal GUARDED_BY(m_mutex){0};
+    //! Deques of the worker threads, followed by the master's.
+    std::vector<WorkerDeque> m_deques;
 
-    //! The temporary evaluation result.
-    bool fAllOk GUARDED_BY(m_mutex){true};
+    //! Deque the next small batch is added to.
+    size_t m_next_deque{0};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo GUARDED_BY(m_mutex){0};
+    std::atomic<unsigned int> m_todo{0};
+
+    //! Number of verifications in the deques. Briefly negative when they
+    //! are taken before Add() accounted for them.
+    std::atomic<int> m_queued{0};
+
+    //! The temporary evaluation result.
+    std::atomic<bool> m_all_ok{true};
+
+    //! Number of worker threads waiting for verifications to be added.
+    std::atomic<int> m_idle{0};
+
+    //! Mutex to sleep and wake up on, and to protect m_request_stop
+    Mutex m_mutex;
+
+    //! Worker threads block on this when out of work
+    std::condition_variable m_worker_cv;
+
+    //! Master thread blocks on this when out of work
+    std::condition_variable m_master_cv;
 
     //! The maximum number of elements to be processed in one batch
     const unsigned int nBatchSize;
@@ -62,64 +84,70 @@ private:
     std::vector<std::thread> m_worker_threads;
     bool m_request_stop GUARDED_BY(m_mutex){false};
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
+    /**
+     * Move a batch of verifications into vChecks, from the back of the given
+     * deque, or from the front of another one once it is empty.
+     * Batches hold half of the deque they are taken from, up to nBatchSize,
+     * so that they get smaller as the work runs out and all workers finish
+     * approximately simultaneously.
+     */
+    bool Take(size_t index, std::vector<T>& vChecks)
+    {
+        for (size_t i = 0; i < m_deques.size(); ++i) {
+            WorkerDeque& deque{m_deques[(index + i) % m_deques.size()]};
+            LOCK(deque.m_mutex);
+            if (deque.m_checks.empty()) continue;
+            const size_t nNow{std::max<size_t>(1, std::min<size_t>(nBatchSize, deque.m_checks.size() / 2))};
+            if (i == 0) {
+                auto start_it = deque.m_checks.end() - nNow;
+                vChecks.assign(std::make_move_iterator(start_it), std::make_move_iterator(deque.m_checks.end()));
+                deque.m_checks.erase(start_it, deque.m_checks.end());
+            } else {
+                auto end_it = deque.m_checks.begin() + nNow;
+                vChecks.assign(std::make_move_iterator(deque.m_checks.begin()), std::make_move_iterator(end_it));
+                deque.m_checks.erase(deque.m_checks.begin(), end_it);
+            }
+            m_queued -= static_cast<int>(nNow);
+            return true;
+        }
+        return false;
+    }
+
+    /** Run a batch of verifications, and account for them once they are destroyed. */
+    void Run(std::vector<T>& vChecks)
+    {
+        // Check whether we need to do work at all
+        bool fOk = m_all_ok;
+        for (T& check : vChecks)
+            if (fOk)
+                fOk = check();
+        if (!fOk) m_all_ok = false;
+        const unsigned int nNow = vChecks.size();
+        vChecks.clear();
+        if (m_todo.fetch_sub(nNow) == nNow) {
+            // We processed the last element; inform the master it can exit and return the result
+            WITH_LOCK(m_mutex, m_master_cv.notify_one());
+        }
+    }
+
+    /** Loop of the worker threads. */
+    void Loop(size_t index) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
     {
-        std::condition_variable& cond = fMaster ? m_master_cv : m_worker_cv;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                WAIT_LOCK(m_mutex, lock);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        m_master_cv.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty() && !m_request_stop) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                if (m_request_stop) {
-                    return false;
-                }
-
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                auto start_it = queue.end() - nNow;
-                vChecks.assign(std::make_move_iterator(start_it), std::make_move_iterator(queue.end()));
-                queue.erase(start_it, queue.end());
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+        while (true) {
+            if (Take(index, vChecks)) {
+                Run(vChecks);
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+            WAIT_LOCK(m_mutex, lock);
+            // Add() reads m_idle after it updated m_queued, so either it
+            // notifies this thread, or it is seen adding work here.
+            ++m_idle;
+            m_worker_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_request_stop || m_queued > 0; });
+            --m_idle;
+            if (m_request_stop) return;
+        }
     }
 
 public:
@@ -127,14 +155,14 @@ public:
     Mutex m_control_mutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int batch_size, int worker_threads_num)
-        : nBatchSize(batch_size)
+    explicit CCheckQueue(unsigned int batch_size, int worker_threads_num, const std::string& thread_name = "scriptch")
+        : m_deques(worker_threads_num + 1), nBatchSize(batch_size)
     {
         m_worker_threads.reserve(worker_threads_num);
         for (int n = 0; n < worker_threads_num; ++n) {
-            m_worker_threads.emplace_back([this, n]() {
-                util::ThreadRename(strprintf("scriptch.%i", n));
-                Loop(false /* worker thread */);
+            m_worker_threads.emplace_back([this, n, thread_name]() {
+                util::ThreadRename(strprintf("%s.%i", thread_name, n));
+                Loop(n);
             });
         }
     }
@@ -149,7 +177,16 @@ public:
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex)
     {
-        return Loop(true /* master thread */);
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        while (Take(m_deques.size() - 1, vChecks)) {
+            Run(vChecks);
+        }
+        // Nothing is left to take, so wait for the workers to finish theirs.
+        WAIT_LOCK(m_mutex, lock);
+        m_master_cv.wait(lock, [&] { return m_todo == 0; });
+        // reset the status for new work later
+        return m_all_ok.exchange(true);
     }
 
     //! Add a batch of checks to the queue
@@ -159,12 +196,23 @@ public:
             return;
         }
 
-        {
-            LOCK(m_mutex);
-            queue.insert(queue.end(), std::make_move_iterator(vChecks.begin()), std::make_move_iterator(vChecks.end()));
-            nTodo += vChecks.size();
+        // Small batches go to one deque after the other, larger ones are
+        // split over all of them.
+        m_todo += vChecks.size();
+        const size_t chunk{(vChecks.size() + m_deques.size() - 1) / m_deques.size()};
+        for (auto it = vChecks.begin(); it != vChecks.end();) {
+            const auto end_it = it + std::min<size_t>(chunk, vChecks.end() - it);
+            WorkerDeque& deque{m_deques[m_next_deque]};
+            m_next_deque = (m_next_deque + 1) % m_deques.size();
+            LOCK(deque.m_mutex);
+            deque.m_checks.insert(deque.m_checks.end(), std::make_move_iterator(it), std::make_move_iterator(end_it));
+            it = end_it;
         }
+        m_queued += static_cast<int>(vChecks.size());
 
+        if (m_idle == 0) return;
+        // An idle worker is either waiting now, or sees the new work.
+        LOCK(m_mutex);
         if (vChecks.size() == 1) {
             m_worker_cv.notify_one();
         } else {
@@ -42,6 +42,16 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
 }
 
+size_t CCoinsViewCache::ReusableMemoryUsage() const {
+    // Nodes are carved out of the pool's chunks one after the other, and all
+    // have the same size, so any of them that was freed can hold a new coin.
+    const auto& resource{m_cache_coins_memory_resource};
+    const size_t nodes_per_chunk{resource.ChunkSizeBytes() / sizeof(CoinsCachePair)};
+    const size_t carved_nodes{nodes_per_chunk * (resource.NumAllocatedChunks() - 1) +
+                              (resource.ChunkSizeBytes() - resource.NumAvailableChunkBytes()) / sizeof(CoinsCachePair)};
+    return Assume(carved_nodes >= cacheCoins.size()) ? (carved_nodes - cacheCoins.size()) * sizeof(CoinsCachePair) : 0;
+}
+
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     const auto [ret, inserted] = cacheCoins.try_emplace(outpoint);
     if (inserted) {
@@ -54,6 +64,8 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
             ret->second.AddFlags(CCoinsCacheEntry::FRESH, *ret, m_sentinel);
         }
         cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
+    } else {
+        ret->second.SetUsed(true);
     }
     return ret;
 }
@@ -118,6 +130,15 @@ void CCoinsViewCache::EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coi
     }
 }
 
+bool CCoinsViewCache::AddPrefetchedCoin(const COutPoint& outpoint, Coin&& coin) {
+    assert(!coin.IsSpent());
+    const auto [it, inserted] = cacheCoins.try_emplace(outpoint, std::move(coin));
+    if (inserted) {
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+    return inserted;
+}
+
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check_for_overwrite) {
     bool fCoinbase = tx.IsCoinBase();
     const Txid& txid = tx.GetHash();
@@ -290,6 +311,34 @@ void CCoinsViewCache::Uncache(const COutPoint& hash)
     }
 }
 
+size_t CCoinsViewCache::Evict(size_t target_usage)
+{
+    const auto over_target{[&] { return DynamicMemoryUsage() - ReusableMemoryUsage() > target_usage; }};
+    size_t evicted{0};
+    // The first sweep removes the coins that were not used since the previous
+    // call, and marks the others unused. If that was not enough, the second
+    // one removes these as well.
+    for (int sweep{0}; sweep < 2 && over_target(); ++sweep) {
+        for (auto it{cacheCoins.begin()}; it != cacheCoins.end();) {
+            if (it->second.GetFlags()) {
+                ++it;
+            } else if (sweep == 0 && it->second.IsUsed()) {
+                it->second.SetUsed(false);
+                ++it;
+            } else if (over_target()) {
+                cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+                ++evicted;
+            } else if (sweep == 0) {
+                ++it;
+            } else {
+                break;
+            }
+        }
+    }
+    return evicted;
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
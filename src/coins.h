@@ -14,13 +14,13 @@
 #include <support/allocators/pool.h>
 #include <uint256.h>
 #include <util/check.h>
+#include <util/flatnodemap.h>
 #include <util/hasher.h>
 
 #include <assert.h>
 #include <stdint.h>
 
 #include <functional>
-#include <unordered_map>
 
 /**
  * A UTXO entry.
@@ -107,7 +107,16 @@ using CoinsCachePair = std::pair<const COutPoint, CCoinsCacheEntry>;
  */
 struct CCoinsCacheEntry
 {
+    //! The actual cached data. As a potentially-overlapping subobject, m_flags can
+    //! be laid out in its tail padding, saving 8 bytes per entry on 64-bit platforms.
+    [[no_unique_address]] Coin coin;
+
 private:
+    uint8_t m_flags{0};
+    //! Whether the coin was added or accessed since the last call to
+    //! CCoinsViewCache::Evict(). Unlike the flags, it has no bearing on the
+    //! linked list, and also fits in Coin's tail padding.
+    bool m_used{true};
     /**
      * These are used to create a doubly linked list of flagged entries.
      * They are set in AddFlags and unset in ClearFlags.
@@ -126,11 +135,8 @@ private:
      */
     CoinsCachePair* m_prev{nullptr};
     CoinsCachePair* m_next{nullptr};
-    uint8_t m_flags{0};
 
 public:
-    Coin coin; // The actual cached data.
-
     enum Flags {
         /**
          * DIRTY means the CCoinsCacheEntry is potentially different from the
@@ -183,6 +189,8 @@ public:
     inline uint8_t GetFlags() const noexcept { return m_flags; }
     inline bool IsDirty() const noexcept { return m_flags & DIRTY; }
     inline bool IsFresh() const noexcept { return m_flags & FRESH; }
+    inline void SetUsed(bool used) noexcept { m_used = used; }
+    inline bool IsUsed() const noexcept { return m_used; }
 
     //! Only call Next when this entry is DIRTY, FRESH, or both
     inline CoinsCachePair* Next() const noexcept {
@@ -208,19 +216,16 @@ public:
 };
 
 /**
- * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data, and adds the size
- * of 4 pointers. We do not know the exact node size used in the std::unordered_node implementation
- * because it is implementation defined. Most implementations have an overhead of 1 or 2 pointers,
- * so nodes can be connected in a linked list, and in some cases the hash value is stored as well.
- * Using an additional sizeof(void*)*4 for MAX_BLOCK_SIZE_BYTES should thus be sufficient so that
- * all implementations can allocate the nodes from the PoolAllocator.
+ * The map of cached coins. Each coin is a node allocated from a PoolAllocator, so
+ * that the flagged entry linked list can point to it, and the nodes are indexed by
+ * a flat open addressing table (see FlatNodeMap). Nodes take exactly
+ * sizeof(CoinsCachePair) bytes.
  */
-using CCoinsMap = std::unordered_map<COutPoint,
-                                     CCoinsCacheEntry,
-                                     SaltedOutpointHasher,
-                                     std::equal_to<COutPoint>,
-                                     PoolAllocator<CoinsCachePair,
-                                                   sizeof(CoinsCachePair) + sizeof(void*) * 4>>;
+using CCoinsMap = FlatNodeMap<COutPoint,
+                              CCoinsCacheEntry,
+                              SaltedOutpointHasher,
+                              std::equal_to<COutPoint>,
+                              PoolAllocator<CoinsCachePair, sizeof(CoinsCachePair)>>;
 
 using CCoinsMapMemoryResource = CCoinsMap::allocator_type::ResourceType;
 
@@ -427,6 +432,16 @@ public:
      */
     void EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin);
 
+    /**
+     * Add a coin read from the backing view ahead of time, as FetchCoin()
+     * would have, unless the outpoint has an entry in this cache already.
+     * The coin must still match the backing view.
+     *
+     * @returns whether the coin was added.
+     * @sa CoinsPrefetcher
+     */
+    bool AddPrefetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -457,12 +472,29 @@ public:
      */
     void Uncache(const COutPoint &outpoint);
 
+    /**
+     * Remove unmodified coins from the cache until its memory usage, not
+     * counting ReusableMemoryUsage(), is at most target_usage. This is an
+     * approximation of LRU (the CLOCK algorithm): coins that were added or
+     * accessed since the previous call are only marked unused the first
+     * time they are swept over, so that the recently used ones are the
+     * last to go. Unlike Flush(), this keeps the cache warm. Call Sync()
+     * first, as modified coins are never removed.
+     *
+     * @returns the number of coins removed.
+     */
+    size_t Evict(size_t target_usage);
+
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Calculate the part of DynamicMemoryUsage() that was freed by removed
+    //! coins, and that is reused for new coins before allocating more.
+    size_t ReusableMemoryUsage() const;
+
     //! Check whether all prevouts of the transaction are present in the UTXO set represented by this view
     bool HaveInputs(const CTransaction& tx) const;
 
@@ -0,0 +1,159 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsprefetch.h>
+
+#include <logging.h>
+#include <primitives/block.h>
+#include <tinyformat.h>
+#include <txdb.h>
+#include <util/threadnames.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+CoinsPrefetcher::CoinsPrefetcher(const CCoinsViewDB& db, int threads_num)
+    : m_db{db}
+{
+    m_worker_threads.reserve(threads_num);
+    for (int n = 0; n < threads_num; ++n) {
+        m_worker_threads.emplace_back([this, n]() {
+            util::ThreadRename(strprintf("coinsprefetch.%i", n));
+            ThreadRead();
+        });
+    }
+}
+
+CoinsPrefetcher::~CoinsPrefetcher()
+{
+    WITH_LOCK(m_mutex, m_request_stop = true);
+    m_worker_cv.notify_all();
+    for (std::thread& t : m_worker_threads) {
+        t.join();
+    }
+}
+
+void CoinsPrefetcher::Prefetch(const CBlock& block, const CCoinsViewCache& cache)
+{
+    AssertLockHeld(::cs_main);
+    const uint256 block_hash{block.GetHash()};
+    {
+        LOCK(m_mutex);
+        if (std::any_of(m_batches.begin(), m_batches.end(), [&](const auto& batch) { return batch->block_hash == block_hash; })) return;
+    }
+
+    // Outputs created earlier in the block are not in the database yet.
+    std::vector<Txid> txids;
+    txids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        txids.push_back(tx->GetHash());
+    }
+    std::sort(txids.begin(), txids.end());
+
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (std::binary_search(txids.begin(), txids.end(), txin.prevout.hash)) continue;
+            if (cache.HaveCoinInCache(txin.prevout)) continue;
+            outpoints.push_back(txin.prevout);
+        }
+    }
+    // Nothing to read, or the database is being written to right now.
+    const uint64_t write_sequence{m_db.GetWriteSequence()};
+    if (outpoints.empty() || write_sequence % 2) return;
+
+    {
+        LOCK(m_mutex);
+        m_batches.push_back(std::make_shared<Batch>(block_hash, std::move(outpoints), write_sequence));
+        while (m_batches.size() > MAX_BLOCKS) {
+            m_batches.front()->next = m_batches.front()->outpoints.size();
+            m_batches.pop_front();
+        }
+    }
+    m_worker_cv.notify_all();
+}
+
+void CoinsPrefetcher::ReadChunk(Batch& batch, UniqueLock<Mutex>& lock)
+{
+    const size_t begin{batch.next};
+    const size_t end{std::min(begin + CHUNK_SIZE, batch.outpoints.size())};
+    batch.next = end;
+    ++batch.reading;
+    ++m_reading;
+    bool stale{false};
+    {
+        REVERSE_LOCK(lock);
+        // Writes bump the sequence number when they start, so no read of the
+        // batch may start once it moved on.
+        for (size_t i = begin; i < end && !stale; ++i) {
+            if (m_db.GetWriteSequence() != batch.write_sequence) {
+                stale = true;
+                continue;
+            }
+            try {
+                m_db.GetCoin(batch.outpoints[i], batch.coins[i]);
+            } catch (const std::runtime_error&) {
+                // Leave it to ConnectBlock() to run into the error and report it.
+                stale = true;
+            }
+        }
+    }
+    batch.stale |= stale;
+    if (stale) batch.next = batch.outpoints.size();
+    --batch.reading;
+    --m_reading;
+    m_done_cv.notify_all();
+}
+
+void CoinsPrefetcher::ThreadRead()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_worker_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+            return m_request_stop || std::any_of(m_batches.begin(), m_batches.end(), [](const auto& batch) { return batch->next < batch->outpoints.size(); });
+        });
+        if (m_request_stop) return;
+        // Serve the oldest block first, as it is most likely to be connected next.
+        const auto batch{*std::find_if(m_batches.begin(), m_batches.end(), [](const auto& batch) { return batch->next < batch->outpoints.size(); })};
+        ReadChunk(*batch, lock);
+    }
+}
+
+size_t CoinsPrefetcher::Apply(const uint256& block_hash, CCoinsViewCache& cache)
+{
+    AssertLockHeld(::cs_main);
+    WAIT_LOCK(m_mutex, lock);
+    const auto it{std::find_if(m_batches.begin(), m_batches.end(), [&](const auto& batch) { return batch->block_hash == block_hash; })};
+    if (it == m_batches.end()) return 0;
+    const std::shared_ptr<Batch> batch{*it};
+    m_batches.erase(it);
+
+    while (batch->next < batch->outpoints.size()) {
+        ReadChunk(*batch, lock);
+    }
+    m_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return batch->reading == 0; });
+    if (batch->stale || m_db.GetWriteSequence() != batch->write_sequence) {
+        LogDebug(BCLog::COINDB, "Dropped %u coins prefetched for block %s\n", batch->outpoints.size(), block_hash.ToString());
+        return 0;
+    }
+
+    size_t added{0};
+    for (size_t i = 0; i < batch->outpoints.size(); ++i) {
+        if (batch->coins[i].IsSpent()) continue;
+        added += cache.AddPrefetchedCoin(batch->outpoints[i], std::move(batch->coins[i]));
+    }
+    LogDebug(BCLog::COINDB, "Added %u of %u coins prefetched for block %s\n", added, batch->outpoints.size(), block_hash.ToString());
+    return added;
+}
+
+void CoinsPrefetcher::Cancel()
+{
+    WAIT_LOCK(m_mutex, lock);
+    for (const auto& batch : m_batches) {
+        batch->next = batch->outpoints.size();
+    }
+    m_batches.clear();
+    m_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_reading == 0; });
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include <coins.h>
+#include <kernel/cs_main.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CCoinsViewDB;
+
+/** Default number of threads reading coins ahead of ConnectBlock(). */
+static const int DEFAULT_COINS_PREFETCH_THREADS = 4;
+/** Maximum number of threads reading coins ahead of ConnectBlock(). */
+static const int MAX_COINS_PREFETCH_THREADS = 16;
+
+/**
+ * Reads the coins spent by blocks from the coins database on worker threads,
+ * ahead of connecting the blocks. Right before a block is connected, the coins
+ * read for it are added to the coins cache, so that ConnectBlock() finds them
+ * there instead of reading them one at a time while holding cs_main.
+ *
+ * Coins read before or while the database was written to are dropped, since
+ * they may no longer match it.
+ */
+class CoinsPrefetcher
+{
+public:
+    /** Maximum number of blocks whose coins are kept. Coins of older blocks are dropped. */
+    static constexpr size_t MAX_BLOCKS{64};
+    /** Number of outpoints a thread reads at once. */
+    static constexpr size_t CHUNK_SIZE{16};
+
+    CoinsPrefetcher(const CCoinsViewDB& db, int threads_num);
+    ~CoinsPrefetcher();
+
+    CoinsPrefetcher(const CoinsPrefetcher&) = delete;
+    CoinsPrefetcher& operator=(const CoinsPrefetcher&) = delete;
+
+    /**
+     * Start reading the coins spent by a block, except for those it creates
+     * itself and those the coins cache has already. Does nothing if the
+     * block is queued already.
+     */
+    void Prefetch(const CBlock& block, const CCoinsViewCache& cache) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, !m_mutex);
+
+    /**
+     * Add the coins read for a block to the coins cache, which has to be
+     * backed by the database. Coins that have not been read yet are read by
+     * the calling thread, together with the worker threads.
+     *
+     * @returns the number of coins added.
+     */
+    size_t Apply(const uint256& block_hash, CCoinsViewCache& cache) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, !m_mutex);
+
+    /** Drop all queued blocks and wait for the reads in progress to finish. */
+    void Cancel() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+private:
+    /** The coins spent by one block. Members other than the constants are guarded by m_mutex. */
+    struct Batch {
+        const uint256 block_hash;
+        const std::vector<COutPoint> outpoints;
+        //! Coins read for outpoints, by index. Missing coins are left spent.
+        std::vector<Coin> coins;
+        //! CCoinsViewDB::GetWriteSequence() when the batch was queued.
+        const uint64_t write_sequence;
+        //! Index of the first outpoint no thread has started reading.
+        size_t next{0};
+        //! Number of chunks being read.
+        size_t reading{0};
+        //! Whether a read failed or saw the database being written to.
+        bool stale{false};
+
+        Batch(const uint256& hash, std::vector<COutPoint> points, uint64_t sequence)
+            : block_hash{hash}, outpoints{std::move(points)}, coins(outpoints.size()), write_sequence{sequence} {}
+    };
+
+    const CCoinsViewDB& m_db;
+
+    Mutex m_mutex;
+    //! Worker threads block on this when out of work.
+    std::condition_variable m_worker_cv;
+    //! Apply() and Cancel() block on this while reads are in progress.
+    std::condition_variable m_done_cv;
+    //! Queued blocks, oldest first.
+    std::deque<std::shared_ptr<Batch>> m_batches GUARDED_BY(m_mutex);
+    //! Number of chunks being read, across all batches.
+    size_t m_reading GUARDED_BY(m_mutex){0};
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+
+    std::vector<std::thread> m_worker_threads;
+
+    /** Read the next chunk of a batch, releasing m_mutex while reading. */
+    void ReadChunk(Batch& batch, UniqueLock<Mutex>& lock) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void ThreadRead() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
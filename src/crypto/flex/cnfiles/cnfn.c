@@ -6,119 +6,28 @@
 // Portions Copyright (c) 2018 The TurtleCoin Developers
 // Portions Copyright (c) 2024 Flex Labs Developers
 
-#include <stddef.h>
-#include <stdint.h>
-#include <string.h>
-#include <stdio.h>
-#include <unistd.h>
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
 #include "cnfn.h"
-#include "crypto/oaes_lib.h"
+#include "cnfn_internal.h"
 #include "crypto/c_keccak.h"
 #include "crypto/c_groestl.h"
 #include "crypto/c_blake256.h"
 #include "crypto/c_skein.h"
-#include "crypto/int-util.h"
-#include "crypto/variant2_int_sqrt.h"
 
-#if defined(_MSC_VER)
+#if defined(_WIN32)
 #include <malloc.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
 #endif
 
-#define AES_BLOCK_SIZE  16
-#define AES_KEY_SIZE    32 /*16*/
-#define INIT_SIZE_BLK   8
-#define INIT_SIZE_BYTE  (INIT_SIZE_BLK * AES_BLOCK_SIZE)
-
-#define VARIANT1_1(p) \
-  do if (variant == 1) \
-  { \
-    const uint8_t tmp = ((const uint8_t*)(p))[11]; \
-    static const uint32_t table = 0x75310; \
-    const uint8_t index = (((tmp >> 3) & 6) | (tmp & 1)) << 1; \
-    ((uint8_t*)(p))[11] = tmp ^ ((table >> index) & 0x30); \
-  } while(0)
-
-#define VARIANT1_2(p) \
-   do if (variant == 1) \
-   { \
-     ((uint64_t*)p)[1] ^= tweak1_2; \
-   } while(0)
-
-#define VARIANT1_INIT() \
-  if (variant == 1 && len < 43) \
-  { \
-    fprintf(stderr, "CNFN variant 1 needs at least 43 bytes of data"); \
-    _exit(1); \
-  } \
-  const uint64_t tweak1_2 = (variant == 1) ? *(const uint64_t*)(((const uint8_t*)input)+35) ^ state.hs.w[24] : 0
-
-#define U64(p) ((uint64_t*)(p))
-
-#define VARIANT2_INIT(b, state) \
-  uint64_t division_result; \
-  uint64_t sqrt_result; \
-  do if (variant >= 2) \
-  { \
-    U64(b)[2] = state.hs.w[8] ^ state.hs.w[10]; \
-    U64(b)[3] = state.hs.w[9] ^ state.hs.w[11]; \
-    division_result = state.hs.w[12]; \
-    sqrt_result = state.hs.w[13]; \
-  } while (0)
-
-#define VARIANT2_SHUFFLE_ADD(base_ptr, offset, a, b) \
-  do if (variant >= 2) \
-  { \
-    uint64_t* chunk1 = U64((base_ptr) + ((offset) ^ 0x10)); \
-    uint64_t* chunk2 = U64((base_ptr) + ((offset) ^ 0x20)); \
-    uint64_t* chunk3 = U64((base_ptr) + ((offset) ^ 0x30)); \
-    \
-    const uint64_t chunk1_old[2] = { chunk1[0], chunk1[1] }; \
-    \
-    chunk1[0] = chunk3[0] + U64(b + 16)[0]; \
-    chunk1[1] = chunk3[1] + U64(b + 16)[1]; \
-    \
-    chunk3[0] = chunk2[0] + U64(a)[0]; \
-    chunk3[1] = chunk2[1] + U64(a)[1]; \
-    \
-    chunk2[0] = chunk1_old[0] + U64(b)[0]; \
-    chunk2[1] = chunk1_old[1] + U64(b)[1]; \
-    } while (0)
-
-#define VARIANT2_INTEGER_MATH_DIVISION_STEP(b, ptr) \
-  ((uint64_t*)(b))[0] ^= division_result ^ (sqrt_result << 32); \
-  { \
-    const uint64_t dividend = ((uint64_t*)(ptr))[1]; \
-    const uint32_t divisor = (((uint32_t*)(ptr))[0] + (uint32_t)(sqrt_result << 1)) | 0x80000001UL; \
-    division_result = ((uint32_t)(dividend / divisor)) + \
-                     (((uint64_t)(dividend % divisor)) << 32); \
-  } \
-  const uint64_t sqrt_input = ((uint64_t*)(ptr))[0] + division_result
-
-#define VARIANT2_INTEGER_MATH(b, ptr) \
-    do if (variant >= 2) \
-    { \
-      VARIANT2_INTEGER_MATH_DIVISION_STEP(b, ptr); \
-      VARIANT2_INTEGER_MATH_SQRT_STEP_FP64(); \
-      VARIANT2_INTEGER_MATH_SQRT_FIXUP(sqrt_result); \
-    } while (0)
-
-#define VARIANT2_2() \
-  do if (variant >= 2) { \
-    ((uint64_t*)(long_state + ((j * AES_BLOCK_SIZE) ^ 0x10)))[0] ^= hi; \
-    ((uint64_t*)(long_state + ((j * AES_BLOCK_SIZE) ^ 0x10)))[1] ^= lo; \
-    hi ^= ((uint64_t*)(long_state + ((j * AES_BLOCK_SIZE) ^ 0x20)))[0]; \
-    lo ^= ((uint64_t*)(long_state + ((j * AES_BLOCK_SIZE) ^ 0x20)))[1]; \
-  } while (0)
-
-#pragma pack(push, 1)
-union cnfn_slow_hash_state {
-    union hash_state hs;
-    struct {
-        uint8_t k[64];
-        uint8_t init[INIT_SIZE_BYTE];
-    };
-};
-#pragma pack(pop)
+/* Every variant fits in the largest page, and huge pages are 2 MiB on common
+ * platforms, so one huge-page aligned scratchpad per thread serves them all. */
+#define SCRATCHPAD_SIZE  CNFN_PAGE_SIZE
+#define SCRATCHPAD_ALIGN 2097152
 
 static void do_blake_hash(const void* input, size_t len, char* output) {
     blake256_hash((uint8_t*)output, input, len);
@@ -140,153 +49,237 @@ static void (* const extra_hashes[3])(const void *, size_t, char *) = {
 extern int aesb_single_round(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey);
 extern int aesb_pseudo_round(const uint8_t *in, uint8_t *out, const uint8_t *expandedKey);
 
-static inline size_t e2i(const uint8_t* a, size_t count) {
-    return (*((uint64_t*) a) / AES_BLOCK_SIZE) & (count - 1);
+/*
+ * Per-thread scratchpads, allocated on first use and reused by every later
+ * hash on that thread. This avoids a 2 MiB allocation (and the page faults
+ * of touching fresh memory) per CryptoNight pass. Explicit huge pages are
+ * used when the system has them reserved, otherwise transparent huge pages
+ * are requested, both to cut TLB misses of the random accesses in the main
+ * loop. Multi-lane hashing uses one scratchpad per lane; lanes beyond the
+ * first are only allocated by threads that use them. The scratchpads are
+ * released when the thread exits.
+ */
+typedef struct {
+  uint8_t* long_state[CNFN_MAX_LANES];
+  int mmapped[CNFN_MAX_LANES];
+} cnfn_scratchpad;
+
+static void cnfn_scratchpad_free(void* ptr)
+{
+  cnfn_scratchpad* pad = (cnfn_scratchpad*) ptr;
+  size_t lane;
+  if (pad == NULL) return;
+  for (lane = 0; lane < CNFN_MAX_LANES; lane++) {
+    if (pad->long_state[lane] == NULL) continue;
+#if defined(_WIN32)
+    _aligned_free(pad->long_state[lane]);
+#else
+    if (pad->mmapped[lane]) {
+      munmap(pad->long_state[lane], SCRATCHPAD_SIZE);
+    } else {
+      free(pad->long_state[lane]);
+    }
+#endif
+  }
+  free(pad);
 }
 
-static void mul(const uint8_t* a, const uint8_t* b, uint8_t* res) {
-    ((uint64_t*) res)[1] = mul128(((uint64_t*) a)[0], ((uint64_t*) b)[0], (uint64_t*) res);
+static uint8_t* cnfn_scratchpad_lane(cnfn_scratchpad* pad, size_t lane)
+{
+  if (pad->long_state[lane] != NULL) return pad->long_state[lane];
+#if defined(_WIN32)
+  pad->long_state[lane] = (uint8_t*) _aligned_malloc(SCRATCHPAD_SIZE, 64);
+#else
+  void* mem = NULL;
+#if defined(MAP_HUGETLB)
+  mem = mmap(NULL, SCRATCHPAD_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem != MAP_FAILED) {
+    pad->mmapped[lane] = 1;
+  } else {
+    mem = NULL;
+  }
+#endif
+  if (mem == NULL) {
+    if (posix_memalign(&mem, SCRATCHPAD_ALIGN, SCRATCHPAD_SIZE) != 0) {
+      mem = NULL;
+    }
+#if defined(MADV_HUGEPAGE)
+    else {
+      madvise(mem, SCRATCHPAD_SIZE, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  pad->long_state[lane] = (uint8_t*) mem;
+#endif
+  return pad->long_state[lane];
 }
 
-static void sum_half_blocks(uint8_t* a, const uint8_t* b) {
-    uint64_t a0, a1, b0, b1;
+#if defined(_WIN32)
+static DWORD scratchpad_fls = FLS_OUT_OF_INDEXES;
+static INIT_ONCE scratchpad_once = INIT_ONCE_STATIC_INIT;
 
-    a0 = SWAP64LE(((uint64_t*) a)[0]);
-    a1 = SWAP64LE(((uint64_t*) a)[1]);
-    b0 = SWAP64LE(((uint64_t*) b)[0]);
-    b1 = SWAP64LE(((uint64_t*) b)[1]);
-    a0 += b0;
-    a1 += b1;
-    ((uint64_t*) a)[0] = SWAP64LE(a0);
-    ((uint64_t*) a)[1] = SWAP64LE(a1);
-}
-
-static inline void copy_block(uint8_t* dst, const uint8_t* src) {
-    ((uint64_t*) dst)[0] = ((uint64_t*) src)[0];
-    ((uint64_t*) dst)[1] = ((uint64_t*) src)[1];
+static VOID NTAPI cnfn_scratchpad_fls_free(PVOID ptr)
+{
+  cnfn_scratchpad_free(ptr);
 }
 
-static void swap_blocks(uint8_t* a, uint8_t* b) {
-    size_t i;
-    uint8_t t;
-    for (i = 0; i < AES_BLOCK_SIZE; i++) {
-        t = a[i];
-        a[i] = b[i];
-        b[i] = t;
-    }
+static BOOL CALLBACK cnfn_scratchpad_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+  scratchpad_fls = FlsAlloc(cnfn_scratchpad_fls_free);
+  return TRUE;
 }
 
-static inline void xor_blocks(uint8_t* a, const uint8_t* b) {
-    ((uint64_t*) a)[0] ^= ((uint64_t*) b)[0];
-    ((uint64_t*) a)[1] ^= ((uint64_t*) b)[1];
+static uint8_t* cnfn_thread_scratchpad(size_t lane)
+{
+  InitOnceExecuteOnce(&scratchpad_once, cnfn_scratchpad_init, NULL, NULL);
+  if (scratchpad_fls == FLS_OUT_OF_INDEXES) return NULL;
+  cnfn_scratchpad* pad = (cnfn_scratchpad*) FlsGetValue(scratchpad_fls);
+  if (pad == NULL) {
+    pad = (cnfn_scratchpad*) calloc(1, sizeof(cnfn_scratchpad));
+    if (pad == NULL) return NULL;
+    FlsSetValue(scratchpad_fls, pad);
+  }
+  return cnfn_scratchpad_lane(pad, lane);
 }
+#else
+static pthread_key_t scratchpad_key;
+static int scratchpad_key_ok = 0;
+static pthread_once_t scratchpad_once = PTHREAD_ONCE_INIT;
 
-static inline void xor_blocks_dst(const uint8_t* a, const uint8_t* b, uint8_t* dst) {
-    ((uint64_t*) dst)[0] = ((uint64_t*) a)[0] ^ ((uint64_t*) b)[0];
-    ((uint64_t*) dst)[1] = ((uint64_t*) a)[1] ^ ((uint64_t*) b)[1];
+static void cnfn_scratchpad_init(void)
+{
+  scratchpad_key_ok = pthread_key_create(&scratchpad_key, cnfn_scratchpad_free) == 0;
 }
 
-void cnfn_slow_hash(const char* input, char* output, int len, int variant, uint32_t page_size, uint32_t iterations, size_t aes_rounds)
+static uint8_t* cnfn_thread_scratchpad(size_t lane)
 {
-  union cnfn_slow_hash_state state;
-  uint8_t text[INIT_SIZE_BYTE];
-  uint8_t a[AES_BLOCK_SIZE];
-  uint8_t b[AES_BLOCK_SIZE * 2];
-  uint8_t c[AES_BLOCK_SIZE];
-  uint8_t aes_key[AES_KEY_SIZE];
-  oaes_ctx* aes_ctx;
-
-  size_t init_rounds = (page_size / INIT_SIZE_BYTE);
-
-#if defined(_MSC_VER)
-  uint8_t *long_state = (uint8_t *)_malloca(page_size);
-#else
-#if defined(__APPLE__)
-  uint8_t *long_state = (uint8_t *)calloc(page_size, sizeof(uint8_t));
-#else
-  uint8_t *long_state = (uint8_t *)malloc(page_size);
-#endif
-#endif
-  hash_process(&state.hs, (const uint8_t*) input, len);
-  memcpy(text, state.init, INIT_SIZE_BYTE);
-  memcpy(aes_key, state.hs.b, AES_KEY_SIZE);
-  aes_ctx = (oaes_ctx*) oaes_alloc();
-  size_t i, j;
-
-  VARIANT1_INIT();
-  VARIANT2_INIT(b, state);
-
-  oaes_key_import_data(aes_ctx, aes_key, AES_KEY_SIZE);
-  for (i = 0; i < init_rounds; i++) {
-    for (j = 0; j < INIT_SIZE_BLK; j++) {
-      aesb_pseudo_round(&text[AES_BLOCK_SIZE * j],
-      &text[AES_BLOCK_SIZE * j],
-      aes_ctx->key->exp_data);
+  pthread_once(&scratchpad_once, cnfn_scratchpad_init);
+  if (!scratchpad_key_ok) return NULL;
+  cnfn_scratchpad* pad = (cnfn_scratchpad*) pthread_getspecific(scratchpad_key);
+  if (pad == NULL) {
+    pad = (cnfn_scratchpad*) calloc(1, sizeof(cnfn_scratchpad));
+    if (pad == NULL) return NULL;
+    if (pthread_setspecific(scratchpad_key, pad) != 0) {
+      free(pad);
+      return NULL;
     }
-    memcpy(&long_state[i * INIT_SIZE_BYTE], text, INIT_SIZE_BYTE);
-  }
-
-  for (i = 0; i < 16; i++) {
-    a[i] = state.k[i] ^ state.k[32 + i];
-    b[i] = state.k[16 + i] ^ state.k[48 + i];
   }
+  return cnfn_scratchpad_lane(pad, lane);
+}
+#endif
 
-  for (i = 0; i < iterations; i++) {
-    /* Dependency chain: address -> read value ------+
-    * written value <-+ hard function (AES or MUL) <+
-    * next address  <-+
-    */
-    /* Iteration 1 */
-    j = e2i(a, aes_rounds);
-    aesb_single_round(&long_state[j * AES_BLOCK_SIZE], c, a);
-    VARIANT2_SHUFFLE_ADD(long_state, j * AES_BLOCK_SIZE, a, b);
-    xor_blocks_dst(c, b, &long_state[j * AES_BLOCK_SIZE]);
-    VARIANT1_1((uint8_t*)&long_state[j * AES_BLOCK_SIZE]);
-    /* Iteration 2 */
-    j = e2i(c, aes_rounds);
-
-    uint64_t* dst = (uint64_t*)&long_state[j * AES_BLOCK_SIZE];
-
-    uint64_t t[2];
-    t[0] = dst[0];
-    t[1] = dst[1];
-
-    VARIANT2_INTEGER_MATH(t, c);
+/* Portable AES, using the table based rounds from aesb.c. */
+typedef struct {
+  const uint8_t* exp_data;
+} cnfn_aes_keys;
 
-    uint64_t hi;
-    uint64_t lo = mul128(((uint64_t*)c)[0], t[0], &hi);
+static inline void cnfn_aes_load_keys(cnfn_aes_keys* keys, const uint8_t* exp_data)
+{
+  keys->exp_data = exp_data;
+}
 
-    VARIANT2_2();
-    VARIANT2_SHUFFLE_ADD(long_state, j * AES_BLOCK_SIZE, a, b);
+static inline void cnfn_aes_pseudo_rounds(const cnfn_aes_keys* keys, uint8_t* blocks)
+{
+  size_t j;
+  for (j = 0; j < INIT_SIZE_BLK; j++) {
+    aesb_pseudo_round(&blocks[AES_BLOCK_SIZE * j], &blocks[AES_BLOCK_SIZE * j], keys->exp_data);
+  }
+}
 
-    ((uint64_t*)a)[0] += hi;
-    ((uint64_t*)a)[1] += lo;
+static inline void cnfn_aes_single_round(const uint8_t* in, uint8_t* out, const uint8_t* key)
+{
+  aesb_single_round(in, out, key);
+}
 
-    dst[0] = ((uint64_t*)a)[0];
-    dst[1] = ((uint64_t*)a)[1];
+#define CNFN_CORE_NAME cnfn_core_portable
+#define CNFN_CORE_MULTI_NAME cnfn_core_multi_portable
+#include "cnfn_core.h"
+#undef CNFN_CORE_NAME
+#undef CNFN_CORE_MULTI_NAME
 
-    ((uint64_t*)a)[0] ^= t[0];
-    ((uint64_t*)a)[1] ^= t[1];
+/* Selected by cnfn_use_aes_implementation(), normally once at startup. */
+static cnfn_core_fn cnfn_core = cnfn_core_portable;
+static cnfn_core_multi_fn cnfn_core_multi = cnfn_core_multi_portable;
 
-    VARIANT1_2((uint8_t*)&long_state[j * AES_BLOCK_SIZE]);
-    copy_block(b + AES_BLOCK_SIZE, b);
-    copy_block(b, c);
+int cnfn_use_aes_implementation(int impl)
+{
+  switch (impl) {
+  case CNFN_AES_PORTABLE:
+    cnfn_core = cnfn_core_portable;
+    cnfn_core_multi = cnfn_core_multi_portable;
+    return 1;
+#if defined(ENABLE_X86_AESNI)
+  case CNFN_AES_X86_AESNI:
+    cnfn_core = cnfn_core_x86_aesni;
+    cnfn_core_multi = cnfn_core_multi_x86_aesni;
+    return 1;
+#endif
+#if defined(ENABLE_ARM_AES)
+  case CNFN_AES_ARM:
+    cnfn_core = cnfn_core_arm_aes;
+    cnfn_core_multi = cnfn_core_multi_arm_aes;
+    return 1;
+#endif
+  default:
+    return 0;
   }
+}
 
-  memcpy(text, state.init, INIT_SIZE_BYTE);
-  oaes_key_import_data(aes_ctx, &state.hs.b[32], AES_KEY_SIZE);
-  for (i = 0; i < init_rounds; i++) {
-    for (j = 0; j < INIT_SIZE_BLK; j++) {
-      xor_blocks(&text[j * AES_BLOCK_SIZE], &long_state[i * INIT_SIZE_BYTE + j * AES_BLOCK_SIZE]);
-      aesb_pseudo_round(&text[j * AES_BLOCK_SIZE], &text[j * AES_BLOCK_SIZE], aes_ctx->key->exp_data);
-    }
+void cnfn_slow_hash(const char* input, char* output, int len, int variant, uint32_t page_size, uint32_t iterations, size_t aes_rounds)
+{
+  union cnfn_slow_hash_state state;
+
+  /* The whole scratchpad is written by the core before it is read, so a
+   * reused one does not need clearing. */
+  uint8_t *long_state = page_size <= SCRATCHPAD_SIZE ? cnfn_thread_scratchpad(0) : NULL;
+  uint8_t *owned_state = NULL;
+  if (long_state == NULL) {
+    owned_state = (uint8_t *)malloc(page_size);
+    long_state = owned_state;
   }
-  memcpy(state.init, text, INIT_SIZE_BYTE);
+  hash_process(&state.hs, (const uint8_t*) input, len);
+  cnfn_core(&state, long_state, input, len, variant, page_size, iterations, aes_rounds);
   hash_permutation(&state.hs);
   /*memcpy(hash, &state, 32);*/
   extra_hashes[state.hs.b[0] & 2](&state, 200, output);
-  oaes_free((OAES_CTX **) &aes_ctx);
-  free(long_state);
+  free(owned_state);
+}
+
+void cnfn_slow_hash_multi(const char* const* inputs, char* const* outputs, uint32_t len, int variant, const cnfn_params* params, size_t count)
+{
+  union cnfn_slow_hash_state states[CNFN_MAX_LANES];
+  union cnfn_slow_hash_state* state_ptrs[CNFN_MAX_LANES];
+  uint8_t* long_states[CNFN_MAX_LANES];
+  size_t lanes, l;
+
+  while (count > 0) {
+    lanes = count < CNFN_MAX_LANES ? count : CNFN_MAX_LANES;
+    for (l = 0; l < lanes; l++) {
+      long_states[l] = params[l].page_size <= SCRATCHPAD_SIZE ? cnfn_thread_scratchpad(l) : NULL;
+      if (long_states[l] == NULL) break;
+    }
+    /* Only variant 1 has an interleaved core; anything else, or a lane
+     * without a scratchpad, is hashed one input at a time. */
+    if (lanes == 1 || variant != 1 || len < 43 || l < lanes) {
+      for (l = 0; l < lanes; l++) {
+        cnfn_slow_hash(inputs[l], outputs[l], len, variant, params[l].page_size, params[l].iterations, params[l].aes_rounds);
+      }
+    } else {
+      for (l = 0; l < lanes; l++) {
+        hash_process(&states[l].hs, (const uint8_t*) inputs[l], len);
+        state_ptrs[l] = &states[l];
+      }
+      cnfn_core_multi(state_ptrs, long_states, inputs, params, lanes);
+      for (l = 0; l < lanes; l++) {
+        hash_permutation(&states[l].hs);
+        extra_hashes[states[l].hs.b[0] & 2](&states[l], 200, outputs[l]);
+      }
+    }
+    inputs += lanes;
+    outputs += lanes;
+    params += lanes;
+    count -= lanes;
+  }
 }
 
 void cnfn_fast_hash(const char* input, char* output, uint32_t len) {
@@ -28,6 +28,21 @@
 
 #define CNFN_TURTLE_LITE_AES_ROUNDS 8192
 
+/* Maximum number of inputs cnfn_slow_hash_multi() interleaves. */
+#define CNFN_MAX_LANES           4
+
+/* Parameters of one CryptoNight variant. */
+typedef struct {
+  uint32_t page_size;
+  uint32_t iterations;
+  size_t aes_rounds;
+} cnfn_params;
+
+/* AES implementations accepted by cnfn_use_aes_implementation(). */
+#define CNFN_AES_PORTABLE        0
+#define CNFN_AES_X86_AESNI       1
+#define CNFN_AES_ARM             2
+
 typedef unsigned char BitSequence;
 typedef unsigned long long DataLength;
 
@@ -49,6 +64,10 @@ extern "C" {
 
   void cnfn_slow_hash(const char* input, char* output, uint32_t len, int variant, uint32_t page_size, uint32_t iterations, size_t aes_rounds);
   void cnfn_fast_hash(const char* input, char* output, uint32_t len);
+  /* Hash count inputs of equal length, input i with params[i], interleaving up to CNFN_MAX_LANES at a time. */
+  void cnfn_slow_hash_multi(const char* const* inputs, char* const* outputs, uint32_t len, int variant, const cnfn_params* params, size_t count);
+  /* Select the AES implementation used by cnfn_slow_hash. Returns 0 if it was not compiled in. */
+  int cnfn_use_aes_implementation(int impl);
 
 //-----------------------------------------------------------------------------------
   inline void cnfn_dark_fast_hash(const char* input, char* output, uint32_t len) {
@@ -0,0 +1,61 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * CryptoNight core using the ARMv8 cryptography extensions. AESE with a zero
+ * key followed by AESMC and a XOR with the round key is one round of
+ * aesb_single_round, so the output matches the portable core.
+ */
+
+#ifdef ENABLE_ARM_AES
+
+#include <arm_neon.h>
+
+#include "cnfn_internal.h"
+
+typedef struct {
+  uint8x16_t k[10];
+} cnfn_aes_keys;
+
+static inline uint8x16_t cnfn_aes_round(uint8x16_t x, uint8x16_t key)
+{
+  return veorq_u8(vaesmcq_u8(vaeseq_u8(x, vdupq_n_u8(0))), key);
+}
+
+static inline void cnfn_aes_load_keys(cnfn_aes_keys* keys, const uint8_t* exp_data)
+{
+  int r;
+  for (r = 0; r < 10; r++) {
+    keys->k[r] = vld1q_u8(exp_data + r * AES_BLOCK_SIZE);
+  }
+}
+
+/* The blocks are independent, so interleave them to hide the AESE latency. */
+static inline void cnfn_aes_pseudo_rounds(const cnfn_aes_keys* keys, uint8_t* blocks)
+{
+  uint8x16_t x[INIT_SIZE_BLK];
+  int j, r;
+  for (j = 0; j < INIT_SIZE_BLK; j++) {
+    x[j] = vld1q_u8(blocks + j * AES_BLOCK_SIZE);
+  }
+  for (r = 0; r < 10; r++) {
+    for (j = 0; j < INIT_SIZE_BLK; j++) {
+      x[j] = cnfn_aes_round(x[j], keys->k[r]);
+    }
+  }
+  for (j = 0; j < INIT_SIZE_BLK; j++) {
+    vst1q_u8(blocks + j * AES_BLOCK_SIZE, x[j]);
+  }
+}
+
+static inline void cnfn_aes_single_round(const uint8_t* in, uint8_t* out, const uint8_t* key)
+{
+  vst1q_u8(out, cnfn_aes_round(vld1q_u8(in), vld1q_u8(key)));
+}
+
+#define CNFN_CORE_NAME cnfn_core_arm_aes
+#define CNFN_CORE_MULTI_NAME cnfn_core_multi_arm_aes
+#include "cnfn_core.h"
+
+#endif
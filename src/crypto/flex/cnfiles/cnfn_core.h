@@ -0,0 +1,192 @@
+// Copyright (c) 2021 The Raptoreum Project
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+// Portions Copyright (c) 2018 The Monero developers
+// Portions Copyright (c) 2018 The TurtleCoin Developers
+// Portions Copyright (c) 2024 Flex Labs Developers
+
+/*
+ * CryptoNight core, instantiated once per AES implementation. Deliberately
+ * has no include guard. Before including it, define CNFN_CORE_NAME and
+ * CNFN_CORE_MULTI_NAME and provide:
+ *
+ *   cnfn_aes_keys            round keys in the implementation's own format
+ *   cnfn_aes_load_keys       load the first 10 round keys of an expanded key
+ *   cnfn_aes_pseudo_rounds   10 AES rounds on each of INIT_SIZE_BLK blocks, in place
+ *   cnfn_aes_single_round    one AES round of a block with a 16-byte key
+ *
+ * All implementations must produce identical output.
+ */
+
+#include "cnfn_internal.h"
+
+/* Fill the scratchpad from the AES encrypted hash state. */
+static inline void cnfn_explode(const union cnfn_slow_hash_state* state, uint8_t* long_state, uint32_t page_size)
+{
+  uint8_t text[INIT_SIZE_BYTE];
+  uint32_t expanded_key[AES_EXPANDED_KEY_SIZE / sizeof(uint32_t)];
+  cnfn_aes_keys keys;
+  size_t init_rounds = (page_size / INIT_SIZE_BYTE);
+  size_t i;
+
+  memcpy(text, state->init, INIT_SIZE_BYTE);
+  oaes_key_expand_data(state->hs.b, AES_KEY_SIZE, (uint8_t*)expanded_key, sizeof(expanded_key));
+  cnfn_aes_load_keys(&keys, (const uint8_t*)expanded_key);
+  for (i = 0; i < init_rounds; i++) {
+    cnfn_aes_pseudo_rounds(&keys, text);
+    memcpy(&long_state[i * INIT_SIZE_BYTE], text, INIT_SIZE_BYTE);
+  }
+}
+
+/* Fold the scratchpad back into the hash state. */
+static inline void cnfn_implode(union cnfn_slow_hash_state* state, const uint8_t* long_state, uint32_t page_size)
+{
+  uint8_t text[INIT_SIZE_BYTE];
+  uint32_t expanded_key[AES_EXPANDED_KEY_SIZE / sizeof(uint32_t)];
+  cnfn_aes_keys keys;
+  size_t init_rounds = (page_size / INIT_SIZE_BYTE);
+  size_t i, j;
+
+  memcpy(text, state->init, INIT_SIZE_BYTE);
+  oaes_key_expand_data(&state->hs.b[32], AES_KEY_SIZE, (uint8_t*)expanded_key, sizeof(expanded_key));
+  cnfn_aes_load_keys(&keys, (const uint8_t*)expanded_key);
+  for (i = 0; i < init_rounds; i++) {
+    for (j = 0; j < INIT_SIZE_BLK; j++) {
+      xor_blocks(&text[j * AES_BLOCK_SIZE], &long_state[i * INIT_SIZE_BYTE + j * AES_BLOCK_SIZE]);
+    }
+    cnfn_aes_pseudo_rounds(&keys, text);
+  }
+  memcpy(state->init, text, INIT_SIZE_BYTE);
+}
+
+void CNFN_CORE_NAME(union cnfn_slow_hash_state* state, uint8_t* long_state, const char* input, int len, int variant, uint32_t page_size, uint32_t iterations, size_t aes_rounds)
+{
+  uint8_t a[AES_BLOCK_SIZE];
+  uint8_t b[AES_BLOCK_SIZE * 2];
+  uint8_t c[AES_BLOCK_SIZE];
+  size_t i, j;
+
+  VARIANT1_INIT(*state);
+  VARIANT2_INIT(b, (*state));
+
+  cnfn_explode(state, long_state, page_size);
+
+  for (i = 0; i < 16; i++) {
+    a[i] = state->k[i] ^ state->k[32 + i];
+    b[i] = state->k[16 + i] ^ state->k[48 + i];
+  }
+
+  for (i = 0; i < iterations; i++) {
+    /* Dependency chain: address -> read value ------+
+    * written value <-+ hard function (AES or MUL) <+
+    * next address  <-+
+    */
+    /* Iteration 1 */
+    j = e2i(a, aes_rounds);
+    cnfn_aes_single_round(&long_state[j * AES_BLOCK_SIZE], c, a);
+    VARIANT2_SHUFFLE_ADD(long_state, j * AES_BLOCK_SIZE, a, b);
+    xor_blocks_dst(c, b, &long_state[j * AES_BLOCK_SIZE]);
+    VARIANT1_1((uint8_t*)&long_state[j * AES_BLOCK_SIZE]);
+    /* Iteration 2 */
+    j = e2i(c, aes_rounds);
+
+    uint64_t* dst = (uint64_t*)&long_state[j * AES_BLOCK_SIZE];
+
+    uint64_t t[2];
+    t[0] = dst[0];
+    t[1] = dst[1];
+
+    VARIANT2_INTEGER_MATH(t, c);
+
+    uint64_t hi;
+    uint64_t lo = mul128(((uint64_t*)c)[0], t[0], &hi);
+
+    VARIANT2_2();
+    VARIANT2_SHUFFLE_ADD(long_state, j * AES_BLOCK_SIZE, a, b);
+
+    ((uint64_t*)a)[0] += hi;
+    ((uint64_t*)a)[1] += lo;
+
+    dst[0] = ((uint64_t*)a)[0];
+    dst[1] = ((uint64_t*)a)[1];
+
+    ((uint64_t*)a)[0] ^= t[0];
+    ((uint64_t*)a)[1] ^= t[1];
+
+    VARIANT1_2((uint8_t*)&long_state[j * AES_BLOCK_SIZE]);
+    copy_block(b + AES_BLOCK_SIZE, b);
+    copy_block(b, c);
+  }
+
+  cnfn_implode(state, long_state, page_size);
+}
+
+/*
+ * Variant 1 passes over up to CNFN_MAX_LANES independent inputs. The main
+ * loops of all lanes advance in lockstep, so the out-of-order core overlaps
+ * their dependency chains and scratchpad misses instead of stalling on one.
+ * Lanes may use different parameters; shorter ones simply drop out.
+ * The caller checks that every input is long enough for variant 1.
+ */
+void CNFN_CORE_MULTI_NAME(union cnfn_slow_hash_state* const* states, uint8_t* const* long_states, const char* const* inputs, const cnfn_params* params, size_t lanes)
+{
+  const int variant = 1;
+  uint64_t a[CNFN_MAX_LANES][2];
+  uint64_t b[CNFN_MAX_LANES][2];
+  uint64_t c[CNFN_MAX_LANES][2];
+  uint64_t tweaks[CNFN_MAX_LANES];
+  uint32_t max_iterations = 0;
+  size_t i, l;
+
+  for (l = 0; l < lanes; l++) {
+    const union cnfn_slow_hash_state* state = states[l];
+    tweaks[l] = *(const uint64_t*)(((const uint8_t*)inputs[l]) + 35) ^ state->hs.w[24];
+    cnfn_explode(state, long_states[l], params[l].page_size);
+    for (i = 0; i < 16; i++) {
+      ((uint8_t*)a[l])[i] = state->k[i] ^ state->k[32 + i];
+      ((uint8_t*)b[l])[i] = state->k[16 + i] ^ state->k[48 + i];
+    }
+    if (params[l].iterations > max_iterations) max_iterations = params[l].iterations;
+  }
+
+  for (i = 0; i < max_iterations; i++) {
+    for (l = 0; l < lanes; l++) {
+      if (i >= params[l].iterations) continue;
+      uint8_t* long_state = long_states[l];
+      const size_t aes_rounds = params[l].aes_rounds;
+      const uint64_t tweak1_2 = tweaks[l];
+      uint8_t* la = (uint8_t*)a[l];
+      uint8_t* lb = (uint8_t*)b[l];
+      uint8_t* lc = (uint8_t*)c[l];
+
+      size_t j = e2i(la, aes_rounds);
+      cnfn_aes_single_round(&long_state[j * AES_BLOCK_SIZE], lc, la);
+      xor_blocks_dst(lc, lb, &long_state[j * AES_BLOCK_SIZE]);
+      VARIANT1_1((uint8_t*)&long_state[j * AES_BLOCK_SIZE]);
+
+      j = e2i(lc, aes_rounds);
+      uint64_t* dst = (uint64_t*)&long_state[j * AES_BLOCK_SIZE];
+      uint64_t t[2];
+      t[0] = dst[0];
+      t[1] = dst[1];
+
+      uint64_t hi;
+      uint64_t lo = mul128(c[l][0], t[0], &hi);
+
+      a[l][0] += hi;
+      a[l][1] += lo;
+      dst[0] = a[l][0];
+      dst[1] = a[l][1];
+      a[l][0] ^= t[0];
+      a[l][1] ^= t[1];
+
+      VARIANT1_2((uint8_t*)dst);
+      copy_block(lb, lc);
+    }
+  }
+
+  for (l = 0; l < lanes; l++) {
+    cnfn_implode(states[l], long_states[l], params[l].page_size);
+  }
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * CryptoNight core using the x86 AES-NI instructions. One AESENC is exactly
+ * one round of aesb_single_round (SubBytes, ShiftRows, MixColumns and the
+ * round key XOR), so the output matches the portable core.
+ */
+
+#ifdef ENABLE_X86_AESNI
+
+#include <immintrin.h>
+
+#include "cnfn_internal.h"
+
+typedef struct {
+  __m128i k[10];
+} cnfn_aes_keys;
+
+static inline void cnfn_aes_load_keys(cnfn_aes_keys* keys, const uint8_t* exp_data)
+{
+  int r;
+  for (r = 0; r < 10; r++) {
+    keys->k[r] = _mm_loadu_si128((const __m128i*)(exp_data + r * AES_BLOCK_SIZE));
+  }
+}
+
+/* The blocks are independent, so interleave them to hide the AESENC latency. */
+static inline void cnfn_aes_pseudo_rounds(const cnfn_aes_keys* keys, uint8_t* blocks)
+{
+  __m128i x[INIT_SIZE_BLK];
+  int j, r;
+  for (j = 0; j < INIT_SIZE_BLK; j++) {
+    x[j] = _mm_loadu_si128((const __m128i*)(blocks + j * AES_BLOCK_SIZE));
+  }
+  for (r = 0; r < 10; r++) {
+    for (j = 0; j < INIT_SIZE_BLK; j++) {
+      x[j] = _mm_aesenc_si128(x[j], keys->k[r]);
+    }
+  }
+  for (j = 0; j < INIT_SIZE_BLK; j++) {
+    _mm_storeu_si128((__m128i*)(blocks + j * AES_BLOCK_SIZE), x[j]);
+  }
+}
+
+static inline void cnfn_aes_single_round(const uint8_t* in, uint8_t* out, const uint8_t* key)
+{
+  const __m128i x = _mm_loadu_si128((const __m128i*)in);
+  _mm_storeu_si128((__m128i*)out, _mm_aesenc_si128(x, _mm_loadu_si128((const __m128i*)key)));
+}
+
+#define CNFN_CORE_NAME cnfn_core_x86_aesni
+#define CNFN_CORE_MULTI_NAME cnfn_core_multi_x86_aesni
+#include "cnfn_core.h"
+
+#endif
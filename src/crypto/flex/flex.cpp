@@ -1,7 +1,19 @@
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <compat/cpuid.h>
+#include <util/trace.h>
+#include "flex.h"
 #include "cnfiles/cnfn.h"
 #include "sph/extra.h"
 #include "sph/sph_blake.h"
@@ -19,6 +31,16 @@
 #include "sph/sph_shabal.h"
 #include "sph/sph_whirlpool.h"
 
+#if defined(__linux__) && defined(ENABLE_ARM_AES)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#if defined(__APPLE__) && defined(ENABLE_ARM_AES)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+
 enum class Algo {
     BLAKE = 0,
     BMW,
@@ -47,6 +69,78 @@ enum class CNFNAlgo {
     CNFN_HASH_FUNC_COUNT
 };
 
+namespace {
+const char* const CN_VARIANT_NAMES[FLEX_CN_VARIANTS] = {"dark", "darklite", "fast", "lite", "turtle", "turtlelite"};
+
+struct CNCounters {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> histogram[FLEX_LATENCY_BUCKETS]{};
+};
+
+std::atomic<bool> g_flex_timing{false};
+std::atomic<uint64_t> g_flex_hashes{0};
+std::atomic<uint64_t> g_flex_total_ns{0};
+CNCounters g_cn_counters[FLEX_CN_VARIANTS];
+
+using TimerStart = std::optional<std::chrono::steady_clock::time_point>;
+
+/** Start timing a hash or step, unless timing is disabled. */
+TimerStart StartTimer()
+{
+    if (!g_flex_timing.load(std::memory_order_relaxed)) return std::nullopt;
+    return std::chrono::steady_clock::now();
+}
+
+std::optional<uint64_t> ElapsedNs(const TimerStart& start)
+{
+    if (!start) return std::nullopt;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - *start).count();
+}
+
+void RecordFlexHashes(uint64_t lanes, std::optional<uint64_t> ns)
+{
+    g_flex_hashes.fetch_add(lanes, std::memory_order_relaxed);
+    if (ns) g_flex_total_ns.fetch_add(*ns, std::memory_order_relaxed);
+    TRACE2(pow, flex_hash, lanes, ns.value_or(0));
+}
+
+void RecordCNStep(uint8_t variant, std::optional<uint64_t> ns)
+{
+    if (variant >= FLEX_CN_VARIANTS) return;
+    CNCounters& counters{g_cn_counters[variant]};
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    if (ns) {
+        counters.total_ns.fetch_add(*ns, std::memory_order_relaxed);
+        const size_t bucket{std::min<size_t>(std::bit_width(*ns / 1000), FLEX_LATENCY_BUCKETS - 1)};
+        counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+    TRACE2(pow, flex_cryptonight, variant, ns.value_or(0));
+}
+} // namespace
+
+void SetFlexTiming(bool enable)
+{
+    g_flex_timing.store(enable, std::memory_order_relaxed);
+}
+
+FlexStats GetFlexStats()
+{
+    FlexStats stats{};
+    stats.timing = g_flex_timing.load(std::memory_order_relaxed);
+    stats.hashes = g_flex_hashes.load(std::memory_order_relaxed);
+    stats.total_ns = g_flex_total_ns.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < FLEX_CN_VARIANTS; ++i) {
+        stats.cn[i].name = CN_VARIANT_NAMES[i];
+        stats.cn[i].count = g_cn_counters[i].count.load(std::memory_order_relaxed);
+        stats.cn[i].total_ns = g_cn_counters[i].total_ns.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < FLEX_LATENCY_BUCKETS; ++b) {
+            stats.cn[i].histogram[b] = g_cn_counters[i].histogram[b].load(std::memory_order_relaxed);
+        }
+    }
+    return stats;
+}
+
 void selectAlgo(unsigned char nibble, bool* selectedAlgos, uint8_t* selectedIndex, int algoCount, int& currentCount) {
     uint8_t algoDigit = (nibble & 0x0F) % algoCount;
     if (!selectedAlgos[algoDigit]) {
@@ -95,27 +189,112 @@ void print_hex_memory(void* mem, unsigned int size) {
     printf("\n");
 }
 
+/** Contexts of the sph functions Flex chains, shared by all steps and lanes. */
+struct FlexContexts {
+    sph_blake512_context blake;
+    sph_bmw512_context bmw;
+    sph_groestl512_context groestl;
+    sph_keccak512_context keccak;
+    sph_skein512_context skein;
+    sph_luffa512_context luffa;
+    sph_cubehash512_context cubehash;
+    sph_shavite512_context shavite;
+    sph_simd512_context simd;
+    sph_echo512_context echo;
+    sph_hamsi512_context hamsi;
+    sph_fugue512_context fugue;
+    sph_shabal512_context shabal;
+    sph_whirlpool_context whirlpool;
+};
+
+/** Run one core (non-CryptoNight) step of the chain. Unknown algos leave hash untouched. */
+static void FlexCoreHash(uint8_t algo, FlexContexts& ctx, void* in, int size, uint32_t* hash)
+{
+    switch (static_cast<Algo>(algo)) {
+        case Algo::BLAKE:
+            sph_blake512_init(&ctx.blake);
+            sph_blake512(&ctx.blake, in, size);
+            sph_blake512_close(&ctx.blake, hash);
+            break;
+        case Algo::BMW:
+            sph_bmw512_init(&ctx.bmw);
+            sph_bmw512(&ctx.bmw, in, size);
+            sph_bmw512_close(&ctx.bmw, hash);
+            break;
+        case Algo::GROESTL:
+            sph_groestl512_init(&ctx.groestl);
+            sph_groestl512(&ctx.groestl, in, size);
+            sph_groestl512_close(&ctx.groestl, hash);
+            break;
+        case Algo::KECCAK:
+            sph_keccak512_init(&ctx.keccak);
+            sph_keccak512(&ctx.keccak, in, size);
+            sph_keccak512_close(&ctx.keccak, hash);
+            break;
+        case Algo::SKEIN:
+            sph_skein512_init(&ctx.skein);
+            sph_skein512(&ctx.skein, in, size);
+            sph_skein512_close(&ctx.skein, hash);
+            break;
+        case Algo::LUFFA:
+            sph_luffa512_init(&ctx.luffa);
+            sph_luffa512(&ctx.luffa, in, size);
+            sph_luffa512_close(&ctx.luffa, hash);
+            break;
+        case Algo::CUBEHASH:
+            sph_cubehash512_init(&ctx.cubehash);
+            sph_cubehash512(&ctx.cubehash, in, size);
+            sph_cubehash512_close(&ctx.cubehash, hash);
+            break;
+        case Algo::SHAVITE:
+            sph_shavite512_init(&ctx.shavite);
+            sph_shavite512(&ctx.shavite, in, size);
+            sph_shavite512_close(&ctx.shavite, hash);
+            break;
+        case Algo::SIMD:
+            sph_simd512_init(&ctx.simd);
+            sph_simd512(&ctx.simd, in, size);
+            sph_simd512_close(&ctx.simd, hash);
+            break;
+        case Algo::ECHO:
+            sph_echo512_init(&ctx.echo);
+            sph_echo512(&ctx.echo, in, size);
+            sph_echo512_close(&ctx.echo, hash);
+            break;
+        case Algo::HAMSI:
+            sph_hamsi512_init(&ctx.hamsi);
+            sph_hamsi512(&ctx.hamsi, in, size);
+            sph_hamsi512_close(&ctx.hamsi, hash);
+            break;
+        case Algo::FUGUE:
+            sph_fugue512_init(&ctx.fugue);
+            sph_fugue512(&ctx.fugue, in, size);
+            sph_fugue512_close(&ctx.fugue, hash);
+            break;
+        case Algo::SHABAL:
+            sph_shabal512_init(&ctx.shabal);
+            sph_shabal512(&ctx.shabal, in, size);
+            sph_shabal512_close(&ctx.shabal, hash);
+            break;
+        case Algo::WHIRLPOOL:
+            sph_whirlpool_init(&ctx.whirlpool);
+            sph_whirlpool(&ctx.whirlpool, in, size);
+            sph_whirlpool_close(&ctx.whirlpool, hash);
+            break;
+        default:
+            break;
+    }
+}
+
 void flex_hash(const char* input, int size, unsigned char* output) {
+    const TimerStart hash_start{StartTimer()};
     uint32_t hash[64 / 4];
-    sph_blake512_context ctx_blake;
-    sph_bmw512_context ctx_bmw;
-    sph_groestl512_context ctx_groestl;
-    sph_keccak512_context ctx_keccak;
-    sph_skein512_context ctx_skein;
-    sph_luffa512_context ctx_luffa;
-    sph_cubehash512_context ctx_cubehash;
-    sph_shavite512_context ctx_shavite;
-    sph_simd512_context ctx_simd;
-    sph_echo512_context ctx_echo;
-    sph_hamsi512_context ctx_hamsi;
-    sph_fugue512_context ctx_fugue;
-    sph_shabal512_context ctx_shabal;
-    sph_whirlpool_context ctx_whirlpool;
+    FlexContexts ctx;
 
     void* in = const_cast<void*>(static_cast<const void*>(input));
-    sph_keccak512_init(&ctx_keccak);
-    sph_keccak512(&ctx_keccak, in, size);
-    sph_keccak512_close(&ctx_keccak, hash);
+    sph_keccak512_init(&ctx.keccak);
+    sph_keccak512(&ctx.keccak, in, size);
+    sph_keccak512_close(&ctx.keccak, hash);
 
     uint8_t selectedAlgoOutput[15] = { 0 };
     uint8_t selectedCNAlgoOutput[6] = { 0 };
@@ -166,6 +345,7 @@ void flex_hash(const char* input, int size, unsigned char* output) {
         }
 
         // selection cnAlgo. if a CN algo is selected then core algo will not be selected
+        const TimerStart cn_start{cnSelection >= 0 ? StartTimer() : std::nullopt};
         switch (static_cast<CNFNAlgo>(cnAlgo)) {
             case CNFNAlgo::CNFNDark:
                 crypto::cnfn_dark_hash((char*)in, (char*)hash, size, 1);
@@ -188,89 +368,245 @@ void flex_hash(const char* input, int size, unsigned char* output) {
             default:
                 break;
         }
+        if (cnSelection >= 0) RecordCNStep(cnAlgo, ElapsedNs(cn_start));
 
         // selection core algo
-        switch (static_cast<Algo>(algo)) {
-            case Algo::BLAKE:
-                sph_blake512_init(&ctx_blake);
-                sph_blake512(&ctx_blake, in, size);
-                sph_blake512_close(&ctx_blake, hash);
-                break;
-            case Algo::BMW:
-                sph_bmw512_init(&ctx_bmw);
-                sph_bmw512(&ctx_bmw, in, size);
-                sph_bmw512_close(&ctx_bmw, hash);
-                break;
-            case Algo::GROESTL:
-                sph_groestl512_init(&ctx_groestl);
-                sph_groestl512(&ctx_groestl, in, size);
-                sph_groestl512_close(&ctx_groestl, hash);
-                break;
-            case Algo::KECCAK:
-                sph_keccak512_init(&ctx_keccak);
-                sph_keccak512(&ctx_keccak, in, size);
-                sph_keccak512_close(&ctx_keccak, hash);
-                break;
-            case Algo::SKEIN:
-                sph_skein512_init(&ctx_skein);
-                sph_skein512(&ctx_skein, in, size);
-                sph_skein512_close(&ctx_skein, hash);
-                break;
-            case Algo::LUFFA:
-                sph_luffa512_init(&ctx_luffa);
-                sph_luffa512(&ctx_luffa, in, size);
-                sph_luffa512_close(&ctx_luffa, hash);
-                break;
-            case Algo::CUBEHASH:
-                sph_cubehash512_init(&ctx_cubehash);
-                sph_cubehash512(&ctx_cubehash, in, size);
-                sph_cubehash512_close(&ctx_cubehash, hash);
-                break;
-            case Algo::SHAVITE:
-                sph_shavite512_init(&ctx_shavite);
-                sph_shavite512(&ctx_shavite, in, size);
-                sph_shavite512_close(&ctx_shavite, hash);
-                break;
-            case Algo::SIMD:
-                sph_simd512_init(&ctx_simd);
-                sph_simd512(&ctx_simd, in, size);
-                sph_simd512_close(&ctx_simd, hash);
-                break;
-            case Algo::ECHO:
-                sph_echo512_init(&ctx_echo);
-                sph_echo512(&ctx_echo, in, size);
-                sph_echo512_close(&ctx_echo, hash);
-                break;
-            case Algo::HAMSI:
-                sph_hamsi512_init(&ctx_hamsi);
-                sph_hamsi512(&ctx_hamsi, in, size);
-                sph_hamsi512_close(&ctx_hamsi, hash);
-                break;
-            case Algo::FUGUE:
-                sph_fugue512_init(&ctx_fugue);
-                sph_fugue512(&ctx_fugue, in, size);
-                sph_fugue512_close(&ctx_fugue, hash);
-                break;
-            case Algo::SHABAL:
-                sph_shabal512_init(&ctx_shabal);
-                sph_shabal512(&ctx_shabal, in, size);
-                sph_shabal512_close(&ctx_shabal, hash);
-                break;
-            case Algo::WHIRLPOOL:
-                sph_whirlpool_init(&ctx_whirlpool);
-                sph_whirlpool(&ctx_whirlpool, in, size);
-                sph_whirlpool_close(&ctx_whirlpool, hash);
-                break;
-            default:
-                break;
-        }
+        FlexCoreHash(algo, ctx, in, size, hash);
 
         in = static_cast<void*>(hash);
         size = 64;
     }
 
-    sph_keccak256_init(&ctx_keccak);
-    sph_keccak256(&ctx_keccak, in, size);
-    sph_keccak256_close(&ctx_keccak, hash);
+    sph_keccak256_init(&ctx.keccak);
+    sph_keccak256(&ctx.keccak, in, size);
+    sph_keccak256_close(&ctx.keccak, hash);
     std::memcpy(output, hash, 32);
+    RecordFlexHashes(1, ElapsedNs(hash_start));
+}
+
+/** CryptoNight parameters of each CNFNAlgo, matching the crypto::cnfn_*_hash wrappers. */
+static const cnfn_params CNFN_ALGO_PARAMS[] = {
+    {CNFN_DARK_PAGE_SIZE, CNFN_DARK_ITERATIONS, CNFN_DARK_AES_ROUNDS},
+    {CNFN_DARK_PAGE_SIZE, CNFN_DARK_ITERATIONS, CNFN_DARK_LITE_AES_ROUNDS},
+    {CNFN_FAST_PAGE_SIZE, CNFN_FAST_ITERATIONS, CNFN_FAST_AES_ROUNDS},
+    {CNFN_LITE_PAGE_SIZE, CNFN_LITE_ITERATIONS, CNFN_LITE_AES_ROUNDS},
+    {CNFN_TURTLE_PAGE_SIZE, CNFN_TURTLE_ITERATIONS, CNFN_TURTLE_AES_ROUNDS},
+    {CNFN_TURTLE_PAGE_SIZE, CNFN_TURTLE_ITERATIONS, CNFN_TURTLE_LITE_AES_ROUNDS},
+};
+static_assert(std::size(CNFN_ALGO_PARAMS) == static_cast<size_t>(CNFNAlgo::CNFN_HASH_FUNC_COUNT));
+static_assert(FLEX_MAX_LANES == CNFN_MAX_LANES);
+
+void flex_hash_multi(const char* const* inputs, int size, unsigned char* const* outputs, size_t count) {
+    FlexContexts ctx;
+
+    for (size_t first = 0; first < count; first += FLEX_MAX_LANES) {
+        const TimerStart hash_start{StartTimer()};
+        const size_t lanes = std::min<size_t>(count - first, FLEX_MAX_LANES);
+        uint32_t hash[FLEX_MAX_LANES][64 / 4];
+        uint8_t selectedAlgoOutput[FLEX_MAX_LANES][15] = {};
+        uint8_t selectedCNAlgoOutput[FLEX_MAX_LANES][6] = {};
+
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            void* in = const_cast<void*>(static_cast<const void*>(inputs[first + lane]));
+            sph_keccak512_init(&ctx.keccak);
+            sph_keccak512(&ctx.keccak, in, size);
+            sph_keccak512_close(&ctx.keccak, hash[lane]);
+            getAlgoString(&hash[lane], 64, selectedAlgoOutput[lane], static_cast<int>(Algo::HASH_FUNC_COUNT));
+            getAlgoString(&hash[lane], 64, selectedCNAlgoOutput[lane], static_cast<int>(CNFNAlgo::CNFN_HASH_FUNC_COUNT));
+        }
+
+        // Same chain as flex_hash(): CryptoNight at steps 5, 11 and 17, with
+        // all lanes hashed together there, and core algos everywhere else.
+        for (int i = 0; i < 18; ++i) {
+            if (i == 5 || i == 11 || i == 17) {
+                const int cnSelection = i / 6;
+                const char* cn_in[FLEX_MAX_LANES];
+                char* cn_out[FLEX_MAX_LANES];
+                cnfn_params params[FLEX_MAX_LANES];
+                for (size_t lane = 0; lane < lanes; ++lane) {
+                    cn_in[lane] = reinterpret_cast<const char*>(hash[lane]);
+                    cn_out[lane] = reinterpret_cast<char*>(hash[lane]);
+                    params[lane] = CNFN_ALGO_PARAMS[selectedCNAlgoOutput[lane][cnSelection]];
+                }
+                const TimerStart cn_start{StartTimer()};
+                crypto::cnfn_slow_hash_multi(cn_in, cn_out, 64, 1, params, lanes);
+                const std::optional<uint64_t> cn_ns{ElapsedNs(cn_start)};
+                for (size_t lane = 0; lane < lanes; ++lane) {
+                    RecordCNStep(selectedCNAlgoOutput[lane][cnSelection], cn_ns);
+                }
+                continue;
+            }
+            const int coreSelection = i < 5 ? i : (i < 11 ? i - 1 : i - 2);
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                void* in = i == 0 ? const_cast<void*>(static_cast<const void*>(inputs[first + lane])) : static_cast<void*>(hash[lane]);
+                FlexCoreHash(selectedAlgoOutput[lane][coreSelection], ctx, in, i == 0 ? size : 64, hash[lane]);
+            }
+        }
+
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            sph_keccak256_init(&ctx.keccak);
+            sph_keccak256(&ctx.keccak, hash[lane], 64);
+            sph_keccak256_close(&ctx.keccak, hash[lane]);
+            std::memcpy(outputs[first + lane], hash[lane], 32);
+        }
+        RecordFlexHashes(lanes, ElapsedNs(hash_start));
+    }
+}
+
+namespace {
+/** Check the selected CryptoNight implementation against a known answer. */
+bool CNFNSelfTest()
+{
+    static const unsigned char expected[32] = {
+        0x00, 0x0c, 0x78, 0xe1, 0x84, 0xa7, 0x4f, 0x21,
+        0x6d, 0x05, 0x55, 0x22, 0x25, 0x94, 0x54, 0x73,
+        0x12, 0xea, 0x33, 0x5a, 0xf6, 0xb5, 0x60, 0x9f,
+        0x73, 0x09, 0x31, 0x29, 0x4c, 0x6d, 0x33, 0x09,
+    };
+    unsigned char input[80];
+    unsigned char output[HASH_SIZE];
+    for (int i = 0; i < 80; ++i) input[i] = i;
+    crypto::cnfn_turtlelite_hash((const char*)input, (char*)output, sizeof(input), 1);
+    return std::memcmp(output, expected, sizeof(expected)) == 0;
+}
+
+/** Known-answer test for the sph primitives that have accelerated versions. */
+bool SphSelfTest()
+{
+    static const unsigned char groestl_expected[64] = {
+        0xa4, 0x1b, 0xd1, 0x39, 0xd3, 0xda, 0x52, 0x3a,
+        0xa7, 0x00, 0xce, 0x9d, 0xea, 0x78, 0xca, 0x3c,
+        0x7c, 0x4b, 0x66, 0xe3, 0x8e, 0x67, 0x69, 0xbe,
+        0xcb, 0xcd, 0x8f, 0xed, 0x37, 0x81, 0x3f, 0xbc,
+        0x5c, 0x2e, 0x6b, 0x1b, 0x9b, 0x91, 0x47, 0xe3,
+        0xe7, 0xe8, 0x01, 0xe8, 0xe5, 0x23, 0x1a, 0x15,
+        0x86, 0xf9, 0xba, 0x99, 0xec, 0xf6, 0x56, 0x5f,
+        0xfb, 0x77, 0xee, 0x5e, 0x79, 0x24, 0x47, 0xbc,
+    };
+    static const unsigned char echo_expected[64] = {
+        0x92, 0xb8, 0xe2, 0x21, 0x94, 0x35, 0x92, 0xe1,
+        0xee, 0x59, 0xfd, 0x99, 0xa3, 0x44, 0x9a, 0xc7,
+        0xba, 0x19, 0x51, 0x8c, 0x9d, 0x0f, 0x84, 0x1f,
+        0x47, 0x81, 0x0e, 0x50, 0xfc, 0x7f, 0x15, 0x80,
+        0x62, 0xba, 0x2b, 0xb4, 0x4c, 0xdd, 0xe7, 0x78,
+        0x76, 0x99, 0xfd, 0x2d, 0xb2, 0x51, 0xfa, 0xd8,
+        0x63, 0xcf, 0xfb, 0xab, 0x38, 0x32, 0x96, 0xb8,
+        0x4e, 0x9f, 0x08, 0x39, 0x2b, 0xf8, 0x56, 0x7a,
+    };
+    static const unsigned char shavite_expected[64] = {
+        0x34, 0xe6, 0x61, 0x84, 0x0d, 0x41, 0x1f, 0x32,
+        0xb5, 0xf0, 0x7c, 0x63, 0x8d, 0xf5, 0x3b, 0xc0,
+        0x82, 0x31, 0x9c, 0x59, 0x40, 0xc8, 0x0b, 0xea,
+        0x38, 0x3f, 0x16, 0x49, 0xa4, 0x2f, 0xf6, 0x0d,
+        0x2c, 0x4d, 0xe8, 0xe0, 0xef, 0xa2, 0xfd, 0x62,
+        0x14, 0x91, 0x54, 0x15, 0xb5, 0x8c, 0xf5, 0xa4,
+        0xd8, 0x5c, 0xb2, 0x87, 0xe5, 0xa4, 0x55, 0x09,
+        0x65, 0x13, 0xc9, 0x4a, 0x8d, 0x48, 0x97, 0x1b,
+    };
+    static const unsigned char cubehash_expected[64] = {
+        0x3d, 0x3b, 0x4e, 0x61, 0xab, 0x6a, 0x59, 0x8f,
+        0x2b, 0x92, 0xe3, 0xef, 0x64, 0xea, 0xe5, 0x0c,
+        0x71, 0xdc, 0xde, 0x14, 0x56, 0x39, 0xe3, 0xac,
+        0x7f, 0x31, 0x03, 0x78, 0xdc, 0x75, 0x2b, 0xa0,
+        0xde, 0x89, 0xab, 0xf3, 0xe6, 0x1c, 0x6d, 0xbb,
+        0x56, 0x64, 0x67, 0xaf, 0x34, 0x43, 0x27, 0x10,
+        0xb9, 0xdf, 0x88, 0x8e, 0x4d, 0x3b, 0xc0, 0x4d,
+        0x40, 0x08, 0x21, 0x7f, 0x0e, 0xc7, 0x79, 0xcd,
+    };
+    unsigned char input[80];
+    unsigned char output[64];
+    for (int i = 0; i < 80; ++i) input[i] = i;
+
+    sph_groestl512_context groestl;
+    sph_groestl512_init(&groestl);
+    sph_groestl512(&groestl, input, sizeof(input));
+    sph_groestl512_close(&groestl, output);
+    if (std::memcmp(output, groestl_expected, sizeof(output)) != 0) return false;
+
+    sph_echo512_context echo;
+    sph_echo512_init(&echo);
+    sph_echo512(&echo, input, sizeof(input));
+    sph_echo512_close(&echo, output);
+    if (std::memcmp(output, echo_expected, sizeof(output)) != 0) return false;
+
+    sph_shavite512_context shavite;
+    sph_shavite512_init(&shavite);
+    sph_shavite512(&shavite, input, sizeof(input));
+    sph_shavite512_close(&shavite, output);
+    if (std::memcmp(output, shavite_expected, sizeof(output)) != 0) return false;
+
+    sph_cubehash512_context cubehash;
+    sph_cubehash512_init(&cubehash);
+    sph_cubehash512(&cubehash, input, sizeof(input));
+    sph_cubehash512_close(&cubehash, output);
+    return std::memcmp(output, cubehash_expected, sizeof(output)) == 0;
+}
+} // namespace
+
+FlexCPUFeatures GetFlexCPUFeatures()
+{
+    FlexCPUFeatures features;
+
+#if defined(HAVE_GETCPUID)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    // The AES-NI cores are built with SSE4.1 as well.
+    features.x86_aesni = ((ecx >> 25) & 1) && ((ecx >> 19) & 1);
+    if (((ecx >> 27) & 1) && ((ecx >> 28) & 1)) { // XSAVE and AVX
+        if ((GetXCR0() & 6) == 6) { // OS saves the XMM and YMM registers
+            GetCPUID(7, 0, eax, ebx, ecx, edx);
+            features.avx2 = (ebx >> 5) & 1;
+        }
+    }
+#endif
+
+#if defined(__linux__) && defined(ENABLE_ARM_AES)
+#if defined(__arm__) // 32-bit
+    features.arm_aes = getauxval(AT_HWCAP2) & HWCAP2_AES;
+#endif
+#if defined(__aarch64__) // 64-bit
+    features.arm_aes = getauxval(AT_HWCAP) & HWCAP_AES;
+#endif
+#endif
+
+#if defined(__APPLE__) && defined(ENABLE_ARM_AES)
+    int val = 0;
+    size_t len = sizeof(val);
+    if (sysctlbyname("hw.optional.arm.FEAT_AES", &val, &len, nullptr, 0) == 0) {
+        features.arm_aes = val != 0;
+    }
+#endif
+
+    return features;
+}
+
+std::string FlexAutoDetect()
+{
+    std::string ret = "standard";
+    crypto::cnfn_use_aes_implementation(CNFN_AES_PORTABLE);
+    sph_groestl_use_x86_aesni(0);
+    sph_echo_use_x86_aesni(0);
+    sph_shavite_use_x86_aesni(0);
+    sph_cubehash_use_avx2(0);
+
+    const FlexCPUFeatures features{GetFlexCPUFeatures()};
+
+    if (features.x86_aesni && crypto::cnfn_use_aes_implementation(CNFN_AES_X86_AESNI)) {
+        sph_groestl_use_x86_aesni(1);
+        sph_echo_use_x86_aesni(1);
+        sph_shavite_use_x86_aesni(1);
+        ret = "x86_aesni(cnfn,groestl,echo,shavite)";
+    }
+
+    if (features.avx2 && sph_cubehash_use_avx2(1)) {
+        ret = (ret == "standard" ? "" : ret + ",") + "avx2(cubehash)";
+    }
+
+    if (features.arm_aes && crypto::cnfn_use_aes_implementation(CNFN_AES_ARM)) {
+        ret = "arm_aes";
+    }
+
+    assert(CNFNSelfTest());
+    assert(SphSelfTest());
+    return ret;
 }
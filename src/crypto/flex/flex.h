@@ -1 +1,63 @@
-void flex_hash(const char* input, int size, unsigned char* output);
\ No newline at end of file
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** Number of inputs flex_hash_multi() hashes together. */
+static constexpr size_t FLEX_MAX_LANES{4};
+
+void flex_hash(const char* input, int size, unsigned char* output);
+
+/**
+ * Compute flex_hash() of count inputs of the same size. Groups of up to
+ * FLEX_MAX_LANES inputs have their CryptoNight steps interleaved, which hides
+ * much of the scratchpad latency a single hash stalls on.
+ */
+void flex_hash_multi(const char* const* inputs, int size, unsigned char* const* outputs, size_t count);
+
+/** Number of CryptoNight variants a Flex hash selects from. */
+static constexpr size_t FLEX_CN_VARIANTS{6};
+/** Latency histogram buckets: bucket i counts CryptoNight steps that took
+ *  less than 2^i microseconds, and the last bucket also counts slower ones. */
+static constexpr size_t FLEX_LATENCY_BUCKETS{16};
+
+/** Counters of one CryptoNight variant. */
+struct FlexCNStats {
+    const char* name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t histogram[FLEX_LATENCY_BUCKETS];
+};
+
+/** Counters of all Flex hashes computed since startup. Steps of an
+ *  interleaved flex_hash_multi() group all record the group's latency.
+ *  Times and histograms only cover hashes computed while timing was on. */
+struct FlexStats {
+    bool timing;
+    uint64_t hashes;
+    uint64_t total_ns;
+    FlexCNStats cn[FLEX_CN_VARIANTS];
+};
+
+FlexStats GetFlexStats();
+
+static constexpr bool DEFAULT_POW_TIMING{false};
+
+/** Time every Flex hash and CryptoNight step for GetFlexStats() and the
+ *  pow tracepoints. Off by default, as reading the clock slows hashing. */
+void SetFlexTiming(bool enable);
+
+/** CPU features the accelerated Flex implementations need, as reported by
+ *  the CPU and enabled by the OS. */
+struct FlexCPUFeatures {
+    bool x86_aesni{false};
+    bool avx2{false};
+    bool arm_aes{false};
+};
+
+FlexCPUFeatures GetFlexCPUFeatures();
+
+/** Select the fastest CryptoNight AES and sph (Groestl, Echo, Shavite, CubeHash)
+ *  implementations this CPU supports and return a description of them. */
+std::string FlexAutoDetect();
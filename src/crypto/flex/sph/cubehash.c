@@ -30,10 +30,13 @@
  * @author   Thomas Pornin <thomas.pornin@cryptolog.com>
  */
 
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
 #include <stddef.h>
 #include <string.h>
 #include <limits.h>
 
+#include "sph_dispatch.h"
 #include "sph_cubehash.h"
 #ifdef __cplusplus
 extern "C"{
@@ -253,17 +256,6 @@ static const sph_u32 IV512[] = {
 
 #endif
 
-#define INPUT_BLOCK   do { \
-		x0 ^= sph_dec32le_aligned(buf +  0); \
-		x1 ^= sph_dec32le_aligned(buf +  4); \
-		x2 ^= sph_dec32le_aligned(buf +  8); \
-		x3 ^= sph_dec32le_aligned(buf + 12); \
-		x4 ^= sph_dec32le_aligned(buf + 16); \
-		x5 ^= sph_dec32le_aligned(buf + 20); \
-		x6 ^= sph_dec32le_aligned(buf + 24); \
-		x7 ^= sph_dec32le_aligned(buf + 28); \
-	} while (0)
-
 #define ROUND_EVEN   do { \
 		xg = T32(x0 + xg); \
 		x0 = ROTL32(x0, 7); \
@@ -531,6 +523,54 @@ static const sph_u32 IV512[] = {
 
 #endif
 
+/*
+ * Apply count times sixteen rounds to the state. This is the part of the
+ * hash that has an AVX2 implementation, see sph_cubehash_use_avx2().
+ */
+static void
+cubehash_rounds_portable(sph_cubehash_context *sc, unsigned count)
+{
+	DECL_STATE
+
+	READ_STATE(sc);
+	while (count -- > 0) {
+		SIXTEEN_ROUNDS;
+	}
+	WRITE_STATE(sc);
+}
+
+#ifdef ENABLE_AVX2
+void sph_cubehash_rounds_avx2(sph_cubehash_context *sc, unsigned count);
+#endif
+
+static void (*SPH_DISPATCH cubehash_rounds)(sph_cubehash_context *sc, unsigned count)
+	= cubehash_rounds_portable;
+
+/* see sph_cubehash.h */
+int
+sph_cubehash_use_avx2(int enable)
+{
+	if (!enable) {
+		SPH_DISPATCH_STORE(cubehash_rounds, cubehash_rounds_portable);
+		return 1;
+	}
+#ifdef ENABLE_AVX2
+	SPH_DISPATCH_STORE(cubehash_rounds, sph_cubehash_rounds_avx2);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void
+cubehash_input_block(sph_cubehash_context *sc)
+{
+	int i;
+
+	for (i = 0; i < 8; i ++)
+		sc->state[i] ^= sph_dec32le_aligned(sc->buf + (i << 2));
+}
+
 static void
 cubehash_init(sph_cubehash_context *sc, const sph_u32 *iv)
 {
@@ -543,7 +583,6 @@ cubehash_core(sph_cubehash_context *sc, const void *data, size_t len)
 {
 	unsigned char *buf;
 	size_t ptr;
-	DECL_STATE
 
 	buf = sc->buf;
 	ptr = sc->ptr;
@@ -554,7 +593,6 @@ cubehash_core(sph_cubehash_context *sc, const void *data, size_t len)
 		return;
 	}
 
-	READ_STATE(sc);
 	while (len > 0) {
 		size_t clen;
 
@@ -566,12 +604,11 @@ cubehash_core(sph_cubehash_context *sc, const void *data, size_t len)
 		data = (const unsigned char *)data + clen;
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
-			INPUT_BLOCK;
-			SIXTEEN_ROUNDS;
+			cubehash_input_block(sc);
+			SPH_DISPATCH_LOAD(cubehash_rounds)(sc, 1);
 			ptr = 0;
 		}
 	}
-	WRITE_STATE(sc);
 	sc->ptr = ptr;
 }
 
@@ -582,22 +619,16 @@ cubehash_close(sph_cubehash_context *sc, unsigned ub, unsigned n,
 	unsigned char *buf, *out;
 	size_t ptr;
 	unsigned z;
-	int i;
-	DECL_STATE
 
 	buf = sc->buf;
 	ptr = sc->ptr;
 	z = 0x80 >> n;
 	buf[ptr ++] = ((ub & -z) | z) & 0xFF;
 	memset(buf + ptr, 0, (sizeof sc->buf) - ptr);
-	READ_STATE(sc);
-	INPUT_BLOCK;
-	for (i = 0; i < 11; i ++) {
-		SIXTEEN_ROUNDS;
-		if (i == 0)
-			xv ^= SPH_C32(1);
-	}
-	WRITE_STATE(sc);
+	cubehash_input_block(sc);
+	SPH_DISPATCH_LOAD(cubehash_rounds)(sc, 1);
+	sc->state[31] ^= SPH_C32(1);
+	SPH_DISPATCH_LOAD(cubehash_rounds)(sc, 10);
 	out = dst;
 	for (z = 0; z < out_size_w32; z ++)
 		sph_enc32le(out + (z << 2), sc->state[z]);
@@ -0,0 +1,58 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * CubeHash rounds using AVX2. The 32-word state is held as four vectors of
+ * eight words, so every step of a round is a single vector operation and the
+ * word swaps become lane permutations.
+ */
+
+#ifdef ENABLE_AVX2
+
+#include <immintrin.h>
+
+#include "sph_cubehash.h"
+
+#define CUBEHASH_ROTL(x, n)   _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+void sph_cubehash_rounds_avx2(sph_cubehash_context *sc, unsigned count)
+{
+	__m256i x0 = _mm256_loadu_si256((const __m256i *)&sc->state[0]);
+	__m256i x1 = _mm256_loadu_si256((const __m256i *)&sc->state[8]);
+	__m256i x2 = _mm256_loadu_si256((const __m256i *)&sc->state[16]);
+	__m256i x3 = _mm256_loadu_si256((const __m256i *)&sc->state[24]);
+	__m256i t;
+	unsigned r;
+
+	for (r = 0; r < 16 * count; r ++) {
+		x2 = _mm256_add_epi32(x0, x2);
+		x3 = _mm256_add_epi32(x1, x3);
+		/* Rotate by 7 and swap x[i] with x[i ^ 8]. */
+		t = CUBEHASH_ROTL(x0, 7);
+		x0 = CUBEHASH_ROTL(x1, 7);
+		x1 = t;
+		x0 = _mm256_xor_si256(x0, x2);
+		x1 = _mm256_xor_si256(x1, x3);
+		/* Swap x[i + 16] with x[(i ^ 2) + 16]. */
+		x2 = _mm256_shuffle_epi32(x2, _MM_SHUFFLE(1, 0, 3, 2));
+		x3 = _mm256_shuffle_epi32(x3, _MM_SHUFFLE(1, 0, 3, 2));
+		x2 = _mm256_add_epi32(x0, x2);
+		x3 = _mm256_add_epi32(x1, x3);
+		/* Rotate by 11 and swap x[i] with x[i ^ 4]. */
+		x0 = _mm256_permute4x64_epi64(CUBEHASH_ROTL(x0, 11), _MM_SHUFFLE(1, 0, 3, 2));
+		x1 = _mm256_permute4x64_epi64(CUBEHASH_ROTL(x1, 11), _MM_SHUFFLE(1, 0, 3, 2));
+		x0 = _mm256_xor_si256(x0, x2);
+		x1 = _mm256_xor_si256(x1, x3);
+		/* Swap x[i + 16] with x[(i ^ 1) + 16]. */
+		x2 = _mm256_shuffle_epi32(x2, _MM_SHUFFLE(2, 3, 0, 1));
+		x3 = _mm256_shuffle_epi32(x3, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+
+	_mm256_storeu_si256((__m256i *)&sc->state[0], x0);
+	_mm256_storeu_si256((__m256i *)&sc->state[8], x1);
+	_mm256_storeu_si256((__m256i *)&sc->state[16], x2);
+	_mm256_storeu_si256((__m256i *)&sc->state[24], x3);
+}
+
+#endif
@@ -30,10 +30,13 @@
  * @author   Thomas Pornin <thomas.pornin@cryptolog.com>
  */
 
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
 #include <stddef.h>
 #include <string.h>
 #include <limits.h>
 
+#include "sph_dispatch.h"
 #include "sph_echo.h"
 
 #ifdef __cplusplus
@@ -720,13 +723,36 @@ echo_small_compress(sph_echo_small_context *sc)
 }
 
 static void
-echo_big_compress(sph_echo_big_context *sc)
+echo_big_compress_portable(sph_echo_big_context *sc)
 {
 	DECL_STATE_BIG
 
 	COMPRESS_BIG(sc);
 }
 
+#ifdef ENABLE_X86_AESNI
+void sph_echo512_compress_x86_aesni(sph_echo_big_context *sc);
+#endif
+
+static void (*SPH_DISPATCH echo_big_compress)(sph_echo_big_context *sc)
+	= echo_big_compress_portable;
+
+/* see sph_echo.h */
+int
+sph_echo_use_x86_aesni(int enable)
+{
+	if (!enable) {
+		SPH_DISPATCH_STORE(echo_big_compress, echo_big_compress_portable);
+		return 1;
+	}
+#ifdef ENABLE_X86_AESNI
+	SPH_DISPATCH_STORE(echo_big_compress, sph_echo512_compress_x86_aesni);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 static void
 echo_small_core(sph_echo_small_context *sc,
 	const unsigned char *data, size_t len)
@@ -790,7 +816,7 @@ echo_big_core(sph_echo_big_context *sc,
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
 			INCR_COUNTER(sc, 1024);
-			echo_big_compress(sc);
+			SPH_DISPATCH_LOAD(echo_big_compress)(sc);
 			ptr = 0;
 		}
 	}
@@ -897,13 +923,13 @@ echo_big_close(sph_echo_big_context *sc, unsigned ub, unsigned n,
 	buf[ptr ++] = ((ub & -z) | z) & 0xFF;
 	memset(buf + ptr, 0, (sizeof sc->buf) - ptr);
 	if (ptr > ((sizeof sc->buf) - 18)) {
-		echo_big_compress(sc);
+		SPH_DISPATCH_LOAD(echo_big_compress)(sc);
 		sc->C0 = sc->C1 = sc->C2 = sc->C3 = 0;
 		memset(buf, 0, sizeof sc->buf);
 	}
 	sph_enc16le(buf + (sizeof sc->buf) - 18, out_size_w32 << 5);
 	memcpy(buf + (sizeof sc->buf) - 16, u.tmp, 16);
-	echo_big_compress(sc);
+	SPH_DISPATCH_LOAD(echo_big_compress)(sc);
 #if SPH_ECHO_64
 	for (VV = &sc->u.Vb[0][0], k = 0; k < ((out_size_w32 + 1) >> 1); k ++)
 		sph_enc64le_aligned(u.tmp + (k << 3), VV[k]);
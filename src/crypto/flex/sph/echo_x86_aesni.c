@@ -0,0 +1,102 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * ECHO-512 compression function using the x86 AES-NI instructions. Each
+ * 128-bit ECHO word is an AES state in the byte order of the portable code,
+ * so BIG.SubWords is one AESENC with the counter as key followed by one
+ * AESENC with a zero key.
+ */
+
+#ifdef ENABLE_X86_AESNI
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "sph_echo.h"
+
+/* Multiply each byte by 2 in GF(2^8) with the AES polynomial. */
+static inline __m128i echo_mul2(__m128i x)
+{
+	const __m128i hi = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+	return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+static inline void echo_mix_column(__m128i *W, int ia, int ib, int ic, int id)
+{
+	const __m128i a = W[ia];
+	const __m128i b = W[ib];
+	const __m128i c = W[ic];
+	const __m128i d = W[id];
+	const __m128i ab = _mm_xor_si128(a, b);
+	const __m128i bc = _mm_xor_si128(b, c);
+	const __m128i cd = _mm_xor_si128(c, d);
+	const __m128i abx = echo_mul2(ab);
+	const __m128i bcx = echo_mul2(bc);
+	const __m128i cdx = echo_mul2(cd);
+	W[ia] = _mm_xor_si128(abx, _mm_xor_si128(bc, d));
+	W[ib] = _mm_xor_si128(bcx, _mm_xor_si128(a, cd));
+	W[ic] = _mm_xor_si128(cdx, _mm_xor_si128(ab, d));
+	W[id] = _mm_xor_si128(_mm_xor_si128(abx, bcx), _mm_xor_si128(_mm_xor_si128(cdx, ab), c));
+}
+
+static inline void echo_shift_row1(__m128i *W, int a, int b, int c, int d)
+{
+	const __m128i tmp = W[a];
+	W[a] = W[b];
+	W[b] = W[c];
+	W[c] = W[d];
+	W[d] = tmp;
+}
+
+void sph_echo512_compress_x86_aesni(sph_echo_big_context *sc)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i W[16];
+	uint64_t klo = (uint64_t)sc->C0 | ((uint64_t)sc->C1 << 32);
+	uint64_t khi = (uint64_t)sc->C2 | ((uint64_t)sc->C3 << 32);
+	__m128i tmp;
+	int n, r;
+
+	for (n = 0; n < 8; n ++) {
+		W[n] = _mm_loadu_si128((const __m128i *)&sc->u.Vs[n][0]);
+		W[n + 8] = _mm_loadu_si128((const __m128i *)(sc->buf + 16 * n));
+	}
+
+	for (r = 0; r < 10; r ++) {
+		/* BIG.SubWords, the 128-bit counter increments once per word. */
+		for (n = 0; n < 16; n ++) {
+			const __m128i k = _mm_set_epi64x((long long)khi, (long long)klo);
+			W[n] = _mm_aesenc_si128(_mm_aesenc_si128(W[n], k), zero);
+			if (++klo == 0) {
+				++khi;
+			}
+		}
+
+		/* BIG.ShiftRows */
+		echo_shift_row1(W, 1, 5, 9, 13);
+		tmp = W[2];
+		W[2] = W[10];
+		W[10] = tmp;
+		tmp = W[6];
+		W[6] = W[14];
+		W[14] = tmp;
+		echo_shift_row1(W, 15, 11, 7, 3);
+
+		/* BIG.MixColumns */
+		echo_mix_column(W, 0, 1, 2, 3);
+		echo_mix_column(W, 4, 5, 6, 7);
+		echo_mix_column(W, 8, 9, 10, 11);
+		echo_mix_column(W, 12, 13, 14, 15);
+	}
+
+	for (n = 0; n < 8; n ++) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)&sc->u.Vs[n][0]);
+		const __m128i m = _mm_loadu_si128((const __m128i *)(sc->buf + 16 * n));
+		_mm_storeu_si128((__m128i *)&sc->u.Vs[n][0],
+			_mm_xor_si128(_mm_xor_si128(v, m), _mm_xor_si128(W[n], W[n + 8])));
+	}
+}
+
+#endif
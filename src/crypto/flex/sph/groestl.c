@@ -30,9 +30,12 @@
  * @author   Thomas Pornin <thomas.pornin@cryptolog.com>
  */
 
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
 #include <stddef.h>
 #include <string.h>
 
+#include "sph_dispatch.h"
 #include "sph_groestl.h"
 
 #ifdef __cplusplus
@@ -2868,6 +2871,68 @@ groestl_small_close(sph_groestl_small_context *sc,
 	groestl_small_init(sc, (unsigned)out_len << 3);
 }
 
+static void
+groestl_big_compress_portable(sph_groestl_big_context *sc)
+{
+	unsigned char *buf;
+	DECL_STATE_BIG
+
+	buf = sc->buf;
+	READ_STATE_BIG(sc);
+	COMPRESS_BIG;
+	WRITE_STATE_BIG(sc);
+}
+
+static void
+groestl_big_final_portable(sph_groestl_big_context *sc)
+{
+	DECL_STATE_BIG
+
+	READ_STATE_BIG(sc);
+	FINAL_BIG;
+	WRITE_STATE_BIG(sc);
+}
+
+/*
+ * The compression and output functions are switched together, so that a
+ * hash never mixes the two implementations.
+ */
+typedef struct {
+	void (*compress)(sph_groestl_big_context *sc);
+	void (*final)(sph_groestl_big_context *sc);
+} groestl_big_impl;
+
+static const groestl_big_impl groestl_big_portable = {
+	groestl_big_compress_portable, groestl_big_final_portable
+};
+
+#ifdef ENABLE_X86_AESNI
+void sph_groestl512_compress_x86_aesni(sph_groestl_big_context *sc);
+void sph_groestl512_final_x86_aesni(sph_groestl_big_context *sc);
+
+static const groestl_big_impl groestl_big_x86_aesni = {
+	sph_groestl512_compress_x86_aesni, sph_groestl512_final_x86_aesni
+};
+#endif
+
+static const groestl_big_impl *SPH_DISPATCH groestl_big = &groestl_big_portable;
+
+/* see sph_groestl.h */
+int
+sph_groestl_use_x86_aesni(int enable)
+{
+	if (!enable) {
+		SPH_DISPATCH_STORE(groestl_big, &groestl_big_portable);
+		return 1;
+	}
+#ifdef ENABLE_X86_AESNI
+	SPH_DISPATCH_STORE(groestl_big, &groestl_big_x86_aesni);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 static void
 groestl_big_init(sph_groestl_big_context *sc, unsigned out_size)
 {
@@ -2904,9 +2969,9 @@ groestl_big_init(sph_groestl_big_context *sc, unsigned out_size)
 static void
 groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 {
+	const groestl_big_impl *impl;
 	unsigned char *buf;
 	size_t ptr;
-	DECL_STATE_BIG
 
 	buf = sc->buf;
 	ptr = sc->ptr;
@@ -2917,7 +2982,7 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 		return;
 	}
 
-	READ_STATE_BIG(sc);
+	impl = SPH_DISPATCH_LOAD(groestl_big);
 	while (len > 0) {
 		size_t clen;
 
@@ -2929,7 +2994,7 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 		data = (const unsigned char *)data + clen;
 		len -= clen;
 		if (ptr == sizeof sc->buf) {
-			COMPRESS_BIG;
+			impl->compress(sc);
 #if SPH_64
 			sc->count ++;
 #else
@@ -2939,7 +3004,6 @@ groestl_big_core(sph_groestl_big_context *sc, const void *data, size_t len)
 			ptr = 0;
 		}
 	}
-	WRITE_STATE_BIG(sc);
 	sc->ptr = ptr;
 }
 
@@ -2989,8 +3053,8 @@ groestl_big_close(sph_groestl_big_context *sc,
 	sph_enc64be(pad + pad_len - 4, count_low);
 #endif
 	groestl_big_core(sc, pad, pad_len);
+	SPH_DISPATCH_LOAD(groestl_big)->final(sc);
 	READ_STATE_BIG(sc);
-	FINAL_BIG;
 #if SPH_GROESTL_64
 	for (u = 0; u < 8; u ++)
 		enc64e(pad + (u << 3), H[u + 8]);
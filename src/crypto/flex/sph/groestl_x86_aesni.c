@@ -0,0 +1,221 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * Groestl-512 compression and output functions using the x86 AES-NI
+ * instructions. The 8x16 byte state is kept with one row per register.
+ * SubBytes is AESENCLAST with a zero key, whose own ShiftRows step is
+ * undone by the PSHUFB that also performs ShiftBytes. MixBytes works on
+ * whole rows, so it is a sum of multiples of the eight registers.
+ */
+
+#ifdef ENABLE_X86_AESNI
+
+#include <immintrin.h>
+#include <stdint.h>
+
+#include "sph_groestl.h"
+
+/*
+ * Row i of P (Q) is rotated left by sigma_P[i] (sigma_Q[i]) bytes, with
+ * sigma_P = {0, 1, 2, 3, 4, 5, 6, 11} and sigma_Q = {1, 3, 5, 11, 0, 2, 4, 6},
+ * composed with the inverse of the AES ShiftRows step.
+ */
+static const unsigned char groestl_shift_p[8][16] __attribute__((aligned(16))) = {
+	{  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+	{  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4 },
+	{  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5 },
+	{  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6 },
+	{  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7 },
+	{  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8 },
+	{  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9 },
+	{ 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14 },
+};
+
+static const unsigned char groestl_shift_q[8][16] __attribute__((aligned(16))) = {
+	{  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4 },
+	{  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6 },
+	{  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8 },
+	{ 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14 },
+	{  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+	{  2, 15, 12,  9,  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5 },
+	{  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3,  0, 13, 10,  7 },
+	{  6,  3,  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9 },
+};
+
+/* Multiply each byte by 2 in GF(2^8) with the AES polynomial. */
+static inline __m128i groestl_mul2(__m128i x)
+{
+	const __m128i hi = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+	return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(hi, _mm_set1_epi8(0x1B)));
+}
+
+/* Transpose the eight 8x16-bit words of X in place. */
+static inline void groestl_transpose_words(__m128i *X)
+{
+	__m128i a[8], b[8];
+
+	a[0] = _mm_unpacklo_epi16(X[0], X[1]);
+	a[1] = _mm_unpackhi_epi16(X[0], X[1]);
+	a[2] = _mm_unpacklo_epi16(X[2], X[3]);
+	a[3] = _mm_unpackhi_epi16(X[2], X[3]);
+	a[4] = _mm_unpacklo_epi16(X[4], X[5]);
+	a[5] = _mm_unpackhi_epi16(X[4], X[5]);
+	a[6] = _mm_unpacklo_epi16(X[6], X[7]);
+	a[7] = _mm_unpackhi_epi16(X[6], X[7]);
+	b[0] = _mm_unpacklo_epi32(a[0], a[2]);
+	b[1] = _mm_unpackhi_epi32(a[0], a[2]);
+	b[2] = _mm_unpacklo_epi32(a[1], a[3]);
+	b[3] = _mm_unpackhi_epi32(a[1], a[3]);
+	b[4] = _mm_unpacklo_epi32(a[4], a[6]);
+	b[5] = _mm_unpackhi_epi32(a[4], a[6]);
+	b[6] = _mm_unpacklo_epi32(a[5], a[7]);
+	b[7] = _mm_unpackhi_epi32(a[5], a[7]);
+	X[0] = _mm_unpacklo_epi64(b[0], b[4]);
+	X[1] = _mm_unpackhi_epi64(b[0], b[4]);
+	X[2] = _mm_unpacklo_epi64(b[1], b[5]);
+	X[3] = _mm_unpackhi_epi64(b[1], b[5]);
+	X[4] = _mm_unpacklo_epi64(b[2], b[6]);
+	X[5] = _mm_unpackhi_epi64(b[2], b[6]);
+	X[6] = _mm_unpacklo_epi64(b[3], b[7]);
+	X[7] = _mm_unpackhi_epi64(b[3], b[7]);
+}
+
+/*
+ * The state is stored column by column, as in the portable code. Each
+ * 16-byte load holds two columns, whose bytes are interleaved so that the
+ * pairs of a row form one 16-bit word, and a word transpose yields rows.
+ */
+static inline void groestl_load_rows(__m128i *R, const unsigned char *src)
+{
+	const __m128i interleave = _mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+	int i;
+
+	for (i = 0; i < 8; i ++)
+		R[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + 16 * i)), interleave);
+	groestl_transpose_words(R);
+}
+
+static inline void groestl_store_rows(unsigned char *dst, const __m128i *R)
+{
+	const __m128i deinterleave = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+	__m128i X[8];
+	int i;
+
+	for (i = 0; i < 8; i ++)
+		X[i] = R[i];
+	groestl_transpose_words(X);
+	for (i = 0; i < 8; i ++)
+		_mm_storeu_si128((__m128i *)(dst + 16 * i), _mm_shuffle_epi8(X[i], deinterleave));
+}
+
+/*
+ * The rounds index the state arrays with constants, so they must be fully
+ * unrolled for the rows to stay in registers.
+ */
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+#define GROESTL_UNROLL _Pragma("GCC unroll 8")
+#else
+#define GROESTL_UNROLL
+#endif
+
+/* SubBytes and ShiftBytes with the given row shifts, then MixBytes. */
+static inline void groestl_round_tail(__m128i *R, const unsigned char (*shift)[16])
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i T[8], X[8], Y[8];
+	int i;
+
+	GROESTL_UNROLL
+	for (i = 0; i < 8; i ++) {
+		R[i] = _mm_aesenclast_si128(
+			_mm_shuffle_epi8(R[i], _mm_load_si128((const __m128i *)shift[i])), zero);
+	}
+
+	/*
+	 * Row i of the result is sum_k c[k] * R[i + k] for the circulant
+	 * c = {2, 2, 3, 4, 5, 3, 5, 7}. Factored as in "Byte Slicing
+	 * Groestl" (Kasper et al.), it takes two doublings per row:
+	 *   t_i = R_i + R_{i+1}
+	 *   x_i = t_i + t_{i+3}
+	 *   y_i = t_i + t_{i+2} + R_{i+6}
+	 *   result_i = 2 * (2 * x_{i+3} + y_{i+7}) + y_{i+4}
+	 */
+	GROESTL_UNROLL
+	for (i = 0; i < 8; i ++)
+		T[i] = _mm_xor_si128(R[i], R[(i + 1) & 7]);
+	GROESTL_UNROLL
+	for (i = 0; i < 8; i ++) {
+		X[i] = _mm_xor_si128(T[i], T[(i + 3) & 7]);
+		Y[i] = _mm_xor_si128(_mm_xor_si128(T[i], T[(i + 2) & 7]), R[(i + 6) & 7]);
+	}
+	GROESTL_UNROLL
+	for (i = 0; i < 8; i ++) {
+		const __m128i w = _mm_xor_si128(groestl_mul2(X[(i + 3) & 7]), Y[(i + 7) & 7]);
+		R[i] = _mm_xor_si128(groestl_mul2(w), Y[(i + 4) & 7]);
+	}
+}
+
+static inline void groestl_round_p(__m128i *R, int r)
+{
+	const __m128i columns = _mm_setr_epi8(0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
+		(char)0x80, (char)0x90, (char)0xA0, (char)0xB0, (char)0xC0, (char)0xD0, (char)0xE0, (char)0xF0);
+
+	R[0] = _mm_xor_si128(R[0], _mm_xor_si128(columns, _mm_set1_epi8((char)r)));
+	groestl_round_tail(R, groestl_shift_p);
+}
+
+static inline void groestl_round_q(__m128i *R, int r)
+{
+	const __m128i columns = _mm_setr_epi8(0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
+		(char)0x80, (char)0x90, (char)0xA0, (char)0xB0, (char)0xC0, (char)0xD0, (char)0xE0, (char)0xF0);
+	const __m128i ones = _mm_set1_epi8((char)0xFF);
+	int i;
+
+	GROESTL_UNROLL
+	for (i = 0; i < 7; i ++)
+		R[i] = _mm_xor_si128(R[i], ones);
+	R[7] = _mm_xor_si128(R[7], _mm_xor_si128(columns, _mm_set1_epi8((char)(0xFF ^ r))));
+	groestl_round_tail(R, groestl_shift_q);
+}
+
+void sph_groestl512_compress_x86_aesni(sph_groestl_big_context *sc)
+{
+	unsigned char *state = (unsigned char *)&sc->state;
+	__m128i H[8], P[8], Q[8];
+	int i, r;
+
+	groestl_load_rows(H, state);
+	groestl_load_rows(Q, sc->buf);
+	for (i = 0; i < 8; i ++)
+		P[i] = _mm_xor_si128(H[i], Q[i]);
+
+	/* P and Q are independent, interleaving them hides the AESENCLAST latency. */
+	for (r = 0; r < 14; r ++) {
+		groestl_round_p(P, r);
+		groestl_round_q(Q, r);
+	}
+
+	for (i = 0; i < 8; i ++)
+		H[i] = _mm_xor_si128(H[i], _mm_xor_si128(P[i], Q[i]));
+	groestl_store_rows(state, H);
+}
+
+void sph_groestl512_final_x86_aesni(sph_groestl_big_context *sc)
+{
+	unsigned char *state = (unsigned char *)&sc->state;
+	__m128i H[8], P[8];
+	int i, r;
+
+	groestl_load_rows(H, state);
+	for (i = 0; i < 8; i ++)
+		P[i] = H[i];
+	for (r = 0; r < 14; r ++)
+		groestl_round_p(P, r);
+	for (i = 0; i < 8; i ++)
+		H[i] = _mm_xor_si128(H[i], P[i]);
+	groestl_store_rows(state, H);
+}
+
+#endif
@@ -30,9 +30,12 @@
  * @author   Thomas Pornin <thomas.pornin@cryptolog.com>
  */
 
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
 #include <stddef.h>
 #include <string.h>
 
+#include "sph_dispatch.h"
 #include "sph_shavite.h"
 
 #ifdef __cplusplus
@@ -726,7 +729,7 @@ c256(sph_shavite_small_context *sc, const void *msg)
  * This function assumes that "msg" is aligned for 32-bit access.
  */
 static void
-c512(sph_shavite_big_context *sc, const void *msg)
+c512_portable(sph_shavite_big_context *sc, const void *msg)
 {
 	sph_u32 p0, p1, p2, p3, p4, p5, p6, p7;
 	sph_u32 p8, p9, pA, pB, pC, pD, pE, pF;
@@ -897,7 +900,7 @@ c512(sph_shavite_big_context *sc, const void *msg)
  * This function assumes that "msg" is aligned for 32-bit access.
  */
 static void
-c512(sph_shavite_big_context *sc, const void *msg)
+c512_portable(sph_shavite_big_context *sc, const void *msg)
 {
 	sph_u32 p0, p1, p2, p3, p4, p5, p6, p7;
 	sph_u32 p8, p9, pA, pB, pC, pD, pE, pF;
@@ -1550,6 +1553,29 @@ shavite_small_close(sph_shavite_small_context *sc,
 		sph_enc32le((unsigned char *)dst + (u << 2), sc->h[u]);
 }
 
+#ifdef ENABLE_X86_AESNI
+void sph_shavite512_c512_x86_aesni(sph_shavite_big_context *sc, const void *msg);
+#endif
+
+static void (*SPH_DISPATCH c512)(sph_shavite_big_context *sc, const void *msg)
+	= c512_portable;
+
+/* see sph_shavite.h */
+int
+sph_shavite_use_x86_aesni(int enable)
+{
+	if (!enable) {
+		SPH_DISPATCH_STORE(c512, c512_portable);
+		return 1;
+	}
+#ifdef ENABLE_X86_AESNI
+	SPH_DISPATCH_STORE(c512, sph_shavite512_c512_x86_aesni);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 static void
 shavite_big_init(sph_shavite_big_context *sc, const sph_u32 *iv)
 {
@@ -1590,7 +1616,7 @@ shavite_big_core(sph_shavite_big_context *sc, const void *data, size_t len)
 					}
 				}
 			}
-			c512(sc, buf);
+			SPH_DISPATCH_LOAD(c512)(sc, buf);
 			ptr = 0;
 		}
 	}
@@ -1624,7 +1650,7 @@ shavite_big_close(sph_shavite_big_context *sc,
 	} else {
 		buf[ptr ++] = z;
 		memset(buf + ptr, 0, 128 - ptr);
-		c512(sc, buf);
+		SPH_DISPATCH_LOAD(c512)(sc, buf);
 		memset(buf, 0, 110);
 		sc->count0 = sc->count1 = sc->count2 = sc->count3 = 0;
 	}
@@ -1634,7 +1660,7 @@ shavite_big_close(sph_shavite_big_context *sc,
 	sph_enc32le(buf + 122, count3);
 	buf[126] = out_size_w32 << 5;
 	buf[127] = out_size_w32 >> 3;
-	c512(sc, buf);
+	SPH_DISPATCH_LOAD(c512)(sc, buf);
 	for (u = 0; u < out_size_w32; u ++)
 		sph_enc32le((unsigned char *)dst + (u << 2), sc->h[u]);
 }
@@ -0,0 +1,85 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * SHAvite-3-512 compression function using the x86 AES-NI instructions.
+ * The portable code applies a keyless AES round and then XORs the next
+ * subkey, which is exactly what AESENC does with that subkey as round key.
+ */
+
+#ifdef ENABLE_X86_AESNI
+
+#include <immintrin.h>
+
+#include "sph_shavite.h"
+
+void sph_shavite512_c512_x86_aesni(sph_shavite_big_context *sc, const void *msg)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i rk[112];
+	__m128i p0, p1, p2, p3, x, t;
+	int u, r, s;
+
+	for (u = 0; u < 8; u ++) {
+		rk[u] = _mm_loadu_si128((const __m128i *)msg + u);
+	}
+
+	/* Message expansion, four 32-bit subkey words per vector. */
+	u = 8;
+	for (;;) {
+		for (s = 0; s < 8; s ++) {
+			x = _mm_shuffle_epi32(rk[u - 8], _MM_SHUFFLE(0, 3, 2, 1));
+			rk[u] = _mm_xor_si128(_mm_aesenc_si128(x, zero), rk[u - 1]);
+			if (u == 8) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(~sc->count3, sc->count2, sc->count1, sc->count0));
+			} else if (u == 41) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(~sc->count0, sc->count1, sc->count2, sc->count3));
+			} else if (u == 79) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(~sc->count1, sc->count0, sc->count3, sc->count2));
+			} else if (u == 110) {
+				rk[u] = _mm_xor_si128(rk[u], _mm_set_epi32(~sc->count2, sc->count3, sc->count0, sc->count1));
+			}
+			u ++;
+		}
+		if (u == 112)
+			break;
+		for (s = 0; s < 8; s ++) {
+			t = _mm_or_si128(_mm_srli_si128(rk[u - 2], 4), _mm_slli_si128(rk[u - 1], 12));
+			rk[u] = _mm_xor_si128(rk[u - 8], t);
+			u ++;
+		}
+	}
+
+	p0 = _mm_loadu_si128((const __m128i *)&sc->h[0x0]);
+	p1 = _mm_loadu_si128((const __m128i *)&sc->h[0x4]);
+	p2 = _mm_loadu_si128((const __m128i *)&sc->h[0x8]);
+	p3 = _mm_loadu_si128((const __m128i *)&sc->h[0xC]);
+	u = 0;
+	for (r = 0; r < 14; r ++) {
+		x = _mm_xor_si128(p1, rk[u]);
+		x = _mm_aesenc_si128(x, rk[u + 1]);
+		x = _mm_aesenc_si128(x, rk[u + 2]);
+		x = _mm_aesenc_si128(x, rk[u + 3]);
+		p0 = _mm_xor_si128(p0, _mm_aesenc_si128(x, zero));
+
+		x = _mm_xor_si128(p3, rk[u + 4]);
+		x = _mm_aesenc_si128(x, rk[u + 5]);
+		x = _mm_aesenc_si128(x, rk[u + 6]);
+		x = _mm_aesenc_si128(x, rk[u + 7]);
+		p2 = _mm_xor_si128(p2, _mm_aesenc_si128(x, zero));
+		u += 8;
+
+		t = p3;
+		p3 = p2;
+		p2 = p1;
+		p1 = p0;
+		p0 = t;
+	}
+	_mm_storeu_si128((__m128i *)&sc->h[0x0], _mm_xor_si128(_mm_loadu_si128((const __m128i *)&sc->h[0x0]), p0));
+	_mm_storeu_si128((__m128i *)&sc->h[0x4], _mm_xor_si128(_mm_loadu_si128((const __m128i *)&sc->h[0x4]), p1));
+	_mm_storeu_si128((__m128i *)&sc->h[0x8], _mm_xor_si128(_mm_loadu_si128((const __m128i *)&sc->h[0x8]), p2));
+	_mm_storeu_si128((__m128i *)&sc->h[0xC], _mm_xor_si128(_mm_loadu_si128((const __m128i *)&sc->h[0xC]), p3));
+}
+
+#endif
@@ -285,6 +285,18 @@ void sph_cubehash512_close(void *cc, void *dst);
  */
 void sph_cubehash512_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
+
+/**
+ * Select the AVX2 implementation of the CubeHash compression
+ * function, or the portable one if <code>enable</code> is zero. The
+ * caller must check that the CPU supports AVX2. This may be called
+ * while other threads are hashing.
+ *
+ * @param enable   whether to use the AVX2 implementation
+ * @return  0 if the AVX2 implementation was not compiled in
+ */
+int sph_cubehash_use_avx2(int enable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,42 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * Function pointers selecting between the portable and the accelerated
+ * sph cores. They are switched by FlexAutoDetect() while other threads
+ * may be hashing, so they are atomic where the compiler supports C11
+ * atomics. Relaxed ordering is enough: each pointer is read once per call
+ * and both targets compute the same function.
+ *
+ * Accelerated cores exist for Groestl, Echo and Shavite (AES-NI) and for
+ * CubeHash (AVX2). SIMD, BMW, Blake and Luffa only have the portable code.
+ *
+ * TODO: add SSE4.1/AVX2 cores for SIMD, BMW, Blake and Luffa. A
+ * row-per-register AVX2 Blake-512 was tried and was about 25% slower than
+ * the portable code for one message, as its rotations and diagonal lane
+ * permutations lengthen the dependency chain of every G step. These
+ * functions likely only gain from hashing several inputs at once, as
+ * flex_hash_multi() does.
+ */
+
+#ifndef SPH_DISPATCH_H__
+#define SPH_DISPATCH_H__
+
+#if defined __STDC_VERSION__ && __STDC_VERSION__ >= 201112L && !defined __STDC_NO_ATOMICS__
+
+#include <stdatomic.h>
+
+#define SPH_DISPATCH                 _Atomic
+#define SPH_DISPATCH_LOAD(p)         atomic_load_explicit(&(p), memory_order_relaxed)
+#define SPH_DISPATCH_STORE(p, v)     atomic_store_explicit(&(p), (v), memory_order_relaxed)
+
+#else
+
+#define SPH_DISPATCH
+#define SPH_DISPATCH_LOAD(p)         (p)
+#define SPH_DISPATCH_STORE(p, v)     ((p) = (v))
+
+#endif
+
+#endif
@@ -322,6 +322,18 @@ void sph_groestl512_close(void *cc, void *dst);
 void sph_groestl512_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
 
+/**
+ * Select the AES-NI implementation of the Groestl-384 and Groestl-512
+ * compression and output functions, or the portable one if
+ * <code>enable</code> is zero. The caller must check that the CPU
+ * supports AES-NI and SSE4.1. This may be called while other threads
+ * are hashing.
+ *
+ * @param enable   whether to use the AES-NI implementation
+ * @return  0 if the AES-NI implementation was not compiled in
+ */
+int sph_groestl_use_x86_aesni(int enable);
+
 #ifdef __cplusplus
 }
 #endif
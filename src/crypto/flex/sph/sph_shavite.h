@@ -307,6 +307,17 @@ void sph_shavite512_close(void *cc, void *dst);
 void sph_shavite512_addbits_and_close(
 	void *cc, unsigned ub, unsigned n, void *dst);
 	
+/**
+ * Select the AES-NI implementation of the SHAvite-384 and SHAvite-512 compression
+ * function, or the portable one if <code>enable</code> is zero. The
+ * caller must check that the CPU supports AES-NI and SSE4.1. This may be
+ * called while other threads are hashing.
+ *
+ * @param enable   whether to use the AES-NI implementation
+ * @return  0 if the AES-NI implementation was not compiled in
+ */
+int sph_shavite_use_x86_aesni(int enable);
+
 #ifdef __cplusplus
 }
 #endif	
@@ -5,16 +5,30 @@
 // Based on https://github.com/mjosaarinen/tiny_sha3/blob/master/sha3.c
 // by Markku-Juhani O. Saarinen <mjos@iki.fi>
 
+#include <config/bitcoin-config.h> // IWYU pragma: keep
+
 #include <crypto/sha3.h>
 #include <crypto/common.h>
+#include <compat/cpuid.h>
 #include <span.h>
 
 #include <algorithm>
 #include <array> // For std::begin and std::end.
 #include <bit>
+#include <cassert>
 
 #include <stdint.h>
 
+namespace sha3_avx2
+{
+void Hash_D80_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha3_avx512
+{
+void Hash_D80_8way(unsigned char* out, const unsigned char* in);
+}
+
 void KeccakF(uint64_t (&st)[25])
 {
     static constexpr uint64_t RNDC[24] = {
@@ -154,3 +168,128 @@ SHA3_256& SHA3_256::Reset()
     std::fill(std::begin(m_state), std::end(m_state), 0);
     return *this;
 }
+
+namespace
+{
+typedef void (*Hash80Way)(unsigned char* out, const unsigned char* in);
+
+Hash80Way Hash80_4way = nullptr;
+Hash80Way Hash80_8way = nullptr;
+
+/** Double hash one 80-byte message. Both passes fit in a single SHA3-256 block. */
+void Hash80(unsigned char* out, const unsigned char* in)
+{
+    uint64_t st[25] = {0};
+    for (unsigned i = 0; i < 10; ++i) {
+        st[i] = ReadLE64(in + 8 * i);
+    }
+    st[10] = 0x06;
+    st[16] = 0x8000000000000000;
+    KeccakF(st);
+    std::fill(st + 4, st + 25, 0);
+    st[4] = 0x06;
+    st[16] = 0x8000000000000000;
+    KeccakF(st);
+    for (unsigned i = 0; i < 4; ++i) {
+        WriteLE64(out + 8 * i, st[i]);
+    }
+}
+
+bool SelfTest()
+{
+    // Eight distinct 80-byte inputs, checked against the streaming SHA3_256.
+    unsigned char in[8 * 80];
+    for (unsigned i = 0; i < sizeof(in); ++i) {
+        in[i] = (unsigned char)(i * 7 + 3);
+    }
+    unsigned char expected[8 * 32];
+    for (unsigned i = 0; i < 8; ++i) {
+        SHA3_256().Write(Span{in + 80 * i, 80}).Finalize(Span{expected + 32 * i, 32});
+        SHA3_256().Write(Span{expected + 32 * i, 32}).Finalize(Span{expected + 32 * i, 32});
+    }
+
+    unsigned char out[8 * 32];
+    for (unsigned i = 0; i < 8; ++i) {
+        Hash80(out + 32 * i, in + 80 * i);
+    }
+    if (!std::equal(out, out + sizeof(out), expected)) return false;
+
+    if (Hash80_4way) {
+        Hash80_4way(out, in);
+        if (!std::equal(out, out + 128, expected)) return false;
+    }
+
+    if (Hash80_8way) {
+        Hash80_8way(out, in);
+        if (!std::equal(out, out + 256, expected)) return false;
+    }
+
+    return true;
+}
+} // namespace
+
+std::string SHA3AutoDetect()
+{
+    std::string ret = "standard";
+    Hash80_4way = nullptr;
+    Hash80_8way = nullptr;
+
+#if defined(HAVE_GETCPUID)
+    [[maybe_unused]] bool have_avx2 = false;
+    [[maybe_unused]] bool have_avx512 = false;
+
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        const uint64_t xcr0{GetXCR0()};
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        // The OS must save the YMM state, and for AVX-512 also the opmask and ZMM state.
+        have_avx2 = (xcr0 & 6) == 6 && ((ebx >> 5) & 1);
+        have_avx512 = (xcr0 & 0xe6) == 0xe6 && ((ebx >> 16) & 1);
+    }
+
+#if defined(ENABLE_AVX2)
+    if (have_avx2) {
+        Hash80_4way = sha3_avx2::Hash_D80_4way;
+        ret = "avx2(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX512)
+    if (have_avx512) {
+        Hash80_8way = sha3_avx512::Hash_D80_8way;
+        ret = (ret == "standard" ? "" : ret + ",") + "avx512(8way)";
+    }
+#endif
+#endif // defined(HAVE_GETCPUID)
+
+    assert(SelfTest());
+    return ret;
+}
+
+void SHA3_256D80(unsigned char* output, const unsigned char* input, size_t blocks)
+{
+    if (Hash80_8way) {
+        while (blocks >= 8) {
+            Hash80_8way(output, input);
+            output += 256;
+            input += 640;
+            blocks -= 8;
+        }
+    }
+    if (Hash80_4way) {
+        while (blocks >= 4) {
+            Hash80_4way(output, input);
+            output += 128;
+            input += 320;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        Hash80(output, input);
+        output += 32;
+        input += 80;
+        --blocks;
+    }
+}
@@ -9,10 +9,23 @@
 
 #include <cstdlib>
 #include <stdint.h>
+#include <string>
 
 //! The Keccak-f[1600] transform.
 void KeccakF(uint64_t (&st)[25]);
 
+/** Autodetect the best available multi-buffer SHA3 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA3AutoDetect();
+
+/** Compute multiple double SHA3-256 hashes of 80-byte inputs, such as block headers.
+ *  input:  pointer to a blocks*80 byte input buffer
+ *  output: pointer to a blocks*32 byte output buffer
+ *  blocks: the number of hashes to compute
+ */
+void SHA3_256D80(unsigned char* output, const unsigned char* input, size_t blocks);
+
 class SHA3_256
 {
 private:
@@ -0,0 +1,170 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Multi-buffer double SHA3-256 of 80-byte messages (block headers) using AVX2: lane j of every vector holds the
+// state of message j, so 4 independent block hashes run in lockstep.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <attributes.h>
+#include <crypto/common.h>
+
+namespace sha3_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Xor(Xor(x, y), Xor(z, w), v); }
+/** Compute ~x & y. */
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+template <int n>
+__m256i inline Rotl(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+__m256i inline Read4(const unsigned char* in, int offset) {
+    return _mm256_set_epi64x(
+        ReadLE64(in + 240 + offset),
+        ReadLE64(in + 160 + offset),
+        ReadLE64(in + 80 + offset),
+        ReadLE64(in + 0 + offset)
+    );
+}
+
+void inline Write4(unsigned char* out, int offset, __m256i v) {
+    alignas(32) uint64_t words[4];
+    _mm256_store_si256((__m256i*)words, v);
+    for (int j = 0; j < 4; ++j) {
+        WriteLE64(out + 32 * j + offset, words[j]);
+    }
+}
+
+/** One round of Keccak-f[1600] on 4 states, following the scalar KeccakF. */
+void ALWAYS_INLINE Round(__m256i (&st)[25], __m256i rc)
+{
+    __m256i bc0, bc1, bc2, bc3, bc4, t;
+
+    // Theta
+    bc0 = Xor(st[0], st[5], st[10], st[15], st[20]);
+    bc1 = Xor(st[1], st[6], st[11], st[16], st[21]);
+    bc2 = Xor(st[2], st[7], st[12], st[17], st[22]);
+    bc3 = Xor(st[3], st[8], st[13], st[18], st[23]);
+    bc4 = Xor(st[4], st[9], st[14], st[19], st[24]);
+    t = Xor(bc4, Rotl<1>(bc1)); st[0] = Xor(st[0], t); st[5] = Xor(st[5], t); st[10] = Xor(st[10], t); st[15] = Xor(st[15], t); st[20] = Xor(st[20], t);
+    t = Xor(bc0, Rotl<1>(bc2)); st[1] = Xor(st[1], t); st[6] = Xor(st[6], t); st[11] = Xor(st[11], t); st[16] = Xor(st[16], t); st[21] = Xor(st[21], t);
+    t = Xor(bc1, Rotl<1>(bc3)); st[2] = Xor(st[2], t); st[7] = Xor(st[7], t); st[12] = Xor(st[12], t); st[17] = Xor(st[17], t); st[22] = Xor(st[22], t);
+    t = Xor(bc2, Rotl<1>(bc4)); st[3] = Xor(st[3], t); st[8] = Xor(st[8], t); st[13] = Xor(st[13], t); st[18] = Xor(st[18], t); st[23] = Xor(st[23], t);
+    t = Xor(bc3, Rotl<1>(bc0)); st[4] = Xor(st[4], t); st[9] = Xor(st[9], t); st[14] = Xor(st[14], t); st[19] = Xor(st[19], t); st[24] = Xor(st[24], t);
+
+    // Rho Pi
+    t = st[1];
+    bc0 = st[10]; st[10] = Rotl<1>(t); t = bc0;
+    bc0 = st[7]; st[7] = Rotl<3>(t); t = bc0;
+    bc0 = st[11]; st[11] = Rotl<6>(t); t = bc0;
+    bc0 = st[17]; st[17] = Rotl<10>(t); t = bc0;
+    bc0 = st[18]; st[18] = Rotl<15>(t); t = bc0;
+    bc0 = st[3]; st[3] = Rotl<21>(t); t = bc0;
+    bc0 = st[5]; st[5] = Rotl<28>(t); t = bc0;
+    bc0 = st[16]; st[16] = Rotl<36>(t); t = bc0;
+    bc0 = st[8]; st[8] = Rotl<45>(t); t = bc0;
+    bc0 = st[21]; st[21] = Rotl<55>(t); t = bc0;
+    bc0 = st[24]; st[24] = Rotl<2>(t); t = bc0;
+    bc0 = st[4]; st[4] = Rotl<14>(t); t = bc0;
+    bc0 = st[15]; st[15] = Rotl<27>(t); t = bc0;
+    bc0 = st[23]; st[23] = Rotl<41>(t); t = bc0;
+    bc0 = st[19]; st[19] = Rotl<56>(t); t = bc0;
+    bc0 = st[13]; st[13] = Rotl<8>(t); t = bc0;
+    bc0 = st[12]; st[12] = Rotl<25>(t); t = bc0;
+    bc0 = st[2]; st[2] = Rotl<43>(t); t = bc0;
+    bc0 = st[20]; st[20] = Rotl<62>(t); t = bc0;
+    bc0 = st[14]; st[14] = Rotl<18>(t); t = bc0;
+    bc0 = st[22]; st[22] = Rotl<39>(t); t = bc0;
+    bc0 = st[9]; st[9] = Rotl<61>(t); t = bc0;
+    bc0 = st[6]; st[6] = Rotl<20>(t); t = bc0;
+    st[1] = Rotl<44>(t);
+
+    // Chi Iota
+    bc0 = st[0]; bc1 = st[1]; bc2 = st[2]; bc3 = st[3]; bc4 = st[4];
+    st[0] = Xor(bc0, AndNot(bc1, bc2), rc);
+    st[1] = Xor(bc1, AndNot(bc2, bc3));
+    st[2] = Xor(bc2, AndNot(bc3, bc4));
+    st[3] = Xor(bc3, AndNot(bc4, bc0));
+    st[4] = Xor(bc4, AndNot(bc0, bc1));
+    bc0 = st[5]; bc1 = st[6]; bc2 = st[7]; bc3 = st[8]; bc4 = st[9];
+    st[5] = Xor(bc0, AndNot(bc1, bc2));
+    st[6] = Xor(bc1, AndNot(bc2, bc3));
+    st[7] = Xor(bc2, AndNot(bc3, bc4));
+    st[8] = Xor(bc3, AndNot(bc4, bc0));
+    st[9] = Xor(bc4, AndNot(bc0, bc1));
+    bc0 = st[10]; bc1 = st[11]; bc2 = st[12]; bc3 = st[13]; bc4 = st[14];
+    st[10] = Xor(bc0, AndNot(bc1, bc2));
+    st[11] = Xor(bc1, AndNot(bc2, bc3));
+    st[12] = Xor(bc2, AndNot(bc3, bc4));
+    st[13] = Xor(bc3, AndNot(bc4, bc0));
+    st[14] = Xor(bc4, AndNot(bc0, bc1));
+    bc0 = st[15]; bc1 = st[16]; bc2 = st[17]; bc3 = st[18]; bc4 = st[19];
+    st[15] = Xor(bc0, AndNot(bc1, bc2));
+    st[16] = Xor(bc1, AndNot(bc2, bc3));
+    st[17] = Xor(bc2, AndNot(bc3, bc4));
+    st[18] = Xor(bc3, AndNot(bc4, bc0));
+    st[19] = Xor(bc4, AndNot(bc0, bc1));
+    bc0 = st[20]; bc1 = st[21]; bc2 = st[22]; bc3 = st[23]; bc4 = st[24];
+    st[20] = Xor(bc0, AndNot(bc1, bc2));
+    st[21] = Xor(bc1, AndNot(bc2, bc3));
+    st[22] = Xor(bc2, AndNot(bc3, bc4));
+    st[23] = Xor(bc3, AndNot(bc4, bc0));
+    st[24] = Xor(bc4, AndNot(bc0, bc1));
+}
+
+const uint64_t RNDC[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a, 0x8000000080008000,
+    0x000000000000808b, 0x0000000080000001, 0x8000000080008081, 0x8000000000008009,
+    0x000000000000008a, 0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089, 0x8000000000008003,
+    0x8000000000008002, 0x8000000000000080, 0x000000000000800a, 0x800000008000000a,
+    0x8000000080008081, 0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+};
+
+} // namespace
+
+void Hash_D80_4way(unsigned char* out, const unsigned char* in)
+{
+    __m256i st[25];
+
+    // Absorb the 80-byte messages and the SHA3 padding into the first block.
+    for (int i = 0; i < 10; ++i) {
+        st[i] = Read4(in, 8 * i);
+    }
+    st[10] = K(0x06);
+    for (int i = 11; i < 25; ++i) {
+        st[i] = K(0);
+    }
+    st[16] = K(0x8000000000000000);
+
+    for (int round = 0; round < 24; ++round) {
+        Round(st, K(RNDC[round]));
+    }
+
+    // Hash the 32-byte digest again, again in a single block.
+    st[4] = K(0x06);
+    for (int i = 5; i < 25; ++i) {
+        st[i] = K(0);
+    }
+    st[16] = K(0x8000000000000000);
+
+    for (int round = 0; round < 24; ++round) {
+        Round(st, K(RNDC[round]));
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        Write4(out, 8 * i, st[i]);
+    }
+}
+
+}
+
+#endif
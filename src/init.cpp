@@ -19,6 +19,7 @@
 #include <common/args.h>
 #include <common/system.h>
 #include <consensus/amount.h>
+#include <crypto/flex/flex.h>
 #include <deploymentstatus.h>
 #include <hash.h>
 #include <httprpc.h>
@@ -33,6 +34,7 @@
 #include <interfaces/node.h>
 #include <kernel/context.h>
 #include <key.h>
+#include <key_io.h>
 #include <logging.h>
 #include <mapport.h>
 #include <net.h>
@@ -58,7 +60,9 @@
 #include <policy/fees_args.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <pow_cache.h>
 #include <protocol.h>
+#include <rpc/auxpow_miner.h>
 #include <rpc/blockchain.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
@@ -66,6 +70,7 @@
 #include <scheduler.h>
 #include <script/sigcache.h>
 #include <sync.h>
+#include <stratum.h>
 #include <torcontrol.h>
 #include <txdb.h>
 #include <txmempool.h>
@@ -119,9 +124,12 @@ using common::InvalidPortErrMsg;
 using common::ResolveErrMsg;
 
 using node::ApplyArgsManOptions;
+using node::BlockAssembler;
 using node::BlockManager;
+using node::BlockTemplateCache;
 using node::CacheSizes;
 using node::CalculateCacheSizes;
+using node::DEFAULT_GENERATE_THREADS;
 using node::DEFAULT_PERSIST_MEMPOOL;
 using node::DEFAULT_PRINT_MODIFIED_FEE;
 using node::DEFAULT_STOPATHEIGHT;
@@ -257,6 +265,7 @@ void Interrupt(NodeContext& node)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     InterruptMapPort();
     if (node.connman)
         node.connman->Interrupt();
@@ -295,6 +304,8 @@ void Shutdown(NodeContext& node)
     if (node.connman) node.connman->Stop();
 
     StopTorControl();
+    StopStratumServer();
+    AuxpowMiner::get().stopWorkNotifier();
 
     if (node.chainman && node.chainman->m_thread_load.joinable()) node.chainman->m_thread_load.join();
     // After everything has been shut down, but before things get flushed, stop the
@@ -371,9 +382,11 @@ void Shutdown(NodeContext& node)
 #endif
 
     node.chain_clients.clear();
+    GetPowHashCache().CloseStore();
     if (node.validation_signals) {
         node.validation_signals->UnregisterAllValidationInterfaces();
     }
+    node.block_template_cache.reset();
     node.mempool.reset();
     node.fee_estimator.reset();
     node.chainman.reset();
@@ -470,6 +483,8 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-alertnotify=<cmd>", "Execute command when an alert is raised (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     argsman.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet3: %s, testnet4: %s, signet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnet4ChainParams->GetConsensus().defaultAssumeValid.GetHex(), signetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-backgroundflush", strprintf("Write the coins cache to disk on a background thread while blocks keep being validated (default: %u)", DEFAULT_BACKGROUND_FLUSH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-blockchecksums", strprintf("Record a crc32c checksum of each block written to disk, so reading it back checks the checksum instead of recomputing the proof of work (default: %u)", kernel::DEFAULT_BLOCK_CHECKSUMS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksxor",
                    strprintf("Whether an XOR-key applies to blocksdir *.dat files. "
@@ -498,6 +513,10 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet3: %s, testnet4: %s, signet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnet4ChainParams->GetConsensus().nMinimumChainWork.GetHex(), signetChainParams->GetConsensus().nMinimumChainWork.GetHex()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     argsman.AddArg("-par=<n>", strprintf("Set the number of script verification threads (0 = auto, up to %d, <0 = leave that many cores free, default: %d)",
         MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-parheaders=<n>", strprintf("Set the number of threads checking the proof of work of received headers, in addition to -par (0 = check in the message handler thread, up to %d, default: %d)",
+        MAX_SCRIPTCHECK_THREADS, DEFAULT_HEADERPOW_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-prefetchthreads=<n>", strprintf("Set the number of threads reading the coins spent by new blocks from disk ahead of validating them (0 to disable, up to %d, default: %d)",
+        MAX_COINS_PREFETCH_THREADS, DEFAULT_COINS_PREFETCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-persistmempoolv1",
                    strprintf("Whether a mempool.dat file created by -persistmempool or the savemempool RPC will be written in the legacy format "
@@ -592,22 +611,26 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubsequence=<address>", "Enable publish hash block and tx sequence in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    argsman.AddArg("-zmqpubhashauxblock=<address>", "Enable publish merge-mining work (as returned by createauxblock) in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     argsman.AddArg("-zmqpubsequencehwm=<n>", strprintf("Set publish hash sequence message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    argsman.AddArg("-zmqpubhashauxblockhwm=<n>", strprintf("Set publish merge-mining work outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
     hidden_args.emplace_back("-zmqpubsequence=<n>");
+    hidden_args.emplace_back("-zmqpubhashauxblock=<address>");
     hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubsequencehwm=<n>");
+    hidden_args.emplace_back("-zmqpubhashauxblockhwm=<n>");
 #endif
 
     argsman.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
@@ -626,6 +649,8 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-test=<option>", "Pass a test-only option. Options include : " + Join(TEST_OPTIONS_DOC, ", ") + ".", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-capturemessages", "Capture all P2P messages to disk", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-mocktime=<n>", "Replace actual time with " + UNIX_EPOCH_TIME + " (default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    argsman.AddArg("-powtiming", strprintf("Time every Flex proof-of-work hash for getpowstats and the pow tracepoints, which slows hashing (default: %u)", DEFAULT_POW_TIMING), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    argsman.AddArg("-powcachesize=<n>", strprintf("Limit the in-memory cache of Flex proof-of-work hashes to <n> MiB (default: %u)", DEFAULT_POW_CACHE_BYTES >> 20), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_VALIDATION_CACHE_BYTES >> 20), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     argsman.AddArg("-maxtipage=<n>",
                    strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)",
@@ -659,6 +684,13 @@ void SetupServerArgs(ArgsManager& argsman)
     argsman.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kvB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     argsman.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-stratum", strprintf("Accept Stratum v1 mining connections (default: %u)", DEFAULT_STRATUM), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-stratumaddress=<address>", "Pay blocks mined over Stratum to <address> unless the miner's user name is an address", ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-stratumbind=<addr>[:port]", strprintf("Bind the Stratum server to the given address (default: %s). The port defaults to -stratumport", DEFAULT_STRATUM_BIND), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-stratumdifficulty=<n>", strprintf("Share difficulty for Stratum miners (default: %g)", DEFAULT_STRATUM_DIFFICULTY), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-stratummaxconnections=<n>", strprintf("Accept at most <n> Stratum connections at the same time (default: %u)", DEFAULT_STRATUM_MAX_CONNECTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-stratumport=<port>", strprintf("Listen for Stratum connections on <port> (default: %u)", DEFAULT_STRATUM_PORT), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::BLOCK_CREATION);
+    argsman.AddArg("-generatethreads=<n>", strprintf("Number of threads the generate RPCs search for a valid nonce with (0 = one per core, default: %d)", DEFAULT_GENERATE_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
     argsman.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     argsman.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid values for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0), a network/CIDR (e.g. 1.2.3.4/24), all ipv4 (0.0.0.0/0), or all ipv6 (::/0). This option can be specified multiple times", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
@@ -1038,6 +1070,8 @@ bool AppInitParameterInteraction(const ArgsManager& args)
     // Option to startup with mocktime set (used for regression testing):
     SetMockTime(args.GetIntArg("-mocktime", 0)); // SetMockTime(0) is a no-op
 
+    SetFlexTiming(args.GetBoolArg("-powtiming", DEFAULT_POW_TIMING));
+
     if (args.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
@@ -1321,6 +1355,7 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
         {"-onion",                  true},
         {"-proxy",                  true},
         {"-rpcbind",                false},
+        {"-stratumbind",            false},
         {"-torcontrol",             false},
         {"-whitebind",              false},
         {"-zmqpubhashblock",        true},
@@ -1328,6 +1363,7 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
         {"-zmqpubrawblock",         true},
         {"-zmqpubrawtx",            true},
         {"-zmqpubsequence",         true},
+        {"-zmqpubhashauxblock",     true},
     }) {
         for (const std::string& socket_addr : args.GetArgs(arg)) {
             std::string host_out;
@@ -1489,6 +1525,17 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
 
     if (g_zmq_notification_interface) {
         validation_signals.RegisterValidationInterface(g_zmq_notification_interface.get());
+
+        if (args.IsArgSet("-zmqpubhashauxblock")) {
+            // The work is built on a thread of its own, and published from
+            // the validation interface queue like the other notifications,
+            // so the notifiers are only ever used from one thread.
+            AuxpowMiner::get().startWorkNotifier(node, [signals = &validation_signals](const CScript& script_pub_key, const uint256& hash, const uint256& target, int32_t chain_id) {
+                signals->CallFunctionInValidationInterfaceQueue([script_pub_key, hash, target, chain_id] {
+                    g_zmq_notification_interface->NotifyAuxBlock(script_pub_key, hash, target, chain_id);
+                });
+            });
+        }
     }
 #endif
 
@@ -1525,6 +1572,22 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
     }
     LogPrintf("* Using %.1f MiB for chain state database\n", cache_sizes.coins_db * (1.0 / 1024 / 1024));
 
+    {
+        const size_t pow_cache_bytes{size_t(std::max<int64_t>(0, args.GetIntArg("-powcachesize", DEFAULT_POW_CACHE_BYTES >> 20))) << 20};
+        GetPowHashCache().Resize(pow_cache_bytes);
+        LogPrintf("* Using %.1f MiB for proof-of-work hash cache\n", pow_cache_bytes * (1.0 / 1024 / 1024));
+
+        // Superseded by powcache.sqlite, which stores raw hashes instead of hex strings.
+        const fs::path legacy_pow_cache{args.GetDataDirNet() / "cache.db"};
+        std::error_code ec;
+        if (fs::remove(legacy_pow_cache, ec)) {
+            LogPrintf("Removed obsolete proof-of-work hash cache %s\n", fs::PathToString(legacy_pow_cache));
+        }
+        if (!GetPowHashCache().OpenStore(args.GetDataDirNet() / "powcache.sqlite")) {
+            LogPrintf("Unable to open proof-of-work hash cache database, continuing with in-memory cache only\n");
+        }
+    }
+
     assert(!node.mempool);
     assert(!node.chainman);
 
@@ -1660,6 +1723,11 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
                                      peerman_opts);
     validation_signals.RegisterValidationInterface(node.peerman.get());
 
+    BlockAssembler::Options assembler_options;
+    ApplyArgsManOptions(args, assembler_options);
+    node.block_template_cache = std::make_unique<BlockTemplateCache>(chainman, *node.mempool, assembler_options);
+    validation_signals.RegisterValidationInterface(node.block_template_cache.get());
+
     // ********************************************************* Step 8: start indexers
 
     if (args.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
@@ -1986,6 +2054,38 @@ bool AppInitMain(NodeContext& node, interfaces::BlockAndHeaderTipInfo* tip_info)
         return false;
     }
 
+    if (args.GetBoolArg("-stratum", DEFAULT_STRATUM)) {
+        const std::string bind_arg{args.GetArg("-stratumbind", DEFAULT_STRATUM_BIND)};
+        const std::optional<CService> stratum_bind{Lookup(bind_arg, args.GetIntArg("-stratumport", DEFAULT_STRATUM_PORT), false)};
+        if (!stratum_bind.has_value()) {
+            return InitError(ResolveErrMsg("stratumbind", bind_arg));
+        }
+        CScript payout;
+        if (args.IsArgSet("-stratumaddress")) {
+            const std::string address{args.GetArg("-stratumaddress", "")};
+            const CTxDestination dest{DecodeDestination(address)};
+            if (!IsValidDestination(dest)) {
+                return InitError(strprintf(_("Invalid address for -stratumaddress: '%s'"), address));
+            }
+            payout = GetScriptForDestination(dest);
+        }
+        double difficulty{DEFAULT_STRATUM_DIFFICULTY};
+        if (args.IsArgSet("-stratumdifficulty")) {
+            int64_t value;
+            if (!ParseFixedPoint(args.GetArg("-stratumdifficulty", ""), 8, &value) || value <= 0) {
+                return InitError(strprintf(_("Invalid -stratumdifficulty '%s'"), args.GetArg("-stratumdifficulty", "")));
+            }
+            difficulty = value / 1e8;
+        }
+        const int64_t max_connections{args.GetIntArg("-stratummaxconnections", DEFAULT_STRATUM_MAX_CONNECTIONS)};
+        if (max_connections < 1) {
+            return InitError(strprintf(_("Invalid -stratummaxconnections '%d'"), max_connections));
+        }
+        if (!StartStratumServer(*node.mining, stratum_bind.value(), payout, difficulty, max_connections)) {
+            return InitError(strprintf(_("Unable to start the Stratum server on %s."), stratum_bind->ToStringAddrPort()));
+        }
+    }
+
     // ********************************************************* Step 13: finished
 
     // At this point, the RPC is "started", but still in warmup, which means it
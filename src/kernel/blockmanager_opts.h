@@ -15,6 +15,7 @@ class CChainParams;
 namespace kernel {
 
 static constexpr bool DEFAULT_XOR_BLOCKSDIR{true};
+static constexpr bool DEFAULT_BLOCK_CHECKSUMS{false};
 
 /**
  * An options struct for `BlockManager`, more ergonomically referred to as
@@ -23,6 +24,8 @@ static constexpr bool DEFAULT_XOR_BLOCKSDIR{true};
 struct BlockManagerOpts {
     const CChainParams& chainparams;
     bool use_xor{DEFAULT_XOR_BLOCKSDIR};
+    //! Record a crc32c of each block written, so reads can check it instead of the proof of work
+    bool block_checksums{DEFAULT_BLOCK_CHECKSUMS};
     uint64_t prune_target{0};
     bool fast_prune{false};
     const fs::path blocks_dir;
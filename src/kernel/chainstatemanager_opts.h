@@ -49,6 +49,10 @@ struct ChainstateManagerOpts {
     ValidationSignals* signals{nullptr};
     //! Number of script check worker threads. Zero means no parallel verification.
     int worker_threads_num{0};
+    //! Number of header proof-of-work check worker threads. Zero means headers are checked by the calling thread.
+    int header_pow_threads_num{0};
+    //! Number of threads reading the coins spent by blocks ahead of connecting them. Zero disables it.
+    int coins_prefetch_threads{0};
     size_t script_execution_cache_bytes{DEFAULT_SCRIPT_EXECUTION_CACHE_BYTES};
     size_t signature_cache_bytes{DEFAULT_SIGNATURE_CACHE_BYTES};
 };
@@ -4,7 +4,9 @@
 
 #include <kernel/context.h>
 
+#include <crypto/flex/flex.h>
 #include <crypto/sha256.h>
+#include <crypto/sha3.h>
 #include <logging.h>
 #include <random.h>
 
@@ -18,6 +20,10 @@ Context::Context()
     std::call_once(globals_initialized, []() {
         std::string sha256_algo = SHA256AutoDetect();
         LogInfo("Using the '%s' SHA256 implementation\n", sha256_algo);
+        std::string sha3_algo = SHA3AutoDetect();
+        LogInfo("Using the '%s' SHA3 implementation\n", sha3_algo);
+        std::string flex_algo = FlexAutoDetect();
+        LogInfo("Using the '%s' Flex implementation\n", flex_algo);
         RandomInit();
     });
 }
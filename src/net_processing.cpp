@@ -2718,8 +2718,9 @@ void PeerManagerImpl::SendBlockTransactions(CNode& pfrom, Peer& peer, const CBlo
 
 bool PeerManagerImpl::CheckHeadersPoW(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, Peer& peer)
 {
-    // Do these headers have proof-of-work matching what's claimed?
-    if (!HasValidProofOfWork(headers, consensusParams)) {
+    // Do these headers have proof-of-work matching what's claimed? The Flex
+    // hash is expensive, so check the headers on the worker threads.
+    if (!HasValidProofOfWork(headers, consensusParams, &m_chainman.GetHeaderPoWCheckQueue())) {
         Misbehaving(peer, "header with invalid proof of work");
         return false;
     }
@@ -4739,6 +4740,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
 
         CBlockHeaderAndShortTxIDs cmpctblock;
         vRecv >> cmpctblock;
+        cmpctblock.header.CacheHash();
 
         bool received_new_header = false;
         const auto blockhash = cmpctblock.header.GetHash();
@@ -5007,10 +5009,14 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             return;
         }
         headers.resize(nCount);
+        std::vector<CPureBlockHeader*> header_ptrs(nCount);
         for (unsigned int n = 0; n < nCount; n++) {
             vRecv >> headers[n];
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+            header_ptrs[n] = &headers[n];
         }
+        // Headers are hashed repeatedly while they are checked and accepted.
+        CPureBlockHeader::CacheHashes(header_ptrs);
 
         ProcessHeadersMessage(pfrom, *peer, std::move(headers), /*via_compact_block=*/false);
 
@@ -5041,6 +5047,7 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
 
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         vRecv >> TX_WITH_WITNESS(*pblock);
+        pblock->CacheHash();
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom.GetId());
 
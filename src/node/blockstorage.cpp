@@ -5,9 +5,11 @@
 #include <node/blockstorage.h>
 
 #include <arith_uint256.h>
+#include <auxpow.h>
 #include <chain.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
+#include <crc32c/crc32c.h>
 #include <dbwrapper.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -17,6 +19,7 @@
 #include <kernel/notifications_interface.h>
 #include <logging.h>
 #include <pow.h>
+#include <pow_cache.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -33,11 +36,15 @@
 #include <util/fs.h>
 #include <util/signalinterrupt.h>
 #include <util/strencodings.h>
+#include <util/trace.h>
 #include <util/translation.h>
 #include <validation.h>
 
 #include <map>
+#include <optional>
 #include <ranges>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 
 namespace kernel {
@@ -46,6 +53,8 @@ static constexpr uint8_t DB_BLOCK_INDEX{'b'};
 static constexpr uint8_t DB_FLAG{'F'};
 static constexpr uint8_t DB_REINDEX_FLAG{'R'};
 static constexpr uint8_t DB_LAST_BLOCK{'l'};
+static constexpr uint8_t DB_AUXPOW{'a'};
+static constexpr uint8_t DB_BLOCK_CHECKSUM{'k'};
 // Keys used in previous version that might still be found in the DB:
 // BlockTreeDB::DB_TXINDEX_BLOCK{'T'};
 // BlockTreeDB::DB_TXINDEX{'t'}
@@ -75,7 +84,8 @@ bool BlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read(DB_LAST_BLOCK, nFile);
 }
 
-bool BlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*>>& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo)
+bool BlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*>>& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                                 const std::vector<uint256>& erased_checksums)
 {
     CDBBatch batch(*this);
     for (const auto& [file, info] : fileInfo) {
@@ -84,10 +94,31 @@ bool BlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFi
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (const CBlockIndex* bi : blockinfo) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, bi->GetBlockHash()), CDiskBlockIndex{bi});
+        // Kept out of the index entry so older versions can still read it. The
+        // position ties the record to the data the checksum was computed from.
+        const auto [pos, checksum]{WITH_LOCK(::cs_main, return std::make_pair(bi->GetBlockPos(), bi->nDataChecksum))};
+        if (checksum) batch.Write(std::make_pair(DB_BLOCK_CHECKSUM, bi->GetBlockHash()), std::make_pair(pos, *checksum));
+    }
+    for (const uint256& hash : erased_checksums) {
+        batch.Erase(std::make_pair(DB_BLOCK_CHECKSUM, hash));
     }
     return WriteBatch(batch, true);
 }
 
+bool BlockTreeDB::WriteAuxpows(const std::vector<std::pair<uint256, const std::vector<uint8_t>*>>& auxpows)
+{
+    CDBBatch batch(*this);
+    for (const auto& [hash, auxpow] : auxpows) {
+        batch.Write(std::make_pair(DB_AUXPOW, hash), *auxpow);
+    }
+    return WriteBatch(batch);
+}
+
+bool BlockTreeDB::ReadAuxpow(const uint256& hash, std::vector<uint8_t>& auxpow)
+{
+    return Read(std::make_pair(DB_AUXPOW, hash), auxpow);
+}
+
 bool BlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? uint8_t{'1'} : uint8_t{'0'});
@@ -148,6 +179,33 @@ bool BlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, s
 
     return true;
 }
+
+bool BlockTreeDB::LoadBlockChecksums(const std::function<CBlockIndex*(const uint256&)>& lookupBlockIndex, const util::SignalInterrupt& interrupt)
+{
+    AssertLockHeld(::cs_main);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_BLOCK_CHECKSUM, uint256()));
+
+    while (pcursor->Valid()) {
+        if (interrupt) return false;
+        std::pair<uint8_t, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_CHECKSUM) break;
+        std::pair<FlatFilePos, uint32_t> value;
+        if (!pcursor->GetValue(value)) {
+            LogError("%s: failed to read value\n", __func__);
+            return false;
+        }
+        // Ignore records for block data that was since pruned or written again
+        // elsewhere, e.g. by a version that does not record checksums.
+        CBlockIndex* pindex{lookupBlockIndex(key.second)};
+        if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA) && pindex->GetBlockPos() == value.first) {
+            pindex->nDataChecksum = value.second;
+        }
+        pcursor->Next();
+    }
+
+    return true;
+}
 } // namespace kernel
 
 namespace node {
@@ -231,23 +289,145 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block, CBlockInde
     }
 
     m_dirty_blockindex.insert(pindexNew);
+    if (block.auxpow) {
+        StoreAuxpow(pindexNew->GetBlockHash(), *block.auxpow);
+        // Do not let a long headers sync keep them all in memory until the
+        // next block index flush.
+        if (WITH_LOCK(m_auxpow_mutex, return m_dirty_auxpow_bytes) > MAX_DIRTY_AUXPOW_BYTES && m_block_tree_db) {
+            WriteDirtyAuxpows();
+        }
+    }
 
     return pindexNew;
 }
 
+void BlockManager::StoreAuxpow(const uint256& hash, const CAuxPow& auxpow) const
+{
+    std::vector<uint8_t> data;
+    VectorWriter{data, 0, auxpow};
+    LOCK(m_auxpow_mutex);
+    if (m_auxpow.count(hash) == 0) {
+        const size_t size{data.size()};
+        if (m_dirty_auxpow.try_emplace(hash, std::move(data)).second) m_dirty_auxpow_bytes += size;
+    }
+}
+
+bool BlockManager::WriteDirtyAuxpows()
+{
+    AssertLockHeld(::cs_main);
+    // The dirty auxpows stay readable while they are written. References to
+    // them stay valid, as only this function (under cs_main) erases them.
+    std::vector<std::pair<uint256, const std::vector<uint8_t>*>> auxpows;
+    {
+        LOCK(m_auxpow_mutex);
+        auxpows.reserve(m_dirty_auxpow.size());
+        for (const auto& [hash, data] : m_dirty_auxpow) {
+            auxpows.emplace_back(hash, &data);
+        }
+    }
+    if (auxpows.empty()) return true;
+    if (!m_block_tree_db->WriteAuxpows(auxpows)) {
+        return false;
+    }
+    LOCK(m_auxpow_mutex);
+    for (const auto& [hash, data] : auxpows) {
+        auto node{m_dirty_auxpow.extract(hash)};
+        m_dirty_auxpow_bytes -= node.mapped().size();
+        CacheAuxpow(hash, std::move(node.mapped()));
+    }
+    return true;
+}
+
+void BlockManager::CacheAuxpow(const uint256& hash, std::vector<uint8_t>&& data) const
+{
+    AssertLockHeld(m_auxpow_mutex);
+    if (m_auxpow.count(hash)) return;
+    m_auxpow_cache_bytes += data.size();
+    m_auxpow_lru.emplace_back(hash, std::move(data));
+    m_auxpow.emplace(hash, std::prev(m_auxpow_lru.end()));
+    while (m_auxpow_cache_bytes > MAX_AUXPOW_CACHE_BYTES && m_auxpow_lru.size() > 1) {
+        m_auxpow_cache_bytes -= m_auxpow_lru.front().second.size();
+        m_auxpow.erase(m_auxpow_lru.front().first);
+        m_auxpow_lru.pop_front();
+    }
+}
+
+std::shared_ptr<CAuxPow> BlockManager::GetAuxpow(const CBlockIndex& index) const
+{
+    const uint256 hash{index.GetBlockHash()};
+    {
+        LOCK(m_auxpow_mutex);
+        const std::vector<uint8_t>* data{nullptr};
+        if (const auto it{m_dirty_auxpow.find(hash)}; it != m_dirty_auxpow.end()) {
+            data = &it->second;
+        } else if (const auto it{m_auxpow.find(hash)}; it != m_auxpow.end()) {
+            m_auxpow_lru.splice(m_auxpow_lru.end(), m_auxpow_lru, it->second);
+            data = &it->second->second;
+        }
+        if (data) {
+            auto auxpow{std::make_shared<CAuxPow>()};
+            SpanReader{*data} >> *auxpow;
+            m_auxpow_memory_reads.fetch_add(1, std::memory_order_relaxed);
+            return auxpow;
+        }
+    }
+
+    // LevelDB reads are thread-safe, cs_main only guards the pointer.
+    BlockTreeDB* const block_tree_db{WITH_LOCK(::cs_main, return m_block_tree_db.get())};
+    std::vector<uint8_t> data;
+    if (block_tree_db && block_tree_db->ReadAuxpow(hash, data)) {
+        auto auxpow{std::make_shared<CAuxPow>()};
+        SpanReader{data} >> *auxpow;
+        m_auxpow_db_reads.fetch_add(1, std::memory_order_relaxed);
+        LOCK(m_auxpow_mutex);
+        CacheAuxpow(hash, std::move(data));
+        return auxpow;
+    }
+
+    // Accepted before the auxpow store existed; keep it once read.
+    m_auxpow_disk_reads.fetch_add(1, std::memory_order_relaxed);
+    const FlatFilePos pos{WITH_LOCK(::cs_main, return index.GetBlockPos())};
+    TRACE2(auxpow, header_disk_read, index.nHeight, pos.nFile);
+    CBlockHeader header;
+    if (!ReadBlockHeaderFromDisk(header, index) || !header.auxpow) {
+        return nullptr;
+    }
+    // The header is already in the block index database, so the auxpow can
+    // be written right away instead of waiting for the next flush.
+    std::vector<uint8_t> serialized;
+    VectorWriter{serialized, 0, *header.auxpow};
+    if (block_tree_db && block_tree_db->WriteAuxpows({{hash, &serialized}})) {
+        LOCK(m_auxpow_mutex);
+        CacheAuxpow(hash, std::move(serialized));
+    } else {
+        StoreAuxpow(hash, *header.auxpow);
+    }
+    return header.auxpow;
+}
+
 void BlockManager::PruneOneBlockFile(const int fileNumber)
 {
     AssertLockHeld(cs_main);
     LOCK(cs_LastBlockFile);
 
+    std::vector<uint256> pruned_hashes;
     for (auto& entry : m_block_index) {
         CBlockIndex* pindex = &entry.second;
         if (pindex->nFile == fileNumber) {
+            pruned_hashes.push_back(pindex->GetBlockHash());
+            // Merge-mined blocks have their PoW hash cached under the parent block.
+            if (pindex->GetPureHeader().IsAuxpow()) {
+                if (const auto auxpow{GetAuxpow(*pindex)}) {
+                    pruned_hashes.push_back(auxpow->getParentBlock().GetHash(pindex->nVersion));
+                }
+            }
+            if (pindex->nDataChecksum) m_pruned_checksums.push_back(pindex->GetBlockHash());
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
+            pindex->nDataChecksum.reset();
             m_dirty_blockindex.insert(pindex);
 
             // Prune from m_blocks_unlinked -- any block we prune would have
@@ -265,6 +445,7 @@ void BlockManager::PruneOneBlockFile(const int fileNumber)
         }
     }
 
+    GetPowHashCache().Erase(pruned_hashes);
     m_blockfile_info.at(fileNumber) = CBlockFileInfo{};
     m_dirty_fileinfo.insert(fileNumber);
 }
@@ -400,6 +581,10 @@ bool BlockManager::LoadBlockIndex(const std::optional<uint256>& snapshot_blockha
             GetConsensus(), [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }, m_interrupt)) {
         return false;
     }
+    if (!m_block_tree_db->LoadBlockChecksums(
+            [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->LookupBlockIndex(hash); }, m_interrupt)) {
+        return false;
+    }
 
     if (snapshot_blockhash) {
         const std::optional<AssumeutxoData> maybe_au_data = GetParams().AssumeutxoForBlockhash(*snapshot_blockhash);
@@ -488,10 +673,18 @@ bool BlockManager::WriteBlockIndexDB()
         vBlocks.push_back(*it);
         m_dirty_blockindex.erase(it++);
     }
+    // Synced along with the block index batch below.
+    if (!WriteDirtyAuxpows()) {
+        return false;
+    }
     int max_blockfile = WITH_LOCK(cs_LastBlockFile, return this->MaxBlockfileNum());
-    if (!m_block_tree_db->WriteBatchSync(vFiles, max_blockfile, vBlocks)) {
+    if (!m_block_tree_db->WriteBatchSync(vFiles, max_blockfile, vBlocks, m_pruned_checksums)) {
         return false;
     }
+    m_pruned_checksums.clear();
+    // Persist cached PoW hashes (and apply pruning of them) along with the
+    // block index. Failures are not fatal, the hashes can be recomputed.
+    GetPowHashCache().Flush();
     return true;
 }
 
@@ -500,6 +693,7 @@ bool BlockManager::LoadBlockIndexDB(const std::optional<uint256>& snapshot_block
     if (!LoadBlockIndex(snapshot_blockhash)) {
         return false;
     }
+
     int max_blockfile_num{0};
 
     // Load block file info
@@ -967,7 +1161,34 @@ bool BlockManager::FindUndoPos(BlockValidationState& state, int nFile, FlatFileP
     return true;
 }
 
-bool BlockManager::WriteBlockToDisk(const CBlock& block, FlatFilePos& pos) const
+namespace {
+/** Writer stream that passes data on to a file, accumulating its crc32c. */
+class Crc32cFileWriter
+{
+    AutoFile& m_file;
+    uint32_t m_crc{0};
+
+public:
+    explicit Crc32cFileWriter(AutoFile& file) : m_file{file} {}
+
+    void write(Span<const std::byte> src)
+    {
+        m_file.write(src);
+        m_crc = crc32c::Extend(m_crc, UCharCast(src.data()), src.size());
+    }
+
+    template <typename T>
+    Crc32cFileWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    uint32_t GetCrc() const { return m_crc; }
+};
+} // namespace
+
+bool BlockManager::WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, std::optional<uint32_t>* checksum) const
 {
     // Open history file to append
     AutoFile fileout{OpenBlockFile(pos)};
@@ -987,7 +1208,13 @@ bool BlockManager::WriteBlockToDisk(const CBlock& block, FlatFilePos& pos) const
         return false;
     }
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << TX_WITH_WITNESS(block);
+    if (checksum) {
+        Crc32cFileWriter writer{fileout};
+        writer << TX_WITH_WITNESS(block);
+        *checksum = writer.GetCrc();
+    } else {
+        fileout << TX_WITH_WITNESS(block);
+    }
 
     return true;
 }
@@ -1041,7 +1268,7 @@ namespace
    both a block and its header.  */
 
 template<typename T>
-bool ReadBlockOrHeader(T& block, const FlatFilePos& pos, const BlockManager& blockman)
+bool ReadBlockOrHeader(T& block, const FlatFilePos& pos, const BlockManager& blockman, bool check_pow = true)
 {
     block.SetNull();
 
@@ -1059,9 +1286,11 @@ bool ReadBlockOrHeader(T& block, const FlatFilePos& pos, const BlockManager& blo
         LogError("%s: Deserialize or I/O error - %s at %s\n", __func__, e.what(), pos.ToString());
         return false;
     }
+    // Callers compare the hash with the index, and the PoW check needs it too.
+    block.CacheHash();
 
     // Check the header
-    if (!CheckProofOfWork(block, blockman.GetConsensus())) {
+    if (check_pow && !CheckProofOfWork(block, blockman.GetConsensus())) {
         LogError("%s: Errors in block header at %s\n", __func__, pos.ToString());
         return false;
     }
@@ -1075,18 +1304,67 @@ bool ReadBlockOrHeader(T& block, const FlatFilePos& pos, const BlockManager& blo
     return true;
 }
 
+/** Read a block whose index entry carries a checksum, verifying the data
+ *  against it. The block was fully validated before it was written, so
+ *  neither its proof of work nor its auxpow needs to be checked again. */
+bool ReadBlockWithChecksum(CBlock& block, const FlatFilePos& pos, uint32_t checksum, const BlockManager& blockman)
+{
+    block.SetNull();
+
+    std::vector<uint8_t> data;
+    if (!blockman.ReadRawBlockFromDisk(data, pos)) {
+        return false;
+    }
+    if (crc32c::Crc32c(data.data(), data.size()) != checksum) {
+        LogError("%s: Checksum mismatch for block data at %s\n", __func__, pos.ToString());
+        return false;
+    }
+    try {
+        SpanReader{data} >> TX_WITH_WITNESS(block);
+    } catch (const std::exception& e) {
+        LogError("%s: Deserialize error - %s at %s\n", __func__, e.what(), pos.ToString());
+        return false;
+    }
+    block.CacheHash();
+    return true;
+}
+
 template<typename T>
 bool ReadBlockOrHeader(T& block, const CBlockIndex& index, const BlockManager& blockman)
 {
-    const FlatFilePos block_pos{WITH_LOCK(cs_main, return index.GetBlockPos())};
+    const auto [block_pos, pow_verified, checksum]{WITH_LOCK(cs_main, return std::make_tuple(
+        index.GetBlockPos(),
+        (index.nStatus & BLOCK_POW_VERIFIED) != 0,
+        index.nDataChecksum))};
+
+    if constexpr (std::is_same_v<T, CBlock>) {
+        if (checksum) {
+            if (!ReadBlockWithChecksum(block, block_pos, *checksum, blockman)) {
+                return false;
+            }
+            if (block.GetHash() != index.GetBlockHash()) {
+                LogError("%s: GetHash() doesn't match index for %s at %s\n", __func__, index.ToString(), block_pos.ToString());
+                return false;
+            }
+            return true;
+        }
+    }
 
-    if (!ReadBlockOrHeader(block, block_pos, blockman)) {
+    if (!ReadBlockOrHeader(block, block_pos, blockman, /*check_pow=*/!pow_verified)) {
         return false;
     }
-    if (block.GetHash() != index.GetBlockHash()) {
+    const uint256 hash{block.GetHash()};
+    if (hash != index.GetBlockHash()) {
         LogError("%s: GetHash() doesn't match index for %s at %s\n", __func__, index.ToString(), block_pos.ToString());
         return false;
     }
+    // The header matches one whose proof of work was verified on acceptance.
+    // The auxpow is not committed to by the block hash, so still make sure it
+    // links to this block; only the expensive parent PoW hash is skipped.
+    if (pow_verified && block.auxpow && !block.auxpow->check(hash, block.GetChainId(), blockman.GetConsensus())) {
+        LogError("%s: Errors in auxpow for %s at %s\n", __func__, index.ToString(), block_pos.ToString());
+        return false;
+    }
     return true;
 }
 
@@ -1152,7 +1430,7 @@ bool BlockManager::ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatF
     return true;
 }
 
-FlatFilePos BlockManager::SaveBlockToDisk(const CBlock& block, int nHeight)
+FlatFilePos BlockManager::SaveBlockToDisk(const CBlock& block, int nHeight, std::optional<uint32_t>* checksum)
 {
     unsigned int nBlockSize = ::GetSerializeSize(TX_WITH_WITNESS(block));
     // Account for the 4 magic message start bytes + the 4 length bytes (8 bytes total,
@@ -1163,7 +1441,7 @@ FlatFilePos BlockManager::SaveBlockToDisk(const CBlock& block, int nHeight)
         LogError("%s: FindNextBlockPos failed\n", __func__);
         return FlatFilePos();
     }
-    if (!WriteBlockToDisk(block, blockPos)) {
+    if (!WriteBlockToDisk(block, blockPos, m_opts.block_checksums ? checksum : nullptr)) {
         m_opts.notifications.fatalError(_("Failed to write block."));
         return FlatFilePos();
     }
@@ -25,6 +25,7 @@
 #include <cstdint>
 #include <functional>
 #include <limits>
+#include <list>
 #include <map>
 #include <memory>
 #include <optional>
@@ -51,7 +52,8 @@ class BlockTreeDB : public CDBWrapper
 {
 public:
     using CDBWrapper::CDBWrapper;
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*>>& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*>>& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                        const std::vector<uint256>& erased_checksums = {});
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& info);
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindexing);
@@ -60,6 +62,13 @@ public:
     bool ReadFlag(const std::string& name, bool& fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const util::SignalInterrupt& interrupt)
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+    /** Set the recorded block data checksums on the loaded block index entries. */
+    bool LoadBlockChecksums(const std::function<CBlockIndex*(const uint256&)>& lookupBlockIndex, const util::SignalInterrupt& interrupt)
+        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+    /** Read the serialized auxpow of a block header from the auxpow store. */
+    bool ReadAuxpow(const uint256& hash, std::vector<uint8_t>& auxpow);
+    /** Add serialized auxpows to the auxpow store, without syncing. */
+    bool WriteAuxpows(const std::vector<std::pair<uint256, const std::vector<uint8_t>*>>& auxpows);
 };
 } // namespace kernel
 
@@ -76,6 +85,11 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** Size of header written by WriteBlockToDisk before a serialized CBlock */
 static constexpr size_t BLOCK_SERIALIZATION_HEADER_SIZE = std::tuple_size_v<MessageStartChars> + sizeof(unsigned int);
 
+/** Memory for the most recently used serialized block header auxpows (in bytes) */
+static constexpr size_t MAX_AUXPOW_CACHE_BYTES{16 << 20};
+/** Memory for serialized auxpows of newly accepted headers before they are written out early (in bytes) */
+static constexpr size_t MAX_DIRTY_AUXPOW_BYTES{16 << 20};
+
 // Because validation code takes pointers to the map's CBlockIndex objects, if
 // we ever switch to another associative container, we need to either use a
 // container that has stable addressing (true of all std associative
@@ -176,9 +190,9 @@ private:
      * Write a block to disk. The pos argument passed to this function is modified by this call. Before this call, it should
      * point to an unused file location where separator fields will be written, followed by the serialized CBlock data.
      * After this call, it will point to the beginning of the serialized CBlock data, after the separator fields
-     * (BLOCK_SERIALIZATION_HEADER_SIZE)
+     * (BLOCK_SERIALIZATION_HEADER_SIZE). If checksum is given, it is set to the crc32c of the written block data.
      */
-    bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos) const;
+    bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, std::optional<uint32_t>* checksum = nullptr) const;
     bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const uint256& hashBlock) const;
 
     /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
@@ -252,6 +266,37 @@ private:
     /** Dirty block file entries. */
     std::set<int> m_dirty_fileinfo;
 
+    /** Blocks whose data was pruned, for which a checksum record is to be erased. */
+    std::vector<uint256> m_pruned_checksums;
+
+    /**
+     * Serialized auxpow of auxpow block headers, by block hash, so headers can
+     * be served without reading the block files. All of them are stored in
+     * the block tree database. Entries are added when headers are accepted,
+     * and lazily for headers accepted before the store existed.
+     */
+    mutable Mutex m_auxpow_mutex;
+    /** Entries not yet written to the block tree database, up to about
+     *  MAX_DIRTY_AUXPOW_BYTES. Only WriteDirtyAuxpows erases them, so it can
+     *  write them without the lock. */
+    mutable std::unordered_map<uint256, std::vector<uint8_t>, BlockHasher> m_dirty_auxpow GUARDED_BY(m_auxpow_mutex);
+    mutable size_t m_dirty_auxpow_bytes GUARDED_BY(m_auxpow_mutex){0};
+    /** The most recently used written entries, up to MAX_AUXPOW_CACHE_BYTES, most recent last. */
+    using AuxpowLru = std::list<std::pair<uint256, std::vector<uint8_t>>>;
+    mutable AuxpowLru m_auxpow_lru GUARDED_BY(m_auxpow_mutex);
+    mutable std::unordered_map<uint256, AuxpowLru::iterator, BlockHasher> m_auxpow GUARDED_BY(m_auxpow_mutex);
+    mutable size_t m_auxpow_cache_bytes GUARDED_BY(m_auxpow_mutex){0};
+    //! How GetAuxpow requests were served, for getpowstats
+    mutable std::atomic<uint64_t> m_auxpow_memory_reads{0};
+    mutable std::atomic<uint64_t> m_auxpow_db_reads{0};
+    mutable std::atomic<uint64_t> m_auxpow_disk_reads{0};
+
+    void StoreAuxpow(const uint256& hash, const CAuxPow& auxpow) const EXCLUSIVE_LOCKS_REQUIRED(!m_auxpow_mutex);
+    /** Write the dirty auxpows to the block tree database and move them to the cache. */
+    bool WriteDirtyAuxpows() EXCLUSIVE_LOCKS_REQUIRED(::cs_main, !m_auxpow_mutex);
+    /** Add a written entry to the cache, evicting the least recently used ones. */
+    void CacheAuxpow(const uint256& hash, std::vector<uint8_t>&& data) const EXCLUSIVE_LOCKS_REQUIRED(m_auxpow_mutex);
+
     /**
      * Map from external index name to oldest block that must not be pruned.
      *
@@ -333,6 +378,18 @@ public:
     /** Get block file info entry for one block file */
     CBlockFileInfo* GetBlockFileInfo(size_t n);
 
+    /**
+     * The auxpow of an auxpow block header, or nullptr if it is not known.
+     * Served from memory or the block tree database; headers accepted before
+     * the store existed are read from the block files once.
+     */
+    std::shared_ptr<CAuxPow> GetAuxpow(const CBlockIndex& index) const EXCLUSIVE_LOCKS_REQUIRED(!m_auxpow_mutex);
+
+    /** Number of GetAuxpow calls served from memory, the block tree database and the block files. */
+    uint64_t AuxpowMemoryReads() const { return m_auxpow_memory_reads.load(std::memory_order_relaxed); }
+    uint64_t AuxpowDBReads() const { return m_auxpow_db_reads.load(std::memory_order_relaxed); }
+    uint64_t AuxpowDiskReads() const { return m_auxpow_disk_reads.load(std::memory_order_relaxed); }
+
     bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationState& state, CBlockIndex& block)
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
@@ -340,11 +397,12 @@ public:
      *
      * @param[in]  block        the block to be stored
      * @param[in]  nHeight      the height of the block
+     * @param[out] checksum     if given and -blockchecksums is set, the crc32c of the written block data
      *
      * @returns in case of success, the position to which the block was written to
      *          in case of an error, an empty FlatFilePos
      */
-    FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight);
+    FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, std::optional<uint32_t>* checksum = nullptr);
 
     /** Update blockfile info while processing a block during reindex. The block must be available on disk.
      *
@@ -56,6 +56,13 @@ util::Result<void> ApplyArgsManOptions(const ArgsManager& args, ChainstateManage
     opts.worker_threads_num = std::clamp(script_threads - 1, 0, MAX_SCRIPTCHECK_THREADS);
     LogPrintf("Script verification uses %d additional threads\n", opts.worker_threads_num);
 
+    // Header proof-of-work checks run in their own pool, so that they do not
+    // add to the script verification threads chosen with -par.
+    opts.header_pow_threads_num = std::clamp<int>(args.GetIntArg("-parheaders", DEFAULT_HEADERPOW_THREADS), 0, MAX_SCRIPTCHECK_THREADS);
+    LogPrintf("Header proof-of-work verification uses %d additional threads\n", opts.header_pow_threads_num);
+
+    opts.coins_prefetch_threads = std::clamp<int>(args.GetIntArg("-prefetchthreads", DEFAULT_COINS_PREFETCH_THREADS), 0, MAX_COINS_PREFETCH_THREADS);
+
     if (auto max_size = args.GetIntArg("-maxsigcachesize")) {
         // 1. When supplied with a max_size of 0, both the signature cache and
         //    script execution cache create the minimum possible cache (2
@@ -911,6 +911,9 @@ public:
 
     std::unique_ptr<CBlockTemplate> createNewBlock(const CScript& script_pub_key, const BlockCreateOptions& options) override
     {
+        if (m_node.block_template_cache && options == BlockCreateOptions{}) {
+            return m_node.block_template_cache->CreateNewBlock(script_pub_key);
+        }
         BlockAssembler::Options assemble_options{options};
         ApplyArgsManOptions(*Assert(m_node.args), assemble_options);
         return BlockAssembler{chainman().ActiveChainstate(), context()->mempool.get(), assemble_options}.CreateNewBlock(script_pub_key);
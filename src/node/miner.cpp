@@ -14,19 +14,28 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <crypto/flex/flex.h>
 #include <deploymentstatus.h>
 #include <logging.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <pow.h>
+#include <primitives/pureheader.h>
 #include <primitives/transaction.h>
+#include <streams.h>
 #include <util/moneystr.h>
+#include <util/signalinterrupt.h>
 #include <util/strencodings.h>
 #include <util/time.h>
 #include <validation.h>
 
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace node {
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -94,6 +103,41 @@ void ApplyArgsManOptions(const ArgsManager& args, BlockAssembler::Options& optio
     options.print_modified_fee = args.GetBoolArg("-printpriority", options.print_modified_fee);
 }
 
+/**
+ * Create the coinbase of a template whose other transactions are in place,
+ * paying the block reward and fees to scriptPubKeyIn and the dev fund, and
+ * add the witness commitment.
+ */
+static void CreateCoinbase(CBlockTemplate& tmpl, const CScript& scriptPubKeyIn, CAmount nFees, const CBlockIndex* pindexPrev, const ChainstateManager& chainman)
+{
+    const CChainParams& chainparams{chainman.GetParams()};
+    const int nHeight{pindexPrev->nHeight + 1};
+
+	CAmount blockReward = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
+	CAmount devReward = blockReward * 0.1;
+	CAmount minerReward = blockReward - devReward;
+
+    // Create coinbase transaction.
+    CMutableTransaction coinbaseTx;
+    if(nHeight >= chainparams.GetConsensus().nFlexhashHeight) coinbaseTx.version = 8;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout.SetNull();
+    coinbaseTx.vout.resize(2);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = minerReward;
+    if(chainparams.GetChainType() == ChainType::TESTNET) {
+        coinbaseTx.vout[1].scriptPubKey = CScript() << OP_0 << ParseHex("e5bcbecfc77c35e44309828adb0260961adbe7a1");
+    } else {
+        coinbaseTx.vout[1].scriptPubKey = CScript() << OP_0 << ParseHex("e278645407a9c322b0becef0b31762f32ec03a66");
+    }
+    coinbaseTx.vout[1].nValue = devReward;
+    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    tmpl.block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    tmpl.vchCoinbaseCommitment = chainman.GenerateCoinbaseCommitment(tmpl.block, pindexPrev);
+    tmpl.vTxFees[0] = -nFees;
+    tmpl.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*tmpl.block.vtx[0]);
+}
+
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
@@ -105,6 +149,9 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    m_lowest_package_feerate.reset();
+    m_block_full = false;
 }
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
@@ -133,7 +180,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     const int32_t nChainId = chainparams.GetConsensus ().nAuxpowChainId;
     pblock->SetBaseVersion(4, nChainId);
-    if(nHeight >= consensusParams.nFlexhashHeight) pblock->nVersion |= 0x8000;
 
     // FIXME: Active version bits after the always-auxpow fork!
     //pblock->nVersion = m_chainstate.m_chainman.m_versionbitscache.ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -143,6 +189,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (chainparams.MineBlocksOnDemand()) {
         pblock->SetBaseVersion(gArgs.GetIntArg("-blockversion", pblock->GetBaseVersion()), nChainId);
     }
+    // Set after the base version, which SetBaseVersion overwrites.
+    if(nHeight >= consensusParams.nFlexhashHeight) pblock->nVersion |= 0x8000;
 
     
 
@@ -161,37 +209,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     m_last_block_num_txs = nBlockTx;
     m_last_block_weight = nBlockWeight;
 
-	CAmount blockReward = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-	CAmount devReward = blockReward * 0.1;
-	CAmount minerReward = blockReward - devReward;
-
-    // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    if(nHeight >= consensusParams.nFlexhashHeight) coinbaseTx.version = 8;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(2);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = minerReward;
-    if(chainparams.GetChainType() == ChainType::TESTNET) {
-        coinbaseTx.vout[1].scriptPubKey = CScript() << OP_0 << ParseHex("e5bcbecfc77c35e44309828adb0260961adbe7a1");
-    } else {
-        coinbaseTx.vout[1].scriptPubKey = CScript() << OP_0 << ParseHex("e278645407a9c322b0becef0b31762f32ec03a66");
-    }
-    coinbaseTx.vout[1].nValue = devReward;
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = m_chainstate.m_chainman.GenerateCoinbaseCommitment(*pblock, pindexPrev);
-    pblocktemplate->vTxFees[0] = -nFees;
+    CreateCoinbase(*pblocktemplate, scriptPubKeyIn, nFees, pindexPrev, m_chainstate.m_chainman);
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
     // Fill in header
     pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    pblock->nBits          = GetNextWorkRequiredCached(pindexPrev, pblock, chainparams.GetConsensus());
     pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
     BlockValidationState state;
     if (m_options.test_block_validity && !TestBlockValidity(state, chainparams, m_chainstate, *pblock, pindexPrev,
@@ -400,6 +426,7 @@ void BlockAssembler::addPackageTxs(const CTxMemPool& mempool, int& nPackagesSele
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            m_block_full = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -446,9 +473,264 @@ void BlockAssembler::addPackageTxs(const CTxMemPool& mempool, int& nPackagesSele
         }
 
         ++nPackagesSelected;
+        const CFeeRate package_feerate{packageFees, static_cast<uint32_t>(packageSize)};
+        if (!m_lowest_package_feerate || package_feerate < *m_lowest_package_feerate) {
+            m_lowest_package_feerate = package_feerate;
+        }
 
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(mempool, ancestors, mapModifiedTx);
     }
 }
+
+BlockTemplateCache::BlockTemplateCache(ChainstateManager& chainman, CTxMemPool& mempool, const BlockAssembler::Options& options)
+    : m_chainman{chainman},
+      m_mempool{mempool},
+      m_options{ClampOptions(options)}
+{
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::CreateNewBlock(const CScript& script_pub_key)
+{
+    LOCK(::cs_main);
+    const CBlockIndex* tip{Assert(m_chainman.ActiveChain().Tip())};
+    LOCK2(m_mempool.cs, m_mutex);
+    if (!m_template || m_template->block.hashPrevBlock != tip->GetBlockHash() ||
+        m_next_sequence != m_mempool.GetSequence() || m_transactions_updated != m_mempool.GetTransactionsUpdated()) {
+        Rebuild(*tip);
+    } else if (m_coinbase_stale) {
+        CreateCoinbase(*m_template, CScript{}, m_fees, tip, m_chainman);
+        m_coinbase_stale = false;
+    }
+
+    auto pblocktemplate{std::make_unique<CBlockTemplate>(*m_template)};
+    CBlock& block{pblocktemplate->block};
+    // The coinbase is left out of the witness commitment, so it can pay
+    // elsewhere without touching the commitment.
+    CMutableTransaction coinbase{*block.vtx[0]};
+    coinbase.vout[0].scriptPubKey = script_pub_key;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
+    UpdateTime(&block, m_chainman.GetConsensus(), tip);
+
+    BlockAssembler::m_last_block_num_txs = block.vtx.size() - 1;
+    BlockAssembler::m_last_block_weight = m_block_weight;
+    return pblocktemplate;
+}
+
+uint64_t BlockTemplateCache::GetRebuildCount() const
+{
+    LOCK(m_mutex);
+    return m_rebuilds;
+}
+
+void BlockTemplateCache::Rebuild(const CBlockIndex& tip)
+{
+    AssertLockHeld(::cs_main);
+    AssertLockHeld(m_mempool.cs);
+    AssertLockHeld(m_mutex);
+
+    m_template.reset();
+    BlockAssembler assembler{m_chainman.ActiveChainstate(), &m_mempool, m_options};
+    m_template = assembler.CreateNewBlock(CScript{});
+    ++m_rebuilds;
+    m_coinbase_stale = false;
+
+    m_in_block.clear();
+    m_block_weight = m_options.coinbase_max_additional_weight;
+    m_block_sigops_cost = m_options.coinbase_output_max_additional_sigops;
+    m_fees = 0;
+    for (size_t i = 1; i < m_template->block.vtx.size(); ++i) {
+        const CTransaction& tx{*m_template->block.vtx[i]};
+        m_in_block.insert(tx.GetHash());
+        m_block_weight += GetTransactionWeight(tx);
+        m_block_sigops_cost += m_template->vTxSigOpsCost[i];
+        m_fees += m_template->vTxFees[i];
+    }
+    m_lowest_package_feerate = assembler.GetLowestPackageFeeRate();
+    m_block_full = assembler.IsBlockFull();
+    m_height = tip.nHeight + 1;
+    m_lock_time_cutoff = tip.GetMedianTimePast();
+    m_next_sequence = m_mempool.GetSequence();
+    m_transactions_updated = m_mempool.GetTransactionsUpdated();
+}
+
+bool BlockTemplateCache::Follow(uint64_t mempool_sequence)
+{
+    AssertLockHeld(m_mutex);
+    // Changes from before the selection was built are already part of it.
+    if (!m_template || mempool_sequence < m_next_sequence) return false;
+    if (mempool_sequence > m_next_sequence) {
+        // A change was not notified, like transactions leaving for a block.
+        m_template.reset();
+        return false;
+    }
+    ++m_next_sequence;
+    ++m_transactions_updated;
+    return true;
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const NewMempoolTransactionInfo& tx, uint64_t mempool_sequence)
+{
+    LOCK2(m_mempool.cs, m_mutex);
+    if (!Follow(mempool_sequence)) return;
+    // A transaction that left the mempool again since is not selected
+    // either way, and its removal will find nothing to do.
+    const auto it{m_mempool.GetIter(tx.info.m_tx->GetHash().ToUint256())};
+    if (!it) return;
+    const CTxMemPoolEntry& entry{**it};
+    if (!IsFinalTx(entry.GetTx(), m_height, m_lock_time_cutoff)) return;
+
+    // With its parents selected the transaction is a package of its own,
+    // otherwise it would be selected along with the ancestors left out.
+    const auto& parents{entry.GetMemPoolParentsConst()};
+    const bool parents_selected{std::all_of(parents.begin(), parents.end(), [&](const CTxMemPoolEntry& parent) {
+        return m_in_block.count(parent.GetTx().GetHash()) > 0;
+    })};
+    const uint64_t package_size{parents_selected ? static_cast<uint64_t>(entry.GetTxSize()) : entry.GetSizeWithAncestors()};
+    const CAmount package_fees{parents_selected ? entry.GetModifiedFee() : entry.GetModFeesWithAncestors()};
+    if (package_fees < m_options.blockMinFeeRate.GetFee(package_size)) return;
+    const CFeeRate package_feerate{package_fees, static_cast<uint32_t>(package_size)};
+
+    if (parents_selected) {
+        if (m_block_weight + WITNESS_SCALE_FACTOR * package_size < m_options.nBlockMaxWeight &&
+            m_block_sigops_cost + entry.GetSigOpCost() < MAX_BLOCK_SIGOPS_COST) {
+            m_template->block.vtx.emplace_back(entry.GetSharedTx());
+            m_template->vTxFees.push_back(entry.GetFee());
+            m_template->vTxSigOpsCost.push_back(entry.GetSigOpCost());
+            m_block_weight += entry.GetTxWeight();
+            m_block_sigops_cost += entry.GetSigOpCost();
+            m_fees += entry.GetFee();
+            m_in_block.insert(entry.GetTx().GetHash());
+            if (!m_lowest_package_feerate || package_feerate < *m_lowest_package_feerate) {
+                m_lowest_package_feerate = package_feerate;
+            }
+            m_coinbase_stale = true;
+            return;
+        }
+        m_block_full = true;
+    }
+
+    // A full pass would pull in ancestors that were left out, or select the
+    // package ahead of the cheapest one in the block.
+    if (!m_block_full || !m_lowest_package_feerate || *m_lowest_package_feerate < package_feerate) {
+        m_template.reset();
+    }
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    LOCK(m_mutex);
+    if (!Follow(mempool_sequence) || !m_in_block.erase(tx->GetHash())) return;
+    // Room freed up in a full block may fit packages that were left out.
+    if (m_block_full) {
+        m_template.reset();
+        return;
+    }
+
+    // Descendants are removed along with the transaction, so the rest of
+    // the selection stays valid.
+    std::vector<CTransactionRef>& vtx{m_template->block.vtx};
+    const auto pos{std::find_if(std::next(vtx.begin()), vtx.end(), [&](const CTransactionRef& block_tx) {
+        return block_tx->GetHash() == tx->GetHash();
+    })};
+    const size_t i = pos - vtx.begin();
+    m_block_weight -= GetTransactionWeight(*tx);
+    m_block_sigops_cost -= m_template->vTxSigOpsCost[i];
+    m_fees -= m_template->vTxFees[i];
+    vtx.erase(pos);
+    m_template->vTxFees.erase(m_template->vTxFees.begin() + i);
+    m_template->vTxSigOpsCost.erase(m_template->vTxSigOpsCost.begin() + i);
+    m_coinbase_stale = true;
+}
+
+double NonceSearchResult::HashRate() const
+{
+    return elapsed.count() > 0 ? hashes / Ticks<SecondsDouble>(elapsed) : 0.0;
+}
+
+NonceSearchResult SearchNonce(CPureBlockHeader& header, int32_t nBlockVersion, unsigned int nBits, const Consensus::Params& params,
+                              uint64_t max_tries, int threads, const util::SignalInterrupt& interrupt)
+{
+    const auto start_time{SteadyClock::now()};
+    const uint64_t first{header.nNonce};
+    const uint64_t end{first + std::min<uint64_t>(max_tries, std::numeric_limits<uint32_t>::max() - first)};
+    const bool flex{(nBlockVersion & 0x8000) != 0};
+    // A Flex hash takes milliseconds, so hand those out one multi-buffer call
+    // at a time; SHA hashes are cheap enough to batch more.
+    const uint64_t chunk{flex ? FLEX_MAX_LANES : 1024};
+
+    std::atomic<uint64_t> next{first};
+    // Lowest nonce found so far, or end. Chunks are handed out in order, so
+    // once every chunk below it is done no lower nonce can turn up.
+    std::atomic<uint64_t> best{end};
+    std::atomic<uint64_t> hashes{0};
+
+    const auto worker{[&] {
+        CPureBlockHeader candidate{header};
+        std::vector<unsigned char> serialized;
+        VectorWriter{serialized, 0, candidate};
+        // The nonce is the last field of the serialized header.
+        const size_t nonce_offset{serialized.size() - sizeof(candidate.nNonce)};
+        std::vector<std::vector<unsigned char>> lanes(flex ? FLEX_MAX_LANES : 0, serialized);
+        std::vector<const char*> inputs(lanes.size());
+        std::vector<uint256> pow_hashes(lanes.size());
+        std::vector<unsigned char*> outputs(lanes.size());
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            inputs[i] = reinterpret_cast<const char*>(lanes[i].data());
+            outputs[i] = pow_hashes[i].begin();
+        }
+
+        while (!interrupt) {
+            const uint64_t from{next.fetch_add(chunk)};
+            const uint64_t to{std::min(from + chunk, best.load())};
+            if (from >= to) break;
+
+            std::optional<uint64_t> found;
+            if (flex) {
+                const size_t count = to - from;
+                for (size_t i = 0; i < count; ++i) {
+                    WriteLE32(lanes[i].data() + nonce_offset, from + i);
+                }
+                flex_hash_multi(inputs.data(), serialized.size(), outputs.data(), count);
+                hashes += count;
+                for (size_t i = 0; i < count && !found; ++i) {
+                    if (CheckProofOfWork(pow_hashes[i], nBits, params)) found = from + i;
+                }
+            } else {
+                for (uint64_t nonce = from; nonce < to && !found; ++nonce) {
+                    candidate.nNonce = nonce;
+                    ++hashes;
+                    if (CheckProofOfWork(candidate.GetHash(nBlockVersion), nBits, params)) found = nonce;
+                }
+            }
+
+            if (found) {
+                uint64_t current{best.load()};
+                while (*found < current && !best.compare_exchange_weak(current, *found)) {}
+            }
+        }
+    }};
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    NonceSearchResult result;
+    result.hashes = hashes;
+    result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - start_time);
+    if (best < end) {
+        result.found = true;
+        result.tries = best - first;
+        header.nNonce = best;
+    } else {
+        result.tries = std::min(next.load(), end) - first;
+    }
+    return result;
+}
 } // namespace node
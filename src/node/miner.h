@@ -9,8 +9,11 @@
 #include <node/types.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
+#include <validationinterface.h>
 
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <stdint.h>
@@ -24,14 +27,18 @@
 class ArgsManager;
 class CBlockIndex;
 class CChainParams;
+class CPureBlockHeader;
 class CScript;
 class Chainstate;
 class ChainstateManager;
 
 namespace Consensus { struct Params; };
+namespace util { class SignalInterrupt; };
 
 namespace node {
 static const bool DEFAULT_PRINT_MODIFIED_FEE = false;
+/** Default for -generatethreads, 0 uses one thread per core */
+static const int DEFAULT_GENERATE_THREADS = 0;
 
 struct CBlockTemplate
 {
@@ -148,6 +155,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     std::unordered_set<Txid, SaltedTxidHasher> inBlock;
+    std::optional<CFeeRate> m_lowest_package_feerate;
+    bool m_block_full;
 
     // Chain context for the block
     int nHeight;
@@ -172,6 +181,11 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
+    /** Lowest ancestor feerate of the packages the last CreateNewBlock() selected, if it selected any */
+    std::optional<CFeeRate> GetLowestPackageFeeRate() const { return m_lowest_package_feerate; }
+    /** Whether the last CreateNewBlock() left out a package for lack of room in the block */
+    bool IsBlockFull() const { return m_block_full; }
+
     inline static std::optional<int64_t> m_last_block_num_txs{};
     inline static std::optional<int64_t> m_last_block_weight{};
 
@@ -204,6 +218,62 @@ private:
     void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
 };
 
+/**
+ * Keeps the transaction selection of the last block template and updates it
+ * as transactions enter and leave the mempool, so that templates for an
+ * unchanged tip are handed out without another pass over the mempool.
+ *
+ * A transaction entering the mempool is appended if its parents are already
+ * selected and it fits; one leaving is dropped. The selection is rebuilt with
+ * BlockAssembler on the next request when that would no longer match what a
+ * full pass picks (a new package beats the cheapest one selected, or room
+ * freed up in a full block), when the tip changed, or when the mempool
+ * changed in a way this was not notified of, like a prioritisation.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+public:
+    BlockTemplateCache(ChainstateManager& chainman, CTxMemPool& mempool, const BlockAssembler::Options& options);
+
+    /** Return a block template with coinbase to script_pub_key, as BlockAssembler::CreateNewBlock() does */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& script_pub_key) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Number of times the selection was built from scratch */
+    uint64_t GetRebuildCount() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+protected:
+    void TransactionAddedToMempool(const NewMempoolTransactionInfo& tx, uint64_t mempool_sequence) override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+private:
+    ChainstateManager& m_chainman;
+    CTxMemPool& m_mempool;
+    const BlockAssembler::Options m_options;
+
+    mutable Mutex m_mutex;
+    //! Template for the current selection, with coinbase to an empty script. Null when it has to be rebuilt.
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    //! Whether the coinbase of m_template predates the last change to the selection
+    bool m_coinbase_stale GUARDED_BY(m_mutex){false};
+    std::unordered_set<Txid, SaltedTxidHasher> m_in_block GUARDED_BY(m_mutex);
+    uint64_t m_block_weight GUARDED_BY(m_mutex){0};
+    int64_t m_block_sigops_cost GUARDED_BY(m_mutex){0};
+    CAmount m_fees GUARDED_BY(m_mutex){0};
+    std::optional<CFeeRate> m_lowest_package_feerate GUARDED_BY(m_mutex);
+    bool m_block_full GUARDED_BY(m_mutex){false};
+    int m_height GUARDED_BY(m_mutex){0};
+    int64_t m_lock_time_cutoff GUARDED_BY(m_mutex){0};
+    //! Mempool sequence number of the next notification to apply
+    uint64_t m_next_sequence GUARDED_BY(m_mutex){0};
+    //! Mempool transactions-updated counter the selection is in sync with
+    unsigned int m_transactions_updated GUARDED_BY(m_mutex){0};
+    uint64_t m_rebuilds GUARDED_BY(m_mutex){0};
+
+    void Rebuild(const CBlockIndex& tip) EXCLUSIVE_LOCKS_REQUIRED(::cs_main, m_mempool.cs, m_mutex);
+    /** Whether to apply the notification with the given sequence number to the selection */
+    bool Follow(uint64_t mempool_sequence) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
 /** Update an old GenerateCoinbaseCommitment from CreateNewBlock after the block txs have changed */
@@ -211,6 +281,37 @@ void RegenerateCommitments(CBlock& block, ChainstateManager& chainman);
 
 /** Apply -blockmintxfee and -blockmaxweight options from ArgsManager to BlockAssembler options. */
 void ApplyArgsManOptions(const ArgsManager& gArgs, BlockAssembler::Options& options);
+
+/** Outcome of a SearchNonce call. */
+struct NonceSearchResult {
+    //! Whether a nonce meeting the target was found; it is then set in the header
+    bool found{false};
+    //! Number of nonces tried before the search ended, as a serial search would count them
+    uint64_t tries{0};
+    //! Number of proof of work hashes computed by all threads
+    uint64_t hashes{0};
+    //! Wall-clock duration of the search
+    std::chrono::microseconds elapsed{0};
+
+    /** Hashes per second over the search. */
+    double HashRate() const;
+};
+
+/**
+ * Search for a nonce, starting at header.nNonce, that gives the header a
+ * proof of work hash meeting nBits. The hash is computed as for a block with
+ * version nBlockVersion, i.e. the Flex hash once 0x8000 is set (see
+ * CPureBlockHeader::GetPoWHash). The nonce range is shared out in small chunks
+ * across the given number of threads, and Flex chunks are hashed with
+ * flex_hash_multi. The search returns the lowest matching nonce, the same one
+ * a serial search would find.
+ *
+ * At most max_tries nonces are tried. The last nonce value is never tried.
+ * The search stops early when interrupt is signalled. The computed hashes are
+ * not added to the PoW hash cache.
+ */
+NonceSearchResult SearchNonce(CPureBlockHeader& header, int32_t nBlockVersion, unsigned int nBits, const Consensus::Params& params,
+                              uint64_t max_tries, int threads, const util::SignalInterrupt& interrupt);
 } // namespace node
 
 #endif // BITCOIN_NODE_MINER_H
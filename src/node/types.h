@@ -43,6 +43,8 @@ struct BlockCreateOptions {
      * transaction outputs.
      */
     size_t coinbase_output_max_additional_sigops{400};
+
+    friend bool operator==(const BlockCreateOptions&, const BlockCreateOptions&) = default;
 };
 } // namespace node
 
@@ -0,0 +1 @@
+#define BUILD_GIT_COMMIT "3dd6b20856eb"
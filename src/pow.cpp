@@ -10,6 +10,9 @@
 #include <primitives/block.h>
 #include <uint256.h>
 
+#include <optional>
+#include <utility>
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     assert(pindexLast != nullptr);
@@ -94,19 +97,109 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
     return CalculateNextWorkRequired(pindexLast, pindexFirst->GetBlockTime(), params);
 }
 
+unsigned int GetNextWorkRequiredCached(const CBlockIndex* pindexLast, const CBlockHeader* pblock, const Consensus::Params& params)
+{
+    AssertLockHeld(::cs_main);
+    // Min-difficulty blocks make the result depend on the new block's time.
+    if (params.fPowAllowMinDifficultyBlocks) {
+        return GetNextWorkRequired(pindexLast, pblock, params);
+    }
+    if (pindexLast->m_next_work_required == 0) {
+        pindexLast->m_next_work_required = GetNextWorkRequired(pindexLast, pblock, params);
+    }
+    return pindexLast->m_next_work_required;
+}
+
+size_t CheckNextWorkRequired(const CBlockIndex* pindexLast, Span<const CBlockHeader> headers, const Consensus::Params& params)
+{
+    assert(pindexLast != nullptr);
+    // Min-difficulty blocks depend on the time of each new block, so leave
+    // them to the per-header checks.
+    if (params.fPowAllowMinDifficultyBlocks) return 0;
+
+    // The block at a height at or below pindexLast's, or one of the headers.
+    const auto block_at = [&](int height) -> std::pair<unsigned int, int64_t> {
+        if (height > pindexLast->nHeight) {
+            const CBlockHeader& header = headers[height - pindexLast->nHeight - 1];
+            return {header.nBits, header.GetBlockTime()};
+        }
+        const CBlockIndex* pindex = pindexLast->GetAncestor(height);
+        return {pindex->nBits, pindex->GetBlockTime()};
+    };
+
+    uint256 hashPrev = pindexLast->GetBlockHash();
+    for (size_t i = 0; i < headers.size(); ++i) {
+        const CBlockHeader& header = headers[i];
+        if (header.hashPrevBlock != hashPrev) return i;
+
+        // Mirrors GetNextWorkRequired(): between retargets nBits must stay
+        // the same, so only retargets are computed.
+        const int height = pindexLast->nHeight + 1 + i;
+        // The fork heights are unsigned, and height is at least 1.
+        const uint64_t fork_height{static_cast<uint64_t>(height)};
+        const auto [last_bits, last_time] = block_at(height - 1);
+        std::optional<int> first_height;
+        unsigned int expected{last_bits};
+        if (fork_height == params.n2023Height) {
+            expected = params.n2023Bits;
+        } else if (fork_height == params.n2023Height2) {
+            expected = params.n2023Bits2;
+        } else if (fork_height == params.nFlexhashHeight) {
+            expected = params.nFlexhashBits;
+        } else if (fork_height < params.n2023Height) {
+            if (height % params.DifficultyAdjustmentInterval() == 0) first_height = height - params.DifficultyAdjustmentInterval();
+        } else if (fork_height < params.n2023Height2) {
+            if (fork_height % params.n2023Window == 0) first_height = height - static_cast<int>(params.n2023Window);
+        } else {
+            first_height = height - 2;
+        }
+        if (first_height) {
+            if (*first_height < 0) return i;
+            const unsigned int base_bits{params.enforce_BIP94 ? block_at(height - params.DifficultyAdjustmentInterval()).first : last_bits};
+            expected = CalculateNextWorkRequired(last_bits, base_bits, last_time, height - 1, block_at(*first_height).second, params);
+        }
+        if (header.nBits != expected) return i;
+        hashPrev = header.GetHash();
+    }
+    return headers.size();
+}
+
+void SetNextWorkRequired(const CBlockIndex& pindexLast, unsigned int nBits, const Consensus::Params& params)
+{
+    AssertLockHeld(::cs_main);
+    if (!params.fPowAllowMinDifficultyBlocks) {
+        pindexLast.m_next_work_required = nBits;
+    }
+}
+
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params& params)
+{
+    unsigned int nBaseBits = pindexLast->nBits;
+    // Special difficulty rule for Testnet4
+    if (params.enforce_BIP94) {
+        // Here we use the first block of the difficulty period. This way
+        // the real difficulty is always preserved in the first block as
+        // it is not allowed to use the min-difficulty exception.
+        int nHeightFirst = pindexLast->nHeight - (params.DifficultyAdjustmentInterval()-1);
+        const CBlockIndex* pindexFirst = pindexLast->GetAncestor(nHeightFirst);
+        nBaseBits = pindexFirst->nBits;
+    }
+    return CalculateNextWorkRequired(pindexLast->nBits, nBaseBits, pindexLast->GetBlockTime(), pindexLast->nHeight, nFirstBlockTime, params);
+}
+
+unsigned int CalculateNextWorkRequired(unsigned int nLastBits, unsigned int nBaseBits, int64_t nLastBlockTime, int nLastHeight, int64_t nFirstBlockTime, const Consensus::Params& params)
 {
     if (params.fPowNoRetargeting)
-        return pindexLast->nBits;
+        return nLastBits;
 
     // Limit adjustment step
-    int64_t nActualTimespan = pindexLast->GetBlockTime() - nFirstBlockTime;
-	if((pindexLast->nHeight+1) < params.n2023Height) {
+    int64_t nActualTimespan = nLastBlockTime - nFirstBlockTime;
+	if((nLastHeight+1) < params.n2023Height) {
 		if (nActualTimespan < params.nPowTargetTimespan/4)
 			nActualTimespan = params.nPowTargetTimespan/4;
 		if (nActualTimespan > params.nPowTargetTimespan*4)
 			nActualTimespan = params.nPowTargetTimespan*4;
-	} else if((pindexLast->nHeight+1) < params.n2023Height2) {
+	} else if((nLastHeight+1) < params.n2023Height2) {
 		if (nActualTimespan < params.n2023Timespan/1.014)
 			nActualTimespan = params.n2023Timespan/1.014;
 		if (nActualTimespan > params.n2023Timespan*1.014)
@@ -122,22 +215,12 @@ unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nF
     const arith_uint256 bnPowLimit = UintToArith256(params.powLimit);
     arith_uint256 bnNew;
 
-    // Special difficulty rule for Testnet4
-    if (params.enforce_BIP94) {
-        // Here we use the first block of the difficulty period. This way
-        // the real difficulty is always preserved in the first block as
-        // it is not allowed to use the min-difficulty exception.
-        int nHeightFirst = pindexLast->nHeight - (params.DifficultyAdjustmentInterval()-1);
-        const CBlockIndex* pindexFirst = pindexLast->GetAncestor(nHeightFirst);
-        bnNew.SetCompact(pindexFirst->nBits);
-    } else {
-        bnNew.SetCompact(pindexLast->nBits);
-    }
+    bnNew.SetCompact(nBaseBits);
 
     bnNew *= nActualTimespan;
-    if((pindexLast->nHeight+1) < params.n2023Height) {
+    if((nLastHeight+1) < params.n2023Height) {
         bnNew /= params.nPowTargetTimespan;
-    } else if((pindexLast->nHeight+1) < params.n2023Height2) {
+    } else if((nLastHeight+1) < params.n2023Height2) {
         bnNew /= params.n2023Timespan;
     } else {
         bnNew /= 38;
@@ -7,7 +7,11 @@
 #define BITCOIN_POW_H
 
 #include <consensus/params.h>
+#include <kernel/cs_main.h>
+#include <span.h>
+#include <sync.h>
 
+#include <cstddef>
 #include <stdint.h>
 
 class CBlockHeader;
@@ -16,6 +20,34 @@ class uint256;
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
+/**
+ * Retarget from the last block's nBits, time and height. nBaseBits is the
+ * nBits scaled by the timespan, which is the last block's except on Testnet4.
+ */
+unsigned int CalculateNextWorkRequired(unsigned int nLastBits, unsigned int nBaseBits, int64_t nLastBlockTime, int nLastHeight, int64_t nFirstBlockTime, const Consensus::Params&);
+
+/**
+ * GetNextWorkRequired(), memoized in pindexLast. Unless min-difficulty blocks
+ * are allowed, the result only depends on the chain up to pindexLast, and is
+ * asked for again by header acceptance, block checks and template building.
+ */
+unsigned int GetNextWorkRequiredCached(const CBlockIndex* pindexLast, const CBlockHeader* pblock, const Consensus::Params&) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+/**
+ * Check the nBits of a chain of headers, the first one building on
+ * pindexLast, in one pass. Only headers at a retarget compute one, from the
+ * times of the earlier headers or of pindexLast's ancestors; the others must
+ * keep the nBits of their parent. Returns the number of leading headers that
+ * link up and have the nBits GetNextWorkRequired() asks of them, which is 0
+ * where min-difficulty blocks are allowed.
+ *
+ * Results for headers that pass can be handed to the block index entries of
+ * their parents with SetNextWorkRequired().
+ */
+size_t CheckNextWorkRequired(const CBlockIndex* pindexLast, Span<const CBlockHeader> headers, const Consensus::Params&);
+
+/** Memoize nBits, checked by CheckNextWorkRequired(), as required of a block building on pindexLast. */
+void SetNextWorkRequired(const CBlockIndex& pindexLast, unsigned int nBits, const Consensus::Params&) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
@@ -1,150 +1,437 @@
-#include "pow_cache.h"
-#include <logging.h>
-
-// Static member initialization
-std::mutex SQLiteCache::db_mutex;  // Ensures thread safety for SQLite access.
-sqlite3* SQLiteCache::db = nullptr;  // Shared database connection pointer.
-
-static void PowCacheErrorLogCallback(void* arg, int code, const char* msg)
-{
-    assert(arg == nullptr);
-    LogPrintf("SQLite Error. Code: %d. Message: %s\n", code, msg);
-}
-
-// Constructor
-SQLiteCache::SQLiteCache(const std::string& dbName) {
-    // Lock the mutex to synchronize database access across threads.
-    std::lock_guard<std::mutex> lock(db_mutex);
-
-    // If the database connection is not already open, open it.
-    if (db == nullptr) {
-        const fs::path path = gArgs.GetDataDirNet() / fs::u8path(dbName.c_str());
-        int rc = sqlite3_config(SQLITE_CONFIG_LOG, PowCacheErrorLogCallback, nullptr);
-        rc = sqlite3_config(SQLITE_CONFIG_SERIALIZED);
-        int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;  // Open with read/write permissions and create if necessary.
-        sqlite3_initialize();  // Initialize SQLite if not already done.
-
-        // Open the database using the specified path.
-        rc = sqlite3_open_v2(path.utf8string().c_str(), &db, flags, nullptr);
-        if (rc != SQLITE_OK) {
-            std::cerr << "Can't open database: " << sqlite3_errmsg(db) << std::endl;
-            sqlite3_close(db);  // Close the database if opening fails.
-            db = nullptr;
-        } else {
-            setupPragmas();  // Set PRAGMA settings to optimize performance.
-            createTable();   // Create the cache table if it doesn't exist.
-        }
-    }
-}
-
-// Destructor: We don’t close the database here, allowing it to be reused by other threads.
-// SQLite will close the connection when the program exits.
-SQLiteCache::~SQLiteCache() {
-    // Database closing logic can be handled when the program terminates.
-    // This prevents closing the connection while another thread might be using it.
-}
-
-// Inserts or updates a key-value pair in the database.
-bool SQLiteCache::set(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);  // Lock database access for thread safety.
-
-    // SQL statement to insert or replace the key-value pair.
-    const std::string sql = "INSERT OR REPLACE INTO Cache (key, value) VALUES (?, ?);";
-    sqlite3_stmt* stmt = nullptr;
-
-    // Prepare the SQL statement.
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << std::endl;
-        return false;
-    }
-
-    // Bind the key and value to the SQL statement.
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_STATIC);
-
-    // Execute the statement.
-    rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE) {
-        std::cerr << "Execution failed: " << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);  // Finalize the statement to avoid memory leaks.
-        return false;
-    }
-
-    sqlite3_finalize(stmt);  // Finalize the statement after successful execution.
-    return true;
-}
-
-// Retrieves the value associated with the given key.
-std::string SQLiteCache::get(const std::string& key) {
-    std::lock_guard<std::mutex> lock(db_mutex);  // Lock database access for thread safety.
-
-    // SQL statement to retrieve the value based on the key.
-    const std::string sql = "SELECT value FROM Cache WHERE key = ?;";
-    sqlite3_stmt* stmt = nullptr;
-
-    // Prepare the SQL statement.
-    int rc = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
-    if (rc != SQLITE_OK) {
-        std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << std::endl;
-        return "";
-    }
-
-    // Bind the key to the SQL statement.
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
-
-    // Execute the statement and fetch the result.
-    rc = sqlite3_step(stmt);
-    std::string result;
-    if (rc == SQLITE_ROW) {
-        const unsigned char* text = sqlite3_column_text(stmt, 0);
-        if (text) {
-            result = reinterpret_cast<const char*>(text);  // Convert the result to a std::string.
-        }
-    } else if (rc != SQLITE_DONE) {
-        std::cerr << "Execution failed: " << sqlite3_errmsg(db) << std::endl;
-    }
-
-    sqlite3_finalize(stmt);  // Finalize the statement to avoid memory leaks.
-    return result;
-}
-
-// Create the cache table if it doesn't exist.
-void SQLiteCache::createTable() {
-    const char* sql = "CREATE TABLE IF NOT EXISTS Cache (key TEXT PRIMARY KEY, value TEXT);";
-    char* errMsg = nullptr;
-
-    // Execute the SQL statement to create the table.
-    int rc = sqlite3_exec(db, sql, nullptr, nullptr, &errMsg);
-    if (rc != SQLITE_OK) {
-        std::cerr << "SQL error: " << errMsg << std::endl;
-        sqlite3_free(errMsg);  // Free the error message memory allocated by SQLite.
-    }
-}
-
-// Set performance-related PRAGMA settings for the SQLite database.
-void SQLiteCache::setupPragmas() {
-    // Array of PRAGMA SQL statements.
-    const char* pragmas[] = {
-        "PRAGMA synchronous = NORMAL;",
-        "PRAGMA journal_mode = DELETE;",
-        "PRAGMA temp_store = 1;",
-        "PRAGMA cache_size = 10000;",
-        "PRAGMA journal_size_limit = 1000000;",
-        "PRAGMA locking_mode = NORMAL;",
-        "PRAGMA count_changes = OFF;"
-        "PRAGMA auto_vacuum = 0;"
-        "PRAGMA page_size = 4096;"
-        "PRAGMA lock_timeout = 5000;"
-    };
-
-    // Loop through each PRAGMA statement and execute it.
-    for (const char* pragma : pragmas) {
-        char* errMsg = nullptr;
-        int rc = sqlite3_exec(db, pragma, nullptr, nullptr, &errMsg);
-        if (rc != SQLITE_OK) {
-            std::cerr << "PRAGMA error: " << errMsg << std::endl;
-            sqlite3_free(errMsg);  // Free the error message memory allocated by SQLite.
-        }
-    }
-}
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pow_cache.h>
+
+#include <logging.h>
+#include <memusage.h>
+#include <util/trace.h>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <cstring>
+
+static void PowCacheErrorLogCallback(void* arg, int code, const char* msg)
+{
+    assert(arg == nullptr);
+    LogPrintf("SQLite Error. Code: %d. Message: %s\n", code, msg);
+}
+
+static bool PrepareStatement(sqlite3* db, const char* sql, sqlite3_stmt** stmt)
+{
+    int rc = sqlite3_prepare_v2(db, sql, -1, stmt, nullptr);
+    if (rc != SQLITE_OK) {
+        LogPrintf("PoW hash cache: failed to prepare statement \"%s\": %s\n", sql, sqlite3_errstr(rc));
+        return false;
+    }
+    return true;
+}
+
+static bool ExecStatement(sqlite3* db, const char* sql)
+{
+    char* err_msg{nullptr};
+    int rc = sqlite3_exec(db, sql, nullptr, nullptr, &err_msg);
+    if (rc != SQLITE_OK) {
+        LogPrintf("PoW hash cache: failed to execute \"%s\": %s\n", sql, err_msg ? err_msg : sqlite3_errstr(rc));
+        sqlite3_free(err_msg);
+        return false;
+    }
+    return true;
+}
+
+PowHashStore::PowHashStore(const fs::path& path, size_t max_entries) : m_path{path}, m_max_entries{max_entries}
+{
+    LOCK(m_mutex);
+    // Only has an effect before SQLite is initialized; the wallet may already have done so.
+    sqlite3_config(SQLITE_CONFIG_LOG, PowCacheErrorLogCallback, nullptr);
+    sqlite3_initialize();
+
+    int rc = sqlite3_open_v2(path.utf8string().c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr);
+    if (rc != SQLITE_OK) {
+        LogPrintf("PoW hash cache: unable to open database %s: %s\n", fs::PathToString(path), sqlite3_errstr(rc));
+        sqlite3_close(m_db);
+        m_db = nullptr;
+        return;
+    }
+
+    // The cache can always be recomputed, so favour speed over durability.
+    // The WAL journal lets the read-only connections read while writing.
+    const char* setup[] = {
+        "PRAGMA synchronous = OFF;",
+        "PRAGMA journal_mode = WAL;",
+        "PRAGMA temp_store = MEMORY;",
+        "CREATE TABLE IF NOT EXISTS powhash (hash BLOB PRIMARY KEY NOT NULL, powhash BLOB NOT NULL) WITHOUT ROWID;",
+    };
+    bool ok{true};
+    for (const char* sql : setup) {
+        ok = ok && ExecStatement(m_db, sql);
+    }
+    ok = ok && PrepareStatement(m_db, "INSERT OR REPLACE INTO powhash (hash, powhash) VALUES (?, ?);", &m_insert_stmt);
+    ok = ok && PrepareStatement(m_db, "DELETE FROM powhash WHERE hash = ?;", &m_erase_stmt);
+    ok = ok && PrepareStatement(m_db, "SELECT COUNT(*) FROM powhash;", &m_count_stmt);
+    ok = ok && PrepareStatement(m_db, "DELETE FROM powhash WHERE hash IN (SELECT hash FROM powhash LIMIT ?);", &m_trim_stmt);
+    const std::optional<size_t> entries{ok ? CountLocked() : std::nullopt};
+    if (!entries) {
+        sqlite3_finalize(m_insert_stmt);
+        sqlite3_finalize(m_erase_stmt);
+        sqlite3_finalize(m_count_stmt);
+        sqlite3_finalize(m_trim_stmt);
+        m_insert_stmt = m_erase_stmt = m_count_stmt = m_trim_stmt = nullptr;
+        sqlite3_close(m_db);
+        m_db = nullptr;
+        return;
+    }
+    m_entries = *entries;
+    m_open = true;
+}
+
+PowHashStore::~PowHashStore()
+{
+    {
+        LOCK(m_readers_mutex);
+        for (Reader& reader : m_idle_readers) CloseReader(reader);
+        m_idle_readers.clear();
+    }
+    LOCK(m_mutex);
+    if (!m_db) return;
+    FlushLocked();
+    sqlite3_finalize(m_insert_stmt);
+    sqlite3_finalize(m_erase_stmt);
+    sqlite3_finalize(m_count_stmt);
+    sqlite3_finalize(m_trim_stmt);
+    sqlite3_close(m_db);
+    m_db = nullptr;
+}
+
+bool PowHashStore::IsOpen()
+{
+    LOCK(m_mutex);
+    return m_db != nullptr;
+}
+
+std::optional<PowHashStore::Reader> PowHashStore::OpenReader() const
+{
+    Reader reader;
+    int rc = sqlite3_open_v2(m_path.utf8string().c_str(), &reader.db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+    if (rc != SQLITE_OK || !PrepareStatement(reader.db, "SELECT powhash FROM powhash WHERE hash = ?;", &reader.stmt)) {
+        if (rc != SQLITE_OK) LogPrintf("PoW hash cache: unable to open database for reading: %s\n", sqlite3_errstr(rc));
+        CloseReader(reader);
+        return std::nullopt;
+    }
+    return reader;
+}
+
+void PowHashStore::CloseReader(Reader& reader)
+{
+    sqlite3_finalize(reader.stmt);
+    sqlite3_close(reader.db);
+    reader = {};
+}
+
+void PowHashStore::RecordLockWait(SteadyClock::time_point wait_start)
+{
+    const auto wait_ns{std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now() - wait_start).count()};
+    m_lock_wait_ns += wait_ns;
+    TRACE1(pow, cache_store_lock_wait, wait_ns);
+}
+
+std::optional<uint256> PowHashStore::Read(const uint256& header_hash)
+{
+    if (!m_open) return std::nullopt;
+    std::optional<Reader> reader;
+    {
+        const auto wait_start{SteadyClock::now()};
+        LOCK(m_readers_mutex);
+        RecordLockWait(wait_start);
+        if (!m_idle_readers.empty()) {
+            reader = m_idle_readers.back();
+            m_idle_readers.pop_back();
+        }
+    }
+    if (!reader) reader = OpenReader();
+    if (!reader) return std::nullopt;
+
+    const auto read_start{SteadyClock::now()};
+    std::optional<uint256> result;
+    sqlite3_bind_blob(reader->stmt, 1, header_hash.data(), header_hash.size(), SQLITE_STATIC);
+    int rc = sqlite3_step(reader->stmt);
+    if (rc == SQLITE_ROW && sqlite3_column_bytes(reader->stmt, 0) == static_cast<int>(uint256::size())) {
+        result.emplace();
+        std::memcpy(result->data(), sqlite3_column_blob(reader->stmt, 0), uint256::size());
+    } else if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+        LogPrintf("PoW hash cache: read failed: %s\n", sqlite3_errstr(rc));
+    }
+    sqlite3_clear_bindings(reader->stmt);
+    sqlite3_reset(reader->stmt);
+    m_read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now() - read_start).count();
+
+    LOCK(m_readers_mutex);
+    m_idle_readers.push_back(*reader);
+    return result;
+}
+
+void PowHashStore::Write(const Entry& entry)
+{
+    const auto wait_start{SteadyClock::now()};
+    LOCK(m_mutex);
+    RecordLockWait(wait_start);
+    if (!m_db) return;
+    m_pending.push_back(entry);
+    if (m_pending.size() >= POW_CACHE_WRITE_BATCH) FlushLocked();
+}
+
+void PowHashStore::Erase(const std::vector<uint256>& header_hashes)
+{
+    LOCK(m_mutex);
+    if (!m_db) return;
+    m_pending_erase.insert(m_pending_erase.end(), header_hashes.begin(), header_hashes.end());
+}
+
+bool PowHashStore::Flush()
+{
+    const auto wait_start{SteadyClock::now()};
+    LOCK(m_mutex);
+    RecordLockWait(wait_start);
+    return FlushLocked();
+}
+
+size_t PowHashStore::Count()
+{
+    LOCK(m_mutex);
+    if (!m_db) return 0;
+    return CountLocked().value_or(0);
+}
+
+std::optional<size_t> PowHashStore::CountLocked()
+{
+    AssertLockHeld(m_mutex);
+    std::optional<size_t> count;
+    int rc = sqlite3_step(m_count_stmt);
+    if (rc == SQLITE_ROW) {
+        count = sqlite3_column_int64(m_count_stmt, 0);
+    } else {
+        LogPrintf("PoW hash cache: count failed: %s\n", sqlite3_errstr(rc));
+    }
+    sqlite3_reset(m_count_stmt);
+    return count;
+}
+
+bool PowHashStore::TrimLocked()
+{
+    AssertLockHeld(m_mutex);
+    if (m_entries <= m_max_entries) return true;
+    // Replaced entries were counted twice, so count again before dropping any.
+    const std::optional<size_t> entries{CountLocked()};
+    if (!entries) return false;
+    m_entries = *entries;
+    if (m_entries <= m_max_entries) return true;
+
+    const size_t target{m_max_entries - m_max_entries / 10};
+    sqlite3_bind_int64(m_trim_stmt, 1, m_entries - target);
+    int rc = sqlite3_step(m_trim_stmt);
+    sqlite3_clear_bindings(m_trim_stmt);
+    sqlite3_reset(m_trim_stmt);
+    if (rc != SQLITE_DONE) {
+        LogPrintf("PoW hash cache: trim failed: %s\n", sqlite3_errstr(rc));
+        return false;
+    }
+    LogPrintf("PoW hash cache: dropped %u of %u stored entries\n", m_entries - target, m_entries);
+    m_entries = target;
+    return true;
+}
+
+bool PowHashStore::FlushLocked()
+{
+    AssertLockHeld(m_mutex);
+    if (!m_db) return false;
+    if (m_pending.empty() && m_pending_erase.empty()) return true;
+
+    if (!ExecStatement(m_db, "BEGIN TRANSACTION;")) return false;
+    bool ok{true};
+    for (const Entry& entry : m_pending) {
+        sqlite3_bind_blob(m_insert_stmt, 1, entry.header_hash.data(), entry.header_hash.size(), SQLITE_STATIC);
+        sqlite3_bind_blob(m_insert_stmt, 2, entry.pow_hash.data(), entry.pow_hash.size(), SQLITE_STATIC);
+        int rc = sqlite3_step(m_insert_stmt);
+        sqlite3_clear_bindings(m_insert_stmt);
+        sqlite3_reset(m_insert_stmt);
+        if (rc != SQLITE_DONE) {
+            LogPrintf("PoW hash cache: insert failed: %s\n", sqlite3_errstr(rc));
+            ok = false;
+            break;
+        }
+        ++m_entries;
+    }
+    // Deletions are queued after any insert of the same hash, so apply them last.
+    for (size_t i = 0; ok && i < m_pending_erase.size(); ++i) {
+        sqlite3_bind_blob(m_erase_stmt, 1, m_pending_erase[i].data(), m_pending_erase[i].size(), SQLITE_STATIC);
+        int rc = sqlite3_step(m_erase_stmt);
+        sqlite3_clear_bindings(m_erase_stmt);
+        sqlite3_reset(m_erase_stmt);
+        if (rc != SQLITE_DONE) {
+            LogPrintf("PoW hash cache: delete failed: %s\n", sqlite3_errstr(rc));
+            ok = false;
+        }
+        if (sqlite3_changes(m_db) > 0 && m_entries > 0) --m_entries;
+    }
+    ok = ok && TrimLocked();
+    if (!ok) {
+        ExecStatement(m_db, "ROLLBACK TRANSACTION;");
+    } else {
+        ok = ExecStatement(m_db, "COMMIT TRANSACTION;");
+    }
+    // Entries can always be recomputed, so a failed batch is dropped rather than retried.
+    m_pending.clear();
+    m_pending_erase.clear();
+    return ok;
+}
+
+PowHashCache::PowHashCache(size_t max_bytes)
+{
+    Resize(max_bytes);
+}
+
+PowHashCache::~PowHashCache()
+{
+    CloseStore();
+}
+
+size_t PowHashCache::EntryBytes()
+{
+    return memusage::MallocUsage(sizeof(memusage::unordered_node<std::pair<const uint256, LruList::iterator>>)) + sizeof(void*) +
+           memusage::MallocUsage(sizeof(memusage::list_node<LruList::value_type>));
+}
+
+void PowHashCache::Shard::EvictTo(size_t max_entries)
+{
+    while (m_lru.size() > max_entries) {
+        m_map.erase(m_lru.front().first);
+        m_lru.pop_front();
+    }
+}
+
+void PowHashCache::Resize(size_t max_bytes)
+{
+    const size_t max_shard_entries{std::max<size_t>(1, max_bytes / EntryBytes() / NUM_SHARDS)};
+    m_max_shard_entries = max_shard_entries;
+    for (Shard& shard : m_shards) {
+        LOCK(shard.m_mutex);
+        shard.EvictTo(max_shard_entries);
+    }
+}
+
+bool PowHashCache::OpenStore(const fs::path& path, size_t max_entries)
+{
+    auto store{std::make_shared<PowHashStore>(path, max_entries)};
+    if (!store->IsOpen()) return false;
+    LOCK(m_store_mutex);
+    m_store = std::move(store);
+    return true;
+}
+
+void PowHashCache::CloseStore()
+{
+    std::shared_ptr<PowHashStore> store;
+    {
+        LOCK(m_store_mutex);
+        store.swap(m_store);
+    }
+    if (store) store->Flush();
+}
+
+std::shared_ptr<PowHashStore> PowHashCache::GetStore()
+{
+    LOCK(m_store_mutex);
+    return m_store;
+}
+
+void PowHashCache::InsertMemory(const uint256& header_hash, const uint256& pow_hash)
+{
+    Shard& shard{GetShard(header_hash)};
+    LOCK(shard.m_mutex);
+    const auto [it, inserted]{shard.m_map.try_emplace(header_hash)};
+    if (!inserted) return;
+    it->second = shard.m_lru.emplace(shard.m_lru.end(), header_hash, pow_hash);
+    shard.EvictTo(m_max_shard_entries.load());
+}
+
+std::optional<uint256> PowHashCache::Get(const uint256& header_hash)
+{
+    {
+        Shard& shard{GetShard(header_hash)};
+        LOCK(shard.m_mutex);
+        auto it{shard.m_map.find(header_hash)};
+        if (it != shard.m_map.end()) {
+            // Move the entry to the most recently used end.
+            shard.m_lru.splice(shard.m_lru.end(), shard.m_lru, it->second);
+            ++m_memory_hits;
+            TRACE1(pow, cache_lookup, 0);
+            return it->second->second;
+        }
+    }
+    if (auto store{GetStore()}) {
+        if (auto pow_hash{store->Read(header_hash)}) {
+            InsertMemory(header_hash, *pow_hash);
+            ++m_store_hits;
+            TRACE1(pow, cache_lookup, 1);
+            return pow_hash;
+        }
+    }
+    ++m_misses;
+    TRACE1(pow, cache_lookup, 2);
+    return std::nullopt;
+}
+
+void PowHashCache::Insert(const uint256& header_hash, const uint256& pow_hash)
+{
+    InsertMemory(header_hash, pow_hash);
+    if (auto store{GetStore()}) store->Write({header_hash, pow_hash});
+}
+
+void PowHashCache::Erase(const std::vector<uint256>& header_hashes)
+{
+    for (const uint256& header_hash : header_hashes) {
+        Shard& shard{GetShard(header_hash)};
+        LOCK(shard.m_mutex);
+        if (auto it{shard.m_map.find(header_hash)}; it != shard.m_map.end()) {
+            shard.m_lru.erase(it->second);
+            shard.m_map.erase(it);
+        }
+    }
+    if (auto store{GetStore()}) store->Erase(header_hashes);
+}
+
+void PowHashCache::Flush()
+{
+    if (auto store{GetStore()}) store->Flush();
+}
+
+size_t PowHashCache::Size() const
+{
+    size_t size{0};
+    for (const Shard& shard : m_shards) {
+        LOCK(shard.m_mutex);
+        size += shard.m_map.size();
+    }
+    return size;
+}
+
+PowHashCache::Stats PowHashCache::GetStats()
+{
+    Stats stats;
+    stats.memory_hits = m_memory_hits.load();
+    stats.store_hits = m_store_hits.load();
+    stats.misses = m_misses.load();
+    if (auto store{GetStore()}) {
+        stats.store_lock_wait = store->LockWaitTime();
+        stats.store_read_time = store->ReadTime();
+    }
+    return stats;
+}
+
+PowHashCache& GetPowHashCache()
+{
+    static PowHashCache g_pow_cache;
+    return g_pow_cache;
+}
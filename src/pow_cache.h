@@ -1,43 +1,203 @@
-#ifndef SQLITE_CACHE_H
-#define SQLITE_CACHE_H
-
-#include <mutex>
-#include <string>
-#include <sqlite3.h>
-#include <iostream>
-#include <util/fs.h>
-#include <common/args.h>
-#include <utility>
-
-class SQLiteCache {
-public:
-    // Constructor: Opens the SQLite database with the provided database name.
-    // If the database connection is already established, it won't re-open.
-    SQLiteCache(const std::string& dbName);
-
-    // Destructor: Does not close the database connection here, allowing shared use across threads.
-    ~SQLiteCache();
-
-    // Inserts or updates a key-value pair in the cache.
-    // Returns true on success, false on failure.
-    bool set(const std::string& key, const std::string& value);
-
-    // Retrieves the value associated with the given key.
-    // Returns an empty string if the key does not exist or on error.
-    std::string get(const std::string& key);
-
-private:
-    // Mutex to protect shared access to the SQLite database across threads.
-    static std::mutex db_mutex;
-
-    // Shared database connection across instances.
-    static sqlite3* db;
-
-    // Creates the cache table if it does not already exist.
-    void createTable();
-
-    // Set PRAGMA settings for database performance optimizations.
-    void setupPragmas();
-};
-
-#endif // SQLITE_CACHE_H
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_POW_CACHE_H
+#define BITCOIN_POW_CACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+#include <util/fs.h>
+#include <util/hasher.h>
+#include <util/time.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+//! Default memory budget for the in-memory PoW hash cache.
+static constexpr size_t DEFAULT_POW_CACHE_BYTES{32 << 20};
+//! Number of pending inserts after which the persistent store is written.
+static constexpr size_t POW_CACHE_WRITE_BATCH{512};
+//! Default number of entries kept in the persistent store (about 100 MiB on disk).
+static constexpr size_t DEFAULT_POW_CACHE_STORE_ENTRIES{1'000'000};
+
+/**
+ * Persistent backing store of the PoW hash cache.
+ *
+ * Entries map the 32-byte header hash to the 32-byte Flex PoW hash, both
+ * stored as raw blobs.  Statements are prepared once, and inserts and
+ * deletions are buffered and written in a single transaction.  Once the
+ * store holds more than its maximum number of entries, a tenth of them is
+ * dropped; as header hashes are uniformly distributed, dropping those with
+ * the lowest hashes drops random entries.  Reads do not
+ * wait for writes or for each other: each concurrent reader gets a read-only
+ * connection of its own, which the WAL journal lets run alongside the writer.
+ */
+class PowHashStore
+{
+public:
+    struct Entry {
+        uint256 header_hash;
+        uint256 pow_hash;
+    };
+
+    /** Open (or create) the store at the given path. */
+    explicit PowHashStore(const fs::path& path, size_t max_entries = DEFAULT_POW_CACHE_STORE_ENTRIES);
+    ~PowHashStore();
+
+    PowHashStore(const PowHashStore&) = delete;
+    PowHashStore& operator=(const PowHashStore&) = delete;
+
+    /** Whether the underlying database was opened successfully. */
+    bool IsOpen() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Read an entry. Entries that are queued but not written yet are not found. */
+    std::optional<uint256> Read(const uint256& header_hash) EXCLUSIVE_LOCKS_REQUIRED(!m_readers_mutex);
+    /** Queue an entry, writing the batch once POW_CACHE_WRITE_BATCH entries are pending. */
+    void Write(const Entry& entry) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    /** Remove the entries of the given header hashes on the next flush. */
+    void Erase(const std::vector<uint256>& header_hashes) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    /** Write all pending entries and apply pending deletions. */
+    bool Flush() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    /** Number of entries in the database, not counting pending ones. */
+    size_t Count() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Total time callers waited for the database or reader locks. */
+    std::chrono::nanoseconds LockWaitTime() const { return std::chrono::nanoseconds{m_lock_wait_ns.load()}; }
+    /** Total time spent in SQLite reads. */
+    std::chrono::nanoseconds ReadTime() const { return std::chrono::nanoseconds{m_read_ns.load()}; }
+
+private:
+    /** A read-only connection, used by one reader at a time. */
+    struct Reader {
+        sqlite3* db{nullptr};
+        sqlite3_stmt* stmt{nullptr};
+    };
+
+    const fs::path m_path;
+    const size_t m_max_entries;
+    //! Whether the database was opened, set by the constructor only.
+    bool m_open{false};
+    Mutex m_mutex;
+    std::atomic<int64_t> m_lock_wait_ns{0};
+    std::atomic<int64_t> m_read_ns{0};
+    sqlite3* m_db GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_insert_stmt GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_erase_stmt GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_count_stmt GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_trim_stmt GUARDED_BY(m_mutex){nullptr};
+    //! Number of entries, counting replaced ones twice until the next trim recounts them.
+    size_t m_entries GUARDED_BY(m_mutex){0};
+    std::vector<Entry> m_pending GUARDED_BY(m_mutex);
+    std::vector<uint256> m_pending_erase GUARDED_BY(m_mutex);
+
+    Mutex m_readers_mutex;
+    //! Connections not in use by a reader. More are opened when all are busy.
+    std::vector<Reader> m_idle_readers GUARDED_BY(m_readers_mutex);
+
+    bool FlushLocked() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    std::optional<size_t> CountLocked() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    /** Drop entries if there are more than m_max_entries. Called within the flush transaction. */
+    bool TrimLocked() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    std::optional<Reader> OpenReader() const;
+    static void CloseReader(Reader& reader);
+    /** Account the time since wait_start, taken just before locking m_mutex. */
+    void RecordLockWait(SteadyClock::time_point wait_start);
+};
+
+/**
+ * Cache of Flex PoW hashes keyed by the header hash.
+ *
+ * Computing the Flex hash of a header is expensive, and the same header is
+ * checked many times (header sync, block connection, block reads from disk).
+ * Lookups are served from a sharded in-memory map so that concurrent callers
+ * only contend when they hit the same shard.  Each shard is bounded and
+ * evicts its least recently used entries first.  Misses fall through to an optional
+ * persistent store, which is attached once the data directory is known.
+ */
+class PowHashCache
+{
+public:
+    static constexpr size_t NUM_SHARDS{16};
+
+    /** Lookup counters since startup, see getpowstats. */
+    struct Stats {
+        uint64_t memory_hits{0};
+        uint64_t store_hits{0};
+        uint64_t misses{0};
+        //! Time spent waiting for the persistent store's locks.
+        std::chrono::nanoseconds store_lock_wait{0};
+        //! Time spent reading from the persistent store.
+        std::chrono::nanoseconds store_read_time{0};
+    };
+
+    explicit PowHashCache(size_t max_bytes = DEFAULT_POW_CACHE_BYTES);
+    ~PowHashCache();
+
+    PowHashCache(const PowHashCache&) = delete;
+    PowHashCache& operator=(const PowHashCache&) = delete;
+
+    /** Change the memory budget, evicting entries if it shrinks. */
+    void Resize(size_t max_bytes);
+    /** Attach a persistent store. Returns false if the store could not be opened. */
+    bool OpenStore(const fs::path& path, size_t max_entries = DEFAULT_POW_CACHE_STORE_ENTRIES);
+    /** Flush and detach the persistent store, if any. */
+    void CloseStore();
+
+    std::optional<uint256> Get(const uint256& header_hash);
+    void Insert(const uint256& header_hash, const uint256& pow_hash);
+
+    /** Drop the entries of the given header hashes, e.g. those of pruned blocks. */
+    void Erase(const std::vector<uint256>& header_hashes);
+    /** Write pending entries to the persistent store. */
+    void Flush();
+
+    /** Number of entries held in memory. */
+    size_t Size() const;
+    /** Approximate memory used per cached entry. */
+    static size_t EntryBytes();
+
+    Stats GetStats() EXCLUSIVE_LOCKS_REQUIRED(!m_store_mutex);
+
+private:
+    //! Header hash and PoW hash, in least recently used first order.
+    using LruList = std::list<std::pair<uint256, uint256>>;
+
+    struct Shard {
+        mutable Mutex m_mutex;
+        LruList m_lru GUARDED_BY(m_mutex);
+        std::unordered_map<uint256, LruList::iterator, BlockHasher> m_map GUARDED_BY(m_mutex);
+
+        void EvictTo(size_t max_entries) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    };
+
+    std::array<Shard, NUM_SHARDS> m_shards;
+    std::atomic<size_t> m_max_shard_entries;
+
+    std::atomic<uint64_t> m_memory_hits{0};
+    std::atomic<uint64_t> m_store_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+
+    Mutex m_store_mutex;
+    std::shared_ptr<PowHashStore> m_store GUARDED_BY(m_store_mutex);
+
+    Shard& GetShard(const uint256& header_hash) { return m_shards[header_hash.data()[31] % NUM_SHARDS]; }
+    std::shared_ptr<PowHashStore> GetStore() EXCLUSIVE_LOCKS_REQUIRED(!m_store_mutex);
+    void InsertMemory(const uint256& header_hash, const uint256& pow_hash);
+};
+
+/** Process-wide PoW hash cache used by CPureBlockHeader::GetPoWHash(). */
+PowHashCache& GetPowHashCache();
+
+#endif // BITCOIN_POW_CACHE_H
@@ -5,24 +5,104 @@
 
 #include <primitives/pureheader.h>
 
+#include <crypto/common.h>
+#include <crypto/flex/flex.h>
+#include <crypto/sha3.h>
 #include <hash.h>
+#include <pow_cache.h>
+#include <streams.h>
 #include <util/strencodings.h>
 
+#include <algorithm>
+#include <vector>
+
+namespace {
+//! Counted per thread, so that the hot path does not share a cache line between threads.
+thread_local BlockHashMemoStats g_hash_memo_stats;
+
+uint256 ComputeHash(const std::array<unsigned char, 80>& data, bool sha3)
+{
+    ++g_hash_memo_stats.computed;
+    if (!sha3) return Hash(data);
+    uint256 hash;
+    SHA3_256D80(hash.begin(), data.data(), 1);
+    return hash;
+}
+} // namespace
+
+BlockHashMemoStats GetBlockHashMemoStats()
+{
+    return g_hash_memo_stats;
+}
+
+std::array<unsigned char, 80> CPureBlockHeader::SerializeHash() const
+{
+    std::array<unsigned char, 80> data;
+    WriteLE32(data.data(), nVersion);
+    std::copy(hashPrevBlock.begin(), hashPrevBlock.end(), data.begin() + 4);
+    std::copy(hashMerkleRoot.begin(), hashMerkleRoot.end(), data.begin() + 36);
+    WriteLE32(data.data() + 68, nTime);
+    WriteLE32(data.data() + 72, nBits);
+    WriteLE32(data.data() + 76, nNonce);
+    return data;
+}
+
+std::optional<uint256> CPureBlockHeader::GetMemoizedHash(const std::array<unsigned char, 80>& data, bool sha3) const
+{
+    if (!m_memo_valid || m_memo_sha3 != sha3 || m_memo_data != data) return std::nullopt;
+    ++g_hash_memo_stats.hits;
+    return m_memo_hash;
+}
+
 uint256 CPureBlockHeader::GetHash() const
 {
-    if(nVersion & 0x8000) {
-        return (Hash3Writer{} << *this).GetHash();
-    } else {
-        return (HashWriter{} << *this).GetHash();
-    }
+    return GetHash(nVersion);
 }
 
 uint256 CPureBlockHeader::GetHash(int32_t nBlockVersion) const
 {
-    if(nBlockVersion & 0x8000) {
-        return (Hash3Writer{} << *this).GetHash();
-    } else {
-        return (HashWriter{} << *this).GetHash();
+    const bool sha3{(nBlockVersion & 0x8000) != 0};
+    const auto data{SerializeHash()};
+    if (auto memo{GetMemoizedHash(data, sha3)}) return *memo;
+    return ComputeHash(data, sha3);
+}
+
+void CPureBlockHeader::CacheHash(int32_t nBlockVersion)
+{
+    const bool sha3{(nBlockVersion & 0x8000) != 0};
+    const auto data{SerializeHash()};
+    if (GetMemoizedHash(data, sha3)) return;
+    m_memo_hash = ComputeHash(data, sha3);
+    m_memo_data = data;
+    m_memo_sha3 = sha3;
+    m_memo_valid = true;
+}
+
+void CPureBlockHeader::CacheHashes(Span<CPureBlockHeader* const> headers)
+{
+    std::vector<CPureBlockHeader*> sha3_headers;
+    std::vector<unsigned char> data;
+    for (CPureBlockHeader* header : headers) {
+        if (!(header->nVersion & 0x8000)) {
+            header->CacheHash();
+            continue;
+        }
+        const auto header_data{header->SerializeHash()};
+        if (header->GetMemoizedHash(header_data, /*sha3=*/true)) continue;
+        sha3_headers.push_back(header);
+        data.insert(data.end(), header_data.begin(), header_data.end());
+    }
+    if (sha3_headers.empty()) return;
+
+    std::vector<unsigned char> hash_data(sha3_headers.size() * uint256::size());
+    SHA3_256D80(hash_data.data(), data.data(), sha3_headers.size());
+    g_hash_memo_stats.computed += sha3_headers.size();
+    for (size_t i = 0; i < sha3_headers.size(); ++i) {
+        CPureBlockHeader& header{*sha3_headers[i]};
+        header.m_memo_hash = uint256{Span{hash_data}.subspan(i * uint256::size(), uint256::size())};
+        std::copy_n(data.begin() + i * header.m_memo_data.size(), header.m_memo_data.size(), header.m_memo_data.begin());
+        header.m_memo_sha3 = true;
+        header.m_memo_valid = true;
     }
 }
 
@@ -33,42 +113,73 @@ uint256 CPureBlockHeader::GetHash2() const
 
 uint256 CPureBlockHeader::GetPoWHash() const
 {
-    uint256 hash;
-    uint256 hash2;
-    std::string result;
-    hash = GetHash();
-    if(nVersion & 0x8000) {
-        SQLiteCache cache("cache.db");
-        result = cache.get(hash.ToString());
-        if(result == "") {
-            hash2 = GetHash2();
-            cache.set(hash.ToString(), hash2.ToString());
-        } else {
-            hash2 = uint256S(result);
-        }
-        return hash2;
-    }
-    return hash;
+    return GetPoWHash(nVersion);
 }
 
 uint256 CPureBlockHeader::GetPoWHash(int32_t nBlockVersion) const
 {
-    uint256 hash;
-    uint256 hash2;
-    std::string result;
-    hash = GetHash(nBlockVersion);
-    if(nBlockVersion & 0x8000) {
-        SQLiteCache cache("cache.db");
-        result = cache.get(hash.ToString());
-        if(result == "") {
-            hash2 = GetHash2();
-            cache.set(hash.ToString(), hash2.ToString());
-        } else {
-            hash2 = uint256S(result);
+    const uint256 hash{GetHash(nBlockVersion)};
+    if (!(nBlockVersion & 0x8000)) return hash;
+
+    PowHashCache& cache{GetPowHashCache()};
+    if (auto cached{cache.Get(hash)}) return *cached;
+    const uint256 hash2{GetHash2()};
+    cache.Insert(hash, hash2);
+    return hash2;
+}
+
+void CPureBlockHeader::CachePoWHashes(Span<const std::pair<const CPureBlockHeader*, int32_t>> headers)
+{
+    // Both the SHA3 block hash and the Flex hash cover the serialized 80-byte
+    // header, so serialize the SHA3 headers once and compute the block hashes
+    // that are not memoized as a batch.
+    std::vector<const CPureBlockHeader*> sha3_headers;
+    std::vector<unsigned char> data;
+    std::vector<std::optional<uint256>> hashes;
+    for (const auto& [header, nBlockVersion] : headers) {
+        if (!(nBlockVersion & 0x8000)) continue;
+        const auto header_data{header->SerializeHash()};
+        sha3_headers.push_back(header);
+        hashes.push_back(header->GetMemoizedHash(header_data, /*sha3=*/true));
+        data.insert(data.end(), header_data.begin(), header_data.end());
+    }
+    if (sha3_headers.empty()) return;
+    const size_t header_size{data.size() / sha3_headers.size()};
+
+    std::vector<size_t> unhashed;
+    std::vector<unsigned char> unhashed_data;
+    for (size_t i = 0; i < sha3_headers.size(); ++i) {
+        if (hashes[i]) continue;
+        unhashed.push_back(i);
+        unhashed_data.insert(unhashed_data.end(), data.begin() + i * header_size, data.begin() + (i + 1) * header_size);
+    }
+    if (!unhashed.empty()) {
+        std::vector<unsigned char> hash_data(unhashed.size() * uint256::size());
+        SHA3_256D80(hash_data.data(), unhashed_data.data(), unhashed.size());
+        g_hash_memo_stats.computed += unhashed.size();
+        for (size_t i = 0; i < unhashed.size(); ++i) {
+            hashes[unhashed[i]] = uint256{Span{hash_data}.subspan(i * uint256::size(), uint256::size())};
         }
-        return hash2;
     }
-    return hash;
+
+    PowHashCache& cache{GetPowHashCache()};
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < sha3_headers.size(); ++i) {
+        if (!cache.Get(*hashes[i])) pending.push_back(i);
+    }
+    if (pending.empty()) return;
+
+    std::vector<const char*> inputs(pending.size());
+    std::vector<uint256> pow_hashes(pending.size());
+    std::vector<unsigned char*> outputs(pending.size());
+    for (size_t i = 0; i < pending.size(); ++i) {
+        inputs[i] = reinterpret_cast<const char*>(data.data() + pending[i] * header_size);
+        outputs[i] = pow_hashes[i].begin();
+    }
+    flex_hash_multi(inputs.data(), header_size, outputs.data(), pending.size());
+    for (size_t i = 0; i < pending.size(); ++i) {
+        cache.Insert(*hashes[pending[i]], pow_hashes[i]);
+    }
 }
 
 void CPureBlockHeader::SetBaseVersion(int32_t nBaseVersion, int32_t nChainId)
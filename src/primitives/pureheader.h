@@ -6,11 +6,26 @@
 #ifndef BITCOIN_PRIMITIVES_PUREHEADER_H
 #define BITCOIN_PRIMITIVES_PUREHEADER_H
 
-#include <pow_cache.h>
 #include <serialize.h>
 #include <uint256.h>
 #include <util/time.h>
 
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+/** Counters of CPureBlockHeader::GetHash() calls, to measure the hash memo. */
+struct BlockHashMemoStats {
+    //! Hashes answered from the memo.
+    uint64_t hits{0};
+    //! Hashes computed from the header fields.
+    uint64_t computed{0};
+};
+
+/** Return the block hash memo counters of the calling thread. */
+BlockHashMemoStats GetBlockHashMemoStats();
+
 /**
  * A block header without auxpow information.  This "intermediate step"
  * in constructing the full header is useful, because it breaks the cyclic
@@ -28,6 +43,22 @@ private:
     /** Bits above are reserved for the auxpow chain ID.  */
     static const int32_t VERSION_CHAIN_START = (1 << 16);
 
+    /**
+     * Block hash remembered by CacheHash(), with the serialized header it was
+     * computed from. It is only returned while the header still serializes
+     * to m_memo_data, so changing any field invalidates it.
+     */
+    std::array<unsigned char, 80> m_memo_data{};
+    uint256 m_memo_hash;
+    bool m_memo_sha3{false};
+    bool m_memo_valid{false};
+
+    /** Serialize the header like SERIALIZE_METHODS, without a stream. */
+    std::array<unsigned char, 80> SerializeHash() const;
+
+    /** Return the memoized hash if it is still valid for these bytes and algorithm. */
+    std::optional<uint256> GetMemoizedHash(const std::array<unsigned char, 80>& data, bool sha3) const;
+
 public:
     // header
     int32_t nVersion;
@@ -61,10 +92,32 @@ public:
 
     uint256 GetHash() const;
     uint256 GetHash(int32_t nBlockVersion) const;
+
+    /**
+     * Opt in to memoizing the block hash (see GetHash(int32_t) for the
+     * version argument). Like the txid of a CTransaction, it is computed
+     * once here, so later GetHash() calls from validation, auxpow checks
+     * and logging are a compare instead of a double SHA256 or SHA3. Only
+     * call this where the header is not shared with other threads.
+     */
+    void CacheHash(int32_t nBlockVersion);
+    void CacheHash() { CacheHash(nVersion); }
+
+    /** CacheHash() several headers, computing their SHA3 hashes as a batch. */
+    static void CacheHashes(Span<CPureBlockHeader* const> headers);
     uint256 GetHash2() const;
     uint256 GetPoWHash() const;
     uint256 GetPoWHash(int32_t nBlockVersion) const;
 
+    /**
+     * Fill the PoW hash cache for several headers at once, each paired with
+     * the block version it is hashed under (see GetPoWHash(int32_t)).
+     * The SHA3 block hashes are computed as a batch with SHA3_256D80() and
+     * uncached Flex hashes are computed together with flex_hash_multi(), so
+     * later GetPoWHash() calls on these headers are cache hits.
+     */
+    static void CachePoWHashes(Span<const std::pair<const CPureBlockHeader*, int32_t>> headers);
+
     NodeSeconds Time() const
     {
         return NodeSeconds{std::chrono::seconds{nTime}};
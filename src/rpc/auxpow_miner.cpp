@@ -8,13 +8,16 @@
 #include <auxpow.h>
 #include <chainparams.h>
 #include <consensus/merkle.h>
+#include <logging.h>
 #include <net.h>
 #include <node/context.h>
+#include <primitives/transaction.h>
 #include <rpc/blockchain.h>
 #include <rpc/protocol.h>
 #include <rpc/request.h>
 #include <rpc/server_util.h>
 #include <util/strencodings.h>
+#include <util/thread.h>
 #include <util/time.h>
 #include <validation.h>
 
@@ -51,6 +54,40 @@ void auxMiningCheck(const node::NodeContext& node)
 
 }  // anonymous namespace
 
+const CBlock*
+AuxpowMiner::specialiseTemplate (const CScript& scriptPubKey)
+{
+  AssertLockHeld (cs);
+  assert (curTemplate != nullptr);
+
+  auto block = std::make_unique<CBlock> (curTemplate->block);
+  CMutableTransaction coinbase(*block->vtx[0]);
+  coinbase.vout[0].scriptPubKey = scriptPubKey;
+  block->vtx[0] = MakeTransactionRef (std::move (coinbase));
+  /* The witness commitment does not cover the coinbase, so only the
+     merkle root needs to be updated.  */
+  block->hashMerkleRoot = BlockMerkleRoot (*block);
+
+  const uint256 hash = block->GetHash ();
+  const CBlock* pblock = block.get ();
+  if (!blocks.emplace (hash, std::move (block)).second)
+    return blocks.at (hash).get ();
+  blockOrder.push_back (hash);
+
+  while (blocks.size () > MAX_AUXPOW_BLOCKS)
+    {
+      const auto iter = blocks.find (blockOrder.front ());
+      std::erase_if (curBlocks, [&iter] (const auto& entry)
+        {
+          return entry.second == iter->second.get ();
+        });
+      blocks.erase (iter);
+      blockOrder.pop_front ();
+    }
+
+  return pblock;
+}
+
 const CBlock*
 AuxpowMiner::getCurrentBlock (ChainstateManager& chainman, Mining& miner,
                               const CTxMemPool& mempool,
@@ -61,12 +98,7 @@ AuxpowMiner::getCurrentBlock (ChainstateManager& chainman, Mining& miner,
 
   {
     LOCK (cs_main);
-    CScriptID scriptID (scriptPubKey);
-    auto iter = curBlocks.find(scriptID);
-    if (iter != curBlocks.end())
-      pblockCur = iter->second;
-
-    if (pblockCur == nullptr
+    if (curTemplate == nullptr
         || pindexPrev != chainman.ActiveChain ().Tip ()
         || (mempool.GetTransactionsUpdated () != txUpdatedLast
             && GetTime () - startTime > 60))
@@ -75,14 +107,13 @@ AuxpowMiner::getCurrentBlock (ChainstateManager& chainman, Mining& miner,
           {
             /* Clear old blocks since they're obsolete now.  */
             blocks.clear ();
-            templates.clear ();
-            curBlocks.clear ();
+            blockOrder.clear ();
           }
 
-        /* Create new block with nonce = 0 and extraNonce = 1.  */
-        std::unique_ptr<node::CBlockTemplate> newBlock
+        /* Select transactions once for all payout scripts.  */
+        std::unique_ptr<node::CBlockTemplate> newTemplate
             = miner.createNewBlock (scriptPubKey);
-        if (newBlock == nullptr)
+        if (newTemplate == nullptr)
           throw JSONRPCError (RPC_OUT_OF_MEMORY, "out of memory");
 
         /* Update state only when CreateNewBlock succeeded.  */
@@ -90,23 +121,19 @@ AuxpowMiner::getCurrentBlock (ChainstateManager& chainman, Mining& miner,
         pindexPrev = chainman.ActiveTip ();
         startTime = GetTime ();
 
-        /* Finalise it by setting the version and building the merkle root.  */
-        newBlock->block.hashMerkleRoot = BlockMerkleRoot (newBlock->block);
-        newBlock->block.SetAuxpowVersion (true);
-
-        /* Save in our map of constructed blocks.  */
-        pblockCur = &newBlock->block;
-        curBlocks.emplace(scriptID, pblockCur);
-        blocks[pblockCur->GetHash ()] = pblockCur;
-        templates.push_back (std::move (newBlock));
+        newTemplate->block.SetAuxpowVersion (true);
+        curTemplate = std::move (newTemplate);
+        curBlocks.clear ();
       }
+
+    const CScriptID scriptID(scriptPubKey);
+    auto iter = curBlocks.find (scriptID);
+    if (iter == curBlocks.end ())
+      iter = curBlocks.emplace (scriptID,
+                                specialiseTemplate (scriptPubKey)).first;
+    pblockCur = iter->second;
   }
 
-  /* At this point, pblockCur is always initialised:  If we make it here
-     without creating a new block above, it means that, in particular,
-     pindexPrev == ::ChainActive ().Tip().  But for that to happen, we must
-     already have created a pblockCur in a previous call, as pindexPrev is
-     initialised only when pblockCur is.  */
   assert (pblockCur);
 
   arith_uint256 arithTarget;
@@ -130,7 +157,7 @@ AuxpowMiner::lookupSavedBlock (const std::string& hashHex) const
   if (iter == blocks.end ())
     throw JSONRPCError (RPC_INVALID_PARAMETER, "block hash unknown");
 
-  return iter->second;
+  return iter->second.get ();
 }
 
 UniValue
@@ -148,6 +175,7 @@ AuxpowMiner::createAuxBlock (const JSONRPCRequest& request,
   uint256 target;
   const CBlock* pblock = getCurrentBlock (chainman, mining, mempool,
                                           scriptPubKey, target);
+  addNotifyScript (scriptPubKey, pblock->GetHash ());
 
   UniValue result(UniValue::VOBJ);
   result.pushKV ("hash", pblock->GetHash ().GetHex ());
@@ -183,12 +211,100 @@ AuxpowMiner::submitAuxBlock (const JSONRPCRequest& request,
   std::unique_ptr<CAuxPow> pow(new CAuxPow ());
   ss >> *pow;
   shared_block->SetAuxpow (std::move (pow));
+  shared_block->CacheHash ();
   assert (shared_block->GetHash ().GetHex () == hashHex);
 
   return chainman.ProcessNewBlock (shared_block, /*force_processing=*/true,
                                    /*min_pow_checked=*/true, nullptr);
 }
 
+AuxpowMiner::~AuxpowMiner ()
+{
+  stopWorkNotifier ();
+}
+
+void
+AuxpowMiner::addNotifyScript (const CScript& scriptPubKey, const uint256& hash)
+{
+  AssertLockHeld (cs);
+
+  std::erase_if (notifyScripts, [&scriptPubKey] (const auto& entry)
+    {
+      return entry.first == scriptPubKey;
+    });
+  notifyScripts.emplace_back (scriptPubKey, hash);
+  if (notifyScripts.size () > MAX_AUXPOW_NOTIFY_SCRIPTS)
+    notifyScripts.pop_front ();
+}
+
+void
+AuxpowMiner::startWorkNotifier (const node::NodeContext& node,
+                                WorkNotifier notifier)
+{
+  WITH_LOCK (cs, workNotifier = std::move (notifier));
+  WITH_LOCK (workThreadMutex, stopWorkThread = false);
+  workThread = std::thread (&util::TraceThread, "auxwork", [this, &node] {
+    WAIT_LOCK (workThreadMutex, lock);
+    while (!workThreadCv.wait_for (lock, AUXPOW_REFRESH_INTERVAL,
+                                   [this] () EXCLUSIVE_LOCKS_REQUIRED (workThreadMutex) { return stopWorkThread; }))
+      {
+        REVERSE_LOCK (lock);
+        refreshWork (node);
+      }
+  });
+}
+
+void
+AuxpowMiner::stopWorkNotifier ()
+{
+  if (!workThread.joinable ())
+    return;
+  WITH_LOCK (workThreadMutex, stopWorkThread = true);
+  workThreadCv.notify_all ();
+  workThread.join ();
+  WITH_LOCK (cs, workNotifier = nullptr);
+}
+
+void
+AuxpowMiner::refreshWork (const node::NodeContext& node)
+{
+  LOCK (cs);
+  if (!workNotifier || notifyScripts.empty () || !node.chainman
+        || !node.mempool || !node.mining)
+    return;
+  if (node.chainman->IsInitialBlockDownload ())
+    return;
+
+  /* The first script rebuilds the template if needed, the others only
+     get their coinbase swapped in.  */
+  for (auto& [scriptPubKey, lastNotified] : notifyScripts)
+    {
+      uint256 target;
+      const CBlock* pblock;
+      try
+        {
+          pblock = getCurrentBlock (*node.chainman, *node.mining,
+                                    *node.mempool, scriptPubKey, target);
+        }
+      catch (const UniValue& e)
+        {
+          LogPrintf ("%s: %s\n", __func__, e["message"].getValStr ());
+          return;
+        }
+      catch (const std::exception& e)
+        {
+          LogPrintf ("%s: %s\n", __func__, e.what ());
+          return;
+        }
+
+      const uint256 hash = pblock->GetHash ();
+      if (hash == lastNotified)
+        continue;
+      lastNotified = hash;
+      workNotifier (scriptPubKey, hash, target, pblock->GetChainId ());
+    }
+}
+
 AuxpowMiner&
 AuxpowMiner::get ()
 {
@@ -14,14 +14,21 @@
 #include <uint256.h>
 #include <univalue.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 class ChainstateManager;
 namespace node {
 class CBlockTemplate;
+struct NodeContext;
 } // namespace node
 
 namespace auxpow_tests
@@ -29,6 +36,21 @@ namespace auxpow_tests
 class AuxpowMinerForTest;
 }
 
+/**
+ * Maximum number of constructed blocks AuxpowMiner keeps around for
+ * submitauxblock.  The oldest ones are forgotten first.
+ */
+static constexpr size_t MAX_AUXPOW_BLOCKS = 1000;
+
+/** How often AuxpowMiner::refreshWork is run when work is pushed.  */
+static constexpr auto AUXPOW_REFRESH_INTERVAL = std::chrono::seconds {1};
+
+/**
+ * Maximum number of payout scripts AuxpowMiner pushes work for.  Those of the
+ * most recent createauxblock calls are kept.
+ */
+static constexpr size_t MAX_AUXPOW_NOTIFY_SCRIPTS = 16;
+
 /**
  * This class holds "global" state used to construct blocks for the auxpow
  * mining RPCs and the map of already constructed blocks to look them up
@@ -40,25 +62,70 @@ class AuxpowMinerForTest;
 class AuxpowMiner
 {
 
+public:
+
+  /**
+   * Callback that is told about new work:  The payout script, the block hash,
+   * the target and the chain ID.
+   */
+  using WorkNotifier
+      = std::function<void (const CScript&, const uint256&, const uint256&,
+                            int32_t)>;
+
 private:
 
   /** The lock used for state in this object.  */
   mutable RecursiveMutex cs;
-  /** All currently "active" block templates.  */
-  std::vector<std::unique_ptr<node::CBlockTemplate>> templates;
-  /** Maps block hashes to pointers in vTemplates.  Does not own the memory.  */
-  std::map<uint256, const CBlock*> blocks;
-  /** Maps coinbase script hashes to pointers in vTemplates.  Does not own the memory.  */
+  /**
+   * Block template with the current transaction selection.  It is shared by
+   * all payout scripts; only the coinbase differs between their blocks.
+   */
+  std::unique_ptr<node::CBlockTemplate> curTemplate;
+  /** Constructed blocks by hash, so that they can be submitted.  */
+  std::map<uint256, std::unique_ptr<const CBlock>> blocks;
+  /** Hashes in blocks in the order they were constructed, for eviction.  */
+  std::deque<uint256> blockOrder;
+  /** Maps coinbase script hashes to blocks built from curTemplate.  */
   std::map<CScriptID, const CBlock*> curBlocks;
 
-  /** The current extra nonce for block creation.  */
-  unsigned extraNonce = 0;
-
-  /* Some data about when the current block (pblock) was constructed.  */
+  /* Some data about when the current template was constructed.  */
   unsigned txUpdatedLast;
   const CBlockIndex* pindexPrev = nullptr;
   uint64_t startTime;
 
+  /**
+   * Payout scripts of recent createauxblock calls, the most recent last,
+   * with the hash of the block last passed to workNotifier for each.
+   */
+  std::deque<std::pair<CScript, uint256>> notifyScripts;
+
+  /** Called by refreshWork with new work.  */
+  WorkNotifier workNotifier;
+
+  /**
+   * The thread running refreshWork.  Building a block template takes a
+   * while, so it gets a thread of its own rather than holding up the
+   * scheduler and the validation callbacks that run there.
+   */
+  std::thread workThread;
+  Mutex workThreadMutex;
+  std::condition_variable workThreadCv;
+  bool stopWorkThread GUARDED_BY (workThreadMutex) = false;
+
+  /**
+   * Remembers scriptPubKey as one to push work for, with hash as the block
+   * its miner already knows about.
+   */
+  void addNotifyScript (const CScript& scriptPubKey, const uint256& hash)
+      EXCLUSIVE_LOCKS_REQUIRED (cs);
+
+  /**
+   * Builds the block for the given payout script from curTemplate by
+   * replacing the coinbase output and merkle root, and saves it.
+   */
+  const CBlock* specialiseTemplate (const CScript& scriptPubKey)
+      EXCLUSIVE_LOCKS_REQUIRED (cs);
+
   /**
    * Constructs a new current block if necessary (checking the current state to
    * see if "enough changed" for this), and returns a pointer to the block
@@ -83,6 +150,7 @@ private:
 public:
 
   AuxpowMiner () = default;
+  ~AuxpowMiner ();
 
   /**
    * Performs the main work for the "createauxblock" RPC:  Construct a new block
@@ -102,6 +170,26 @@ public:
                        const std::string& hashHex,
                        const std::string& auxpowHex) const;
 
+  /**
+   * Starts a thread that runs refreshWork every AUXPOW_REFRESH_INTERVAL
+   * and passes new work to notifier.
+   */
+  void startWorkNotifier (const node::NodeContext& node,
+                          WorkNotifier notifier);
+
+  /**
+   * Stops the thread started by startWorkNotifier, if any.
+   */
+  void stopWorkNotifier ();
+
+  /**
+   * Builds new work if getCurrentBlock would do so now (after a tip change
+   * or once the mempool refresh interval passed) for the payout scripts of
+   * the recent createauxblock calls, and passes the blocks that changed to
+   * the work notifier.  Does nothing until createauxblock was called once.
+   */
+  void refreshWork (const node::NodeContext& node);
+
   /**
    * Returns the singleton instance of AuxpowMiner that is used for RPCs.
    */
@@ -5,9 +5,11 @@
 
 #include <config/bitcoin-config.h> // IWYU pragma: keep
 
+#include <auxpow.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <chainparamsbase.h>
+#include <common/args.h>
 #include <common/system.h>
 #include <consensus/amount.h>
 #include <consensus/consensus.h>
@@ -15,6 +17,7 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/flex/flex.h>
 #include <deploymentinfo.h>
 #include <deploymentstatus.h>
 #include <interfaces/mining.h>
@@ -24,6 +27,7 @@
 #include <node/miner.h>
 #include <node/warnings.h>
 #include <pow.h>
+#include <pow_cache.h>
 #include <rpc/auxpow_miner.h>
 #include <rpc/blockchain.h>
 #include <rpc/mining.h>
@@ -43,6 +47,8 @@
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <atomic>
+#include <chrono>
 #include <stdint.h>
 #include <string>
 #include <utility>
@@ -52,6 +58,7 @@ using node::CBlockTemplate;
 using interfaces::Mining;
 using node::NodeContext;
 using node::RegenerateCommitments;
+using node::SearchNonce;
 using node::UpdateTime;
 using util::ToString;
 
@@ -132,23 +139,35 @@ static RPCHelpMan getnetworkhashps()
     };
 }
 
-static bool GenerateBlock(ChainstateManager& chainman, Mining& miner, CBlock& block, uint64_t& max_tries, std::shared_ptr<const CBlock>& block_out, bool process_new_block)
+/** Hash rate of the most recent generate* nonce search, reported by getmininginfo. */
+static std::atomic<double> g_generate_hashps{0.0};
+
+/** Number of threads the generate* RPCs search nonces with, see -generatethreads. */
+static int GetGenerateThreads(const std::any& context)
+{
+    const int threads{static_cast<int>(EnsureAnyArgsman(context).GetIntArg("-generatethreads", node::DEFAULT_GENERATE_THREADS))};
+    return threads > 0 ? threads : std::max(GetNumCores(), 1);
+}
+
+static bool GenerateBlock(ChainstateManager& chainman, Mining& miner, CBlock& block, uint64_t& max_tries, std::shared_ptr<const CBlock>& block_out, bool process_new_block, int threads)
 {
     block_out.reset();
     block.hashMerkleRoot = BlockMerkleRoot(block);
 
+    // The parent block's proof of work is hashed under the version of the
+    // block itself, which selects the Flex hash once it is active.
     auto& miningHeader = CAuxPow::initAuxPow(block);
-    while (max_tries > 0 && miningHeader.nNonce < std::numeric_limits<uint32_t>::max() && !CheckProofOfWork(miningHeader.GetHash(), block.nBits, chainman.GetConsensus()) && !chainman.m_interrupt) {
-        ++miningHeader.nNonce;
-        --max_tries;
-    }
+    const auto search{SearchNonce(miningHeader, block.nVersion, block.nBits, chainman.GetConsensus(), max_tries, threads, chainman.m_interrupt)};
+    max_tries -= search.tries;
+    g_generate_hashps = search.HashRate();
     if (max_tries == 0 || chainman.m_interrupt) {
         return false;
     }
-    if (miningHeader.nNonce == std::numeric_limits<uint32_t>::max()) {
+    if (!search.found) {
         return true;
     }
 
+    block.CacheHash();
     block_out = std::make_shared<const CBlock>(block);
 
     if (!process_new_block) return true;
@@ -160,7 +179,7 @@ static bool GenerateBlock(ChainstateManager& chainman, Mining& miner, CBlock& bl
     return true;
 }
 
-static UniValue generateBlocks(ChainstateManager& chainman, Mining& miner, const CScript& coinbase_script, int nGenerate, uint64_t nMaxTries)
+static UniValue generateBlocks(ChainstateManager& chainman, Mining& miner, const CScript& coinbase_script, int nGenerate, uint64_t nMaxTries, int threads)
 {
     UniValue blockHashes(UniValue::VARR);
     while (nGenerate > 0 && !chainman.m_interrupt) {
@@ -169,7 +188,7 @@ static UniValue generateBlocks(ChainstateManager& chainman, Mining& miner, const
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
 
         std::shared_ptr<const CBlock> block_out;
-        if (!GenerateBlock(chainman, miner, pblocktemplate->block, nMaxTries, block_out, /*process_new_block=*/true)) {
+        if (!GenerateBlock(chainman, miner, pblocktemplate->block, nMaxTries, block_out, /*process_new_block=*/true, threads)) {
             break;
         }
 
@@ -248,7 +267,7 @@ static RPCHelpMan generatetodescriptor()
     Mining& miner = EnsureMining(node);
     ChainstateManager& chainman = EnsureChainman(node);
 
-    return generateBlocks(chainman, miner, coinbase_script, num_blocks, max_tries);
+    return generateBlocks(chainman, miner, coinbase_script, num_blocks, max_tries, GetGenerateThreads(request.context));
 },
     };
 }
@@ -296,7 +315,7 @@ static RPCHelpMan generatetoaddress()
 
     CScript coinbase_script = GetScriptForDestination(destination);
 
-    return generateBlocks(chainman, miner, coinbase_script, num_blocks, max_tries);
+    return generateBlocks(chainman, miner, coinbase_script, num_blocks, max_tries, GetGenerateThreads(request.context));
 },
     };
 }
@@ -397,7 +416,7 @@ static RPCHelpMan generateblock()
     std::shared_ptr<const CBlock> block_out;
     uint64_t max_tries{DEFAULT_MAX_TRIES};
 
-    if (!GenerateBlock(chainman, miner, block, max_tries, block_out, process_new_block) || !block_out) {
+    if (!GenerateBlock(chainman, miner, block, max_tries, block_out, process_new_block, GetGenerateThreads(request.context)) || !block_out) {
         throw JSONRPCError(RPC_MISC_ERROR, "Failed to make block.");
     }
 
@@ -426,6 +445,7 @@ static RPCHelpMan getmininginfo()
                         {RPCResult::Type::NUM, "currentblocktx", /*optional=*/true, "The number of block transactions of the last assembled block (only present if a block was ever assembled)"},
                         {RPCResult::Type::NUM, "difficulty", "The current difficulty"},
                         {RPCResult::Type::NUM, "networkhashps", "The network hashes per second"},
+                        {RPCResult::Type::NUM, "generatehashps", "The hashes per second of the last generate RPC nonce search (0 if none ran yet)"},
                         {RPCResult::Type::NUM, "pooledtx", "The size of the mempool"},
                         {RPCResult::Type::STR, "chain", "current network name (" LIST_CHAIN_NAMES ")"},
                         (IsDeprecatedRPCEnabled("warnings") ?
@@ -455,6 +475,7 @@ static RPCHelpMan getmininginfo()
     if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
     obj.pushKV("difficulty",       (double)GetDifficultyForBits(active_chain.Tip()->nBits));
     obj.pushKV("networkhashps",    getnetworkhashps().HandleRequest(request));
+    obj.pushKV("generatehashps",   g_generate_hashps.load());
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain", chainman.GetParams().GetChainTypeString());
     obj.pushKV("warnings", node::GetWarningsForRpc(*CHECK_NONFATAL(node.warnings), IsDeprecatedRPCEnabled("warnings")));
@@ -1039,6 +1060,7 @@ static RPCHelpMan submitblock()
     if (!DecodeHexBlk(block, request.params[0].get_str())) {
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
     }
+    block.CacheHash();
 
     if (block.vtx.empty() || !block.vtx[0]->IsCoinBase()) {
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block does not start with a coinbase");
@@ -1125,6 +1147,105 @@ static RPCHelpMan submitheader()
     };
 }
 
+static RPCHelpMan getpowstats()
+{
+    return RPCHelpMan{"getpowstats",
+                "\nReturns counters about proof-of-work hashing and auxpow verification since startup.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "flex", "Flex hashes",
+                        {
+                            {RPCResult::Type::BOOL, "timing", "whether hashes are being timed (-powtiming); times and histograms only cover timed hashes"},
+                            {RPCResult::Type::NUM, "hashes", "number of Flex hashes computed"},
+                            {RPCResult::Type::NUM, "total_us", "time spent computing them, in microseconds"},
+                            {RPCResult::Type::OBJ_DYN, "cryptonight", "CryptoNight steps by variant",
+                            {
+                                {RPCResult::Type::OBJ, "variant", "",
+                                {
+                                    {RPCResult::Type::NUM, "count", "number of steps"},
+                                    {RPCResult::Type::NUM, "total_us", "time spent in them, in microseconds"},
+                                    {RPCResult::Type::ARR, "histogram", "step counts by latency; entry i counts steps below 2^i microseconds and the last entry also counts slower ones",
+                                        {{RPCResult::Type::NUM, "", ""}}},
+                                }},
+                            }},
+                        }},
+                        {RPCResult::Type::OBJ, "powcache", "PoW hash cache",
+                        {
+                            {RPCResult::Type::NUM, "entries", "entries held in memory"},
+                            {RPCResult::Type::NUM, "memory_hits", "lookups served from memory"},
+                            {RPCResult::Type::NUM, "store_hits", "lookups served from the on-disk store"},
+                            {RPCResult::Type::NUM, "misses", "lookups that found nothing"},
+                            {RPCResult::Type::NUM, "store_lock_wait_us", "time spent waiting for the on-disk store's lock, in microseconds"},
+                            {RPCResult::Type::NUM, "store_read_us", "time spent reading the on-disk store, in microseconds"},
+                        }},
+                        {RPCResult::Type::OBJ, "auxpow", "auxpow verification",
+                        {
+                            {RPCResult::Type::NUM, "checks", "number of auxpows checked"},
+                            {RPCResult::Type::NUM, "failures", "number of auxpows that failed the check"},
+                            {RPCResult::Type::NUM, "total_us", "time spent checking them, in microseconds"},
+                            {RPCResult::Type::NUM, "header_memory_reads", "auxpows of block headers served from memory"},
+                            {RPCResult::Type::NUM, "header_db_reads", "auxpows of block headers read from the block index database"},
+                            {RPCResult::Type::NUM, "header_disk_reads", "auxpows of block headers read from the block files"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getpowstats", "")
+            + HelpExampleRpc("getpowstats", "")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const ChainstateManager& chainman = EnsureAnyChainman(request.context);
+    const auto to_us{[](auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); }};
+
+    const FlexStats flex_stats{GetFlexStats()};
+    UniValue flex(UniValue::VOBJ);
+    flex.pushKV("timing", flex_stats.timing);
+    flex.pushKV("hashes", flex_stats.hashes);
+    flex.pushKV("total_us", flex_stats.total_ns / 1000);
+    UniValue cryptonight(UniValue::VOBJ);
+    for (const FlexCNStats& cn : flex_stats.cn) {
+        UniValue variant(UniValue::VOBJ);
+        variant.pushKV("count", cn.count);
+        variant.pushKV("total_us", cn.total_ns / 1000);
+        UniValue histogram(UniValue::VARR);
+        for (const uint64_t n : cn.histogram) {
+            histogram.push_back(n);
+        }
+        variant.pushKV("histogram", std::move(histogram));
+        cryptonight.pushKV(cn.name, std::move(variant));
+    }
+    flex.pushKV("cryptonight", std::move(cryptonight));
+
+    PowHashCache& pow_cache{GetPowHashCache()};
+    const PowHashCache::Stats cache_stats{pow_cache.GetStats()};
+    UniValue powcache(UniValue::VOBJ);
+    powcache.pushKV("entries", uint64_t(pow_cache.Size()));
+    powcache.pushKV("memory_hits", cache_stats.memory_hits);
+    powcache.pushKV("store_hits", cache_stats.store_hits);
+    powcache.pushKV("misses", cache_stats.misses);
+    powcache.pushKV("store_lock_wait_us", to_us(cache_stats.store_lock_wait));
+    powcache.pushKV("store_read_us", to_us(cache_stats.store_read_time));
+
+    const AuxpowCheckStats check_stats{CAuxPow::getCheckStats()};
+    UniValue auxpow(UniValue::VOBJ);
+    auxpow.pushKV("checks", check_stats.checks);
+    auxpow.pushKV("failures", check_stats.failures);
+    auxpow.pushKV("total_us", check_stats.total_ns / 1000);
+    auxpow.pushKV("header_memory_reads", chainman.m_blockman.AuxpowMemoryReads());
+    auxpow.pushKV("header_db_reads", chainman.m_blockman.AuxpowDBReads());
+    auxpow.pushKV("header_disk_reads", chainman.m_blockman.AuxpowDiskReads());
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("flex", std::move(flex));
+    obj.pushKV("powcache", std::move(powcache));
+    obj.pushKV("auxpow", std::move(auxpow));
+    return obj;
+},
+    };
+}
+
 /* ************************************************************************** */
 /* Merge mining.  */
 
@@ -1207,6 +1328,7 @@ void RegisterMiningRPCCommands(CRPCTable& t)
         {"mining", &getblocktemplate},
         {"mining", &submitblock},
         {"mining", &submitheader},
+        {"mining", &getpowstats},
 
         {"mining", &createauxblock},
         {"mining", &submitauxblock},
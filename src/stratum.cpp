@@ -0,0 +1,856 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <chain.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <interfaces/mining.h>
+#include <key_io.h>
+#include <logging.h>
+#include <netaddress.h>
+#include <node/interface_ui.h>
+#include <node/miner.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <script/script.h>
+#include <serialize.h>
+#include <streams.h>
+#include <sync.h>
+#include <tinyformat.h>
+#include <univalue.h>
+#include <util/strencodings.h>
+#include <util/thread.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/signals2/connection.hpp>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <variant>
+
+const std::string DEFAULT_STRATUM_BIND = "127.0.0.1";
+
+/** Maximum length of a line received from a miner. */
+static const size_t MAX_LINE_LENGTH = 16 * 1024;
+/** Jobs a connection keeps around for late shares. */
+static const size_t MAX_CLIENT_JOBS = 8;
+/** Shares a connection remembers to detect duplicates. */
+static const size_t MAX_CLIENT_SHARES = 1024;
+/**
+ * Shares a connection may submit per second, and at once after a quiet
+ * period. Every share costs a Flex hash on the worker thread.
+ */
+static constexpr double MAX_CLIENT_SHARE_RATE{10};
+static constexpr double MAX_CLIENT_SHARE_BURST{50};
+/** Shares of all connections waiting to be hashed before new ones are refused. */
+static const size_t MAX_PENDING_SHARES = 256;
+/** How often the template is checked for updates. */
+static constexpr auto REFRESH_INTERVAL = std::chrono::seconds{1};
+/** Minimum age of a template before mempool changes replace it. */
+static constexpr auto TEMPLATE_MIN_AGE = std::chrono::seconds{60};
+
+/****** Jobs ********/
+
+StratumJob StratumJob::Create(std::string id, const CBlock& block, const CScript& payout)
+{
+    StratumJob job;
+    job.id = std::move(id);
+    job.block = block;
+
+    // Keep the BIP34 height push and append a zeroed extranonce to it.
+    CMutableTransaction coinbase{*block.vtx[0]};
+    coinbase.vout[0].scriptPubKey = payout;
+    const CScript& script_sig{coinbase.vin[0].scriptSig};
+    CScript::const_iterator pc{script_sig.begin()};
+    opcodetype opcode;
+    script_sig.GetOp(pc, opcode);
+    CScript new_script_sig(script_sig.begin(), pc);
+    new_script_sig << std::vector<unsigned char>(STRATUM_EXTRANONCE_SIZE, 0);
+    coinbase.vin[0].scriptSig = new_script_sig;
+
+    DataStream stream;
+    stream << TX_NO_WITNESS(coinbase);
+    // Version, input count and prevout come before the scriptSig.
+    const size_t offset{4 + 1 + 36 + GetSizeOfCompactSize(new_script_sig.size()) + new_script_sig.size() - STRATUM_EXTRANONCE_SIZE};
+    const auto data{MakeUCharSpan(stream)};
+    job.coinb1.assign(data.begin(), data.begin() + offset);
+    job.coinb2.assign(data.begin() + offset + STRATUM_EXTRANONCE_SIZE, data.end());
+
+    job.block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    job.block.hashMerkleRoot = BlockMerkleRoot(job.block);
+
+    // The sibling at each level of the tree never depends on the coinbase.
+    std::vector<uint256> level;
+    level.reserve(job.block.vtx.size());
+    for (const auto& tx : job.block.vtx) {
+        level.push_back(tx->GetHash().ToUint256());
+    }
+    while (level.size() > 1) {
+        job.merkle_branch.push_back(level[1]);
+        if (level.size() & 1) level.push_back(level.back());
+        for (size_t i = 0; i < level.size() / 2; ++i) {
+            level[i] = Hash(level[2 * i], level[2 * i + 1]);
+        }
+        level.resize(level.size() / 2);
+    }
+    return job;
+}
+
+bool StratumJob::BuildBlock(Span<const unsigned char> extranonce, uint32_t time, uint32_t nonce, CBlock& out) const
+{
+    if (extranonce.size() != STRATUM_EXTRANONCE_SIZE) return false;
+
+    std::vector<unsigned char> data{coinb1};
+    data.insert(data.end(), extranonce.begin(), extranonce.end());
+    data.insert(data.end(), coinb2.begin(), coinb2.end());
+    CMutableTransaction coinbase;
+    SpanReader{data} >> TX_NO_WITNESS(coinbase);
+    coinbase.vin[0].scriptWitness = block.vtx[0]->vin[0].scriptWitness;
+
+    out = block;
+    out.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    uint256 root{out.vtx[0]->GetHash().ToUint256()};
+    for (const uint256& hash : merkle_branch) {
+        root = Hash(root, hash);
+    }
+    out.hashMerkleRoot = root;
+    out.nTime = time;
+    out.nNonce = nonce;
+    return true;
+}
+
+/** Hash as miners expect it: each 32-bit word byte-swapped. */
+static std::string StratumHash(const uint256& hash)
+{
+    std::vector<unsigned char> data(hash.begin(), hash.end());
+    for (size_t i = 0; i < data.size(); i += 4) {
+        std::reverse(data.begin() + i, data.begin() + i + 4);
+    }
+    return HexStr(data);
+}
+
+UniValue StratumJob::NotifyParams(bool clean_jobs) const
+{
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : merkle_branch) {
+        branch.push_back(HexStr(hash));
+    }
+
+    UniValue params(UniValue::VARR);
+    params.push_back(id);
+    params.push_back(StratumHash(block.hashPrevBlock));
+    params.push_back(HexStr(coinb1));
+    params.push_back(HexStr(coinb2));
+    params.push_back(std::move(branch));
+    params.push_back(strprintf("%08x", static_cast<uint32_t>(block.nVersion)));
+    params.push_back(strprintf("%08x", block.nBits));
+    params.push_back(strprintf("%08x", block.nTime));
+    params.push_back(clean_jobs);
+    return params;
+}
+
+arith_uint256 StratumShareTarget(double difficulty)
+{
+    // The difficulty 1 target is 0xffff * 2^208, so the share target is
+    // 0xffff / difficulty * 2^208.
+    int exp;
+    const double frac{std::frexp(0xffff / difficulty, &exp)};
+    const int shift{208 + exp - 53};
+    if (shift >= 256 - 53) return ~arith_uint256{};
+    arith_uint256 target{static_cast<uint64_t>(std::ldexp(frac, 53))};
+    if (shift >= 0) {
+        target <<= shift;
+    } else {
+        target >>= -shift;
+    }
+    return target;
+}
+
+/****** Server ********/
+
+namespace {
+
+/** Error codes of the Stratum protocol. */
+enum StratumErrorCode {
+    STRATUM_ERROR_OTHER = 20,
+    STRATUM_ERROR_JOB_NOT_FOUND = 21,
+    STRATUM_ERROR_DUPLICATE_SHARE = 22,
+    STRATUM_ERROR_LOW_DIFFICULTY = 23,
+    STRATUM_ERROR_UNAUTHORIZED = 24,
+    STRATUM_ERROR_NOT_SUBSCRIBED = 25,
+};
+
+struct StratumError {
+    StratumErrorCode code;
+    std::string message;
+};
+
+struct StratumClient {
+    //! Identifies the connection to replies that are sent later.
+    uint64_t id{0};
+    struct bufferevent* bev{nullptr};
+    std::string peer;
+    std::vector<unsigned char> extranonce1;
+    bool subscribed{false};
+    bool authorized{false};
+    CScript payout;
+    //! Jobs sent to this connection, newest last.
+    std::deque<std::shared_ptr<const StratumJob>> jobs;
+    //! Low 64 bits of the block hashes of the last accepted shares, oldest
+    //! overwritten first. A collision only rejects a share as a duplicate.
+    std::vector<uint64_t> shares;
+    size_t next_share{0};
+    //! Shares the connection may submit before it has to slow down.
+    double share_allowance{MAX_CLIENT_SHARE_BURST};
+    NodeClock::time_point share_allowance_time{NodeClock::now()};
+
+    ~StratumClient()
+    {
+        if (bev) bufferevent_free(bev);
+    }
+
+    bool HasShare(const uint256& hash) const
+    {
+        return std::find(shares.begin(), shares.end(), hash.GetUint64(0)) != shares.end();
+    }
+
+    void AddShare(const uint256& hash)
+    {
+        if (shares.size() < MAX_CLIENT_SHARES) {
+            shares.push_back(hash.GetUint64(0));
+        } else {
+            shares[next_share] = hash.GetUint64(0);
+            next_share = (next_share + 1) % MAX_CLIENT_SHARES;
+        }
+    }
+};
+
+/** A share waiting for the worker thread to check its proof of work. */
+struct PendingShare {
+    uint64_t client_id;
+    std::string peer;
+    UniValue request_id;
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+};
+
+/** A new template built by the worker thread. */
+struct TemplateResult {
+    std::unique_ptr<node::CBlockTemplate> block_template;
+    bool new_tip;
+};
+
+/** The outcome of checking a share, to be replied to on the event thread. */
+struct ShareResult {
+    uint64_t client_id;
+    UniValue request_id;
+    uint256 hash;
+    std::optional<StratumError> error;
+};
+
+uint32_t ParseHex32(const UniValue& value)
+{
+    const std::string& str{value.get_str()};
+    if (str.size() != 8 || !IsHex(str)) {
+        throw StratumError{STRATUM_ERROR_OTHER, "Invalid hex value"};
+    }
+    return ReadBE32(ParseHex(str).data());
+}
+
+/**
+ * Connections are served by a libevent loop on the "stratum" thread. Block
+ * templates are built and shares are hashed on the "stratumwork" thread,
+ * so that neither holds up the other connections; its results are handed
+ * back to the event loop in the order they were produced.
+ */
+class StratumServer
+{
+public:
+    StratumServer(struct event_base* base, interfaces::Mining& mining, const CScript& payout, double difficulty, size_t max_connections)
+        : m_base{base}, m_mining{mining}, m_payout{payout}, m_difficulty{difficulty},
+          m_share_target{StratumShareTarget(difficulty)}, m_max_connections{max_connections},
+          m_next_extranonce{FastRandomContext{}.rand32()}
+    {
+        m_results_event = event_new(m_base, -1, 0, results_cb, this);
+        m_worker = std::thread(&util::TraceThread, "stratumwork", [this] { WorkerThread(); });
+    }
+
+    ~StratumServer()
+    {
+        WITH_LOCK(m_work_mutex, m_stop_worker = true);
+        m_work_cv.notify_all();
+        m_worker.join();
+        m_clients.clear();
+        if (m_listener) evconnlistener_free(m_listener);
+        event_free(m_results_event);
+    }
+
+    bool Listen(const CService& bind)
+    {
+        struct sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        if (!bind.GetSockAddr(reinterpret_cast<struct sockaddr*>(&addr), &len)) return false;
+        m_listener = evconnlistener_new_bind(m_base, accept_cb, this, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1,
+                                             reinterpret_cast<struct sockaddr*>(&addr), len);
+        return m_listener != nullptr;
+    }
+
+    /** Ask the worker thread to check for new work now, from any thread. */
+    void TriggerRefresh() EXCLUSIVE_LOCKS_REQUIRED(!m_work_mutex)
+    {
+        WITH_LOCK(m_work_mutex, m_refresh_requested = true);
+        m_work_cv.notify_one();
+    }
+
+private:
+    // Used on the event thread only.
+    struct event_base* m_base;
+    struct evconnlistener* m_listener{nullptr};
+    struct event* m_results_event;
+    interfaces::Mining& m_mining;
+    const CScript m_payout;
+    const double m_difficulty;
+    const arith_uint256 m_share_target;
+    const size_t m_max_connections;
+
+    std::list<std::unique_ptr<StratumClient>> m_clients;
+    uint64_t m_next_client_id{0};
+    uint32_t m_next_extranonce;
+    uint64_t m_next_job_id{0};
+
+    //! Template all current jobs are built from, shared by all payout scripts.
+    std::unique_ptr<node::CBlockTemplate> m_template;
+    //! Jobs built from m_template by payout script.
+    std::map<CScript, std::shared_ptr<const StratumJob>> m_jobs;
+
+    // Handed between the threads.
+    Mutex m_work_mutex;
+    std::condition_variable m_work_cv;
+    bool m_stop_worker GUARDED_BY(m_work_mutex){false};
+    bool m_refresh_requested GUARDED_BY(m_work_mutex){false};
+    std::deque<PendingShare> m_pending_shares GUARDED_BY(m_work_mutex);
+    Mutex m_results_mutex;
+    std::deque<std::variant<TemplateResult, ShareResult>> m_results GUARDED_BY(m_results_mutex);
+
+    // Used on the worker thread only.
+    std::thread m_worker;
+    std::optional<uint256> m_template_tip;
+    unsigned int m_template_tx_updated{0};
+    SteadyClock::time_point m_template_time;
+
+    static void accept_cb(struct evconnlistener*, evutil_socket_t fd, struct sockaddr* addr, int len, void* ctx);
+    static void read_cb(struct bufferevent* bev, void* ctx);
+    static void event_cb(struct bufferevent* bev, short what, void* ctx);
+    static void results_cb(evutil_socket_t, short, void* ctx);
+
+    StratumClient* FindClient(struct bufferevent* bev);
+    StratumClient* FindClient(uint64_t id);
+    void RemoveClient(StratumClient* client);
+    void Send(StratumClient& client, const UniValue& msg);
+    void Reply(StratumClient& client, const UniValue& id, UniValue result, const StratumError* error);
+    void Notify(StratumClient& client, const std::string& method, UniValue params);
+
+    /** Take a new template and send jobs built from it. */
+    void UseTemplate(TemplateResult&& result);
+    /** Reply to a checked share. */
+    void FinishShare(ShareResult&& result);
+    /** Send the current job for its payout script to an authorized client. */
+    void SendJob(StratumClient& client, bool clean_jobs);
+
+    /** Handle one request line. Returns false if the client should be dropped. */
+    bool HandleLine(StratumClient& client, const std::string& line);
+    UniValue Subscribe(StratumClient& client);
+    UniValue Authorize(StratumClient& client, const UniValue& params);
+    /** Check a share as far as possible without hashing it, and queue it for the worker thread. */
+    void Submit(StratumClient& client, const UniValue& params, const UniValue& request_id) EXCLUSIVE_LOCKS_REQUIRED(!m_work_mutex);
+
+    void WorkerThread() EXCLUSIVE_LOCKS_REQUIRED(!m_work_mutex, !m_results_mutex);
+    /** Build a new template if the tip changed, or the mempool did and the template is old enough. */
+    void Refresh() EXCLUSIVE_LOCKS_REQUIRED(!m_results_mutex);
+    /** Check the proof of work of a share, submitting it if it is a block. */
+    void CheckShare(PendingShare& share) EXCLUSIVE_LOCKS_REQUIRED(!m_results_mutex);
+    /** Hand a result to the event thread. */
+    void PostResult(std::variant<TemplateResult, ShareResult>&& result) EXCLUSIVE_LOCKS_REQUIRED(!m_results_mutex);
+};
+
+void StratumServer::accept_cb(struct evconnlistener*, evutil_socket_t fd, struct sockaddr* addr, int len, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    if (self->m_clients.size() >= self->m_max_connections) {
+        LogPrint(BCLog::STRATUM, "Connection limit of %u reached, refusing connection\n", self->m_max_connections);
+        evutil_closesocket(fd);
+        return;
+    }
+    auto client{std::make_unique<StratumClient>()};
+    client->bev = bufferevent_socket_new(self->m_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!client->bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    client->id = ++self->m_next_client_id;
+    CService peer;
+    if (peer.SetSockAddr(addr)) client->peer = peer.ToStringAddrPort();
+    client->extranonce1.resize(STRATUM_EXTRANONCE1_SIZE);
+    WriteBE32(client->extranonce1.data(), self->m_next_extranonce++);
+
+    bufferevent_setcb(client->bev, read_cb, nullptr, event_cb, self);
+    bufferevent_enable(client->bev, EV_READ | EV_WRITE);
+    LogPrint(BCLog::STRATUM, "New connection from %s\n", client->peer);
+    self->m_clients.push_back(std::move(client));
+}
+
+StratumClient* StratumServer::FindClient(struct bufferevent* bev)
+{
+    for (const auto& client : m_clients) {
+        if (client->bev == bev) return client.get();
+    }
+    return nullptr;
+}
+
+StratumClient* StratumServer::FindClient(uint64_t id)
+{
+    for (const auto& client : m_clients) {
+        if (client->id == id) return client.get();
+    }
+    return nullptr;
+}
+
+void StratumServer::RemoveClient(StratumClient* client)
+{
+    LogPrint(BCLog::STRATUM, "Disconnecting %s\n", client->peer);
+    m_clients.remove_if([client](const auto& c) { return c.get() == client; });
+}
+
+void StratumServer::read_cb(struct bufferevent* bev, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    StratumClient* client{self->FindClient(bev)};
+    if (!client) return;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        std::string s(line, n_read_out);
+        free(line);
+        if (!self->HandleLine(*client, s)) {
+            self->RemoveClient(client);
+            return;
+        }
+    }
+    // Everything left is an incomplete line.
+    if (evbuffer_get_length(input) > MAX_LINE_LENGTH) {
+        LogPrint(BCLog::STRATUM, "Line from %s too long\n", client->peer);
+        self->RemoveClient(client);
+    }
+}
+
+void StratumServer::event_cb(struct bufferevent* bev, short what, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+        if (StratumClient* client{self->FindClient(bev)}) self->RemoveClient(client);
+    }
+}
+
+void StratumServer::results_cb(evutil_socket_t, short, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    std::deque<std::variant<TemplateResult, ShareResult>> results;
+    WITH_LOCK(self->m_results_mutex, results.swap(self->m_results));
+    for (auto& result : results) {
+        if (auto* tmpl = std::get_if<TemplateResult>(&result)) {
+            self->UseTemplate(std::move(*tmpl));
+        } else {
+            self->FinishShare(std::get<ShareResult>(std::move(result)));
+        }
+    }
+}
+
+void StratumServer::Send(StratumClient& client, const UniValue& msg)
+{
+    const std::string str{msg.write() + "\n"};
+    evbuffer_add(bufferevent_get_output(client.bev), str.data(), str.size());
+}
+
+void StratumServer::Reply(StratumClient& client, const UniValue& id, UniValue result, const StratumError* error)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    if (error) {
+        UniValue error_array(UniValue::VARR);
+        error_array.push_back(static_cast<int>(error->code));
+        error_array.push_back(error->message);
+        error_array.push_back(UniValue{});
+        reply.pushKV("result", UniValue{});
+        reply.pushKV("error", std::move(error_array));
+    } else {
+        reply.pushKV("result", std::move(result));
+        reply.pushKV("error", UniValue{});
+    }
+    Send(client, reply);
+}
+
+void StratumServer::Notify(StratumClient& client, const std::string& method, UniValue params)
+{
+    UniValue msg(UniValue::VOBJ);
+    msg.pushKV("id", UniValue{});
+    msg.pushKV("method", method);
+    msg.pushKV("params", std::move(params));
+    Send(client, msg);
+}
+
+void StratumServer::UseTemplate(TemplateResult&& result)
+{
+    m_template = std::move(result.block_template);
+    m_jobs.clear();
+    LogPrint(BCLog::STRATUM, "New template on %s with %u transactions\n", m_template->block.hashPrevBlock.GetHex(), m_template->block.vtx.size());
+
+    for (const auto& client : m_clients) {
+        if (client->authorized) SendJob(*client, result.new_tip);
+    }
+}
+
+void StratumServer::FinishShare(ShareResult&& result)
+{
+    StratumClient* client{FindClient(result.client_id)};
+    if (!client) return;
+    // An identical share may have been checked meanwhile.
+    if (!result.error && client->HasShare(result.hash)) {
+        result.error = StratumError{STRATUM_ERROR_DUPLICATE_SHARE, "Duplicate share"};
+    }
+    if (!result.error) client->AddShare(result.hash);
+    Reply(*client, result.request_id, true, result.error ? &*result.error : nullptr);
+}
+
+void StratumServer::SendJob(StratumClient& client, bool clean_jobs)
+{
+    if (!m_template) return;
+    auto& job{m_jobs[client.payout]};
+    if (!job) {
+        job = std::make_shared<const StratumJob>(StratumJob::Create(strprintf("%x", ++m_next_job_id), m_template->block, client.payout));
+    }
+    if (clean_jobs) {
+        client.jobs.clear();
+        client.shares.clear();
+        client.next_share = 0;
+    }
+    client.jobs.push_back(job);
+    if (client.jobs.size() > MAX_CLIENT_JOBS) client.jobs.pop_front();
+    Notify(client, "mining.notify", job->NotifyParams(clean_jobs));
+}
+
+bool StratumServer::HandleLine(StratumClient& client, const std::string& line)
+{
+    if (line.empty()) return true;
+    UniValue request;
+    if (!request.read(line) || !request.isObject()) {
+        LogPrint(BCLog::STRATUM, "Invalid request from %s\n", client.peer);
+        return false;
+    }
+
+    const bool was_authorized{client.authorized};
+    const UniValue& id{request.find_value("id")};
+    try {
+        const UniValue& method{request.find_value("method")};
+        const UniValue& params{request.find_value("params")};
+        if (!method.isStr() || !(params.isArray() || params.isNull())) {
+            throw StratumError{STRATUM_ERROR_OTHER, "Invalid request"};
+        }
+        UniValue result;
+        if (method.get_str() == "mining.subscribe") {
+            result = Subscribe(client);
+        } else if (method.get_str() == "mining.extranonce.subscribe") {
+            // The extranonce of a connection never changes.
+            result = true;
+        } else if (method.get_str() == "mining.authorize") {
+            result = Authorize(client, params);
+        } else if (method.get_str() == "mining.submit") {
+            // Replied to once the worker thread has checked the share.
+            Submit(client, params, id);
+            return true;
+        } else {
+            throw StratumError{STRATUM_ERROR_OTHER, "Method not found"};
+        }
+        Reply(client, id, std::move(result), nullptr);
+    } catch (const StratumError& e) {
+        Reply(client, id, UniValue{}, &e);
+    } catch (const std::exception& e) {
+        // Wrongly typed parameters.
+        LogPrint(BCLog::STRATUM, "Invalid request from %s: %s\n", client.peer, e.what());
+        return false;
+    }
+
+    // Work follows the authorization reply.
+    if (client.authorized && !was_authorized) {
+        UniValue difficulty(UniValue::VARR);
+        difficulty.push_back(m_difficulty);
+        Notify(client, "mining.set_difficulty", std::move(difficulty));
+        if (m_template) {
+            SendJob(client, /*clean_jobs=*/true);
+        } else {
+            TriggerRefresh();
+        }
+    }
+    return true;
+}
+
+UniValue StratumServer::Subscribe(StratumClient& client)
+{
+    client.subscribed = true;
+    const std::string id{HexStr(client.extranonce1)};
+
+    UniValue subscriptions(UniValue::VARR);
+    for (const char* method : {"mining.set_difficulty", "mining.notify"}) {
+        UniValue subscription(UniValue::VARR);
+        subscription.push_back(method);
+        subscription.push_back(id);
+        subscriptions.push_back(std::move(subscription));
+    }
+
+    UniValue result(UniValue::VARR);
+    result.push_back(std::move(subscriptions));
+    result.push_back(HexStr(client.extranonce1));
+    result.push_back(STRATUM_EXTRANONCE2_SIZE);
+    return result;
+}
+
+UniValue StratumServer::Authorize(StratumClient& client, const UniValue& params)
+{
+    if (!client.subscribed) throw StratumError{STRATUM_ERROR_NOT_SUBSCRIBED, "Not subscribed"};
+    if (params.size() < 1) throw StratumError{STRATUM_ERROR_OTHER, "Missing user name"};
+
+    // A user name of the form <address>[.<worker>] pays to that address.
+    const std::string& user{params[0].get_str()};
+    const CTxDestination dest{DecodeDestination(user.substr(0, user.find('.')))};
+    if (IsValidDestination(dest)) {
+        client.payout = GetScriptForDestination(dest);
+    } else if (!m_payout.empty()) {
+        client.payout = m_payout;
+    } else {
+        throw StratumError{STRATUM_ERROR_UNAUTHORIZED, "User name must be a payout address"};
+    }
+    client.authorized = true;
+    LogPrint(BCLog::STRATUM, "Authorized %s as %s\n", client.peer, user);
+    return true;
+}
+
+void StratumServer::Submit(StratumClient& client, const UniValue& params, const UniValue& request_id)
+{
+    if (!client.authorized) throw StratumError{STRATUM_ERROR_UNAUTHORIZED, "Unauthorized worker"};
+    if (params.size() < 5) throw StratumError{STRATUM_ERROR_OTHER, "Missing parameters"};
+
+    const std::string& job_id{params[1].get_str()};
+    const auto job_it{std::find_if(client.jobs.begin(), client.jobs.end(), [&](const auto& job) { return job->id == job_id; })};
+    if (job_it == client.jobs.end()) throw StratumError{STRATUM_ERROR_JOB_NOT_FOUND, "Job not found"};
+    const StratumJob& job{**job_it};
+
+    const auto now{NodeClock::now()};
+    client.share_allowance = std::min(MAX_CLIENT_SHARE_BURST,
+        client.share_allowance + MAX_CLIENT_SHARE_RATE * Ticks<SecondsDouble>(now - client.share_allowance_time));
+    client.share_allowance_time = now;
+    if (client.share_allowance < 1) throw StratumError{STRATUM_ERROR_OTHER, "Too many shares"};
+    client.share_allowance -= 1;
+
+    const std::string& extranonce2{params[2].get_str()};
+    if (extranonce2.size() != 2 * STRATUM_EXTRANONCE2_SIZE || !IsHex(extranonce2)) {
+        throw StratumError{STRATUM_ERROR_OTHER, "Invalid extranonce2"};
+    }
+    std::vector<unsigned char> extranonce{client.extranonce1};
+    const std::vector<unsigned char> extranonce2_data{ParseHex(extranonce2)};
+    extranonce.insert(extranonce.end(), extranonce2_data.begin(), extranonce2_data.end());
+    const uint32_t time{ParseHex32(params[3])};
+    const uint32_t nonce{ParseHex32(params[4])};
+    if (time < job.block.nTime || time > GetTime() + MAX_FUTURE_BLOCK_TIME) {
+        throw StratumError{STRATUM_ERROR_OTHER, "Time out of range"};
+    }
+
+    auto block{std::make_shared<CBlock>()};
+    if (!job.BuildBlock(extranonce, time, nonce, *block)) {
+        throw StratumError{STRATUM_ERROR_OTHER, "Invalid extranonce"};
+    }
+    const uint256 hash{block->GetHash()};
+    if (client.HasShare(hash)) {
+        throw StratumError{STRATUM_ERROR_DUPLICATE_SHARE, "Duplicate share"};
+    }
+
+    {
+        LOCK(m_work_mutex);
+        if (m_pending_shares.size() >= MAX_PENDING_SHARES) throw StratumError{STRATUM_ERROR_OTHER, "Server busy"};
+        m_pending_shares.push_back({client.id, client.peer, request_id, std::move(block), hash});
+    }
+    m_work_cv.notify_one();
+}
+
+void StratumServer::WorkerThread()
+{
+    auto next_refresh{SteadyClock::now()};
+    WAIT_LOCK(m_work_mutex, lock);
+    while (true) {
+        m_work_cv.wait_until(lock, next_refresh, [this]() EXCLUSIVE_LOCKS_REQUIRED(m_work_mutex) {
+            return m_stop_worker || m_refresh_requested || !m_pending_shares.empty();
+        });
+        if (m_stop_worker) break;
+        std::deque<PendingShare> shares;
+        shares.swap(m_pending_shares);
+        const bool refresh{m_refresh_requested || SteadyClock::now() >= next_refresh};
+        m_refresh_requested = false;
+
+        REVERSE_LOCK(lock);
+        for (PendingShare& share : shares) {
+            CheckShare(share);
+        }
+        if (refresh) {
+            Refresh();
+            next_refresh = SteadyClock::now() + REFRESH_INTERVAL;
+        }
+    }
+}
+
+void StratumServer::Refresh()
+{
+    if (m_mining.isInitialBlockDownload()) return;
+    const std::optional<uint256> tip{m_mining.getTipHash()};
+    const bool new_tip{!m_template_tip || tip != m_template_tip};
+    if (!new_tip && (m_mining.getTransactionsUpdated() == m_template_tx_updated ||
+                     SteadyClock::now() - m_template_time < TEMPLATE_MIN_AGE)) {
+        return;
+    }
+
+    const unsigned int tx_updated{m_mining.getTransactionsUpdated()};
+    std::unique_ptr<node::CBlockTemplate> block_template;
+    try {
+        block_template = m_mining.createNewBlock(CScript{});
+    } catch (const std::exception& e) {
+        LogPrintf("stratum: Unable to create block template: %s\n", e.what());
+        return;
+    }
+    if (!block_template) return;
+
+    m_template_tip = block_template->block.hashPrevBlock;
+    m_template_tx_updated = tx_updated;
+    m_template_time = SteadyClock::now();
+    PostResult(TemplateResult{std::move(block_template), new_tip});
+}
+
+void StratumServer::CheckShare(PendingShare& share)
+{
+    ShareResult result{share.client_id, std::move(share.request_id), share.hash, std::nullopt};
+    const CBlock& block{*share.block};
+    // Computed directly, so that shares do not fill the PoW hash cache.
+    const arith_uint256 pow_hash{UintToArith256((block.nVersion & 0x8000) ? block.GetHash2() : share.hash)};
+    arith_uint256 block_target;
+    block_target.SetCompact(block.nBits);
+    if (pow_hash <= block_target) {
+        LogPrintf("stratum: %s found block %s\n", share.peer, share.hash.GetHex());
+        bool new_block;
+        if (!m_mining.processNewBlock(share.block, &new_block)) {
+            LogPrintf("stratum: Block %s was not accepted\n", share.hash.GetHex());
+        }
+        // Miners get to work on the next block before they hear back.
+        Refresh();
+    } else if (pow_hash > m_share_target) {
+        result.error = StratumError{STRATUM_ERROR_LOW_DIFFICULTY, "Low difficulty share"};
+    }
+    PostResult(std::move(result));
+}
+
+void StratumServer::PostResult(std::variant<TemplateResult, ShareResult>&& result)
+{
+    WITH_LOCK(m_results_mutex, m_results.push_back(std::move(result)));
+    event_active(m_results_event, EV_TIMEOUT, 0);
+}
+
+} // namespace
+
+/****** Thread ********/
+static struct event_base* gBase;
+static GlobalMutex g_stratum_mutex;
+//! Guarded so that block tip notifications in flight do not use it while it is destroyed.
+static std::unique_ptr<StratumServer> g_stratum_server GUARDED_BY(g_stratum_mutex);
+static std::thread stratumThread;
+static boost::signals2::connection g_block_tip_connection;
+
+bool StartStratumServer(interfaces::Mining& mining, const CService& bind, const CScript& payout, double difficulty, size_t max_connections)
+{
+    assert(!gBase);
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    gBase = event_base_new();
+    if (!gBase) {
+        LogPrintf("stratum: Unable to create event_base\n");
+        return false;
+    }
+
+    auto server{std::make_unique<StratumServer>(gBase, mining, payout, difficulty, max_connections)};
+    if (!server->Listen(bind)) {
+        LogPrintf("stratum: Unable to bind to %s\n", bind.ToStringAddrPort());
+        server.reset();
+        event_base_free(gBase);
+        gBase = nullptr;
+        return false;
+    }
+    LogPrintf("stratum: Listening on %s\n", bind.ToStringAddrPort());
+    WITH_LOCK(g_stratum_mutex, g_stratum_server = std::move(server));
+
+    g_block_tip_connection = uiInterface.NotifyBlockTip_connect([](SynchronizationState state, const CBlockIndex*) {
+        if (state != SynchronizationState::POST_INIT) return;
+        LOCK(g_stratum_mutex);
+        if (g_stratum_server) g_stratum_server->TriggerRefresh();
+    });
+
+    stratumThread = std::thread(&util::TraceThread, "stratum", [] {
+        event_base_dispatch(gBase);
+    });
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (gBase) {
+        LogPrintf("stratum: Thread interrupt\n");
+        g_block_tip_connection.disconnect();
+        event_base_once(gBase, -1, EV_TIMEOUT, [](evutil_socket_t, short, void*) {
+            event_base_loopbreak(gBase);
+        }, nullptr, nullptr);
+    }
+}
+
+void StopStratumServer()
+{
+    if (gBase) {
+        stratumThread.join();
+        // Destroyed outside the lock: its worker thread may be submitting a
+        // block, whose tip notification takes the lock.
+        std::unique_ptr<StratumServer> server;
+        WITH_LOCK(g_stratum_mutex, server = std::move(g_stratum_server));
+        server.reset();
+        event_base_free(gBase);
+        gBase = nullptr;
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Stratum v1 server for mining directly against the node.
+ */
+#ifndef BITCOIN_STRATUM_H
+#define BITCOIN_STRATUM_H
+
+#include <arith_uint256.h>
+#include <primitives/block.h>
+#include <span.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CScript;
+class CService;
+class UniValue;
+namespace interfaces {
+class Mining;
+} // namespace interfaces
+
+static const bool DEFAULT_STRATUM = false;
+extern const std::string DEFAULT_STRATUM_BIND;
+constexpr uint16_t DEFAULT_STRATUM_PORT = 3333;
+/** Share difficulty, relative to the difficulty 1 target 0xffff * 2^208. */
+constexpr double DEFAULT_STRATUM_DIFFICULTY = 0.0001;
+/** Miner connections accepted at the same time. */
+constexpr size_t DEFAULT_STRATUM_MAX_CONNECTIONS = 64;
+
+/** Bytes of the coinbase extranonce assigned by the server to a connection. */
+constexpr size_t STRATUM_EXTRANONCE1_SIZE = 4;
+/** Bytes of the coinbase extranonce the miner iterates over. */
+constexpr size_t STRATUM_EXTRANONCE2_SIZE = 4;
+constexpr size_t STRATUM_EXTRANONCE_SIZE = STRATUM_EXTRANONCE1_SIZE + STRATUM_EXTRANONCE2_SIZE;
+
+/**
+ * Work handed to Stratum miners: a block template whose coinbase pays one
+ * script and has room for the extranonce at the end of its scriptSig.
+ */
+struct StratumJob
+{
+    std::string id;
+    //! The template block, with the extranonce zeroed.
+    CBlock block;
+    //! The coinbase serialized without witness, split around the extranonce.
+    std::vector<unsigned char> coinb1;
+    std::vector<unsigned char> coinb2;
+    //! Hashes that combine the coinbase txid into the merkle root.
+    std::vector<uint256> merkle_branch;
+
+    /** Build a job from a template block, paying its coinbase to payout. */
+    static StratumJob Create(std::string id, const CBlock& block, const CScript& payout);
+
+    /**
+     * Rebuild the block a miner solved from the full extranonce (extranonce1
+     * followed by extranonce2), time and nonce. Returns false if the
+     * extranonce has the wrong size.
+     */
+    bool BuildBlock(Span<const unsigned char> extranonce, uint32_t time, uint32_t nonce, CBlock& out) const;
+
+    /** Parameters of the mining.notify message announcing this job. */
+    UniValue NotifyParams(bool clean_jobs) const;
+};
+
+/** Target a share must meet at the given difficulty. */
+arith_uint256 StratumShareTarget(double difficulty);
+
+/**
+ * Start the Stratum server on the given address. Blocks pay to payout
+ * unless a miner authorizes with an address as its user name; if payout is
+ * empty, miners have to do that. Connections beyond max_connections are
+ * closed right away.
+ */
+bool StartStratumServer(interfaces::Mining& mining, const CService& bind, const CScript& payout, double difficulty, size_t max_connections);
+void InterruptStratumServer();
+void StopStratumServer();
+
+#endif // BITCOIN_STRATUM_H
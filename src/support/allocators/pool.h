@@ -259,6 +259,14 @@ public:
         return m_allocated_chunks.size();
     }
 
+    /**
+     * Number of bytes of the last chunk that were not carved out for allocations yet.
+     */
+    [[nodiscard]] std::size_t NumAvailableChunkBytes() const
+    {
+        return std::distance(m_available_memory_it, m_available_memory_end);
+    }
+
     /**
      * Size in bytes to allocate per chunk, currently hardcoded to a fixed size.
      */
@@ -7,11 +7,15 @@
 #include <chainparams.h>
 #include <coins.h>
 #include <consensus/merkle.h>
+#include <crypto/flex/flex.h>
+#include <interfaces/mining.h>
+#include <node/miner.h>
 #include <validation.h>
 #include <pow.h>
 #include <primitives/block.h>
 #include <rpc/auxpow_miner.h>
 #include <script/script.h>
+#include <util/signalinterrupt.h>
 #include <util/strencodings.h>
 #include <util/time.h>
 #include <uint256.h>
@@ -23,6 +27,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <algorithm>
+#include <memory>
 #include <vector>
 
 /* No space between BOOST_AUTO_TEST_SUITE and '(', so that extraction of
@@ -509,6 +514,70 @@ BOOST_FIXTURE_TEST_CASE (auxpow_pow, BasicTestingSetup)
 
 /* ************************************************************************** */
 
+/**
+ * Build a header with valid auxpow, whose parent block is mined with the
+ * Flex hash.  The parent block's PoW hash is not added to the cache.
+ * @param params The consensus parameters.
+ * @param time The header's time, to make it unique.
+ * @return The header.
+ */
+static CBlockHeader
+buildFlexAuxpowHeader (const Consensus::Params& params, uint32_t time)
+{
+  CBlockHeader block;
+  block.SetBaseVersion (2, params.nAuxpowChainId);
+  block.nVersion |= 0x8000;
+  block.SetAuxpowVersion (true);
+  block.nTime = time;
+  const arith_uint256 target = (~arith_uint256 (0) >> 1);
+  block.nBits = target.GetCompact ();
+
+  CAuxpowBuilder builder(5, 42);
+  const unsigned height = 3;
+  const int nonce = 7;
+  const int index = CAuxPow::getExpectedIndex (nonce, params.nAuxpowChainId,
+                                               height);
+  const valtype auxRoot = builder.buildAuxpowChain (block.GetHash (), height,
+                                                    index);
+  builder.setCoinbase (CScript () << CAuxpowBuilder::buildCoinbaseData (
+                                       true, auxRoot, height, nonce));
+
+  util::SignalInterrupt interrupt;
+  BOOST_REQUIRE (node::SearchNonce (builder.parentBlock, block.nVersion,
+                                    block.nBits, params, 1000, 1,
+                                    interrupt).found);
+  block.SetAuxpow (builder.getUnique ());
+
+  return block;
+}
+
+BOOST_FIXTURE_TEST_CASE (auxpow_batch, BasicTestingSetup)
+{
+  SelectParams (ChainType::REGTEST);
+  const Consensus::Params& params = Params ().GetConsensus ();
+
+  std::vector<CBlockHeader> headers;
+  for (unsigned i = 0; i < 2 * FLEX_MAX_LANES + 1; ++i)
+    headers.push_back (buildFlexAuxpowHeader (params, 1700000000 + i));
+  CCheckQueue<CHeaderPoWCheck> queue{/*batch_size=*/1,
+                                     /*worker_threads_num=*/3, "test"};
+
+  /* Invalid auxpow anywhere in the batch is rejected before any Flex
+     hash is computed.  */
+  std::vector<CBlockHeader> invalid = headers;
+  tamperWith (invalid.back ().hashMerkleRoot);
+  const uint64_t hashes = GetFlexStats ().hashes;
+  BOOST_CHECK (!HasValidProofOfWork (invalid, params));
+  BOOST_CHECK (!HasValidProofOfWork (invalid, params, &queue));
+  BOOST_CHECK_EQUAL (GetFlexStats ().hashes, hashes);
+
+  BOOST_CHECK (HasValidProofOfWork (headers, params, &queue));
+  BOOST_CHECK (GetFlexStats ().hashes > hashes);
+  BOOST_CHECK (HasValidProofOfWork (headers, params));
+}
+
+/* ************************************************************************** */
+
 /**
  * Helper class that is friend to AuxpowMiner and makes the tested methods
  * accessible to the test code.
@@ -520,11 +589,13 @@ private:
 
   /** Node (with chainman and mempool) used for the test.  */
   const node::NodeContext& node;
+  /** The test setup does not create a mining interface for the node.  */
+  const std::unique_ptr<interfaces::Mining> mining;
 
 public:
 
-  explicit AuxpowMinerForTest (const node::NodeContext& n)
-    : node(n)
+  explicit AuxpowMinerForTest (node::NodeContext& n)
+    : node(n), mining(interfaces::MakeMining (n))
   {}
 
   using AuxpowMiner::cs;
@@ -533,7 +604,7 @@ public:
   const CBlock*
   getCurrentBlock (const CScript& scriptPubKey, uint256& target)
   {
-    return AuxpowMiner::getCurrentBlock (*node.chainman, *node.mining,
+    return AuxpowMiner::getCurrentBlock (*node.chainman, *mining,
                                          *node.mempool,
                                          scriptPubKey, target);
   }
@@ -616,6 +687,42 @@ BOOST_FIXTURE_TEST_CASE (auxpow_miner_createAndLookupBlock, TestChain100Setup)
   BOOST_CHECK_THROW (miner.lookupSavedBlock ("foobar"), UniValue);
 }
 
+BOOST_FIXTURE_TEST_CASE (auxpow_miner_sharedTemplate, TestChain100Setup)
+{
+  AuxpowMinerForTest miner(m_node);
+  LOCK (miner.cs);
+
+  /* Blocks for different payout scripts share everything but the
+     coinbase output and the merkle root.  */
+  const CScript script1 = CScript () << OP_TRUE;
+  const CScript script2 = CScript () << OP_2;
+  uint256 target;
+  const CBlock* pblock1 = miner.getCurrentBlock (script1, target);
+  const CBlock* pblock2 = miner.getCurrentBlock (script2, target);
+  BOOST_CHECK (pblock1 != pblock2);
+  BOOST_CHECK (pblock1->GetHash () != pblock2->GetHash ());
+  BOOST_CHECK (pblock1->hashPrevBlock == pblock2->hashPrevBlock);
+  BOOST_CHECK_EQUAL (pblock1->vtx.size (), pblock2->vtx.size ());
+  BOOST_CHECK (pblock1->vtx[0]->vout[0].scriptPubKey == script1);
+  BOOST_CHECK (pblock2->vtx[0]->vout[0].scriptPubKey == script2);
+  BOOST_CHECK (pblock1->hashMerkleRoot == BlockMerkleRoot (*pblock1));
+  BOOST_CHECK (pblock2->hashMerkleRoot == BlockMerkleRoot (*pblock2));
+
+  BOOST_CHECK (miner.getCurrentBlock (script1, target) == pblock1);
+  BOOST_CHECK (miner.lookupSavedBlock (pblock1->GetHash ().GetHex ()) == pblock1);
+  BOOST_CHECK (miner.lookupSavedBlock (pblock2->GetHash ().GetHex ()) == pblock2);
+
+  /* Only a bounded number of blocks is kept for submission.  */
+  const uint256 hash1 = pblock1->GetHash ();
+  for (size_t i = 0; i < MAX_AUXPOW_BLOCKS; ++i)
+    miner.getCurrentBlock (CScript () << OP_RETURN << static_cast<int64_t> (i),
+                           target);
+  BOOST_CHECK_THROW (miner.lookupSavedBlock (hash1.GetHex ()), UniValue);
+  const CBlock* pblock = miner.getCurrentBlock (script1, target);
+  BOOST_CHECK (pblock->GetHash () == hash1);
+  BOOST_CHECK (miner.lookupSavedBlock (hash1.GetHex ()) == pblock);
+}
+
 /* ************************************************************************** */
 
 BOOST_AUTO_TEST_SUITE_END ()
@@ -2,21 +2,27 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <auxpow.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <clientversion.h>
+#include <dbwrapper.h>
 #include <node/blockstorage.h>
 #include <node/context.h>
 #include <node/kernel_notifications.h>
+#include <pow_cache.h>
 #include <script/solver.h>
+#include <streams.h>
 #include <primitives/block.h>
 #include <util/chaintype.h>
+#include <util/strencodings.h>
 #include <validation.h>
 
 #include <boost/test/unit_test.hpp>
 #include <test/util/logging.h>
 #include <test/util/setup_common.h>
 
+using kernel::BlockTreeDB;
 using node::BLOCK_SERIALIZATION_HEADER_SIZE;
 using node::BlockManager;
 using node::KernelNotifications;
@@ -133,6 +139,258 @@ BOOST_FIXTURE_TEST_CASE(blockmanager_block_data_availability, TestChain100Setup)
     BOOST_CHECK(!blockman.CheckBlockDataAvailability(tip, *last_pruned_block));
 }
 
+BOOST_FIXTURE_TEST_CASE(blockmanager_read_pow_verified, TestChain100Setup)
+{
+    auto& blockman{m_node.chainman->m_blockman};
+    const CBlockIndex* tip{WITH_LOCK(::cs_main, return m_node.chainman->ActiveTip())};
+    BOOST_CHECK(WITH_LOCK(::cs_main, return tip->nStatus & BLOCK_POW_VERIFIED));
+
+    // A block without valid proof of work, only readable once its index
+    // entry claims the PoW was verified on acceptance.
+    CBlock block;
+    block.nVersion = 1;
+    const FlatFilePos pos{blockman.SaveBlockToDisk(block, /*nHeight=*/1)};
+    const uint256 hash{block.GetHash()};
+    CBlockIndex index{block};
+    index.phashBlock = &hash;
+    {
+        LOCK(::cs_main);
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus = BLOCK_HAVE_DATA;
+    }
+
+    CBlock read_block;
+    {
+        ASSERT_DEBUG_LOG("Errors in block header");
+        BOOST_CHECK(!blockman.ReadBlockFromDisk(read_block, index));
+    }
+    WITH_LOCK(::cs_main, index.nStatus |= BLOCK_POW_VERIFIED);
+    BOOST_CHECK(blockman.ReadBlockFromDisk(read_block, index));
+    BOOST_CHECK(read_block.GetHash() == hash);
+}
+
+BOOST_AUTO_TEST_CASE(blockmanager_read_checksum)
+{
+    KernelNotifications notifications{*Assert(m_node.shutdown), m_node.exit_status, *Assert(m_node.warnings)};
+    const BlockManager::Options blockman_opts{
+        .chainparams = Params(),
+        .block_checksums = true,
+        .blocks_dir = m_args.GetBlocksDirPath(),
+        .notifications = notifications,
+    };
+    BlockManager blockman{*Assert(m_node.shutdown), blockman_opts};
+    WITH_LOCK(::cs_main, blockman.m_block_tree_db = std::make_unique<BlockTreeDB>(DBParams{
+        .path = m_args.GetDataDirNet() / "blocks" / "index",
+        .cache_bytes = 1 << 20,
+        .memory_only = true,
+    }));
+
+    // A block without valid proof of work, readable through its index entry
+    // once that entry records a checksum of the data.
+    CBlock block;
+    block.nVersion = 1;
+    std::optional<uint32_t> checksum;
+    const FlatFilePos pos{blockman.SaveBlockToDisk(block, /*nHeight=*/1, &checksum)};
+    BOOST_REQUIRE(checksum);
+
+    const uint256 hash{block.GetHash()};
+    CBlockIndex index{block};
+    index.phashBlock = &hash;
+    {
+        LOCK(::cs_main);
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus = BLOCK_HAVE_DATA;
+    }
+
+    CBlock read_block;
+    {
+        ASSERT_DEBUG_LOG("Errors in block header");
+        BOOST_CHECK(!blockman.ReadBlockFromDisk(read_block, index));
+    }
+    WITH_LOCK(::cs_main, index.nDataChecksum = checksum);
+    BOOST_CHECK(blockman.ReadBlockFromDisk(read_block, index));
+    BOOST_CHECK(read_block.GetHash() == hash);
+
+    // Data that does not match the recorded checksum is rejected.
+    WITH_LOCK(::cs_main, index.nDataChecksum = *checksum ^ 1);
+    {
+        ASSERT_DEBUG_LOG("Checksum mismatch");
+        BOOST_CHECK(!blockman.ReadBlockFromDisk(read_block, index));
+    }
+
+    // The checksum is persisted under its own key, not in the index entry.
+    WITH_LOCK(::cs_main, index.nDataChecksum = checksum);
+    DataStream stream{};
+    stream << CDiskBlockIndex{&index};
+    CDiskBlockIndex disk_index;
+    stream >> disk_index;
+    BOOST_CHECK(!WITH_LOCK(::cs_main, return disk_index.nDataChecksum));
+
+    BOOST_CHECK(blockman.m_block_tree_db->WriteBatchSync({}, 0, {&index}));
+    const auto load_checksum{[&]() {
+        LOCK(::cs_main);
+        index.nDataChecksum.reset();
+        BOOST_CHECK(blockman.m_block_tree_db->LoadBlockChecksums([&](const uint256& h) { return h == hash ? &index : nullptr; }, *Assert(m_node.shutdown)));
+        return index.nDataChecksum;
+    }};
+    BOOST_CHECK(load_checksum() == checksum);
+
+    // A record for data at another position is ignored.
+    WITH_LOCK(::cs_main, index.nDataPos += 1);
+    BOOST_CHECK(!load_checksum());
+    WITH_LOCK(::cs_main, index.nDataPos -= 1);
+
+    // Pruning erases the record.
+    BOOST_CHECK(blockman.m_block_tree_db->WriteBatchSync({}, 0, {}, {hash}));
+    BOOST_CHECK(!load_checksum());
+
+    // Without -blockchecksums no checksum is computed.
+    BlockManager::Options no_checksum_opts{blockman_opts};
+    no_checksum_opts.block_checksums = false;
+    BlockManager no_checksum_blockman{*Assert(m_node.shutdown), no_checksum_opts};
+    checksum.reset();
+    BOOST_CHECK(!no_checksum_blockman.SaveBlockToDisk(block, /*nHeight=*/1, &checksum).IsNull());
+    BOOST_CHECK(!checksum);
+}
+
+BOOST_AUTO_TEST_CASE(blockmanager_auxpow_store)
+{
+    KernelNotifications notifications{*Assert(m_node.shutdown), m_node.exit_status, *Assert(m_node.warnings)};
+    const BlockManager::Options blockman_opts{
+        .chainparams = Params(),
+        .blocks_dir = m_args.GetBlocksDirPath(),
+        .notifications = notifications,
+    };
+    BlockManager blockman{*Assert(m_node.shutdown), blockman_opts};
+    WITH_LOCK(::cs_main, blockman.m_block_tree_db = std::make_unique<BlockTreeDB>(DBParams{
+        .path = m_args.GetDataDirNet() / "blocks" / "index",
+        .cache_bytes = 1 << 20,
+        .memory_only = true,
+    }));
+
+    // An auxpow header with no block data on disk.
+    CBlockHeader header;
+    header.SetBaseVersion(4, Params().GetConsensus().nAuxpowChainId);
+    header.nTime = 1700000000;
+    header.nBits = 0x207fffff;
+    CAuxPow::initAuxPow(header);
+    DataStream expected{};
+    expected << header;
+
+    CBlockIndex* index{nullptr};
+    {
+        LOCK(::cs_main);
+        CBlockIndex* best_header{nullptr};
+        index = blockman.AddToBlockIndex(header, best_header);
+    }
+    DataStream served{};
+    served << index->GetBlockHeader(blockman);
+    BOOST_CHECK_EQUAL(HexStr(served), HexStr(expected));
+
+    // The auxpow is written along with the block index.
+    BOOST_CHECK(WITH_LOCK(::cs_main, return blockman.WriteBlockIndexDB()));
+    std::vector<uint8_t> loaded;
+    BOOST_CHECK(WITH_LOCK(::cs_main, return blockman.m_block_tree_db->ReadAuxpow(header.GetHash(), loaded)));
+    DataStream auxpow{};
+    auxpow << *header.auxpow;
+    BOOST_CHECK_EQUAL(HexStr(loaded), HexStr(auxpow));
+
+    // Once written it is still served from memory.
+    served.clear();
+    served << index->GetBlockHeader(blockman);
+    BOOST_CHECK_EQUAL(HexStr(served), HexStr(expected));
+    BOOST_CHECK_EQUAL(blockman.AuxpowMemoryReads(), 2U);
+    BOOST_CHECK_EQUAL(blockman.AuxpowDBReads(), 0U);
+
+    // A block manager without the entry in memory reads it from the database.
+    BlockManager restarted{*Assert(m_node.shutdown), blockman_opts};
+    WITH_LOCK(::cs_main, restarted.m_block_tree_db = std::move(blockman.m_block_tree_db));
+    served.clear();
+    served << index->GetBlockHeader(restarted);
+    BOOST_CHECK_EQUAL(HexStr(served), HexStr(expected));
+    BOOST_CHECK_EQUAL(restarted.AuxpowDBReads(), 1U);
+    BOOST_CHECK_EQUAL(restarted.AuxpowDiskReads(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockmanager_prune_pow_cache)
+{
+    KernelNotifications notifications{*Assert(m_node.shutdown), m_node.exit_status, *Assert(m_node.warnings)};
+    const BlockManager::Options blockman_opts{
+        .chainparams = Params(),
+        .blocks_dir = m_args.GetBlocksDirPath(),
+        .notifications = notifications,
+    };
+    BlockManager blockman{*Assert(m_node.shutdown), blockman_opts};
+    WITH_LOCK(::cs_main, blockman.m_block_tree_db = std::make_unique<BlockTreeDB>(DBParams{
+        .path = m_args.GetDataDirNet() / "blocks" / "index",
+        .cache_bytes = 1 << 20,
+        .memory_only = true,
+    }));
+
+    // A merge-mined block stored in the first block file.
+    CBlock block;
+    block.SetBaseVersion(4, Params().GetConsensus().nAuxpowChainId);
+    block.nTime = 1700000000;
+    block.nBits = 0x207fffff;
+    CAuxPow::initAuxPow(block);
+    const FlatFilePos pos{blockman.SaveBlockToDisk(block, /*nHeight=*/1)};
+    BOOST_REQUIRE(!pos.IsNull());
+    const uint256 hash{block.GetHash()};
+    const uint256 parent_hash{block.auxpow->getParentBlock().GetHash(block.nVersion)};
+
+    LOCK(::cs_main);
+    CBlockIndex* best_header{nullptr};
+    CBlockIndex* index{blockman.AddToBlockIndex(block, best_header)};
+    index->nFile = pos.nFile;
+    index->nDataPos = pos.nPos;
+    index->nStatus |= BLOCK_HAVE_DATA;
+
+    // Both the block's and its parent block's PoW hashes are dropped.
+    GetPowHashCache().Insert(hash, hash);
+    GetPowHashCache().Insert(parent_hash, parent_hash);
+    blockman.PruneOneBlockFile(pos.nFile);
+    BOOST_CHECK(!GetPowHashCache().Get(hash));
+    BOOST_CHECK(!GetPowHashCache().Get(parent_hash));
+}
+
+BOOST_AUTO_TEST_CASE(blockmanager_auxpow_dirty_limit)
+{
+    KernelNotifications notifications{*Assert(m_node.shutdown), m_node.exit_status, *Assert(m_node.warnings)};
+    const BlockManager::Options blockman_opts{
+        .chainparams = Params(),
+        .blocks_dir = m_args.GetBlocksDirPath(),
+        .notifications = notifications,
+    };
+    BlockManager blockman{*Assert(m_node.shutdown), blockman_opts};
+    WITH_LOCK(::cs_main, blockman.m_block_tree_db = std::make_unique<BlockTreeDB>(DBParams{
+        .path = m_args.GetDataDirNet() / "blocks" / "index",
+        .cache_bytes = 1 << 20,
+        .memory_only = true,
+    }));
+
+    CBlockHeader header;
+    header.SetBaseVersion(4, Params().GetConsensus().nAuxpowChainId);
+    header.nTime = 1700000000;
+    header.nBits = 0x207fffff;
+    CAuxPow::initAuxPow(header);
+    const uint256 first{header.GetHash()};
+    const size_t auxpow_size{GetSerializeSize(*header.auxpow)};
+
+    // Accepting more auxpow headers than fit in memory writes them out
+    // before the block index is flushed.
+    std::vector<uint8_t> loaded;
+    LOCK(::cs_main);
+    CBlockIndex* best_header{nullptr};
+    for (size_t i{0}; i * auxpow_size <= node::MAX_DIRTY_AUXPOW_BYTES; ++i) {
+        BOOST_CHECK(!blockman.m_block_tree_db->ReadAuxpow(first, loaded));
+        header.nNonce = i;
+        blockman.AddToBlockIndex(header, best_header);
+    }
+    BOOST_CHECK(blockman.m_block_tree_db->ReadAuxpow(first, loaded));
+}
+
 BOOST_AUTO_TEST_CASE(blockmanager_flush_block_file)
 {
     KernelNotifications notifications{*Assert(m_node.shutdown), m_node.exit_status, *Assert(m_node.warnings)};
@@ -1077,16 +1077,139 @@ void TestFlushBehavior(
 
 BOOST_AUTO_TEST_CASE(ccoins_flush_behavior)
 {
-    // Create two in-memory caches atop a leveldb view.
-    CCoinsViewDB base{{.path = "test", .cache_bytes = 1 << 23, .memory_only = true}, {}};
-    std::vector<std::unique_ptr<CCoinsViewCacheTest>> caches;
-    caches.push_back(std::make_unique<CCoinsViewCacheTest>(&base));
-    caches.push_back(std::make_unique<CCoinsViewCacheTest>(caches.back().get()));
-
-    for (const auto& view : caches) {
-        TestFlushBehavior(view.get(), base, caches, /*do_erasing_flush=*/false);
-        TestFlushBehavior(view.get(), base, caches, /*do_erasing_flush=*/true);
+    for (const bool background_write : {false, true}) {
+        // Create two in-memory caches atop a leveldb view.
+        CCoinsViewDB base{{.path = "test", .cache_bytes = 1 << 23, .memory_only = true}, {.background_write = background_write}};
+        std::vector<std::unique_ptr<CCoinsViewCacheTest>> caches;
+        caches.push_back(std::make_unique<CCoinsViewCacheTest>(&base));
+        caches.push_back(std::make_unique<CCoinsViewCacheTest>(caches.back().get()));
+
+        for (const auto& view : caches) {
+            TestFlushBehavior(view.get(), base, caches, /*do_erasing_flush=*/false);
+            TestFlushBehavior(view.get(), base, caches, /*do_erasing_flush=*/true);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_write)
+{
+    // Small batches, so that the writer thread takes a while.
+    CCoinsViewDB base{{.path = "test", .cache_bytes = 1 << 23, .memory_only = true}, {.batch_write_bytes = 1 << 10, .background_write = true}};
+    std::map<COutPoint, Coin> expected;
+
+    for (int round = 0; round < 8; ++round) {
+        CCoinsViewCacheTest cache{&base};
+        size_t changed{500};
+        // Spend some of the coins written before, and add new ones.
+        for (auto it{expected.begin()}; it != expected.end();) {
+            if (InsecureRandBool()) {
+                BOOST_CHECK(cache.SpendCoin(it->first));
+                it = expected.erase(it);
+                ++changed;
+            } else {
+                ++it;
+            }
+        }
+        for (int i = 0; i < 500; ++i) {
+            const COutPoint outpoint{Txid::FromUint256(InsecureRand256()), 0};
+            cache.AddCoin(outpoint, MakeCoin(), /*possible_overwrite=*/false);
+            expected.emplace(outpoint, cache.AccessCoin(outpoint));
+        }
+        const uint256 best_block{InsecureRand256()};
+        cache.SetBestBlock(best_block);
+        BOOST_CHECK(round % 2 ? cache.Flush() : cache.Sync());
+        // The copy being written counts against the budget until it is on disk.
+        const size_t pending_usage{base.PendingWriteUsage()};
+        BOOST_CHECK(pending_usage == 0 || pending_usage >= changed * (sizeof(COutPoint) + sizeof(Coin)));
+
+        // The database reflects the write right away, whether the coins are on disk yet or not.
+        BOOST_CHECK_EQUAL(base.GetBestBlock(), best_block);
+        for (const auto& [outpoint, coin] : expected) {
+            Coin read;
+            BOOST_CHECK(base.HaveCoin(outpoint));
+            BOOST_CHECK(base.GetCoin(outpoint, read));
+            BOOST_CHECK(read == coin);
+        }
+        BOOST_CHECK(base.GetHeadBlocks().empty());
+    }
+
+    // The cursor waits for the coins to be on disk.
+    BOOST_CHECK(base.WaitForPendingWrite());
+    BOOST_CHECK_EQUAL(base.PendingWriteUsage(), 0U);
+    size_t count{0};
+    for (auto cursor{base.Cursor()}; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        BOOST_CHECK(expected.at(outpoint) == coin);
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_evict)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache{&base};
+    const auto usage{[&] { return cache.DynamicMemoryUsage() - cache.ReusableMemoryUsage(); }};
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 2000; ++i) {
+        outpoints.emplace_back(Txid::FromUint256(InsecureRand256()), 0);
+        cache.AddCoin(outpoints.back(), MakeCoin(), /*possible_overwrite=*/false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.ReusableMemoryUsage(), 0U);
+
+    // Nothing is removed while the cache is within the target.
+    BOOST_CHECK_EQUAL(cache.Evict(usage()), 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2000U);
+
+    // All coins were just added, so they are marked unused before one of them is removed.
+    BOOST_CHECK_EQUAL(cache.Evict(usage() - 1), 1U);
+    BOOST_CHECK_EQUAL(cache.ReusableMemoryUsage(), sizeof(CoinsCachePair));
+
+    // Use some of the coins again, and add some more.
+    std::vector<COutPoint> hot;
+    for (const auto& outpoint : outpoints) {
+        if (hot.size() < 200 && cache.HaveCoinInCache(outpoint)) {
+            cache.AccessCoin(outpoint);
+            hot.push_back(outpoint);
+        }
+    }
+    for (int i = 0; i < 200; ++i) {
+        hot.emplace_back(Txid::FromUint256(InsecureRand256()), 0);
+        cache.AddCoin(hot.back(), MakeCoin(), /*possible_overwrite=*/false);
+    }
+    BOOST_CHECK(cache.Sync());
+
+    // Only the coins that were not used since are removed.
+    const size_t target{usage() / 2};
+    const size_t evicted{cache.Evict(target)};
+    BOOST_CHECK(evicted > 0 && evicted < 2000 - 200);
+    BOOST_CHECK_LE(usage(), target);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2000 + 200 - 1 - evicted);
+    for (const auto& outpoint : hot) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    }
+    cache.SelfTest();
+
+    // Modified coins are never removed.
+    for (int i = 0; i < 50; ++i) {
+        cache.AddCoin(COutPoint{Txid::FromUint256(InsecureRand256()), 0}, MakeCoin(), /*possible_overwrite=*/false);
+    }
+    cache.Evict(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 50U);
+    cache.SelfTest();
+
+    // Removed coins are read from the base again, into the memory they left behind.
+    const size_t pool_usage{cache.DynamicMemoryUsage() - cache.usage()};
+    for (const auto& outpoint : outpoints) {
+        BOOST_CHECK(cache.HaveCoin(outpoint));
     }
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage() - cache.usage(), pool_usage);
+    cache.SelfTest();
 }
 
 BOOST_AUTO_TEST_CASE(coins_resource_is_used)
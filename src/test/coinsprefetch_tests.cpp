@@ -0,0 +1,96 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <coinsprefetch.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <sync.h>
+#include <test/util/random.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+static void WriteCoins(CCoinsViewDB& db, const std::vector<COutPoint>& add, const std::vector<COutPoint>& spend)
+{
+    CCoinsViewCache cache{&db};
+    for (const COutPoint& outpoint : add) {
+        cache.AddCoin(outpoint, Coin{CTxOut{1000, CScript() << OP_TRUE}, 1, false}, false);
+    }
+    for (const COutPoint& outpoint : spend) {
+        BOOST_REQUIRE(cache.SpendCoin(outpoint));
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_REQUIRE(cache.Flush());
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_coins)
+{
+    CCoinsViewDB db{{.path = "test", .cache_bytes = 1 << 23, .memory_only = true}, {}};
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 40; ++i) {
+        outpoints.emplace_back(Txid::FromUint256(InsecureRand256()), i);
+    }
+    WriteCoins(db, outpoints, {});
+
+    // A block spending 36 coins from the database, one coin that does not
+    // exist, and an output of its own.
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(50, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    CMutableTransaction spend;
+    for (int i = 0; i < 36; ++i) {
+        spend.vin.emplace_back(outpoints[i]);
+    }
+    spend.vin.emplace_back(Txid::FromUint256(InsecureRand256()), 0);
+    spend.vout.emplace_back(1000, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(spend));
+    CMutableTransaction child;
+    child.vin.emplace_back(block.vtx[1]->GetHash(), 0);
+    child.vin.emplace_back(outpoints[36]);
+    block.vtx.push_back(MakeTransactionRef(child));
+    const uint256 hash{block.GetHash()};
+
+    for (const int threads : {0, 3}) {
+        CoinsPrefetcher prefetcher{db, threads};
+        LOCK(cs_main);
+
+        // Coins the cache has already are not read again.
+        CCoinsViewCache cache{&db};
+        BOOST_CHECK(!cache.AccessCoin(outpoints[36]).IsSpent());
+        prefetcher.Prefetch(block, cache);
+        prefetcher.Prefetch(block, cache);
+        BOOST_CHECK_EQUAL(prefetcher.Apply(hash, cache), 36U);
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), 37U);
+        for (int i = 0; i < 37; ++i) {
+            BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+        }
+        BOOST_CHECK(!cache.HaveCoinInCache(COutPoint{block.vtx[1]->GetHash(), 0}));
+        BOOST_CHECK_EQUAL(prefetcher.Apply(hash, cache), 0U);
+
+        // Coins read before the database was written to are dropped.
+        CCoinsViewCache cache2{&db};
+        prefetcher.Prefetch(block, cache2);
+        WriteCoins(db, {}, {outpoints[0]});
+        BOOST_CHECK_EQUAL(prefetcher.Apply(hash, cache2), 0U);
+        BOOST_CHECK_EQUAL(cache2.GetCacheSize(), 0U);
+        BOOST_CHECK(!cache2.HaveCoin(outpoints[0]));
+        WriteCoins(db, {outpoints[0]}, {});
+
+        // Cancelled blocks are gone.
+        prefetcher.Prefetch(block, cache2);
+        prefetcher.Cancel();
+        BOOST_CHECK_EQUAL(prefetcher.Apply(hash, cache2), 0U);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,12 @@
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
 #include <crypto/chacha20poly1305.h>
+#include <crypto/flex/cnfiles/cnfn.h>
+#include <crypto/flex/flex.h>
+#include <crypto/flex/sph/sph_cubehash.h>
+#include <crypto/flex/sph/sph_echo.h>
+#include <crypto/flex/sph/sph_groestl.h>
+#include <crypto/flex/sph/sph_shavite.h>
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
@@ -1076,6 +1082,23 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha3_256d80)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[80 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 80 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            SHA3_256().Write({in + 80 * j, 80}).Finalize({out1 + 32 * j, 32});
+            SHA3_256().Write({out1 + 32 * j, 32}).Finalize({out1 + 32 * j, 32});
+        }
+        SHA3_256D80(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 static void TestSHA3_256(const std::string& input, const std::string& output)
 {
     const auto in_bytes = ParseHex(input);
@@ -1270,4 +1293,102 @@ BOOST_AUTO_TEST_CASE(muhash_tests)
     BOOST_CHECK_EQUAL(HexStr(out4), "3a31e6903aff0de9f62f9a9f7f8b861de76ce2cda09822b90014319ae5dc2271");
 }
 
+BOOST_AUTO_TEST_CASE(cnfn_aes_implementations)
+{
+    using CNFNFunc = void (*)(const char*, char*, uint32_t, int);
+    const CNFNFunc funcs[] = {
+        crypto::cnfn_dark_hash, crypto::cnfn_darklite_hash, crypto::cnfn_cnfast_hash,
+        crypto::cnfn_cnlite_hash, crypto::cnfn_turtle_hash, crypto::cnfn_turtlelite_hash,
+    };
+    const std::vector<unsigned char> input{g_insecure_rand_ctx.randbytes(80)};
+
+    // Every compiled in accelerated implementation must match the portable one.
+    std::vector<std::vector<unsigned char>> expected;
+    BOOST_REQUIRE(crypto::cnfn_use_aes_implementation(CNFN_AES_PORTABLE));
+    for (CNFNFunc func : funcs) {
+        std::vector<unsigned char> out(HASH_SIZE);
+        func((const char*)input.data(), (char*)out.data(), input.size(), 1);
+        expected.push_back(out);
+    }
+    // Only cores this CPU can run are enabled; the others stay untested here.
+    const FlexCPUFeatures features{GetFlexCPUFeatures()};
+    for (const auto& [impl, supported] : {std::pair{CNFN_AES_X86_AESNI, features.x86_aesni}, std::pair{CNFN_AES_ARM, features.arm_aes}}) {
+        if (!supported || !crypto::cnfn_use_aes_implementation(impl)) continue;
+        for (size_t i = 0; i < std::size(funcs); ++i) {
+            std::vector<unsigned char> out(HASH_SIZE);
+            funcs[i]((const char*)input.data(), (char*)out.data(), input.size(), 1);
+            BOOST_CHECK_EQUAL(HexStr(out), HexStr(expected[i]));
+        }
+    }
+    FlexAutoDetect();
+}
+
+template <typename Context, void (*Init)(void*), void (*Update)(void*, const void*, size_t), void (*Close)(void*, void*)>
+static std::vector<unsigned char> SphDigest(const std::vector<unsigned char>& input, size_t split)
+{
+    Context ctx;
+    std::vector<unsigned char> out(64);
+    Init(&ctx);
+    Update(&ctx, input.data(), split);
+    Update(&ctx, input.data() + split, input.size() - split);
+    Close(&ctx, out.data());
+    return out;
+}
+
+//! Switch to the accelerated cores this CPU can run, or back to the portable ones.
+static void SphUseAccelerated(bool enable)
+{
+    const FlexCPUFeatures features{GetFlexCPUFeatures()};
+    sph_groestl_use_x86_aesni(enable && features.x86_aesni);
+    sph_echo_use_x86_aesni(enable && features.x86_aesni);
+    sph_shavite_use_x86_aesni(enable && features.x86_aesni);
+    sph_cubehash_use_avx2(enable && features.avx2);
+}
+
+BOOST_AUTO_TEST_CASE(sph_accelerated_implementations)
+{
+    // Cover empty input, partial blocks and several compression calls, fed in two pieces.
+    for (size_t len : {0, 1, 32, 63, 64, 80, 127, 128, 129, 200, 256, 513}) {
+        const std::vector<unsigned char> input{g_insecure_rand_ctx.randbytes(len)};
+        const size_t split{len ? g_insecure_rand_ctx.randrange(len) : 0};
+
+        SphUseAccelerated(false);
+        const auto groestl{SphDigest<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>(input, split)};
+        const auto echo{SphDigest<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>(input, split)};
+        const auto shavite{SphDigest<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>(input, split)};
+        const auto cubehash{SphDigest<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>(input, split)};
+
+        // Implementations that are not compiled in or not supported keep the portable code, so this always holds.
+        SphUseAccelerated(true);
+        BOOST_CHECK_EQUAL(HexStr(SphDigest<sph_groestl512_context, sph_groestl512_init, sph_groestl512, sph_groestl512_close>(input, split)), HexStr(groestl));
+        BOOST_CHECK_EQUAL(HexStr(SphDigest<sph_echo512_context, sph_echo512_init, sph_echo512, sph_echo512_close>(input, split)), HexStr(echo));
+        BOOST_CHECK_EQUAL(HexStr(SphDigest<sph_shavite512_context, sph_shavite512_init, sph_shavite512, sph_shavite512_close>(input, split)), HexStr(shavite));
+        BOOST_CHECK_EQUAL(HexStr(SphDigest<sph_cubehash512_context, sph_cubehash512_init, sph_cubehash512, sph_cubehash512_close>(input, split)), HexStr(cubehash));
+    }
+    FlexAutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(flex_hash_multi_matches_single)
+{
+    // One full group of lanes plus a partial one.
+    const size_t count{FLEX_MAX_LANES + 2};
+    std::vector<std::vector<unsigned char>> inputs;
+    std::vector<uint256> outputs(count);
+    std::vector<const char*> input_ptrs;
+    std::vector<unsigned char*> output_ptrs;
+    for (size_t i = 0; i < count; ++i) {
+        inputs.push_back(g_insecure_rand_ctx.randbytes(80));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        input_ptrs.push_back((const char*)inputs[i].data());
+        output_ptrs.push_back(outputs[i].begin());
+    }
+    flex_hash_multi(input_ptrs.data(), 80, output_ptrs.data(), count);
+    for (size_t i = 0; i < count; ++i) {
+        uint256 expected;
+        flex_hash((const char*)inputs[i].data(), 80, expected.begin());
+        BOOST_CHECK_EQUAL(outputs[i], expected);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
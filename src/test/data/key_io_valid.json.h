@@ -0,0 +1,2139 @@
+#include <string>
+namespace json_tests{
+static const std::string key_io_valid{
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x31, 0x46, 0x73, 0x53, 0x69, 0x61, 0x39, 
+0x72, 0x76, 0x34, 0x4e, 0x65, 0x45, 0x77, 0x76, 
+0x4a, 0x32, 0x47, 0x76, 0x58, 0x72, 0x58, 0x37, 
+0x4c, 0x79, 0x78, 0x59, 0x73, 0x70, 0x62, 0x4e, 
+0x32, 0x6d, 0x6f, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 
+0x36, 0x61, 0x39, 0x31, 0x34, 0x61, 0x33, 0x31, 
+0x63, 0x30, 0x36, 0x62, 0x64, 0x34, 0x36, 0x33, 
+0x65, 0x33, 0x39, 0x32, 0x33, 0x62, 0x63, 0x31, 
+0x61, 0x61, 0x64, 0x62, 0x64, 0x65, 0x34, 0x38, 
+0x62, 0x31, 0x36, 0x39, 0x37, 0x36, 0x63, 0x30, 
+0x38, 0x30, 0x37, 0x31, 0x37, 0x38, 0x38, 0x61, 
+0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 0x6e, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x33, 0x36, 0x6a, 0x34, 0x4e, 0x66, 
+0x4b, 0x76, 0x36, 0x41, 0x6b, 0x76, 0x61, 0x39, 
+0x61, 0x6d, 0x6a, 0x57, 0x72, 0x4c, 0x47, 0x36, 
+0x4d, 0x75, 0x53, 0x51, 0x79, 0x6d, 0x31, 0x47, 
+0x75, 0x45, 0x6d, 0x6d, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x61, 0x39, 0x31, 0x34, 0x33, 0x37, 0x33, 0x62, 
+0x38, 0x31, 0x39, 0x61, 0x30, 0x36, 0x38, 0x66, 
+0x33, 0x32, 0x62, 0x37, 0x61, 0x36, 0x62, 0x33, 
+0x38, 0x62, 0x36, 0x62, 0x33, 0x38, 0x37, 0x32, 
+0x39, 0x36, 0x34, 0x37, 0x63, 0x66, 0x64, 0x65, 
+0x30, 0x31, 0x63, 0x32, 0x38, 0x37, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x6d, 
+0x7a, 0x4b, 0x32, 0x46, 0x46, 0x44, 0x45, 0x68, 
+0x78, 0x71, 0x48, 0x63, 0x6d, 0x72, 0x4a, 0x77, 
+0x31, 0x79, 0x73, 0x71, 0x46, 0x6b, 0x56, 0x79, 
+0x68, 0x55, 0x55, 0x4c, 0x6f, 0x34, 0x35, 0x68, 
+0x5a, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 0x36, 0x61, 
+0x39, 0x31, 0x34, 0x63, 0x65, 0x32, 0x38, 0x62, 
+0x32, 0x36, 0x63, 0x35, 0x37, 0x34, 0x37, 0x32, 
+0x37, 0x33, 0x37, 0x66, 0x35, 0x63, 0x33, 0x35, 
+0x36, 0x31, 0x61, 0x31, 0x37, 0x36, 0x31, 0x31, 
+0x38, 0x35, 0x62, 0x64, 0x38, 0x35, 0x38, 0x39, 
+0x61, 0x34, 0x33, 0x38, 0x38, 0x61, 0x63, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x32, 0x4e, 0x43, 0x32, 0x68, 0x45, 0x68, 0x65, 
+0x32, 0x38, 0x55, 0x4c, 0x4b, 0x41, 0x4a, 0x6b, 
+0x57, 0x35, 0x4d, 0x6a, 0x5a, 0x33, 0x6a, 0x74, 
+0x54, 0x4d, 0x4a, 0x64, 0x76, 0x58, 0x6d, 0x42, 
+0x79, 0x76, 0x4b, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x61, 
+0x39, 0x31, 0x34, 0x63, 0x65, 0x30, 0x62, 0x62, 
+0x61, 0x37, 0x35, 0x38, 0x39, 0x31, 0x66, 0x66, 
+0x39, 0x65, 0x63, 0x36, 0x30, 0x31, 0x34, 0x38, 
+0x64, 0x34, 0x62, 0x64, 0x34, 0x61, 0x30, 0x39, 
+0x65, 0x65, 0x32, 0x64, 0x63, 0x35, 0x63, 0x39, 
+0x33, 0x33, 0x31, 0x38, 0x37, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 
+0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x6d, 0x77, 
+0x77, 0x34, 0x4c, 0x76, 0x71, 0x74, 0x54, 0x4d, 
+0x4b, 0x76, 0x6d, 0x65, 0x51, 0x76, 0x69, 0x7a, 
+0x50, 0x7a, 0x32, 0x45, 0x51, 0x76, 0x32, 0x36, 
+0x78, 0x54, 0x6e, 0x65, 0x57, 0x72, 0x62, 0x67, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x37, 0x36, 0x61, 0x39, 
+0x31, 0x34, 0x62, 0x34, 0x31, 0x31, 0x30, 0x62, 
+0x61, 0x39, 0x33, 0x61, 0x63, 0x35, 0x34, 0x61, 
+0x66, 0x63, 0x31, 0x34, 0x64, 0x61, 0x33, 0x62, 
+0x64, 0x64, 0x31, 0x39, 0x36, 0x31, 0x34, 0x37, 
+0x37, 0x34, 0x61, 0x32, 0x64, 0x35, 0x35, 0x64, 
+0x32, 0x39, 0x38, 0x38, 0x61, 0x63, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x32, 0x4e, 0x31, 0x72, 0x37, 0x61, 0x43, 
+0x36, 0x39, 0x56, 0x48, 0x65, 0x45, 0x37, 0x79, 
+0x51, 0x4a, 0x50, 0x44, 0x4c, 0x69, 0x39, 0x54, 
+0x31, 0x50, 0x59, 0x71, 0x34, 0x77, 0x6e, 0x77, 
+0x76, 0x6a, 0x75, 0x54, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x61, 0x39, 0x31, 0x34, 0x35, 0x65, 0x35, 0x61, 
+0x33, 0x35, 0x61, 0x62, 0x34, 0x34, 0x62, 0x33, 
+0x65, 0x66, 0x61, 0x65, 0x61, 0x35, 0x31, 0x32, 
+0x39, 0x62, 0x61, 0x32, 0x32, 0x62, 0x38, 0x38, 
+0x62, 0x61, 0x33, 0x65, 0x32, 0x39, 0x37, 0x36, 
+0x36, 0x31, 0x34, 0x35, 0x38, 0x37, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x6e, 0x34, 0x66, 0x61, 0x6a, 0x61, 0x68, 
+0x4a, 0x72, 0x41, 0x75, 0x4b, 0x62, 0x4e, 0x37, 
+0x75, 0x4e, 0x73, 0x4b, 0x6a, 0x4c, 0x6a, 0x51, 
+0x6b, 0x7a, 0x39, 0x51, 0x6e, 0x35, 0x65, 0x77, 
+0x4a, 0x58, 0x51, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 
+0x36, 0x61, 0x39, 0x31, 0x34, 0x66, 0x64, 0x65, 
+0x63, 0x61, 0x33, 0x62, 0x30, 0x38, 0x65, 0x33, 
+0x38, 0x61, 0x66, 0x35, 0x33, 0x64, 0x37, 0x63, 
+0x34, 0x63, 0x36, 0x30, 0x65, 0x33, 0x61, 0x64, 
+0x32, 0x30, 0x38, 0x63, 0x65, 0x35, 0x30, 0x36, 
+0x36, 0x34, 0x34, 0x31, 0x30, 0x38, 0x38, 0x61, 
+0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 0x67, 0x74, 
+0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 
+0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 
+0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x32, 0x4d, 0x78, 
+0x46, 0x61, 0x6a, 0x4c, 0x41, 0x70, 0x58, 0x70, 
+0x59, 0x6b, 0x34, 0x56, 0x6f, 0x64, 0x42, 0x53, 
+0x5a, 0x53, 0x74, 0x37, 0x72, 0x77, 0x38, 0x79, 
+0x34, 0x72, 0x79, 0x41, 0x42, 0x6b, 0x66, 0x41, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x61, 0x39, 0x31, 0x34, 
+0x33, 0x36, 0x65, 0x39, 0x66, 0x31, 0x39, 0x31, 
+0x65, 0x30, 0x62, 0x37, 0x35, 0x30, 0x33, 0x36, 
+0x61, 0x37, 0x37, 0x66, 0x36, 0x35, 0x65, 0x32, 
+0x65, 0x61, 0x61, 0x34, 0x37, 0x35, 0x32, 0x34, 
+0x34, 0x33, 0x32, 0x33, 0x33, 0x66, 0x62, 0x65, 
+0x38, 0x37, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 0x67, 
+0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 
+0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x4a, 
+0x75, 0x57, 0x32, 0x41, 0x4d, 0x44, 0x59, 0x75, 
+0x34, 0x78, 0x56, 0x77, 0x52, 0x47, 0x39, 0x44, 
+0x5a, 0x57, 0x31, 0x38, 0x56, 0x62, 0x7a, 0x51, 
+0x72, 0x47, 0x63, 0x64, 0x35, 0x52, 0x43, 0x67, 
+0x62, 0x39, 0x39, 0x73, 0x53, 0x36, 0x65, 0x68, 
+0x4a, 0x73, 0x4e, 0x51, 0x58, 0x75, 0x35, 0x62, 
+0x39, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x38, 0x66, 0x38, 
+0x39, 0x34, 0x33, 0x62, 0x66, 0x39, 0x35, 0x36, 
+0x64, 0x65, 0x35, 0x39, 0x35, 0x36, 0x36, 0x35, 
+0x63, 0x33, 0x38, 0x66, 0x66, 0x66, 0x66, 0x32, 
+0x33, 0x38, 0x32, 0x37, 0x65, 0x31, 0x37, 0x63, 
+0x31, 0x30, 0x63, 0x64, 0x63, 0x31, 0x63, 0x32, 
+0x37, 0x61, 0x30, 0x32, 0x38, 0x63, 0x61, 0x61, 
+0x65, 0x36, 0x63, 0x39, 0x38, 0x31, 0x30, 0x36, 
+0x32, 0x36, 0x31, 0x39, 0x38, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x6d, 0x61, 0x69, 0x6e, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 0x6f, 
+0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x4c, 0x35, 0x6e, 0x4a, 0x65, 0x71, 0x4b, 0x6d, 
+0x70, 0x48, 0x70, 0x34, 0x50, 0x37, 0x46, 0x38, 
+0x5a, 0x59, 0x79, 0x6a, 0x77, 0x63, 0x35, 0x61, 
+0x37, 0x50, 0x34, 0x64, 0x38, 0x45, 0x61, 0x62, 
+0x75, 0x47, 0x41, 0x7a, 0x66, 0x47, 0x4a, 0x6b, 
+0x37, 0x79, 0x43, 0x31, 0x42, 0x4a, 0x79, 0x7a, 
+0x4e, 0x61, 0x45, 0x64, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x66, 0x66, 0x37, 0x37, 0x38, 0x37, 0x34, 0x30, 
+0x66, 0x38, 0x38, 0x64, 0x64, 0x63, 0x66, 0x31, 
+0x30, 0x32, 0x61, 0x65, 0x62, 0x38, 0x31, 0x64, 
+0x61, 0x65, 0x65, 0x32, 0x38, 0x39, 0x63, 0x30, 
+0x34, 0x34, 0x63, 0x34, 0x61, 0x34, 0x35, 0x37, 
+0x31, 0x63, 0x34, 0x62, 0x36, 0x66, 0x32, 0x38, 
+0x37, 0x34, 0x30, 0x30, 0x66, 0x34, 0x62, 0x38, 
+0x65, 0x30, 0x62, 0x38, 0x34, 0x33, 0x66, 0x38, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 
+0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x39, 0x32, 0x5a, 0x64, 0x45, 0x35, 
+0x48, 0x6f, 0x4c, 0x61, 0x66, 0x79, 0x77, 0x6e, 
+0x54, 0x42, 0x62, 0x7a, 0x50, 0x78, 0x62, 0x76, 
+0x52, 0x6d, 0x70, 0x37, 0x35, 0x70, 0x53, 0x66, 
+0x7a, 0x76, 0x64, 0x55, 0x33, 0x58, 0x61, 0x5a, 
+0x47, 0x68, 0x31, 0x63, 0x54, 0x6f, 0x69, 0x70, 
+0x67, 0x64, 0x48, 0x56, 0x68, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x38, 0x30, 0x63, 0x33, 0x32, 0x64, 0x38, 
+0x31, 0x65, 0x39, 0x31, 0x62, 0x64, 0x65, 0x61, 
+0x30, 0x34, 0x63, 0x64, 0x37, 0x61, 0x33, 0x38, 
+0x31, 0x39, 0x62, 0x33, 0x32, 0x32, 0x37, 0x35, 
+0x66, 0x63, 0x33, 0x32, 0x39, 0x38, 0x61, 0x66, 
+0x34, 0x63, 0x37, 0x65, 0x63, 0x38, 0x37, 0x65, 
+0x62, 0x30, 0x30, 0x39, 0x39, 0x35, 0x32, 0x37, 
+0x64, 0x30, 0x34, 0x31, 0x63, 0x65, 0x64, 0x35, 
+0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 
+0x73, 0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 0x66, 
+0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 
+0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x56, 0x38, 0x33, 
+0x6b, 0x4b, 0x69, 0x73, 0x46, 0x33, 0x52, 0x51, 
+0x53, 0x76, 0x58, 0x62, 0x55, 0x43, 0x6d, 0x39, 
+0x6f, 0x78, 0x33, 0x6b, 0x61, 0x7a, 0x35, 0x4a, 
+0x6a, 0x45, 0x55, 0x42, 0x57, 0x63, 0x78, 0x38, 
+0x74, 0x4e, 0x79, 0x64, 0x66, 0x47, 0x4a, 0x63, 
+0x79, 0x65, 0x55, 0x78, 0x75, 0x48, 0x34, 0x37, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x65, 0x30, 0x66, 0x63, 
+0x64, 0x34, 0x63, 0x65, 0x34, 0x65, 0x33, 0x64, 
+0x30, 0x65, 0x33, 0x64, 0x65, 0x30, 0x39, 0x31, 
+0x66, 0x32, 0x31, 0x34, 0x31, 0x35, 0x62, 0x62, 
+0x37, 0x63, 0x64, 0x30, 0x31, 0x31, 0x66, 0x61, 
+0x63, 0x32, 0x38, 0x38, 0x63, 0x34, 0x32, 0x30, 
+0x32, 0x30, 0x61, 0x38, 0x37, 0x39, 0x66, 0x32, 
+0x38, 0x63, 0x32, 0x61, 0x34, 0x33, 0x38, 0x37, 
+0x64, 0x66, 0x39, 0x62, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 
+0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 
+0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 0x6f, 0x6d, 
+0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 0x22, 
+0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x39, 0x32, 
+0x51, 0x75, 0x53, 0x6e, 0x79, 0x77, 0x72, 0x68, 
+0x73, 0x56, 0x37, 0x57, 0x50, 0x5a, 0x43, 0x68, 
+0x54, 0x67, 0x53, 0x51, 0x41, 0x32, 0x33, 0x75, 
+0x53, 0x6d, 0x6a, 0x39, 0x4d, 0x43, 0x45, 0x45, 
+0x6e, 0x6f, 0x31, 0x65, 0x52, 0x42, 0x44, 0x47, 
+0x39, 0x73, 0x67, 0x38, 0x4d, 0x32, 0x39, 0x63, 
+0x58, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x36, 0x63, 0x66, 
+0x36, 0x33, 0x36, 0x65, 0x64, 0x38, 0x61, 0x63, 
+0x31, 0x62, 0x61, 0x62, 0x30, 0x33, 0x33, 0x62, 
+0x36, 0x34, 0x66, 0x36, 0x36, 0x66, 0x65, 0x61, 
+0x62, 0x61, 0x36, 0x35, 0x66, 0x37, 0x30, 0x65, 
+0x36, 0x38, 0x34, 0x37, 0x33, 0x31, 0x65, 0x33, 
+0x66, 0x33, 0x39, 0x31, 0x30, 0x35, 0x36, 0x30, 
+0x35, 0x39, 0x36, 0x38, 0x64, 0x33, 0x61, 0x39, 
+0x36, 0x33, 0x38, 0x30, 0x31, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 
+0x65, 0x64, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x4e, 0x44, 0x35, 0x33, 0x44, 
+0x68, 0x70, 0x38, 0x65, 0x43, 0x5a, 0x71, 0x47, 
+0x32, 0x67, 0x68, 0x65, 0x38, 0x59, 0x68, 0x53, 
+0x43, 0x47, 0x65, 0x73, 0x58, 0x5a, 0x38, 0x66, 
+0x45, 0x35, 0x50, 0x47, 0x44, 0x31, 0x6b, 0x68, 
+0x72, 0x71, 0x4e, 0x76, 0x45, 0x69, 0x34, 0x52, 
+0x42, 0x6f, 0x58, 0x68, 0x45, 0x4b, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x31, 0x32, 0x62, 0x35, 0x61, 0x31, 
+0x30, 0x66, 0x33, 0x61, 0x31, 0x31, 0x65, 0x37, 
+0x30, 0x38, 0x64, 0x63, 0x35, 0x34, 0x31, 0x32, 
+0x38, 0x33, 0x33, 0x63, 0x34, 0x37, 0x61, 0x62, 
+0x37, 0x63, 0x33, 0x36, 0x38, 0x61, 0x32, 0x31, 
+0x62, 0x39, 0x65, 0x66, 0x65, 0x31, 0x39, 0x32, 
+0x39, 0x33, 0x37, 0x39, 0x33, 0x65, 0x63, 0x38, 
+0x37, 0x39, 0x63, 0x65, 0x36, 0x38, 0x33, 0x30, 
+0x31, 0x38, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x73, 0x69, 0x67, 
+0x6e, 0x65, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 0x6f, 0x6d, 
+0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 0x22, 
+0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x39, 0x31, 
+0x6d, 0x6e, 0x31, 0x77, 0x59, 0x4b, 0x45, 0x42, 
+0x31, 0x7a, 0x79, 0x6f, 0x66, 0x31, 0x56, 0x46, 
+0x6d, 0x38, 0x74, 0x4d, 0x74, 0x6f, 0x63, 0x5a, 
+0x78, 0x31, 0x6f, 0x42, 0x72, 0x4b, 0x4b, 0x52, 
+0x43, 0x75, 0x39, 0x47, 0x43, 0x70, 0x67, 0x5a, 
+0x76, 0x50, 0x6d, 0x42, 0x4c, 0x45, 0x4a, 0x6a, 
+0x70, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x31, 0x38, 0x61, 
+0x38, 0x36, 0x65, 0x35, 0x61, 0x36, 0x63, 0x36, 
+0x39, 0x37, 0x37, 0x64, 0x64, 0x62, 0x61, 0x30, 
+0x64, 0x61, 0x63, 0x61, 0x37, 0x66, 0x62, 0x61, 
+0x35, 0x31, 0x39, 0x30, 0x66, 0x36, 0x37, 0x62, 
+0x61, 0x35, 0x36, 0x63, 0x63, 0x64, 0x63, 0x31, 
+0x62, 0x33, 0x66, 0x33, 0x31, 0x33, 0x30, 0x38, 
+0x39, 0x37, 0x32, 0x32, 0x33, 0x36, 0x63, 0x32, 
+0x65, 0x34, 0x37, 0x37, 0x36, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x72, 0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 
+0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x50, 0x69, 0x73, 0x41, 
+0x55, 0x64, 0x4c, 0x76, 0x71, 0x71, 0x41, 0x72, 
+0x36, 0x4d, 0x59, 0x74, 0x58, 0x6e, 0x72, 0x57, 
+0x76, 0x67, 0x76, 0x79, 0x55, 0x41, 0x77, 0x75, 
+0x4e, 0x79, 0x75, 0x54, 0x76, 0x5a, 0x6b, 0x44, 
+0x47, 0x77, 0x36, 0x6d, 0x69, 0x50, 0x68, 0x5a, 
+0x64, 0x61, 0x69, 0x53, 0x44, 0x4e, 0x48, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x33, 0x66, 0x64, 0x66, 0x65, 
+0x63, 0x31, 0x33, 0x37, 0x31, 0x63, 0x65, 0x64, 
+0x63, 0x64, 0x62, 0x38, 0x63, 0x31, 0x39, 0x30, 
+0x63, 0x61, 0x36, 0x66, 0x66, 0x38, 0x61, 0x64, 
+0x36, 0x30, 0x33, 0x66, 0x38, 0x31, 0x37, 0x65, 
+0x64, 0x63, 0x30, 0x64, 0x39, 0x33, 0x63, 0x32, 
+0x61, 0x36, 0x38, 0x37, 0x63, 0x37, 0x62, 0x33, 
+0x36, 0x64, 0x64, 0x36, 0x36, 0x65, 0x37, 0x30, 
+0x66, 0x32, 0x61, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 
+0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 
+0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 
+0x64, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x62, 0x63, 0x31, 0x71, 0x76, 0x79, 0x71, 0x30, 
+0x63, 0x63, 0x36, 0x72, 0x61, 0x68, 0x79, 0x76, 
+0x73, 0x61, 0x7a, 0x66, 0x64, 0x6a, 0x65, 0x30, 
+0x74, 0x77, 0x6c, 0x37, 0x65, 0x7a, 0x38, 0x32, 
+0x6e, 0x64, 0x6d, 0x75, 0x61, 0x63, 0x32, 0x6c, 
+0x68, 0x76, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 0x30, 
+0x31, 0x34, 0x36, 0x31, 0x30, 0x30, 0x66, 0x63, 
+0x36, 0x33, 0x34, 0x33, 0x65, 0x64, 0x63, 0x38, 
+0x63, 0x38, 0x37, 0x34, 0x34, 0x39, 0x36, 0x63, 
+0x62, 0x32, 0x66, 0x35, 0x62, 0x62, 0x66, 0x65, 
+0x63, 0x38, 0x38, 0x65, 0x61, 0x39, 0x62, 0x37, 
+0x37, 0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 
+0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x31, 0x71, 
+0x79, 0x75, 0x63, 0x79, 0x6b, 0x64, 0x6c, 0x68, 
+0x70, 0x36, 0x32, 0x74, 0x65, 0x7a, 0x73, 0x30, 
+0x68, 0x61, 0x67, 0x71, 0x75, 0x72, 0x79, 0x34, 
+0x30, 0x32, 0x71, 0x77, 0x68, 0x6b, 0x35, 0x38, 
+0x39, 0x71, 0x38, 0x30, 0x74, 0x71, 0x73, 0x35, 
+0x6d, 0x79, 0x68, 0x33, 0x72, 0x78, 0x71, 0x33, 
+0x34, 0x6e, 0x77, 0x71, 0x68, 0x6b, 0x64, 0x68, 
+0x76, 0x37, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 0x30, 
+0x32, 0x30, 0x32, 0x37, 0x33, 0x30, 0x34, 0x62, 
+0x33, 0x37, 0x66, 0x37, 0x30, 0x65, 0x39, 0x34, 
+0x62, 0x63, 0x38, 0x61, 0x30, 0x66, 0x62, 0x66, 
+0x35, 0x30, 0x30, 0x65, 0x30, 0x63, 0x39, 0x35, 
+0x37, 0x61, 0x38, 0x30, 0x65, 0x62, 0x64, 0x61, 
+0x38, 0x37, 0x32, 0x38, 0x30, 0x65, 0x66, 0x35, 
+0x38, 0x32, 0x31, 0x34, 0x64, 0x39, 0x32, 0x66, 
+0x31, 0x31, 0x39, 0x38, 0x31, 0x31, 0x61, 0x63, 
+0x64, 0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 
+0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x31, 0x70, 
+0x38, 0x33, 0x6e, 0x33, 0x61, 0x75, 0x30, 0x72, 
+0x6a, 0x79, 0x6c, 0x65, 0x66, 0x78, 0x71, 0x32, 
+0x6e, 0x63, 0x32, 0x78, 0x68, 0x32, 0x79, 0x34, 
+0x6a, 0x7a, 0x7a, 0x34, 0x70, 0x6d, 0x36, 0x7a, 
+0x78, 0x6a, 0x34, 0x6d, 0x77, 0x35, 0x70, 0x61, 
+0x67, 0x64, 0x6a, 0x6a, 0x72, 0x32, 0x61, 0x39, 
+0x66, 0x33, 0x36, 0x73, 0x36, 0x6a, 0x6a, 0x6e, 
+0x6e, 0x75, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x31, 
+0x32, 0x30, 0x33, 0x63, 0x36, 0x37, 0x31, 0x65, 
+0x66, 0x31, 0x65, 0x33, 0x39, 0x31, 0x33, 0x66, 
+0x39, 0x34, 0x39, 0x38, 0x30, 0x61, 0x39, 0x65, 
+0x31, 0x34, 0x36, 0x62, 0x61, 0x38, 0x39, 0x35, 
+0x39, 0x30, 0x38, 0x35, 0x35, 0x30, 0x65, 0x66, 
+0x34, 0x32, 0x33, 0x34, 0x61, 0x62, 0x62, 0x37, 
+0x35, 0x30, 0x33, 0x64, 0x34, 0x33, 0x36, 0x35, 
+0x32, 0x31, 0x61, 0x62, 0x61, 0x35, 0x34, 0x63, 
+0x37, 0x35, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 
+0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x31, 0x7a, 
+0x32, 0x72, 0x6b, 0x73, 0x75, 0x6b, 0x6b, 0x6a, 
+0x72, 0x38, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x32, 
+0x30, 0x32, 0x35, 0x30, 0x65, 0x64, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 0x79, 
+0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 0x70, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x74, 0x62, 0x31, 0x71, 0x63, 0x72, 0x68, 0x33, 
+0x79, 0x71, 0x6e, 0x34, 0x6e, 0x6c, 0x6c, 0x65, 
+0x70, 0x6c, 0x63, 0x65, 0x7a, 0x32, 0x79, 0x6e, 
+0x64, 0x71, 0x32, 0x72, 0x79, 0x38, 0x68, 0x39, 
+0x6e, 0x63, 0x67, 0x33, 0x71, 0x68, 0x37, 0x6e, 
+0x35, 0x34, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 0x30, 
+0x31, 0x34, 0x63, 0x30, 0x65, 0x66, 0x31, 0x32, 
+0x30, 0x32, 0x37, 0x35, 0x39, 0x66, 0x66, 0x66, 
+0x39, 0x30, 0x66, 0x66, 0x31, 0x39, 0x31, 0x32, 
+0x38, 0x39, 0x33, 0x36, 0x38, 0x31, 0x34, 0x33, 
+0x32, 0x31, 0x65, 0x65, 0x35, 0x39, 0x65, 0x31, 
+0x31, 0x31, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 0x71, 
+0x75, 0x79, 0x6c, 0x39, 0x75, 0x6a, 0x70, 0x67, 
+0x77, 0x72, 0x32, 0x63, 0x68, 0x64, 0x7a, 0x64, 
+0x6e, 0x6e, 0x61, 0x6c, 0x65, 0x6e, 0x34, 0x38, 
+0x73, 0x75, 0x70, 0x32, 0x34, 0x35, 0x76, 0x64, 
+0x66, 0x6e, 0x68, 0x32, 0x6a, 0x78, 0x68, 0x73, 
+0x75, 0x71, 0x33, 0x79, 0x78, 0x38, 0x30, 0x72, 
+0x72, 0x77, 0x6c, 0x71, 0x35, 0x68, 0x71, 0x66, 
+0x65, 0x34, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 0x30, 
+0x32, 0x30, 0x65, 0x31, 0x33, 0x65, 0x35, 0x65, 
+0x34, 0x38, 0x32, 0x38, 0x37, 0x30, 0x64, 0x35, 
+0x38, 0x62, 0x62, 0x34, 0x34, 0x64, 0x39, 0x63, 
+0x66, 0x62, 0x66, 0x63, 0x63, 0x65, 0x61, 0x37, 
+0x38, 0x37, 0x30, 0x32, 0x61, 0x61, 0x64, 0x31, 
+0x38, 0x64, 0x34, 0x63, 0x65, 0x65, 0x61, 0x39, 
+0x31, 0x61, 0x66, 0x30, 0x65, 0x30, 0x32, 0x32, 
+0x34, 0x33, 0x31, 0x64, 0x65, 0x33, 0x31, 0x62, 
+0x62, 0x65, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 0x70, 
+0x33, 0x35, 0x6e, 0x35, 0x32, 0x6a, 0x79, 0x36, 
+0x78, 0x6b, 0x6d, 0x34, 0x77, 0x64, 0x39, 0x30, 
+0x35, 0x74, 0x64, 0x79, 0x38, 0x71, 0x74, 0x61, 
+0x67, 0x72, 0x6e, 0x37, 0x33, 0x6b, 0x71, 0x64, 
+0x7a, 0x37, 0x33, 0x78, 0x65, 0x34, 0x7a, 0x78, 
+0x70, 0x76, 0x71, 0x39, 0x74, 0x33, 0x66, 0x70, 
+0x35, 0x30, 0x61, 0x71, 0x6b, 0x33, 0x73, 0x36, 
+0x67, 0x7a, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x31, 
+0x32, 0x30, 0x38, 0x64, 0x32, 0x37, 0x34, 0x35, 
+0x34, 0x38, 0x39, 0x61, 0x33, 0x35, 0x62, 0x37, 
+0x35, 0x37, 0x33, 0x34, 0x61, 0x66, 0x61, 0x32, 
+0x64, 0x61, 0x34, 0x33, 0x38, 0x31, 0x37, 0x64, 
+0x34, 0x30, 0x65, 0x37, 0x65, 0x38, 0x64, 0x38, 
+0x30, 0x64, 0x31, 0x37, 0x61, 0x32, 0x36, 0x63, 
+0x64, 0x34, 0x34, 0x36, 0x30, 0x62, 0x30, 0x30, 
+0x35, 0x35, 0x63, 0x35, 0x32, 0x31, 0x61, 0x33, 
+0x66, 0x61, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 0x72, 
+0x67, 0x76, 0x35, 0x6d, 0x36, 0x75, 0x76, 0x64, 
+0x6b, 0x33, 0x6b, 0x63, 0x37, 0x71, 0x73, 0x75, 
+0x7a, 0x30, 0x63, 0x37, 0x39, 0x76, 0x38, 0x38, 
+0x79, 0x63, 0x72, 0x35, 0x77, 0x34, 0x77, 0x61, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x35, 0x33, 0x31, 0x30, 
+0x34, 0x33, 0x32, 0x39, 0x62, 0x64, 0x37, 0x31, 
+0x38, 0x64, 0x62, 0x34, 0x36, 0x64, 0x38, 0x66, 
+0x30, 0x32, 0x31, 0x63, 0x31, 0x33, 0x66, 0x31, 
+0x65, 0x32, 0x62, 0x30, 0x65, 0x37, 0x32, 0x36, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 
+0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 
+0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x62, 0x31, 0x71, 0x33, 0x76, 
+0x79, 0x61, 0x32, 0x68, 0x35, 0x34, 0x33, 0x35, 
+0x6a, 0x6b, 0x75, 0x67, 0x71, 0x32, 0x66, 0x65, 
+0x77, 0x37, 0x64, 0x6d, 0x6b, 0x74, 0x6c, 0x72, 
+0x77, 0x71, 0x34, 0x65, 0x6a, 0x6d, 0x66, 0x61, 
+0x77, 0x37, 0x6b, 0x72, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x30, 0x30, 0x31, 0x34, 0x38, 0x62, 0x30, 0x39, 
+0x64, 0x35, 0x35, 0x65, 0x39, 0x35, 0x38, 0x64, 
+0x32, 0x35, 0x36, 0x65, 0x32, 0x30, 0x30, 0x61, 
+0x34, 0x65, 0x35, 0x64, 0x65, 0x36, 0x65, 0x65, 
+0x63, 0x62, 0x66, 0x38, 0x64, 0x63, 0x30, 0x61, 
+0x65, 0x36, 0x35, 0x62, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 
+0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x73, 
+0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 0x79, 
+0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 0x70, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x74, 0x62, 0x31, 0x71, 0x78, 0x6b, 0x68, 0x72, 
+0x6c, 0x32, 0x73, 0x36, 0x74, 0x74, 0x72, 0x63, 
+0x6c, 0x63, 0x6b, 0x6c, 0x64, 0x72, 0x75, 0x65, 
+0x61, 0x30, 0x65, 0x38, 0x61, 0x6e, 0x68, 0x72, 
+0x65, 0x68, 0x66, 0x66, 0x6c, 0x38, 0x78, 0x76, 
+0x37, 0x74, 0x30, 0x70, 0x64, 0x79, 0x72, 0x7a, 
+0x6d, 0x30, 0x38, 0x76, 0x32, 0x68, 0x79, 0x71, 
+0x79, 0x34, 0x30, 0x38, 0x6e, 0x66, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x30, 0x30, 0x32, 0x30, 0x33, 0x35, 
+0x61, 0x65, 0x33, 0x66, 0x61, 0x61, 0x31, 0x61, 
+0x35, 0x61, 0x63, 0x37, 0x38, 0x66, 0x65, 0x32, 
+0x64, 0x66, 0x36, 0x38, 0x66, 0x39, 0x39, 0x65, 
+0x62, 0x66, 0x32, 0x37, 0x65, 0x63, 0x65, 0x65, 
+0x33, 0x63, 0x64, 0x64, 0x32, 0x39, 0x66, 0x39, 
+0x63, 0x63, 0x63, 0x66, 0x32, 0x64, 0x65, 0x31, 
+0x36, 0x39, 0x30, 0x36, 0x32, 0x64, 0x62, 0x63, 
+0x65, 0x63, 0x35, 0x35, 0x63, 0x38, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 
+0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 
+0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x62, 0x31, 0x70, 0x61, 0x65, 
+0x35, 0x75, 0x6d, 0x32, 0x37, 0x61, 0x68, 0x6e, 
+0x38, 0x6e, 0x37, 0x33, 0x70, 0x67, 0x65, 0x78, 
+0x65, 0x33, 0x6b, 0x63, 0x77, 0x6c, 0x70, 0x38, 
+0x64, 0x68, 0x73, 0x77, 0x70, 0x6e, 0x36, 0x38, 
+0x34, 0x68, 0x32, 0x6b, 0x32, 0x77, 0x36, 0x74, 
+0x39, 0x61, 0x37, 0x77, 0x33, 0x65, 0x71, 0x36, 
+0x35, 0x71, 0x65, 0x70, 0x68, 0x64, 0x35, 0x79, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x35, 0x31, 0x32, 0x30, 
+0x65, 0x65, 0x36, 0x39, 0x63, 0x64, 0x61, 0x62, 
+0x64, 0x64, 0x62, 0x63, 0x63, 0x66, 0x33, 0x66, 
+0x34, 0x34, 0x32, 0x38, 0x63, 0x39, 0x62, 0x33, 
+0x31, 0x62, 0x36, 0x31, 0x64, 0x66, 0x30, 0x39, 
+0x64, 0x62, 0x37, 0x38, 0x33, 0x38, 0x33, 0x33, 
+0x64, 0x31, 0x65, 0x62, 0x37, 0x35, 0x35, 0x39, 
+0x34, 0x65, 0x64, 0x32, 0x63, 0x62, 0x64, 0x66, 
+0x33, 0x61, 0x33, 0x39, 0x30, 0x36, 0x61, 0x38, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 0x72, 
+0x78, 0x39, 0x6e, 0x39, 0x67, 0x33, 0x37, 0x61, 
+0x7a, 0x38, 0x6d, 0x75, 0x32, 0x33, 0x36, 0x65, 
+0x35, 0x6a, 0x70, 0x78, 0x64, 0x74, 0x30, 0x6d, 
+0x36, 0x37, 0x79, 0x34, 0x66, 0x75, 0x71, 0x38, 
+0x72, 0x68, 0x73, 0x30, 0x73, 0x73, 0x33, 0x64, 
+0x6a, 0x6e, 0x6d, 0x30, 0x6b, 0x73, 0x63, 0x66, 
+0x72, 0x77, 0x76, 0x71, 0x30, 0x6e, 0x74, 0x6c, 
+0x79, 0x67, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x33, 
+0x32, 0x30, 0x33, 0x31, 0x36, 0x36, 0x35, 0x34, 
+0x34, 0x37, 0x64, 0x64, 0x31, 0x31, 0x66, 0x37, 
+0x63, 0x35, 0x34, 0x37, 0x35, 0x39, 0x61, 0x34, 
+0x38, 0x32, 0x36, 0x36, 0x61, 0x64, 0x66, 0x62, 
+0x64, 0x37, 0x38, 0x39, 0x35, 0x34, 0x66, 0x30, 
+0x30, 0x37, 0x31, 0x64, 0x65, 0x30, 0x66, 0x38, 
+0x34, 0x32, 0x32, 0x64, 0x39, 0x34, 0x66, 0x36, 
+0x66, 0x62, 0x34, 0x33, 0x30, 0x39, 0x31, 0x62, 
+0x39, 0x38, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x73, 0x69, 0x67, 
+0x6e, 0x65, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 
+0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 
+0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 
+0x73, 0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 
+0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 
+0x72, 0x74, 0x31, 0x71, 0x64, 0x61, 0x76, 0x74, 
+0x34, 0x6a, 0x32, 0x73, 0x64, 0x37, 0x64, 0x6c, 
+0x68, 0x71, 0x73, 0x61, 0x76, 0x74, 0x6e, 0x66, 
+0x78, 0x76, 0x7a, 0x70, 0x70, 0x77, 0x36, 0x6b, 
+0x37, 0x71, 0x79, 0x39, 0x37, 0x74, 0x6d, 0x6e, 
+0x75, 0x39, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 0x30, 
+0x31, 0x34, 0x36, 0x66, 0x35, 0x38, 0x62, 0x61, 
+0x63, 0x39, 0x35, 0x30, 0x36, 0x66, 0x39, 0x62, 
+0x66, 0x62, 0x38, 0x32, 0x31, 0x64, 0x36, 0x32, 
+0x65, 0x36, 0x39, 0x33, 0x33, 0x30, 0x34, 0x31, 
+0x30, 0x62, 0x62, 0x35, 0x36, 0x66, 0x30, 0x30, 
+0x38, 0x35, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 0x67, 
+0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 
+0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 
+0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 
+0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 
+0x63, 0x72, 0x74, 0x31, 0x71, 0x61, 0x6e, 0x38, 
+0x67, 0x6e, 0x74, 0x61, 0x63, 0x37, 0x7a, 0x37, 
+0x6d, 0x65, 0x32, 0x65, 0x6a, 0x74, 0x34, 0x68, 
+0x70, 0x72, 0x75, 0x34, 0x32, 0x61, 0x64, 0x32, 
+0x66, 0x37, 0x35, 0x39, 0x66, 0x6d, 0x79, 0x30, 
+0x6d, 0x33, 0x65, 0x6a, 0x76, 0x73, 0x39, 0x38, 
+0x36, 0x35, 0x36, 0x7a, 0x6e, 0x76, 0x37, 0x65, 
+0x71, 0x67, 0x61, 0x34, 0x75, 0x68, 0x76, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x30, 0x30, 0x32, 0x30, 0x65, 
+0x63, 0x63, 0x65, 0x38, 0x39, 0x61, 0x66, 0x62, 
+0x38, 0x66, 0x30, 0x62, 0x64, 0x62, 0x63, 0x61, 
+0x62, 0x33, 0x32, 0x35, 0x64, 0x36, 0x65, 0x31, 
+0x31, 0x66, 0x32, 0x61, 0x61, 0x65, 0x62, 0x35, 
+0x34, 0x39, 0x66, 0x35, 0x30, 0x61, 0x39, 0x64, 
+0x39, 0x31, 0x66, 0x62, 0x38, 0x65, 0x36, 0x34, 
+0x63, 0x38, 0x31, 0x34, 0x66, 0x61, 0x61, 0x36, 
+0x38, 0x35, 0x33, 0x36, 0x37, 0x62, 0x32, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x72, 0x65, 0x67, 0x74, 0x65, 0x73, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 
+0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x72, 0x74, 
+0x31, 0x70, 0x66, 0x77, 0x78, 0x6a, 0x71, 0x76, 
+0x74, 0x74, 0x34, 0x74, 0x63, 0x78, 0x72, 0x74, 
+0x64, 0x6c, 0x75, 0x75, 0x6b, 0x66, 0x6d, 0x79, 
+0x32, 0x64, 0x76, 0x37, 0x78, 0x64, 0x32, 0x71, 
+0x7a, 0x64, 0x66, 0x79, 0x36, 0x6b, 0x61, 0x6a, 
+0x76, 0x35, 0x6e, 0x77, 0x6e, 0x34, 0x79, 0x61, 
+0x6d, 0x33, 0x77, 0x78, 0x6b, 0x71, 0x33, 0x35, 
+0x35, 0x33, 0x75, 0x68, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x35, 0x31, 0x32, 0x30, 0x34, 0x62, 0x38, 0x64, 
+0x32, 0x30, 0x33, 0x31, 0x36, 0x62, 0x61, 0x61, 
+0x66, 0x30, 0x36, 0x31, 0x61, 0x64, 0x62, 0x66, 
+0x65, 0x37, 0x32, 0x63, 0x39, 0x64, 0x39, 0x31, 
+0x34, 0x64, 0x36, 0x37, 0x38, 0x63, 0x64, 0x35, 
+0x30, 0x30, 0x34, 0x64, 0x34, 0x39, 0x33, 0x35, 
+0x36, 0x65, 0x63, 0x39, 0x39, 0x34, 0x39, 0x62, 
+0x61, 0x37, 0x35, 0x32, 0x37, 0x37, 0x37, 0x31, 
+0x37, 0x31, 0x61, 0x63, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 
+0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 
+0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 
+0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 
+0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x62, 0x63, 0x72, 0x74, 0x31, 0x73, 0x78, 
+0x36, 0x70, 0x38, 0x6e, 0x6a, 0x6c, 0x78, 0x37, 
+0x68, 0x39, 0x6d, 0x63, 0x32, 0x61, 0x67, 0x7a, 
+0x34, 0x79, 0x67, 0x38, 0x32, 0x64, 0x7a, 0x6e, 
+0x65, 0x32, 0x33, 0x30, 0x35, 0x30, 0x6e, 0x63, 
+0x71, 0x37, 0x32, 0x63, 0x6e, 0x65, 0x65, 0x65, 
+0x63, 0x65, 0x7a, 0x32, 0x70, 0x73, 0x74, 0x38, 
+0x6d, 0x61, 0x68, 0x6e, 0x38, 0x78, 0x65, 0x63, 
+0x73, 0x66, 0x38, 0x67, 0x36, 0x68, 0x7a, 0x78, 
+0x39, 0x34, 0x34, 0x32, 0x30, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x36, 0x30, 0x32, 0x38, 0x33, 0x36, 0x38, 
+0x32, 0x37, 0x39, 0x63, 0x62, 0x65, 0x36, 0x66, 
+0x35, 0x63, 0x62, 0x62, 0x63, 0x32, 0x62, 0x61, 
+0x38, 0x31, 0x35, 0x34, 0x38, 0x38, 0x33, 0x61, 
+0x39, 0x61, 0x32, 0x39, 0x65, 0x35, 0x35, 0x31, 
+0x37, 0x64, 0x31, 0x66, 0x33, 0x63, 0x30, 0x33, 
+0x63, 0x61, 0x63, 0x34, 0x66, 0x33, 0x39, 0x63, 
+0x65, 0x33, 0x32, 0x32, 0x35, 0x30, 0x36, 0x30, 
+0x62, 0x33, 0x65, 0x66, 0x62, 0x37, 0x39, 0x39, 
+0x63, 0x64, 0x39, 0x63, 0x34, 0x31, 0x32, 0x37, 
+0x34, 0x36, 0x61, 0x65, 0x32, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x72, 0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 
+0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 
+0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x31, 0x46, 0x6a, 0x4c, 0x38, 0x37, 
+0x70, 0x6e, 0x38, 0x6b, 0x79, 0x36, 0x56, 0x62, 
+0x61, 0x76, 0x64, 0x31, 0x5a, 0x48, 0x65, 0x43, 
+0x68, 0x52, 0x58, 0x74, 0x6f, 0x78, 0x77, 0x52, 
+0x47, 0x43, 0x52, 0x64, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x37, 0x36, 0x61, 0x39, 0x31, 0x34, 0x61, 0x31, 
+0x39, 0x33, 0x33, 0x31, 0x62, 0x37, 0x62, 0x32, 
+0x36, 0x32, 0x37, 0x65, 0x36, 0x36, 0x33, 0x65, 
+0x32, 0x35, 0x61, 0x37, 0x62, 0x30, 0x30, 0x31, 
+0x65, 0x34, 0x63, 0x30, 0x64, 0x63, 0x63, 0x35, 
+0x65, 0x32, 0x31, 0x62, 0x63, 0x37, 0x38, 0x38, 
+0x61, 0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 
+0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x33, 0x42, 0x5a, 0x45, 0x43, 
+0x65, 0x41, 0x48, 0x38, 0x67, 0x53, 0x4b, 0x6b, 
+0x6a, 0x72, 0x54, 0x78, 0x38, 0x50, 0x77, 0x4d, 
+0x72, 0x4e, 0x51, 0x42, 0x4c, 0x47, 0x31, 0x38, 
+0x79, 0x48, 0x70, 0x76, 0x66, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x61, 0x39, 0x31, 0x34, 0x36, 0x63, 0x33, 
+0x38, 0x32, 0x64, 0x63, 0x64, 0x66, 0x35, 0x62, 
+0x32, 0x38, 0x34, 0x37, 0x36, 0x30, 0x63, 0x38, 
+0x65, 0x33, 0x66, 0x65, 0x61, 0x64, 0x39, 0x31, 
+0x66, 0x37, 0x34, 0x32, 0x32, 0x63, 0x64, 0x37, 
+0x36, 0x61, 0x61, 0x38, 0x37, 0x38, 0x37, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x6e, 0x34, 0x59, 0x4e, 0x62, 0x59, 0x75, 0x46, 
+0x64, 0x50, 0x77, 0x46, 0x72, 0x78, 0x53, 0x50, 
+0x38, 0x73, 0x6a, 0x48, 0x46, 0x62, 0x41, 0x68, 
+0x55, 0x62, 0x4c, 0x4d, 0x55, 0x69, 0x59, 0x39, 
+0x6a, 0x45, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 0x36, 
+0x61, 0x39, 0x31, 0x34, 0x66, 0x63, 0x38, 0x66, 
+0x39, 0x38, 0x35, 0x31, 0x66, 0x33, 0x63, 0x31, 
+0x65, 0x34, 0x37, 0x31, 0x39, 0x63, 0x64, 0x30, 
+0x62, 0x38, 0x65, 0x34, 0x38, 0x31, 0x36, 0x64, 
+0x64, 0x34, 0x65, 0x38, 0x38, 0x63, 0x37, 0x32, 
+0x65, 0x35, 0x32, 0x38, 0x38, 0x38, 0x61, 0x63, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x32, 0x4e, 0x41, 0x65, 0x51, 0x56, 0x5a, 
+0x61, 0x79, 0x7a, 0x56, 0x46, 0x41, 0x74, 0x67, 
+0x65, 0x43, 0x33, 0x69, 0x59, 0x4a, 0x73, 0x6a, 
+0x70, 0x6a, 0x57, 0x44, 0x6d, 0x73, 0x44, 0x70, 
+0x68, 0x37, 0x31, 0x41, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x61, 0x39, 0x31, 0x34, 0x62, 0x65, 0x64, 0x63, 
+0x37, 0x39, 0x37, 0x33, 0x34, 0x32, 0x63, 0x30, 
+0x33, 0x66, 0x64, 0x37, 0x61, 0x33, 0x34, 0x36, 
+0x63, 0x34, 0x63, 0x37, 0x38, 0x35, 0x37, 0x63, 
+0x61, 0x30, 0x33, 0x64, 0x34, 0x36, 0x37, 0x30, 
+0x31, 0x33, 0x62, 0x36, 0x38, 0x37, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x6d, 
+0x6e, 0x43, 0x42, 0x70, 0x6b, 0x4e, 0x4d, 0x4a, 
+0x45, 0x4a, 0x4c, 0x65, 0x68, 0x67, 0x64, 0x45, 
+0x6b, 0x7a, 0x53, 0x6f, 0x32, 0x65, 0x69, 0x6f, 
+0x6e, 0x69, 0x79, 0x4a, 0x4d, 0x78, 0x4c, 0x70, 
+0x5a, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 0x36, 0x61, 
+0x39, 0x31, 0x34, 0x34, 0x39, 0x33, 0x63, 0x34, 
+0x35, 0x35, 0x35, 0x35, 0x31, 0x65, 0x34, 0x38, 
+0x61, 0x31, 0x34, 0x32, 0x33, 0x32, 0x36, 0x33, 
+0x62, 0x36, 0x32, 0x62, 0x31, 0x32, 0x37, 0x62, 
+0x34, 0x33, 0x36, 0x31, 0x30, 0x36, 0x61, 0x36, 
+0x38, 0x35, 0x34, 0x38, 0x38, 0x61, 0x63, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x32, 0x4e, 0x35, 0x73, 0x4e, 0x48, 
+0x6f, 0x6d, 0x65, 0x4e, 0x4a, 0x44, 0x5a, 0x76, 
+0x36, 0x37, 0x41, 0x63, 0x46, 0x78, 0x39, 0x45, 
+0x53, 0x37, 0x46, 0x42, 0x5a, 0x59, 0x34, 0x6a, 
+0x78, 0x39, 0x4b, 0x44, 0x41, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x61, 0x39, 0x31, 0x34, 0x38, 0x61, 0x37, 
+0x37, 0x36, 0x61, 0x30, 0x66, 0x33, 0x34, 0x64, 
+0x35, 0x36, 0x62, 0x36, 0x33, 0x65, 0x37, 0x63, 
+0x35, 0x39, 0x35, 0x66, 0x32, 0x62, 0x32, 0x30, 
+0x35, 0x64, 0x62, 0x65, 0x31, 0x63, 0x33, 0x39, 
+0x33, 0x36, 0x31, 0x37, 0x61, 0x38, 0x37, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x6d, 0x66, 0x68, 0x45, 0x36, 0x6a, 
+0x41, 0x55, 0x77, 0x6a, 0x55, 0x44, 0x4e, 0x5a, 
+0x68, 0x61, 0x58, 0x31, 0x50, 0x41, 0x73, 0x44, 
+0x54, 0x4b, 0x66, 0x6e, 0x65, 0x51, 0x46, 0x32, 
+0x4e, 0x73, 0x68, 0x63, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x37, 0x36, 0x61, 0x39, 0x31, 0x34, 0x30, 0x31, 
+0x66, 0x31, 0x35, 0x61, 0x34, 0x63, 0x63, 0x30, 
+0x36, 0x33, 0x64, 0x61, 0x65, 0x34, 0x66, 0x34, 
+0x64, 0x35, 0x36, 0x62, 0x38, 0x39, 0x62, 0x66, 
+0x62, 0x63, 0x38, 0x62, 0x63, 0x63, 0x39, 0x61, 
+0x65, 0x35, 0x33, 0x38, 0x37, 0x63, 0x38, 0x38, 
+0x61, 0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 0x67, 
+0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 
+0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x32, 0x4d, 
+0x78, 0x4e, 0x6d, 0x31, 0x56, 0x48, 0x79, 0x56, 
+0x55, 0x34, 0x52, 0x75, 0x50, 0x33, 0x75, 0x31, 
+0x63, 0x31, 0x76, 0x35, 0x61, 0x51, 0x4c, 0x6b, 
+0x32, 0x64, 0x51, 0x6a, 0x77, 0x79, 0x31, 0x51, 
+0x6b, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x61, 0x39, 0x31, 
+0x34, 0x33, 0x38, 0x34, 0x35, 0x36, 0x66, 0x37, 
+0x63, 0x30, 0x37, 0x36, 0x33, 0x35, 0x36, 0x61, 
+0x62, 0x61, 0x64, 0x63, 0x63, 0x36, 0x37, 0x62, 
+0x39, 0x32, 0x61, 0x64, 0x37, 0x37, 0x37, 0x65, 
+0x62, 0x32, 0x30, 0x66, 0x62, 0x39, 0x66, 0x38, 
+0x38, 0x38, 0x37, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 
+0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 
+0x48, 0x73, 0x4c, 0x32, 0x6e, 0x5a, 0x75, 0x45, 
+0x65, 0x62, 0x55, 0x35, 0x6e, 0x4d, 0x33, 0x52, 
+0x78, 0x4e, 0x56, 0x51, 0x44, 0x39, 0x47, 0x63, 
+0x41, 0x6e, 0x76, 0x4e, 0x4d, 0x61, 0x68, 0x71, 
+0x51, 0x73, 0x6b, 0x66, 0x34, 0x66, 0x6b, 0x71, 
+0x48, 0x65, 0x35, 0x34, 0x7a, 0x77, 0x64, 0x31, 
+0x34, 0x65, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 0x36, 
+0x65, 0x38, 0x36, 0x34, 0x39, 0x37, 0x39, 0x30, 
+0x61, 0x39, 0x30, 0x36, 0x31, 0x35, 0x61, 0x34, 
+0x36, 0x64, 0x32, 0x32, 0x64, 0x64, 0x37, 0x36, 
+0x32, 0x65, 0x30, 0x63, 0x34, 0x32, 0x36, 0x31, 
+0x35, 0x33, 0x33, 0x36, 0x37, 0x34, 0x35, 0x33, 
+0x35, 0x36, 0x63, 0x32, 0x65, 0x31, 0x36, 0x31, 
+0x34, 0x37, 0x63, 0x30, 0x66, 0x33, 0x64, 0x34, 
+0x36, 0x62, 0x34, 0x30, 0x64, 0x35, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 
+0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 
+0x64, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x4b, 0x77, 0x75, 0x56, 0x76, 0x75, 0x36, 
+0x68, 0x73, 0x75, 0x45, 0x4d, 0x48, 0x72, 0x66, 
+0x46, 0x57, 0x4a, 0x51, 0x56, 0x36, 0x34, 0x74, 
+0x52, 0x72, 0x57, 0x58, 0x33, 0x51, 0x7a, 0x71, 
+0x48, 0x48, 0x31, 0x38, 0x4a, 0x75, 0x41, 0x48, 
+0x59, 0x71, 0x59, 0x56, 0x36, 0x64, 0x71, 0x42, 
+0x76, 0x4e, 0x4b, 0x78, 0x64, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x31, 0x34, 0x37, 0x38, 0x30, 0x34, 0x62, 
+0x66, 0x38, 0x61, 0x30, 0x64, 0x66, 0x66, 0x66, 
+0x33, 0x35, 0x39, 0x33, 0x39, 0x61, 0x36, 0x31, 
+0x31, 0x63, 0x37, 0x66, 0x35, 0x61, 0x36, 0x30, 
+0x61, 0x63, 0x31, 0x30, 0x37, 0x66, 0x33, 0x33, 
+0x66, 0x33, 0x33, 0x64, 0x36, 0x30, 0x35, 0x39, 
+0x66, 0x32, 0x37, 0x33, 0x64, 0x32, 0x30, 0x37, 
+0x39, 0x61, 0x62, 0x31, 0x64, 0x39, 0x30, 0x66, 
+0x32, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 0x6e, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 
+0x73, 0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x39, 0x32, 0x31, 0x4d, 0x31, 
+0x52, 0x4e, 0x78, 0x67, 0x68, 0x46, 0x63, 0x73, 
+0x56, 0x47, 0x71, 0x41, 0x4a, 0x6b, 0x73, 0x51, 
+0x56, 0x62, 0x53, 0x67, 0x78, 0x33, 0x36, 0x59, 
+0x7a, 0x34, 0x75, 0x36, 0x76, 0x65, 0x62, 0x66, 
+0x7a, 0x31, 0x77, 0x44, 0x75, 0x6a, 0x4e, 0x76, 
+0x67, 0x4e, 0x74, 0x39, 0x33, 0x42, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x33, 0x37, 0x37, 0x37, 0x62, 0x33, 
+0x34, 0x31, 0x63, 0x34, 0x35, 0x65, 0x32, 0x61, 
+0x39, 0x62, 0x39, 0x62, 0x66, 0x36, 0x62, 0x66, 
+0x62, 0x37, 0x31, 0x64, 0x63, 0x37, 0x64, 0x31, 
+0x32, 0x39, 0x66, 0x36, 0x34, 0x66, 0x31, 0x62, 
+0x39, 0x34, 0x30, 0x36, 0x65, 0x64, 0x34, 0x66, 
+0x39, 0x33, 0x61, 0x64, 0x65, 0x38, 0x66, 0x35, 
+0x36, 0x30, 0x36, 0x35, 0x66, 0x31, 0x62, 0x37, 
+0x33, 0x32, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 
+0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 
+0x65, 0x73, 0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 
+0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x4e, 0x45, 
+0x6e, 0x62, 0x66, 0x46, 0x32, 0x66, 0x63, 0x78, 
+0x6d, 0x6d, 0x43, 0x4c, 0x57, 0x71, 0x4d, 0x41, 
+0x61, 0x71, 0x36, 0x66, 0x78, 0x4a, 0x76, 0x56, 
+0x6b, 0x77, 0x4d, 0x62, 0x79, 0x55, 0x33, 0x6b, 
+0x43, 0x62, 0x70, 0x51, 0x7a, 0x6e, 0x7a, 0x34, 
+0x5a, 0x31, 0x6a, 0x36, 0x54, 0x5a, 0x44, 0x47, 
+0x62, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x31, 0x33, 0x39, 
+0x37, 0x62, 0x30, 0x64, 0x34, 0x61, 0x30, 0x33, 
+0x65, 0x31, 0x61, 0x62, 0x32, 0x63, 0x35, 0x34, 
+0x64, 0x64, 0x39, 0x61, 0x66, 0x39, 0x39, 0x63, 
+0x65, 0x31, 0x65, 0x63, 0x62, 0x66, 0x62, 0x39, 
+0x30, 0x63, 0x38, 0x30, 0x61, 0x35, 0x38, 0x38, 
+0x38, 0x36, 0x64, 0x61, 0x39, 0x35, 0x65, 0x31, 
+0x31, 0x38, 0x31, 0x61, 0x35, 0x35, 0x37, 0x30, 
+0x33, 0x64, 0x39, 0x36, 0x62, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 0x6f, 
+0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x39, 
+0x33, 0x42, 0x63, 0x70, 0x43, 0x4d, 0x4b, 0x50, 
+0x6d, 0x46, 0x43, 0x75, 0x59, 0x38, 0x62, 0x71, 
+0x53, 0x34, 0x6b, 0x33, 0x48, 0x46, 0x72, 0x68, 
+0x4a, 0x31, 0x41, 0x66, 0x78, 0x69, 0x34, 0x75, 
+0x53, 0x73, 0x45, 0x65, 0x4a, 0x46, 0x76, 0x58, 
+0x38, 0x36, 0x47, 0x59, 0x57, 0x37, 0x50, 0x43, 
+0x37, 0x57, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x64, 0x32, 
+0x37, 0x64, 0x31, 0x62, 0x36, 0x65, 0x66, 0x35, 
+0x35, 0x63, 0x61, 0x32, 0x65, 0x34, 0x64, 0x34, 
+0x37, 0x35, 0x62, 0x35, 0x32, 0x37, 0x36, 0x66, 
+0x32, 0x64, 0x62, 0x62, 0x38, 0x35, 0x66, 0x37, 
+0x61, 0x36, 0x34, 0x35, 0x39, 0x64, 0x63, 0x65, 
+0x65, 0x62, 0x38, 0x39, 0x63, 0x36, 0x37, 0x62, 
+0x37, 0x37, 0x36, 0x66, 0x64, 0x33, 0x62, 0x62, 
+0x39, 0x37, 0x34, 0x34, 0x35, 0x32, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 
+0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x55, 0x74, 0x77, 0x62, 
+0x79, 0x78, 0x6f, 0x4c, 0x31, 0x6f, 0x77, 0x50, 
+0x78, 0x55, 0x61, 0x66, 0x67, 0x48, 0x32, 0x6d, 
+0x65, 0x45, 0x70, 0x79, 0x64, 0x65, 0x79, 0x77, 
+0x6a, 0x68, 0x6e, 0x54, 0x59, 0x76, 0x32, 0x6d, 
+0x4a, 0x61, 0x46, 0x48, 0x48, 0x63, 0x68, 0x7a, 
+0x33, 0x39, 0x41, 0x61, 0x45, 0x67, 0x79, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x64, 0x61, 0x33, 0x65, 0x64, 
+0x34, 0x65, 0x66, 0x31, 0x36, 0x34, 0x37, 0x65, 
+0x31, 0x37, 0x33, 0x33, 0x65, 0x63, 0x30, 0x37, 
+0x36, 0x39, 0x31, 0x39, 0x63, 0x61, 0x62, 0x36, 
+0x31, 0x35, 0x36, 0x30, 0x37, 0x37, 0x65, 0x64, 
+0x39, 0x35, 0x33, 0x32, 0x65, 0x37, 0x63, 0x33, 
+0x36, 0x35, 0x61, 0x63, 0x63, 0x34, 0x32, 0x35, 
+0x37, 0x34, 0x37, 0x65, 0x31, 0x39, 0x38, 0x62, 
+0x33, 0x65, 0x31, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x73, 0x69, 
+0x67, 0x6e, 0x65, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x43, 0x6f, 
+0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 0x65, 0x64, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x39, 
+0x32, 0x37, 0x7a, 0x50, 0x57, 0x6e, 0x79, 0x32, 
+0x53, 0x69, 0x4e, 0x61, 0x55, 0x6d, 0x48, 0x46, 
+0x35, 0x4e, 0x6e, 0x47, 0x51, 0x58, 0x51, 0x57, 
+0x44, 0x77, 0x62, 0x42, 0x79, 0x66, 0x46, 0x7a, 
+0x58, 0x47, 0x67, 0x75, 0x38, 0x38, 0x6a, 0x39, 
+0x31, 0x5a, 0x6f, 0x75, 0x74, 0x53, 0x6f, 0x73, 
+0x76, 0x45, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x34, 0x36, 
+0x38, 0x65, 0x30, 0x32, 0x38, 0x34, 0x66, 0x32, 
+0x33, 0x30, 0x31, 0x35, 0x33, 0x64, 0x62, 0x38, 
+0x36, 0x38, 0x37, 0x64, 0x38, 0x65, 0x63, 0x32, 
+0x33, 0x64, 0x62, 0x30, 0x37, 0x39, 0x61, 0x35, 
+0x62, 0x36, 0x37, 0x64, 0x37, 0x32, 0x63, 0x61, 
+0x30, 0x34, 0x31, 0x37, 0x34, 0x62, 0x33, 0x38, 
+0x36, 0x37, 0x62, 0x31, 0x33, 0x65, 0x34, 0x65, 
+0x61, 0x39, 0x39, 0x34, 0x35, 0x65, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x72, 0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 
+0x73, 0x73, 0x65, 0x64, 0x22, 0x3a, 0x20, 0x66, 
+0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 
+0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x63, 0x52, 0x65, 0x7a, 
+0x34, 0x35, 0x56, 0x47, 0x53, 0x70, 0x35, 0x45, 
+0x58, 0x4e, 0x71, 0x6d, 0x38, 0x39, 0x4b, 0x33, 
+0x4e, 0x4a, 0x4a, 0x50, 0x53, 0x4b, 0x4b, 0x61, 
+0x70, 0x4a, 0x67, 0x35, 0x4b, 0x62, 0x77, 0x33, 
+0x61, 0x74, 0x78, 0x72, 0x32, 0x33, 0x33, 0x37, 
+0x78, 0x32, 0x67, 0x74, 0x67, 0x59, 0x65, 0x64, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x37, 0x39, 0x38, 0x64, 
+0x38, 0x37, 0x35, 0x38, 0x36, 0x63, 0x66, 0x66, 
+0x62, 0x65, 0x38, 0x63, 0x35, 0x34, 0x35, 0x61, 
+0x62, 0x33, 0x37, 0x34, 0x34, 0x35, 0x34, 0x65, 
+0x34, 0x30, 0x33, 0x62, 0x31, 0x65, 0x62, 0x38, 
+0x33, 0x31, 0x35, 0x30, 0x31, 0x65, 0x62, 0x65, 
+0x38, 0x39, 0x66, 0x33, 0x63, 0x33, 0x62, 0x30, 
+0x32, 0x66, 0x33, 0x31, 0x33, 0x37, 0x62, 0x64, 
+0x37, 0x62, 0x34, 0x36, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 
+0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 
+0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x43, 0x6f, 0x6d, 0x70, 0x72, 0x65, 0x73, 0x73, 
+0x65, 0x64, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x62, 0x63, 0x31, 0x71, 0x68, 0x78, 0x74, 
+0x30, 0x34, 0x73, 0x35, 0x78, 0x6e, 0x70, 0x79, 
+0x30, 0x6b, 0x78, 0x77, 0x34, 0x78, 0x39, 0x39, 
+0x6e, 0x35, 0x68, 0x70, 0x64, 0x66, 0x35, 0x70, 
+0x6d, 0x74, 0x7a, 0x70, 0x71, 0x73, 0x35, 0x32, 
+0x65, 0x73, 0x32, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 
+0x30, 0x31, 0x34, 0x62, 0x39, 0x39, 0x36, 0x66, 
+0x61, 0x63, 0x32, 0x38, 0x36, 0x39, 0x38, 0x34, 
+0x38, 0x66, 0x62, 0x31, 0x39, 0x64, 0x35, 0x33, 
+0x31, 0x34, 0x62, 0x33, 0x61, 0x35, 0x63, 0x32, 
+0x64, 0x34, 0x64, 0x30, 0x33, 0x62, 0x35, 0x38, 
+0x38, 0x32, 0x30, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 
+0x69, 0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x31, 
+0x71, 0x67, 0x63, 0x39, 0x6c, 0x6a, 0x72, 0x76, 
+0x64, 0x66, 0x32, 0x65, 0x30, 0x7a, 0x67, 0x39, 
+0x72, 0x6d, 0x6d, 0x71, 0x38, 0x36, 0x78, 0x6b, 
+0x6c, 0x71, 0x77, 0x66, 0x79, 0x73, 0x37, 0x72, 
+0x36, 0x77, 0x70, 0x74, 0x6a, 0x6c, 0x61, 0x63, 
+0x64, 0x67, 0x72, 0x63, 0x64, 0x63, 0x37, 0x73, 
+0x61, 0x36, 0x67, 0x67, 0x71, 0x75, 0x34, 0x72, 
+0x72, 0x78, 0x66, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 
+0x30, 0x32, 0x30, 0x34, 0x36, 0x30, 0x62, 0x66, 
+0x39, 0x30, 0x64, 0x38, 0x64, 0x34, 0x61, 0x62, 
+0x32, 0x66, 0x31, 0x32, 0x30, 0x61, 0x33, 0x64, 
+0x65, 0x63, 0x30, 0x37, 0x64, 0x31, 0x61, 0x64, 
+0x66, 0x30, 0x33, 0x39, 0x32, 0x34, 0x38, 0x37, 
+0x38, 0x37, 0x61, 0x37, 0x30, 0x35, 0x37, 0x32, 
+0x66, 0x66, 0x37, 0x30, 0x64, 0x34, 0x30, 0x66, 
+0x30, 0x64, 0x63, 0x37, 0x61, 0x31, 0x64, 0x64, 
+0x32, 0x31, 0x30, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 
+0x69, 0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x31, 
+0x70, 0x76, 0x65, 0x37, 0x33, 0x39, 0x79, 0x61, 
+0x70, 0x34, 0x75, 0x78, 0x6a, 0x76, 0x66, 0x6b, 
+0x30, 0x6a, 0x72, 0x65, 0x79, 0x36, 0x39, 0x30, 
+0x37, 0x38, 0x75, 0x30, 0x67, 0x61, 0x73, 0x6d, 
+0x32, 0x6e, 0x77, 0x76, 0x76, 0x34, 0x38, 0x33, 
+0x65, 0x63, 0x36, 0x7a, 0x6b, 0x7a, 0x75, 0x6c, 
+0x67, 0x77, 0x39, 0x78, 0x71, 0x75, 0x34, 0x77, 
+0x39, 0x66, 0x64, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 
+0x31, 0x32, 0x30, 0x36, 0x36, 0x37, 0x64, 0x31, 
+0x32, 0x39, 0x33, 0x61, 0x31, 0x61, 0x66, 0x30, 
+0x64, 0x32, 0x36, 0x32, 0x36, 0x63, 0x66, 0x39, 
+0x30, 0x66, 0x32, 0x34, 0x64, 0x31, 0x35, 0x66, 
+0x65, 0x33, 0x66, 0x31, 0x65, 0x38, 0x65, 0x63, 
+0x33, 0x36, 0x61, 0x39, 0x62, 0x39, 0x38, 0x63, 
+0x61, 0x39, 0x65, 0x33, 0x39, 0x63, 0x36, 0x38, 
+0x35, 0x36, 0x31, 0x37, 0x33, 0x65, 0x38, 0x37, 
+0x31, 0x34, 0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 
+0x69, 0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x31, 
+0x7a, 0x6d, 0x6a, 0x74, 0x71, 0x78, 0x6b, 0x7a, 
+0x73, 0x38, 0x39, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 
+0x32, 0x30, 0x32, 0x64, 0x63, 0x39, 0x36, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 
+0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 
+0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x62, 0x31, 0x71, 0x6c, 0x34, 0x6b, 
+0x35, 0x61, 0x79, 0x76, 0x37, 0x70, 0x37, 0x77, 
+0x30, 0x74, 0x30, 0x67, 0x65, 0x37, 0x74, 0x70, 
+0x6e, 0x74, 0x67, 0x70, 0x6b, 0x67, 0x77, 0x35, 
+0x33, 0x67, 0x32, 0x70, 0x61, 0x79, 0x78, 0x6b, 
+0x73, 0x7a, 0x72, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 
+0x30, 0x31, 0x34, 0x66, 0x64, 0x36, 0x64, 0x34, 
+0x65, 0x39, 0x31, 0x39, 0x65, 0x30, 0x66, 0x39, 
+0x63, 0x66, 0x35, 0x62, 0x64, 0x31, 0x39, 0x66, 
+0x32, 0x63, 0x33, 0x33, 0x35, 0x61, 0x30, 0x33, 
+0x36, 0x34, 0x33, 0x61, 0x39, 0x31, 0x34, 0x32, 
+0x38, 0x33, 0x64, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 
+0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 
+0x71, 0x39, 0x6a, 0x78, 0x33, 0x78, 0x32, 0x71, 
+0x71, 0x64, 0x70, 0x65, 0x6d, 0x70, 0x78, 0x72, 
+0x63, 0x66, 0x67, 0x79, 0x72, 0x6b, 0x6a, 0x64, 
+0x35, 0x66, 0x7a, 0x65, 0x61, 0x63, 0x61, 0x71, 
+0x6a, 0x34, 0x75, 0x61, 0x37, 0x63, 0x73, 0x37, 
+0x66, 0x65, 0x32, 0x73, 0x66, 0x64, 0x32, 0x77, 
+0x64, 0x61, 0x75, 0x65, 0x71, 0x35, 0x77, 0x6e, 
+0x32, 0x36, 0x79, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 
+0x30, 0x32, 0x30, 0x32, 0x63, 0x38, 0x64, 0x31, 
+0x33, 0x32, 0x38, 0x30, 0x30, 0x36, 0x38, 0x37, 
+0x33, 0x62, 0x30, 0x39, 0x38, 0x37, 0x38, 0x34, 
+0x61, 0x30, 0x38, 0x33, 0x62, 0x34, 0x39, 0x62, 
+0x34, 0x34, 0x38, 0x62, 0x33, 0x64, 0x63, 0x37, 
+0x34, 0x31, 0x32, 0x61, 0x66, 0x33, 0x62, 0x65, 
+0x63, 0x34, 0x33, 0x63, 0x39, 0x63, 0x61, 0x61, 
+0x30, 0x39, 0x36, 0x61, 0x39, 0x63, 0x64, 0x65, 
+0x66, 0x33, 0x32, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 
+0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 
+0x70, 0x64, 0x73, 0x77, 0x63, 0x6b, 0x77, 0x64, 
+0x39, 0x79, 0x6d, 0x35, 0x79, 0x66, 0x35, 0x65, 
+0x79, 0x7a, 0x67, 0x38, 0x6a, 0x34, 0x6a, 0x6a, 
+0x77, 0x6e, 0x7a, 0x6c, 0x61, 0x38, 0x79, 0x30, 
+0x74, 0x66, 0x39, 0x63, 0x70, 0x37, 0x61, 0x61, 
+0x73, 0x66, 0x6b, 0x65, 0x6b, 0x30, 0x75, 0x32, 
+0x39, 0x73, 0x7a, 0x39, 0x71, 0x66, 0x72, 0x30, 
+0x30, 0x79, 0x66, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 
+0x31, 0x32, 0x30, 0x36, 0x63, 0x31, 0x64, 0x38, 
+0x62, 0x33, 0x39, 0x61, 0x35, 0x32, 0x36, 0x65, 
+0x38, 0x34, 0x34, 0x64, 0x33, 0x32, 0x34, 0x31, 
+0x32, 0x30, 0x66, 0x32, 0x61, 0x63, 0x61, 0x34, 
+0x65, 0x39, 0x38, 0x62, 0x66, 0x64, 0x33, 0x39, 
+0x31, 0x65, 0x62, 0x34, 0x39, 0x37, 0x30, 0x31, 
+0x66, 0x37, 0x37, 0x62, 0x30, 0x34, 0x64, 0x62, 
+0x33, 0x36, 0x37, 0x66, 0x31, 0x34, 0x35, 0x38, 
+0x30, 0x38, 0x61, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 
+0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 
+0x72, 0x30, 0x65, 0x63, 0x70, 0x66, 0x78, 0x67, 
+0x32, 0x75, 0x64, 0x68, 0x74, 0x63, 0x35, 0x35, 
+0x36, 0x67, 0x71, 0x72, 0x70, 0x77, 0x77, 0x68, 
+0x6b, 0x34, 0x73, 0x77, 0x33, 0x66, 0x30, 0x6b, 
+0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x33, 0x31, 
+0x30, 0x37, 0x65, 0x37, 0x30, 0x31, 0x34, 0x39, 
+0x39, 0x30, 0x61, 0x65, 0x33, 0x36, 0x65, 0x62, 
+0x63, 0x35, 0x32, 0x39, 0x61, 0x34, 0x30, 0x30, 
+0x36, 0x31, 0x37, 0x33, 0x61, 0x66, 0x36, 0x61, 
+0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 
+0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 0x71, 0x36, 
+0x6d, 0x77, 0x66, 0x38, 0x39, 0x68, 0x6e, 0x71, 
+0x68, 0x6c, 0x75, 0x38, 0x74, 0x78, 0x6a, 0x67, 
+0x6a, 0x66, 0x73, 0x34, 0x73, 0x37, 0x70, 0x39, 
+0x33, 0x75, 0x67, 0x66, 0x66, 0x6e, 0x33, 0x6b, 
+0x30, 0x36, 0x32, 0x6c, 0x6c, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x30, 0x30, 0x31, 0x34, 0x64, 0x36, 0x64, 
+0x63, 0x39, 0x33, 0x39, 0x36, 0x66, 0x33, 0x30, 
+0x35, 0x66, 0x66, 0x63, 0x33, 0x61, 0x63, 0x64, 
+0x32, 0x34, 0x34, 0x39, 0x33, 0x30, 0x61, 0x63, 
+0x33, 0x63, 0x31, 0x32, 0x63, 0x37, 0x38, 0x38, 
+0x34, 0x61, 0x36, 0x37, 0x31, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 
+0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 
+0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x74, 0x62, 0x31, 0x71, 0x61, 0x66, 0x72, 
+0x6a, 0x61, 0x6c, 0x75, 0x34, 0x64, 0x37, 0x33, 
+0x64, 0x71, 0x6c, 0x30, 0x63, 0x7a, 0x61, 0x75, 
+0x39, 0x6a, 0x36, 0x7a, 0x34, 0x32, 0x32, 0x34, 
+0x33, 0x34, 0x6b, 0x65, 0x66, 0x32, 0x33, 0x35, 
+0x6d, 0x7a, 0x6c, 0x6a, 0x66, 0x34, 0x38, 0x63, 
+0x6b, 0x64, 0x35, 0x78, 0x7a, 0x33, 0x73, 0x79, 
+0x73, 0x30, 0x39, 0x6a, 0x6d, 0x39, 0x37, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x30, 0x30, 0x32, 0x30, 0x65, 
+0x61, 0x34, 0x37, 0x32, 0x65, 0x66, 0x66, 0x39, 
+0x35, 0x36, 0x66, 0x61, 0x32, 0x64, 0x30, 0x37, 
+0x64, 0x66, 0x38, 0x31, 0x37, 0x37, 0x38, 0x35, 
+0x39, 0x36, 0x38, 0x35, 0x35, 0x35, 0x32, 0x61, 
+0x62, 0x31, 0x61, 0x64, 0x62, 0x32, 0x39, 0x35, 
+0x34, 0x36, 0x39, 0x62, 0x31, 0x37, 0x65, 0x34, 
+0x39, 0x61, 0x39, 0x66, 0x31, 0x36, 0x36, 0x64, 
+0x30, 0x63, 0x32, 0x38, 0x63, 0x30, 0x39, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 
+0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 0x70, 0x77, 
+0x73, 0x74, 0x39, 0x71, 0x73, 0x7a, 0x6a, 0x72, 
+0x68, 0x75, 0x76, 0x32, 0x65, 0x37, 0x61, 0x73, 
+0x30, 0x66, 0x6c, 0x63, 0x71, 0x39, 0x67, 0x6d, 
+0x36, 0x39, 0x38, 0x76, 0x36, 0x67, 0x64, 0x78, 
+0x7a, 0x7a, 0x39, 0x65, 0x38, 0x37, 0x70, 0x30, 
+0x37, 0x73, 0x38, 0x72, 0x73, 0x73, 0x64, 0x78, 
+0x33, 0x7a, 0x71, 0x6b, 0x6c, 0x6d, 0x33, 0x76, 
+0x66, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 0x31, 0x32, 
+0x30, 0x37, 0x34, 0x31, 0x36, 0x35, 0x30, 0x34, 
+0x30, 0x35, 0x32, 0x31, 0x64, 0x66, 0x38, 0x63, 
+0x35, 0x36, 0x37, 0x64, 0x64, 0x38, 0x33, 0x64, 
+0x33, 0x66, 0x63, 0x30, 0x30, 0x61, 0x38, 0x64, 
+0x65, 0x38, 0x61, 0x37, 0x36, 0x36, 0x39, 0x30, 
+0x64, 0x33, 0x30, 0x38, 0x34, 0x35, 0x63, 0x39, 
+0x66, 0x63, 0x31, 0x37, 0x66, 0x61, 0x30, 0x37, 
+0x31, 0x63, 0x32, 0x30, 0x64, 0x33, 0x34, 0x34, 
+0x34, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 
+0x65, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x62, 0x31, 
+0x72, 0x33, 0x73, 0x73, 0x37, 0x36, 0x6a, 0x74, 
+0x73, 0x75, 0x78, 0x65, 0x38, 0x63, 0x38, 0x63, 
+0x38, 0x6c, 0x78, 0x73, 0x65, 0x68, 0x6e, 0x70, 
+0x61, 0x6b, 0x35, 0x35, 0x79, 0x6c, 0x72, 0x67, 
+0x72, 0x33, 0x34, 0x35, 0x70, 0x77, 0x77, 0x30, 
+0x37, 0x36, 0x6c, 0x35, 0x33, 0x36, 0x61, 0x68, 
+0x6a, 0x72, 0x36, 0x6a, 0x73, 0x79, 0x64, 0x61, 
+0x6d, 0x78, 0x33, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x35, 
+0x33, 0x32, 0x30, 0x38, 0x63, 0x32, 0x31, 0x65, 
+0x64, 0x34, 0x39, 0x37, 0x30, 0x65, 0x31, 0x62, 
+0x32, 0x37, 0x63, 0x31, 0x66, 0x30, 0x37, 0x66, 
+0x39, 0x61, 0x31, 0x39, 0x62, 0x63, 0x63, 0x33, 
+0x64, 0x62, 0x35, 0x32, 0x38, 0x34, 0x66, 0x38, 
+0x64, 0x30, 0x33, 0x38, 0x64, 0x36, 0x38, 0x31, 
+0x37, 0x33, 0x39, 0x66, 0x65, 0x64, 0x37, 0x65, 
+0x39, 0x31, 0x64, 0x37, 0x36, 0x66, 0x32, 0x31, 
+0x65, 0x61, 0x35, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x73, 0x69, 
+0x67, 0x6e, 0x65, 0x74, 0x22, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 
+0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 
+0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 
+0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 
+0x63, 0x72, 0x74, 0x31, 0x71, 0x36, 0x35, 0x6e, 
+0x68, 0x6c, 0x6d, 0x34, 0x68, 0x66, 0x32, 0x70, 
+0x74, 0x67, 0x33, 0x74, 0x32, 0x36, 0x34, 0x61, 
+0x6c, 0x35, 0x37, 0x70, 0x37, 0x77, 0x6a, 0x78, 
+0x6a, 0x32, 0x63, 0x33, 0x73, 0x36, 0x6b, 0x79, 
+0x74, 0x38, 0x33, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x30, 
+0x30, 0x31, 0x34, 0x64, 0x35, 0x32, 0x37, 0x37, 
+0x66, 0x65, 0x65, 0x62, 0x37, 0x34, 0x61, 0x38, 
+0x32, 0x62, 0x34, 0x34, 0x35, 0x36, 0x61, 0x64, 
+0x35, 0x37, 0x62, 0x66, 0x61, 0x37, 0x38, 0x33, 
+0x65, 0x37, 0x34, 0x38, 0x64, 0x32, 0x35, 0x36, 
+0x32, 0x33, 0x30, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x72, 0x65, 
+0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 0x50, 
+0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 0x3a, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 0x72, 0x79, 
+0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 0x69, 0x70, 
+0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x62, 0x63, 0x72, 0x74, 0x31, 0x71, 0x61, 0x77, 
+0x76, 0x63, 0x39, 0x30, 0x6c, 0x70, 0x79, 0x74, 
+0x77, 0x33, 0x7a, 0x33, 0x6b, 0x39, 0x65, 0x74, 
+0x64, 0x78, 0x35, 0x34, 0x6c, 0x30, 0x65, 0x78, 
+0x71, 0x35, 0x66, 0x35, 0x73, 0x71, 0x66, 0x7a, 
+0x75, 0x35, 0x65, 0x34, 0x35, 0x6b, 0x6a, 0x6e, 
+0x6c, 0x36, 0x73, 0x6c, 0x77, 0x61, 0x79, 0x65, 
+0x65, 0x71, 0x78, 0x32, 0x64, 0x79, 0x61, 0x63, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x30, 0x30, 0x32, 0x30, 
+0x65, 0x62, 0x39, 0x39, 0x38, 0x32, 0x62, 0x66, 
+0x65, 0x31, 0x32, 0x32, 0x64, 0x64, 0x31, 0x31, 
+0x34, 0x36, 0x63, 0x35, 0x63, 0x61, 0x64, 0x61, 
+0x36, 0x61, 0x35, 0x37, 0x65, 0x66, 0x63, 0x39, 
+0x38, 0x31, 0x34, 0x34, 0x64, 0x32, 0x30, 0x30, 
+0x34, 0x38, 0x62, 0x39, 0x34, 0x63, 0x64, 0x36, 
+0x39, 0x36, 0x39, 0x34, 0x66, 0x66, 0x61, 0x38, 
+0x37, 0x64, 0x64, 0x64, 0x32, 0x36, 0x37, 0x32, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x72, 0x65, 0x67, 0x74, 0x65, 
+0x73, 0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 
+0x65, 0x46, 0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 
+0x74, 0x72, 0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x62, 0x63, 0x72, 
+0x74, 0x31, 0x70, 0x33, 0x39, 0x61, 0x34, 0x73, 
+0x34, 0x76, 0x64, 0x63, 0x77, 0x39, 0x6b, 0x71, 
+0x61, 0x38, 0x77, 0x32, 0x74, 0x30, 0x72, 0x70, 
+0x37, 0x61, 0x6a, 0x38, 0x6b, 0x66, 0x78, 0x79, 
+0x77, 0x37, 0x6d, 0x63, 0x65, 0x35, 0x73, 0x6b, 
+0x35, 0x64, 0x37, 0x30, 0x78, 0x36, 0x77, 0x6e, 
+0x6e, 0x6d, 0x70, 0x76, 0x74, 0x37, 0x73, 0x6b, 
+0x66, 0x32, 0x6b, 0x78, 0x79, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x35, 0x31, 0x32, 0x30, 0x38, 0x39, 0x37, 
+0x62, 0x35, 0x38, 0x35, 0x35, 0x38, 0x64, 0x63, 
+0x33, 0x38, 0x62, 0x36, 0x30, 0x37, 0x34, 0x65, 
+0x65, 0x35, 0x32, 0x64, 0x65, 0x33, 0x30, 0x66, 
+0x62, 0x62, 0x32, 0x33, 0x64, 0x39, 0x32, 0x36, 
+0x32, 0x33, 0x62, 0x64, 0x62, 0x63, 0x36, 0x36, 
+0x39, 0x30, 0x62, 0x35, 0x31, 0x62, 0x65, 0x37, 
+0x39, 0x62, 0x34, 0x65, 0x39, 0x63, 0x66, 0x36, 
+0x31, 0x36, 0x32, 0x66, 0x64, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 
+0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 
+0x72, 0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x74, 
+0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 0x6c, 
+0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x62, 0x63, 0x72, 0x74, 0x31, 0x73, 
+0x34, 0x38, 0x39, 0x64, 0x39, 0x66, 0x68, 0x6d, 
+0x79, 0x65, 0x6c, 0x30, 0x76, 0x7a, 0x66, 0x71, 
+0x73, 0x72, 0x6d, 0x65, 0x77, 0x34, 0x78, 0x37, 
+0x72, 0x38, 0x30, 0x61, 0x73, 0x75, 0x71, 0x65, 
+0x73, 0x6d, 0x35, 0x68, 0x67, 0x71, 0x61, 0x63, 
+0x79, 0x33, 0x35, 0x64, 0x61, 0x66, 0x6c, 0x63, 
+0x79, 0x75, 0x66, 0x68, 0x33, 0x6a, 0x38, 0x63, 
+0x67, 0x64, 0x74, 0x66, 0x6c, 0x76, 0x74, 0x39, 
+0x39, 0x70, 0x68, 0x30, 0x35, 0x6d, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x36, 0x30, 0x32, 0x38, 0x61, 0x39, 
+0x63, 0x61, 0x64, 0x32, 0x61, 0x36, 0x66, 0x62, 
+0x32, 0x36, 0x37, 0x65, 0x66, 0x36, 0x30, 0x39, 
+0x32, 0x30, 0x38, 0x30, 0x66, 0x37, 0x39, 0x37, 
+0x35, 0x34, 0x64, 0x65, 0x31, 0x39, 0x64, 0x66, 
+0x64, 0x38, 0x37, 0x30, 0x31, 0x39, 0x38, 0x36, 
+0x65, 0x39, 0x37, 0x34, 0x30, 0x33, 0x62, 0x38, 
+0x32, 0x34, 0x36, 0x38, 0x64, 0x65, 0x61, 0x37, 
+0x66, 0x38, 0x32, 0x37, 0x31, 0x33, 0x37, 0x38, 
+0x63, 0x38, 0x66, 0x38, 0x34, 0x33, 0x35, 0x36, 
+0x39, 0x66, 0x62, 0x31, 0x36, 0x35, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 0x20, 
+0x22, 0x72, 0x65, 0x67, 0x74, 0x65, 0x73, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x74, 0x72, 0x79, 0x43, 0x61, 0x73, 0x65, 0x46, 
+0x6c, 0x69, 0x70, 0x22, 0x3a, 0x20, 0x74, 0x72, 
+0x75, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x31, 0x47, 0x39, 0x41, 0x39, 
+0x6a, 0x36, 0x57, 0x38, 0x54, 0x4c, 0x75, 0x68, 
+0x36, 0x64, 0x45, 0x65, 0x56, 0x77, 0x57, 0x65, 
+0x79, 0x69, 0x62, 0x4b, 0x31, 0x55, 0x63, 0x35, 
+0x4d, 0x66, 0x56, 0x46, 0x56, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x37, 0x36, 0x61, 0x39, 0x31, 0x34, 0x61, 
+0x36, 0x31, 0x34, 0x64, 0x61, 0x35, 0x34, 0x64, 
+0x61, 0x61, 0x63, 0x64, 0x62, 0x38, 0x38, 0x36, 
+0x31, 0x66, 0x34, 0x35, 0x31, 0x61, 0x30, 0x62, 
+0x37, 0x65, 0x33, 0x63, 0x32, 0x37, 0x63, 0x64, 
+0x66, 0x38, 0x61, 0x30, 0x39, 0x39, 0x65, 0x38, 
+0x38, 0x61, 0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 
+0x69, 0x6e, 0x22, 0x3a, 0x20, 0x22, 0x6d, 0x61, 
+0x69, 0x6e, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 
+0x6b, 0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x22, 0x33, 0x33, 0x47, 0x41, 
+0x33, 0x5a, 0x58, 0x62, 0x77, 0x35, 0x6f, 0x35, 
+0x48, 0x65, 0x55, 0x72, 0x42, 0x45, 0x61, 0x71, 
+0x6b, 0x57, 0x58, 0x46, 0x59, 0x59, 0x5a, 0x6d, 
+0x64, 0x78, 0x47, 0x52, 0x52, 0x50, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x61, 0x39, 0x31, 0x34, 0x31, 0x31, 
+0x33, 0x63, 0x61, 0x31, 0x61, 0x66, 0x65, 0x62, 
+0x34, 0x39, 0x66, 0x66, 0x33, 0x61, 0x62, 0x66, 
+0x31, 0x37, 0x36, 0x66, 0x66, 0x61, 0x31, 0x39, 
+0x63, 0x32, 0x61, 0x32, 0x62, 0x34, 0x64, 0x66, 
+0x31, 0x39, 0x37, 0x31, 0x32, 0x61, 0x38, 0x37, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x6d, 0x61, 0x69, 0x6e, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 
+0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 
+0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x6d, 0x77, 0x67, 0x53, 0x32, 0x48, 0x52, 
+0x62, 0x6a, 0x79, 0x66, 0x59, 0x78, 0x46, 0x6e, 
+0x52, 0x31, 0x6e, 0x46, 0x39, 0x56, 0x4b, 0x4c, 
+0x76, 0x6d, 0x64, 0x67, 0x4d, 0x66, 0x46, 0x42, 
+0x6d, 0x47, 0x71, 0x22, 0x2c, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 
+0x36, 0x61, 0x39, 0x31, 0x34, 0x62, 0x31, 0x34, 
+0x63, 0x65, 0x37, 0x30, 0x37, 0x30, 0x62, 0x35, 
+0x33, 0x63, 0x62, 0x30, 0x65, 0x34, 0x62, 0x35, 
+0x62, 0x35, 0x66, 0x36, 0x65, 0x32, 0x35, 0x33, 
+0x65, 0x38, 0x37, 0x36, 0x39, 0x39, 0x30, 0x61, 
+0x65, 0x63, 0x61, 0x32, 0x65, 0x38, 0x38, 0x61, 
+0x63, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 
+0x22, 0x3a, 0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 
+0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 
+0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x32, 0x4d, 0x77, 0x42, 0x56, 0x72, 
+0x4a, 0x51, 0x37, 0x36, 0x42, 0x64, 0x61, 0x47, 
+0x44, 0x37, 0x36, 0x43, 0x54, 0x6d, 0x6f, 0x75, 
+0x38, 0x63, 0x5a, 0x7a, 0x51, 0x59, 0x4c, 0x70, 
+0x65, 0x34, 0x4e, 0x71, 0x55, 0x22, 0x2c, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x61, 0x39, 0x31, 0x34, 0x32, 0x62, 0x32, 
+0x63, 0x31, 0x34, 0x39, 0x63, 0x64, 0x65, 0x36, 
+0x31, 0x39, 0x65, 0x61, 0x65, 0x33, 0x64, 0x37, 
+0x66, 0x65, 0x39, 0x39, 0x35, 0x32, 0x34, 0x33, 
+0x62, 0x37, 0x36, 0x61, 0x33, 0x34, 0x31, 0x37, 
+0x35, 0x34, 0x31, 0x61, 0x61, 0x38, 0x37, 0x22, 
+0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 0x3a, 
+0x20, 0x22, 0x74, 0x65, 0x73, 0x74, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x69, 0x73, 
+0x50, 0x72, 0x69, 0x76, 0x6b, 0x65, 0x79, 0x22, 
+0x3a, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x0a, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x7d, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x5d, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x5b, 0x0a, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 
+0x6d, 0x66, 0x6e, 0x4a, 0x38, 0x74, 0x45, 0x6b, 
+0x71, 0x4b, 0x4e, 0x46, 0x45, 0x35, 0x59, 0x61, 
+0x48, 0x54, 0x58, 0x46, 0x78, 0x79, 0x48, 0x6b, 
+0x32, 0x6d, 0x6e, 0x44, 0x4b, 0x32, 0x66, 0x76, 
+0x44, 0x68, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x22, 0x37, 0x36, 
+0x61, 0x39, 0x31, 0x34, 0x30, 0x32, 0x65, 0x36, 
+0x63, 0x64, 0x37, 0x37, 0x65, 0x36, 0x34, 0x39, 
+0x61, 0x64, 0x38, 0x62, 0x32, 0x38, 0x31, 0x32, 
+0x37, 0x31, 0x66, 0x31, 0x35, 0x38, 0x66, 0x63, 
+0x39, 0x36, 0x34, 0x63, 0x61, 0x33, 0x66, 0x36, 
+0x36, 0x63, 0x62, 0x30, 0x38, 0x38, 0x61, 0x63, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x5b, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x22, 0x32, 0x4d, 0x79, 0x38, 0x33, 
+0x44, 0x36, 0x37, 0x69, 0x72, 0x37, 0x4b, 0x38, 
+0x50, 0x50, 0x7a, 0x65, 0x54, 0x36, 0x6d, 0x45, 
+0x32, 0x6f, 0x74, 0x68, 0x33, 0x5a, 0x77, 0x4e, 
+0x54, 0x56, 0x52, 0x53, 0x39, 0x46, 0x22, 0x2c, 
+0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x61, 0x39, 0x31, 0x34, 0x34, 0x30, 
+0x37, 0x34, 0x64, 0x38, 0x34, 0x64, 0x33, 0x32, 
+0x66, 0x66, 0x36, 0x32, 0x64, 0x61, 0x37, 0x62, 
+0x31, 0x62, 0x33, 0x63, 0x36, 0x31, 0x39, 0x32, 
+0x35, 0x62, 0x39, 0x33, 0x34, 0x62, 0x66, 0x65, 
+0x62, 0x33, 0x34, 0x62, 0x30, 0x35, 0x38, 0x37, 
+0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7b, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x22, 0x63, 0x68, 0x61, 0x69, 0x6e, 0x22, 
+0x3a, 0x20, 0x22, 0x73, 0x69, 0x67, 0x6e, 0x65, 
+0x74, 0x22, 0x2c, 0x0a, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x22, 0x69, 0x73, 0x50, 0x72, 0x69, 0x76, 0x6b, 
+0x65, 0x79, 0x22, 0x3a, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x0a, 0x20, 0x20, 0x20, 0x20, 0x20, 
+0x20, 0x20, 0x20, 0x7d, 0x0a, 0x20, 0x20, 0x20, 
+0x20, 0x5d, 0x0a, 0x5d, 0x0a, 
+};};
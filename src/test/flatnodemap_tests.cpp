@@ -0,0 +1,148 @@
+// Copyright (c) The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/util/random.h>
+#include <test/util/setup_common.h>
+#include <util/flatnodemap.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <map>
+#include <utility>
+
+namespace {
+/** Hashes everything to few distinct values, so that probe sequences are long and collide. */
+struct BadHasher {
+    size_t operator()(uint64_t key) const noexcept { return (key % 5) << 7 | (key % 3); }
+};
+
+using Map = FlatNodeMap<uint64_t,
+                        uint64_t,
+                        BadHasher,
+                        std::equal_to<uint64_t>,
+                        PoolAllocator<std::pair<const uint64_t, uint64_t>, sizeof(std::pair<const uint64_t, uint64_t>)>>;
+
+void CheckEqual(const Map& map, const std::map<uint64_t, uint64_t>& expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    size_t count{0};
+    for (const auto& [key, value] : map) {
+        const auto it{expected.find(key)};
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK_EQUAL(value, it->second);
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+    for (const auto& [key, value] : expected) {
+        const auto it{map.find(key)};
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->second, value);
+    }
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(flatnodemap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+    Map::allocator_type::ResourceType resource;
+    Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK_EQUAL(map.capacity(), 0U);
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK_EQUAL(map.erase(1), 0U);
+
+    const auto [it, inserted]{map.try_emplace(1, 10)};
+    BOOST_CHECK(inserted);
+    BOOST_CHECK_EQUAL(it->second, 10U);
+    BOOST_CHECK_EQUAL(map.capacity(), 16U);
+    const auto* node{&*it};
+
+    // Existing elements are left alone, and keep their address.
+    BOOST_CHECK(!map.try_emplace(1, 11).second);
+    BOOST_CHECK(!map.emplace(std::piecewise_construct, std::forward_as_tuple(1), std::forward_as_tuple(12)).second);
+    BOOST_CHECK_EQUAL(map[1], 10U);
+    for (uint64_t i{2}; i < 1000; ++i) map[i] = i * 10;
+    BOOST_CHECK_EQUAL(map.size(), 999U);
+    BOOST_CHECK(&*map.find(1) == node);
+
+    BOOST_CHECK_EQUAL(map.erase(1), 1U);
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK_EQUAL(map.size(), 998U);
+
+    const auto capacity{map.capacity()};
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK_EQUAL(map.capacity(), capacity);
+    BOOST_CHECK(map.find(2) == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(erase_while_iterating)
+{
+    Map::allocator_type::ResourceType resource;
+    Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+    std::map<uint64_t, uint64_t> expected;
+    for (uint64_t i{0}; i < 500; ++i) {
+        map[i] = i;
+        expected[i] = i;
+    }
+    for (auto it{map.begin()}; it != map.end();) {
+        if (it->first % 3 == 0) {
+            expected.erase(it->first);
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    CheckEqual(map, expected);
+}
+
+BOOST_AUTO_TEST_CASE(random_operations)
+{
+    Map::allocator_type::ResourceType resource;
+    Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+    std::map<uint64_t, uint64_t> expected;
+    for (int i{0}; i < 20000; ++i) {
+        const uint64_t key{InsecureRandRange(300)};
+        switch (InsecureRandRange(4)) {
+        case 0:
+            BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+            break;
+        case 1:
+            BOOST_CHECK_EQUAL(map.try_emplace(key, i).second, expected.try_emplace(key, i).second);
+            break;
+        case 2:
+            map[key] = i;
+            expected[key] = i;
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(map.find(key) == map.end(), expected.find(key) == expected.end());
+            break;
+        }
+        // The load factor never exceeds 7/8.
+        BOOST_CHECK(map.size() * 8 <= map.capacity() * 7);
+    }
+    CheckEqual(map, expected);
+    map.reserve(10000);
+    BOOST_CHECK_GE(map.capacity() * 7, 10000U * 8);
+    CheckEqual(map, expected);
+}
+
+BOOST_AUTO_TEST_CASE(memusage_test)
+{
+    Map::allocator_type::ResourceType resource;
+    Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+    const auto empty_usage{memusage::DynamicUsage(map)};
+    for (uint64_t i{0}; i < 1000; ++i) map[i] = i;
+    // Nodes come from the pool's chunk, only the table grows.
+    const auto table_usage{memusage::MallocUsage(map.capacity()) + memusage::MallocUsage(sizeof(void*) * map.capacity())};
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), empty_usage + table_usage);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
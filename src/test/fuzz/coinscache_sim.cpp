@@ -383,6 +383,12 @@ FUZZ_TARGET(coinscache_sim)
                 caches.back()->Uncache(data.outpoints[outpointidx]);
             },
 
+            [&]() { // Evict
+                size_t target_usage = provider.ConsumeIntegralInRange<size_t>(0, caches.back()->DynamicMemoryUsage());
+                // Apply to real caches (there is no equivalent in our simulation).
+                caches.back()->Evict(target_usage);
+            },
+
             [&]() { // Add a cache level (if not already at the max).
                 if (caches.size() != MAX_CACHES) {
                     // Apply to real caches.
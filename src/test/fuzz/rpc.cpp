@@ -144,6 +144,7 @@ const std::vector<std::string> RPC_COMMANDS_SAFE_FOR_FUZZING{
     "getnetworkinfo",
     "getnodeaddresses",
     "getpeerinfo",
+    "getpowstats",
     "getprioritisedtransactions",
     "getrawaddrman",
     "getrawmempool",
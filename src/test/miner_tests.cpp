@@ -19,6 +19,7 @@
 #include <util/time.h>
 #include <util/translation.h>
 #include <validation.h>
+#include <validationinterface.h>
 #include <versionbits.h>
 
 #include <test/util/setup_common.h>
@@ -658,4 +659,87 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     TestPrioritisedMining(scriptPubKey, txFirst);
 }
 
+BOOST_AUTO_TEST_CASE(BlockTemplateCache_updates)
+{
+    CTxMemPool& tx_mempool{*m_node.mempool};
+    BlockAssembler::Options options;
+    options.blockMinFeeRate = blockMinFeeRate;
+    // The transactions below spend made-up coins.
+    options.test_block_validity = false;
+    node::BlockTemplateCache cache{*m_node.chainman, tx_mempool, options};
+    m_node.validation_signals->RegisterValidationInterface(&cache);
+
+    const CScript script_pub_key{CScript() << OP_TRUE};
+    TestMemPoolEntryHelper entry;
+    const auto add_tx{[&](const COutPoint& prevout, CAmount fee, bool notify) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(prevout);
+        mtx.vout.emplace_back(50000, CScript() << OP_TRUE);
+        CTransactionRef tx{MakeTransactionRef(std::move(mtx))};
+        {
+            LOCK2(cs_main, tx_mempool.cs);
+            tx_mempool.addUnchecked(entry.Fee(fee).FromTx(tx));
+            if (notify) {
+                m_node.validation_signals->TransactionAddedToMempool(NewMempoolTransactionInfo{tx, fee, 0, 0, false, false, true, false},
+                                                                     tx_mempool.GetAndIncrementSequence());
+            }
+        }
+        m_node.validation_signals->SyncWithValidationInterfaceQueue();
+        return tx;
+    }};
+    // The cache has to select the same transactions and pay the same as a full pass.
+    const auto check_template{[&](size_t num_txs) {
+        auto tmpl{cache.CreateNewBlock(script_pub_key)};
+        const auto full{BlockAssembler{m_node.chainman->ActiveChainstate(), &tx_mempool, options}.CreateNewBlock(script_pub_key)};
+        BOOST_REQUIRE_EQUAL(tmpl->block.vtx.size(), num_txs + 1);
+        BOOST_REQUIRE_EQUAL(full->block.vtx.size(), num_txs + 1);
+        std::set<Txid> txids, full_txids;
+        for (size_t i = 1; i <= num_txs; ++i) {
+            txids.insert(tmpl->block.vtx[i]->GetHash());
+            full_txids.insert(full->block.vtx[i]->GetHash());
+        }
+        BOOST_CHECK(txids == full_txids);
+        BOOST_CHECK(tmpl->block.vtx[0]->vout[0].scriptPubKey == script_pub_key);
+        BOOST_CHECK(tmpl->block.vtx[0]->vout == full->block.vtx[0]->vout);
+        BOOST_CHECK(tmpl->vchCoinbaseCommitment == full->vchCoinbaseCommitment);
+        BOOST_CHECK_EQUAL(tmpl->vTxFees[0], full->vTxFees[0]);
+        return tmpl;
+    }};
+
+    check_template(0);
+    BOOST_CHECK_EQUAL(cache.GetRebuildCount(), 1U);
+
+    // A transaction and its child are appended.
+    const CTransactionRef parent{add_tx(COutPoint{Txid::FromUint256(InsecureRand256()), 0}, 10000, true)};
+    const CTransactionRef child{add_tx(COutPoint{parent->GetHash(), 0}, 20000, true)};
+    auto tmpl{check_template(2)};
+    BOOST_CHECK(tmpl->block.vtx[1] == parent);
+    BOOST_CHECK(tmpl->block.vtx[2] == child);
+    BOOST_CHECK_EQUAL(cache.GetRebuildCount(), 1U);
+
+    // One below the minimum feerate is left out.
+    const CTransactionRef free_tx{add_tx(COutPoint{Txid::FromUint256(InsecureRand256()), 0}, 0, true)};
+    check_template(2);
+    BOOST_CHECK_EQUAL(cache.GetRebuildCount(), 1U);
+
+    // Removing a transaction removes its descendants.
+    WITH_LOCK(tx_mempool.cs, tx_mempool.removeRecursive(*parent, MemPoolRemovalReason::CONFLICT));
+    m_node.validation_signals->SyncWithValidationInterfaceQueue();
+    check_template(0);
+    BOOST_CHECK_EQUAL(cache.GetRebuildCount(), 1U);
+
+    // Prioritisation is not notified, so the selection is rebuilt.
+    tx_mempool.PrioritiseTransaction(free_tx->GetHash().ToUint256(), 10000);
+    tmpl = check_template(1);
+    BOOST_CHECK(tmpl->block.vtx[1] == free_tx);
+    BOOST_CHECK_EQUAL(cache.GetRebuildCount(), 2U);
+
+    // So is a transaction added without a notification.
+    add_tx(COutPoint{Txid::FromUint256(InsecureRand256()), 0}, 10000, false);
+    check_template(2);
+    BOOST_CHECK_EQUAL(cache.GetRebuildCount(), 3U);
+
+    m_node.validation_signals->UnregisterValidationInterface(&cache);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,241 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <hash.h>
+#include <pow_cache.h>
+#include <primitives/pureheader.h>
+#include <test/util/random.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(pow_cache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pow_cache_memory)
+{
+    PowHashCache cache;
+    const uint256 key{InsecureRand256()};
+    const uint256 value{InsecureRand256()};
+    BOOST_CHECK(!cache.Get(key));
+    cache.Insert(key, value);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK(cache.Get(key) == value);
+
+    // Shrinking the budget evicts down to one entry per shard.
+    for (int i = 0; i < 1000; ++i) {
+        cache.Insert(InsecureRand256(), InsecureRand256());
+    }
+    cache.Resize(0);
+    BOOST_CHECK_LE(cache.Size(), PowHashCache::NUM_SHARDS);
+    for (int i = 0; i < 1000; ++i) {
+        cache.Insert(InsecureRand256(), InsecureRand256());
+    }
+    BOOST_CHECK_LE(cache.Size(), PowHashCache::NUM_SHARDS);
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_lru)
+{
+    // Room for two entries per shard, and keys that all fall in the same shard.
+    PowHashCache cache{2 * PowHashCache::NUM_SHARDS * PowHashCache::EntryBytes()};
+    std::vector<uint256> keys(3);
+    for (uint256& key : keys) {
+        key = InsecureRand256();
+        key.data()[31] = 0;
+    }
+    cache.Insert(keys[0], keys[0]);
+    cache.Insert(keys[1], keys[1]);
+    // Looking up the oldest entry makes the other one the least recently used.
+    BOOST_CHECK(cache.Get(keys[0]) == keys[0]);
+    cache.Insert(keys[2], keys[2]);
+    BOOST_CHECK(cache.Get(keys[0]) == keys[0]);
+    BOOST_CHECK(!cache.Get(keys[1]));
+    BOOST_CHECK(cache.Get(keys[2]) == keys[2]);
+
+    cache.Erase({keys[0]});
+    BOOST_CHECK(!cache.Get(keys[0]));
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_store)
+{
+    const fs::path path{m_args.GetDataDirBase() / "powcache_test.sqlite"};
+    const uint256 old_key{InsecureRand256()};
+    const uint256 new_key{InsecureRand256()};
+    const uint256 value{InsecureRand256()};
+    {
+        PowHashCache cache;
+        BOOST_REQUIRE(cache.OpenStore(path));
+        cache.Insert(old_key, value);
+        cache.Insert(new_key, value);
+        cache.CloseStore();
+    }
+    {
+        // Misses in memory are served from the persistent store.
+        PowHashCache cache;
+        BOOST_REQUIRE(cache.OpenStore(path));
+        BOOST_CHECK(cache.Get(old_key) == value);
+        BOOST_CHECK(cache.Get(new_key) == value);
+        cache.Erase({old_key});
+        cache.Flush();
+    }
+    {
+        PowHashCache cache;
+        BOOST_REQUIRE(cache.OpenStore(path));
+        BOOST_CHECK(!cache.Get(old_key));
+        BOOST_CHECK(cache.Get(new_key) == value);
+        BOOST_CHECK(cache.Get(new_key) == value);
+
+        const PowHashCache::Stats stats{cache.GetStats()};
+        BOOST_CHECK_EQUAL(stats.misses, 1U);
+        BOOST_CHECK_EQUAL(stats.store_hits, 1U);
+        BOOST_CHECK_EQUAL(stats.memory_hits, 1U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_store_concurrent_reads)
+{
+    const fs::path path{m_args.GetDataDirBase() / "powcache_concurrent_test.sqlite"};
+    PowHashStore store{path};
+    BOOST_REQUIRE(store.IsOpen());
+    std::vector<uint256> keys(100);
+    for (uint256& key : keys) {
+        key = InsecureRand256();
+        store.Write({key, key});
+    }
+    BOOST_CHECK(store.Flush());
+
+    // Readers use connections of their own, while entries are being written.
+    std::vector<std::thread> readers;
+    std::atomic<int> found{0};
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&] {
+            for (const uint256& key : keys) {
+                if (store.Read(key) == key) ++found;
+            }
+        });
+    }
+    for (int i = 0; i < 1000; ++i) {
+        const uint256 key{InsecureRand256()};
+        store.Write({key, key});
+    }
+    for (std::thread& reader : readers) reader.join();
+    BOOST_CHECK_EQUAL(found, 4 * 100);
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_store_trim)
+{
+    const fs::path path{m_args.GetDataDirBase() / "powcache_trim_test.sqlite"};
+    PowHashStore store{path, /*max_entries=*/100};
+    BOOST_REQUIRE(store.IsOpen());
+    for (int i = 0; i < 100; ++i) {
+        const uint256 key{InsecureRand256()};
+        store.Write({key, key});
+        // Replacing an entry does not add one.
+        store.Write({key, key});
+    }
+    BOOST_CHECK(store.Flush());
+    BOOST_CHECK_EQUAL(store.Count(), 100U);
+
+    // Going over the maximum drops a tenth of the entries.
+    const uint256 key{InsecureRand256()};
+    store.Write({key, key});
+    BOOST_CHECK(store.Flush());
+    BOOST_CHECK_EQUAL(store.Count(), 90U);
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_header)
+{
+    CPureBlockHeader header;
+    header.nVersion = 0x8000;
+    header.nTime = 1700000000;
+    header.nBits = 0x207fffff;
+    header.nNonce = 42;
+
+    const uint256 pow_hash{header.GetPoWHash()};
+    BOOST_CHECK(pow_hash == header.GetHash2());
+    BOOST_CHECK(GetPowHashCache().Get(header.GetHash()) == pow_hash);
+    BOOST_CHECK(header.GetPoWHash() == pow_hash);
+
+    // Pre-Flex headers use the block hash directly and are not cached.
+    header.nVersion = 4;
+    BOOST_CHECK(header.GetPoWHash() == header.GetHash());
+    BOOST_CHECK(!GetPowHashCache().Get(header.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(pow_cache_batch)
+{
+    std::vector<CPureBlockHeader> headers(5);
+    std::vector<std::pair<const CPureBlockHeader*, int32_t>> batch;
+    for (CPureBlockHeader& header : headers) {
+        header.nVersion = 0x8000;
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1700000000;
+        header.nBits = 0x207fffff;
+        batch.emplace_back(&header, header.nVersion);
+    }
+    // Pre-Flex versions are skipped.
+    batch.emplace_back(&headers[0], 4);
+
+    CPureBlockHeader::CachePoWHashes(batch);
+    for (const CPureBlockHeader& header : headers) {
+        BOOST_CHECK(GetPowHashCache().Get(header.GetHash()) == header.GetHash2());
+    }
+    BOOST_CHECK(!GetPowHashCache().Get(headers[0].GetHash(4)));
+}
+
+BOOST_AUTO_TEST_CASE(block_hash_memo)
+{
+    CPureBlockHeader header;
+    header.nVersion = 0x8000;
+    header.hashPrevBlock = InsecureRand256();
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1700000000;
+    header.nBits = 0x207fffff;
+    header.nNonce = 42;
+    const uint256 sha3_hash{(Hash3Writer{} << header).GetHash()};
+    const uint256 sha256_hash{(HashWriter{} << header).GetHash()};
+    BOOST_CHECK(header.GetHash() == sha3_hash);
+    BOOST_CHECK(header.GetHash(4) == sha256_hash);
+
+    header.CacheHash();
+    const BlockHashMemoStats before{GetBlockHashMemoStats()};
+    BOOST_CHECK(header.GetHash() == sha3_hash);
+    BOOST_CHECK(CPureBlockHeader{header}.GetHash() == sha3_hash);
+    BOOST_CHECK_EQUAL(GetBlockHashMemoStats().hits - before.hits, 2U);
+    // The memo is only valid for the algorithm it was computed with.
+    BOOST_CHECK(header.GetHash(4) == sha256_hash);
+
+    // Changing any field invalidates the memo.
+    header.nNonce = 43;
+    BOOST_CHECK(header.GetHash() == (Hash3Writer{} << header).GetHash());
+    header.nNonce = 42;
+    BOOST_CHECK(header.GetHash() == sha3_hash);
+    header.hashMerkleRoot = InsecureRand256();
+    BOOST_CHECK(header.GetHash() == (Hash3Writer{} << header).GetHash());
+
+    // Batches mix SHA3 and SHA256 headers.
+    std::vector<CPureBlockHeader> headers(11);
+    std::vector<CPureBlockHeader*> header_ptrs;
+    for (size_t i = 0; i < headers.size(); ++i) {
+        headers[i].nVersion = i % 3 ? 0x8000 : 4;
+        headers[i].hashMerkleRoot = InsecureRand256();
+        header_ptrs.push_back(&headers[i]);
+    }
+    CPureBlockHeader::CacheHashes(header_ptrs);
+    const BlockHashMemoStats batch_before{GetBlockHashMemoStats()};
+    for (const CPureBlockHeader& h : headers) {
+        if (h.nVersion & 0x8000) {
+            BOOST_CHECK(h.GetHash() == (Hash3Writer{} << h).GetHash());
+        } else {
+            BOOST_CHECK(h.GetHash() == (HashWriter{} << h).GetHash());
+        }
+    }
+    BOOST_CHECK_EQUAL(GetBlockHashMemoStats().hits - batch_before.hits, headers.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
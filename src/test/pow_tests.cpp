@@ -4,10 +4,13 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <node/miner.h>
 #include <pow.h>
+#include <primitives/pureheader.h>
 #include <test/util/random.h>
 #include <test/util/setup_common.h>
 #include <util/chaintype.h>
+#include <util/signalinterrupt.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -156,6 +159,131 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(check_next_work_required)
+{
+    const auto chainParams = CreateChainParams(*m_node.args, ChainType::MAIN);
+    // A chain across both switches, from retargeting every two weeks to
+    // every n2023Window blocks and then to every block.
+    Consensus::Params params = chainParams->GetConsensus();
+    params.n2023Height = 100;
+    params.n2023Height2 = 200;
+    const size_t length = 300;
+    std::vector<CBlockIndex> blocks(length);
+    std::vector<CBlockHeader> headers(length);
+    std::vector<uint256> hashes(length);
+    for (size_t i = 0; i < length; i++) {
+        CBlockHeader& header = headers[i];
+        header.nVersion = 4;
+        header.hashPrevBlock = i ? hashes[i - 1] : uint256{};
+        header.nTime = i ? headers[i - 1].nTime + 30 + InsecureRandRange(16) : 1700000000;
+        header.nNonce = i;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = i;
+        blocks[i].nTime = header.nTime;
+        header.nBits = i ? GetNextWorkRequired(&blocks[i - 1], &header, params) : 0x1c0fffff;
+        blocks[i].nBits = header.nBits;
+        blocks[i].BuildSkip();
+        hashes[i] = header.GetHash();
+        blocks[i].phashBlock = &hashes[i];
+    }
+
+    const size_t start = 50;
+    const Span<const CBlockHeader> chain{Span{headers}.subspan(start + 1)};
+    BOOST_CHECK_EQUAL(CheckNextWorkRequired(&blocks[start], chain, params), chain.size());
+    BOOST_CHECK_EQUAL(CheckNextWorkRequired(&blocks[start], chain.first(0), params), 0U);
+    BOOST_CHECK_EQUAL(CheckNextWorkRequired(&blocks[start + 1], chain, params), 0U);
+
+    for (const size_t bad : {size_t{0}, size_t{25}, chain.size() - 1}) {
+        std::vector<CBlockHeader> bad_bits{chain.begin(), chain.end()};
+        bad_bits[bad].nBits ^= 1;
+        BOOST_CHECK_EQUAL(CheckNextWorkRequired(&blocks[start], bad_bits, params), bad);
+
+        std::vector<CBlockHeader> bad_link{chain.begin(), chain.end()};
+        bad_link[bad].hashPrevBlock = InsecureRand256();
+        BOOST_CHECK_EQUAL(CheckNextWorkRequired(&blocks[start], bad_link, params), bad);
+    }
+
+    // Min-difficulty blocks are left to the per-header checks.
+    Consensus::Params min_difficulty_params{params};
+    min_difficulty_params.fPowAllowMinDifficultyBlocks = true;
+    BOOST_CHECK_EQUAL(CheckNextWorkRequired(&blocks[start], chain, min_difficulty_params), 0U);
+
+    LOCK(cs_main);
+    const CBlockIndex& last = blocks[length - 2];
+    BOOST_CHECK_EQUAL(last.m_next_work_required, 0U);
+    BOOST_CHECK_EQUAL(GetNextWorkRequiredCached(&last, &headers.back(), params), headers.back().nBits);
+    BOOST_CHECK_EQUAL(last.m_next_work_required, headers.back().nBits);
+    SetNextWorkRequired(last, 0x1c00ffff, params);
+    BOOST_CHECK_EQUAL(GetNextWorkRequiredCached(&last, &headers.back(), params), 0x1c00ffffU);
+}
+
+static CPureBlockHeader NonceSearchHeader(int32_t nVersion, unsigned int nBits)
+{
+    CPureBlockHeader header;
+    header.nVersion = nVersion;
+    header.hashPrevBlock = InsecureRand256();
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 1700000000;
+    header.nBits = nBits;
+    return header;
+}
+
+BOOST_AUTO_TEST_CASE(search_nonce_matches_serial)
+{
+    const auto chainParams = CreateChainParams(*m_node.args, ChainType::REGTEST);
+    const Consensus::Params& params{chainParams->GetConsensus()};
+    util::SignalInterrupt interrupt;
+
+    // Pre-Flex headers with a target hit about once in 512 tries, and Flex
+    // headers with one hit about every other try.
+    for (const auto& [nVersion, nBits] : {std::pair{1, 0x1f7fffffU}, std::pair{0x8000, 0x207fffffU}}) {
+        const CPureBlockHeader start{NonceSearchHeader(nVersion, nBits)};
+        uint32_t expected{start.nNonce};
+        CPureBlockHeader serial{start};
+        while (!CheckProofOfWork(serial.GetPoWHash(nVersion), nBits, params)) {
+            expected = ++serial.nNonce;
+        }
+
+        for (int threads : {1, 3}) {
+            CPureBlockHeader header{start};
+            const auto result{node::SearchNonce(header, nVersion, nBits, params, /*max_tries=*/100000, threads, interrupt)};
+            BOOST_CHECK(result.found);
+            BOOST_CHECK_EQUAL(header.nNonce, expected);
+            BOOST_CHECK_EQUAL(result.tries, expected - start.nNonce);
+            BOOST_CHECK_GE(result.hashes, result.tries + 1);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(search_nonce_limits)
+{
+    const auto chainParams = CreateChainParams(*m_node.args, ChainType::REGTEST);
+    const Consensus::Params& params{chainParams->GetConsensus()};
+    util::SignalInterrupt interrupt;
+
+    // A target no hash meets: the search gives up after max_tries.
+    CPureBlockHeader header{NonceSearchHeader(1, 0x03000001)};
+    auto result{node::SearchNonce(header, header.nVersion, header.nBits, params, /*max_tries=*/5000, /*threads=*/2, interrupt)};
+    BOOST_CHECK(!result.found);
+    BOOST_CHECK_EQUAL(result.tries, 5000U);
+    BOOST_CHECK_EQUAL(result.hashes, 5000U);
+    BOOST_CHECK_EQUAL(header.nNonce, 0U);
+
+    // The last nonce value is never tried.
+    header.nNonce = std::numeric_limits<uint32_t>::max() - 10;
+    result = node::SearchNonce(header, header.nVersion, header.nBits, params, /*max_tries=*/5000, /*threads=*/2, interrupt);
+    BOOST_CHECK(!result.found);
+    BOOST_CHECK_EQUAL(result.tries, 10U);
+    BOOST_CHECK_EQUAL(result.hashes, 10U);
+
+    // An interrupted search stops before hashing.
+    BOOST_REQUIRE(interrupt());
+    header.nNonce = 0;
+    result = node::SearchNonce(header, header.nVersion, header.nBits, params, /*max_tries=*/5000, /*threads=*/2, interrupt);
+    BOOST_CHECK(!result.found);
+    BOOST_CHECK_EQUAL(result.hashes, 0U);
+}
+
 void sanity_check_chainparams(const ArgsManager& args, ChainType chain_type)
 {
     const auto chainParams = CreateChainParams(args, chain_type);
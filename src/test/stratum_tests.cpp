@@ -0,0 +1,302 @@
+// Copyright (c) 2024 The Lyncoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addresstype.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <compat/compat.h>
+#include <consensus/merkle.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <interfaces/mining.h>
+#include <key_io.h>
+#include <netbase.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <streams.h>
+#include <stratum.h>
+#include <test/util/random.h>
+#include <test/util/setup_common.h>
+#include <univalue.h>
+#include <util/sock.h>
+#include <util/strencodings.h>
+#include <util/threadinterrupt.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+BOOST_FIXTURE_TEST_SUITE(stratum_tests, BasicTestingSetup)
+
+static CBlock MakeTemplate(size_t num_txs)
+{
+    CBlock block;
+    block.nVersion = 0x8000;
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = 1700000000;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1234 << OP_0;
+    coinbase.vin[0].scriptWitness.stack.emplace_back(32, 0);
+    coinbase.vout.resize(2);
+    coinbase.vout[0].nValue = 50;
+    coinbase.vout[1].nValue = 5;
+    coinbase.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+
+    for (size_t i = 1; i < num_txs; ++i) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(Txid::FromUint256(InsecureRand256()), 0);
+        tx.vout.emplace_back(1, CScript() << OP_TRUE);
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(stratum_job)
+{
+    const CScript payout = CScript() << OP_2;
+    for (const size_t num_txs : {1, 2, 3, 4, 7}) {
+        const StratumJob job{StratumJob::Create("1", MakeTemplate(num_txs), payout)};
+        BOOST_CHECK(job.block.hashMerkleRoot == BlockMerkleRoot(job.block));
+
+        // The split coinbase is the job's coinbase with the extranonce zeroed.
+        std::vector<unsigned char> data{job.coinb1};
+        data.resize(data.size() + STRATUM_EXTRANONCE_SIZE);
+        data.insert(data.end(), job.coinb2.begin(), job.coinb2.end());
+        CMutableTransaction coinbase;
+        SpanReader{data} >> TX_NO_WITNESS(coinbase);
+        BOOST_CHECK(CTransaction{coinbase}.GetHash() == job.block.vtx[0]->GetHash());
+        BOOST_CHECK(coinbase.vout[0].scriptPubKey == payout);
+
+        const std::vector<unsigned char> extranonce{ParseHex("0102030405060708")};
+        CBlock block;
+        BOOST_REQUIRE(job.BuildBlock(extranonce, 1700000100, 42, block));
+        BOOST_CHECK(block.hashMerkleRoot == BlockMerkleRoot(block));
+        BOOST_CHECK(block.hashMerkleRoot != job.block.hashMerkleRoot);
+        BOOST_CHECK_EQUAL(block.nTime, 1700000100U);
+        BOOST_CHECK_EQUAL(block.nNonce, 42U);
+        BOOST_CHECK_EQUAL(block.vtx.size(), num_txs);
+
+        const CScript& script_sig{block.vtx[0]->vin[0].scriptSig};
+        BOOST_CHECK(std::equal(extranonce.begin(), extranonce.end(), script_sig.end() - extranonce.size()));
+        BOOST_CHECK(block.vtx[0]->vin[0].scriptWitness.stack == job.block.vtx[0]->vin[0].scriptWitness.stack);
+
+        BOOST_CHECK(!job.BuildBlock(Span{extranonce}.first(4), 1700000100, 42, block));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stratum_notify)
+{
+    CBlock tmpl{MakeTemplate(3)};
+    tmpl.hashPrevBlock = uint256S("00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff");
+    const StratumJob job{StratumJob::Create("abc", tmpl, CScript() << OP_TRUE)};
+    const UniValue params{job.NotifyParams(/*clean_jobs=*/true)};
+    BOOST_REQUIRE_EQUAL(params.size(), 9U);
+    BOOST_CHECK_EQUAL(params[0].get_str(), "abc");
+    BOOST_CHECK_EQUAL(params[1].get_str(), "ccddeeff8899aabb4455667700112233ccddeeff8899aabb4455667700112233");
+    BOOST_CHECK_EQUAL(params[2].get_str(), HexStr(job.coinb1));
+    BOOST_CHECK_EQUAL(params[3].get_str(), HexStr(job.coinb2));
+    BOOST_CHECK_EQUAL(params[4].size(), 2U);
+    BOOST_CHECK_EQUAL(params[5].get_str(), "00008000");
+    BOOST_CHECK_EQUAL(params[6].get_str(), "207fffff");
+    BOOST_CHECK_EQUAL(params[7].get_str(), "6553f100");
+    BOOST_CHECK(params[8].get_bool());
+}
+
+BOOST_AUTO_TEST_CASE(stratum_share_target)
+{
+    const arith_uint256 diff1{arith_uint256{0xffff} << 208};
+    BOOST_CHECK(StratumShareTarget(1) == diff1);
+    BOOST_CHECK(StratumShareTarget(0.5) == diff1 << 1);
+    BOOST_CHECK(StratumShareTarget(256) == diff1 >> 8);
+    BOOST_CHECK(StratumShareTarget(0xffff) == arith_uint256{1} << 208);
+    BOOST_CHECK(StratumShareTarget(1e-30) == ~arith_uint256{});
+}
+
+/** A miner talking to the Stratum server over a socket. */
+class TestMiner
+{
+public:
+    explicit TestMiner(std::unique_ptr<Sock> sock) : m_sock{std::move(sock)} {}
+
+    /** Send a request and return its reply, keeping track of the notifications before it. */
+    UniValue Request(const std::string& method, const std::string& params)
+    {
+        const int id{++m_next_id};
+        m_sock->SendComplete(strprintf("{\"id\":%d,\"method\":\"%s\",\"params\":%s}\n", id, method, params), 10s, m_interrupt);
+        while (true) {
+            const UniValue msg{Read()};
+            if (msg.find_value("id").isNull()) {
+                HandleNotification(msg);
+            } else {
+                BOOST_REQUIRE_EQUAL(msg.find_value("id").getInt<int>(), id);
+                return msg;
+            }
+        }
+    }
+
+    /** Wait for the server to send a notification. */
+    void ReadNotification() { HandleNotification(Read()); }
+
+    /** Submit a share for the newest job. */
+    UniValue Submit(uint32_t nonce)
+    {
+        return Request("mining.submit", strprintf("[\"worker\",\"%s\",\"00000000\",\"%s\",\"%08x\"]", m_job[0].get_str(), m_job[7].get_str(), nonce));
+    }
+
+    /** The header Submit() sends for the newest job, built like a miner does. */
+    CBlockHeader Header(uint32_t nonce) const
+    {
+        std::vector<unsigned char> data{ParseHex(m_job[2].get_str())};
+        const std::vector<unsigned char> extranonce1{ParseHex(m_extranonce1)};
+        data.insert(data.end(), extranonce1.begin(), extranonce1.end());
+        data.resize(data.size() + STRATUM_EXTRANONCE2_SIZE);
+        const std::vector<unsigned char> coinb2{ParseHex(m_job[3].get_str())};
+        data.insert(data.end(), coinb2.begin(), coinb2.end());
+        CMutableTransaction coinbase;
+        SpanReader{data} >> TX_NO_WITNESS(coinbase);
+
+        CBlockHeader header;
+        header.nVersion = ReadBE32(ParseHex(m_job[5].get_str()).data());
+        std::vector<unsigned char> prev{ParseHex(m_job[1].get_str())};
+        for (size_t i = 0; i < prev.size(); i += 4) {
+            std::reverse(prev.begin() + i, prev.begin() + i + 4);
+        }
+        header.hashPrevBlock = uint256{prev};
+        header.hashMerkleRoot = CTransaction{coinbase}.GetHash().ToUint256();
+        for (const UniValue& hash : m_job[4].getValues()) {
+            header.hashMerkleRoot = Hash(header.hashMerkleRoot, uint256{ParseHex(hash.get_str())});
+        }
+        header.nBits = ReadBE32(ParseHex(m_job[6].get_str()).data());
+        header.nTime = ReadBE32(ParseHex(m_job[7].get_str()).data());
+        header.nNonce = nonce;
+        return header;
+    }
+
+    std::string m_extranonce1;
+    UniValue m_job;
+    size_t m_clean_jobs{0};
+    double m_difficulty{0};
+
+private:
+    std::unique_ptr<Sock> m_sock;
+    CThreadInterrupt m_interrupt;
+    int m_next_id{0};
+
+    UniValue Read()
+    {
+        UniValue msg;
+        BOOST_REQUIRE(msg.read(m_sock->RecvUntilTerminator('\n', 10s, m_interrupt, 1024 * 1024)));
+        return msg;
+    }
+
+    void HandleNotification(const UniValue& msg)
+    {
+        const std::string& method{msg.find_value("method").get_str()};
+        const UniValue& params{msg.find_value("params")};
+        if (method == "mining.notify") {
+            m_job = params;
+            if (params[8].get_bool()) ++m_clean_jobs;
+        } else {
+            BOOST_REQUIRE_EQUAL(method, "mining.set_difficulty");
+            m_difficulty = params[0].get_real();
+        }
+    }
+};
+
+static bool IsBlock(const CBlockHeader& header)
+{
+    return CheckProofOfWork(header.GetPoWHash(), header.nBits, Params().GetConsensus());
+}
+
+static int ErrorCode(const UniValue& reply)
+{
+    const UniValue& error{reply.find_value("error")};
+    return error.isNull() ? 0 : error[0].getInt<int>();
+}
+
+BOOST_FIXTURE_TEST_CASE(stratum_server, TestChain100Setup)
+{
+    // Find a free port.
+    std::unique_ptr<Sock> listen_sock{CreateSockOS(AF_INET, SOCK_STREAM, IPPROTO_TCP)};
+    BOOST_REQUIRE(listen_sock);
+    CService bind{LookupNumeric("127.0.0.1", 0)};
+    struct sockaddr_storage addr;
+    socklen_t len{sizeof(addr)};
+    BOOST_REQUIRE(bind.GetSockAddr(reinterpret_cast<struct sockaddr*>(&addr), &len));
+    BOOST_REQUIRE_EQUAL(listen_sock->Bind(reinterpret_cast<struct sockaddr*>(&addr), len), 0);
+    BOOST_REQUIRE_EQUAL(listen_sock->GetSockName(reinterpret_cast<struct sockaddr*>(&addr), &len), 0);
+    BOOST_REQUIRE(bind.SetSockAddr(reinterpret_cast<struct sockaddr*>(&addr)));
+    listen_sock.reset();
+
+    const std::unique_ptr<interfaces::Mining> mining{interfaces::MakeMining(m_node)};
+    BOOST_REQUIRE(StartStratumServer(*mining, bind, CScript{}, /*difficulty=*/1e-12, /*max_connections=*/2));
+
+    TestMiner miner{ConnectDirectly(bind, /*manual_connection=*/true)};
+    BOOST_CHECK_EQUAL(ErrorCode(miner.Request("mining.authorize", "[\"worker\"]")), 25);
+    const UniValue subscribed{miner.Request("mining.subscribe", "[]")};
+    miner.m_extranonce1 = subscribed.find_value("result")[1].get_str();
+    BOOST_CHECK_EQUAL(miner.m_extranonce1.size(), 2 * STRATUM_EXTRANONCE1_SIZE);
+    BOOST_CHECK_EQUAL(subscribed.find_value("result")[2].getInt<size_t>(), STRATUM_EXTRANONCE2_SIZE);
+
+    // Without -stratumaddress, the user name has to be an address.
+    BOOST_CHECK_EQUAL(ErrorCode(miner.Request("mining.authorize", "[\"worker\"]")), 24);
+    const CScript payout{GetScriptForDestination(WitnessV0KeyHash(coinbaseKey.GetPubKey()))};
+    BOOST_CHECK(miner.Request("mining.authorize", strprintf("[\"%s.1\"]", EncodeDestination(WitnessV0KeyHash(coinbaseKey.GetPubKey())))).find_value("result").get_bool());
+    miner.ReadNotification();
+    miner.ReadNotification();
+    BOOST_CHECK_EQUAL(miner.m_difficulty, 1e-12);
+    BOOST_REQUIRE_EQUAL(miner.m_clean_jobs, 1U);
+
+    // A share that is not a block can only be submitted once. A block moves
+    // the miner to a new job.
+    const int start_height{WITH_LOCK(::cs_main, return m_node.chainman->ActiveHeight())};
+    BOOST_CHECK(miner.Header(0).hashPrevBlock == WITH_LOCK(::cs_main, return m_node.chainman->ActiveTip()->GetBlockHash()));
+    uint32_t nonce{0};
+    while (IsBlock(miner.Header(nonce))) ++nonce;
+    BOOST_CHECK(miner.Submit(nonce).find_value("result").get_bool());
+    BOOST_CHECK_EQUAL(ErrorCode(miner.Submit(nonce)), 22);
+    while (!IsBlock(miner.Header(++nonce))) {}
+    BOOST_CHECK(miner.Submit(nonce).find_value("result").get_bool());
+    BOOST_CHECK_EQUAL(miner.m_clean_jobs, 2U);
+    const CBlockIndex* tip{WITH_LOCK(::cs_main, return m_node.chainman->ActiveChain().Tip())};
+    BOOST_CHECK_EQUAL(tip->nHeight, start_height + 1);
+    BOOST_CHECK(miner.Header(0).hashPrevBlock == tip->GetBlockHash());
+    CBlock block;
+    BOOST_REQUIRE(m_node.chainman->m_blockman.ReadBlockFromDisk(block, *tip));
+    BOOST_CHECK(block.vtx[0]->vout[0].scriptPubKey == payout);
+
+    // Stale jobs are gone after a block.
+    BOOST_CHECK_EQUAL(ErrorCode(miner.Request("mining.submit", "[\"worker\",\"0\",\"00000000\",\"00000000\",\"00000000\"]")), 21);
+
+    // Shares beyond the allowance are rejected until time passes.
+    int accepted{0};
+    UniValue reply;
+    while (!(reply = miner.Submit(++nonce)).find_value("result").isNull()) ++accepted;
+    BOOST_CHECK(accepted < 50);
+    BOOST_CHECK_EQUAL(reply.find_value("error")[1].get_str(), "Too many shares");
+    SetMockTime(GetTime() + 1);
+    BOOST_CHECK(miner.Submit(++nonce).find_value("result").get_bool());
+
+    // The third connection is refused.
+    TestMiner miner2{ConnectDirectly(bind, /*manual_connection=*/true)};
+    BOOST_CHECK(miner2.Request("mining.subscribe", "[]").find_value("result").isArray());
+    TestMiner miner3{ConnectDirectly(bind, /*manual_connection=*/true)};
+    BOOST_CHECK_THROW(miner3.Request("mining.subscribe", "[]"), std::runtime_error);
+
+    InterruptStratumServer();
+    StopStratumServer();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
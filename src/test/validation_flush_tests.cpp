@@ -68,7 +68,7 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
     // We should be able to add COINS_UNTIL_CRITICAL coins to the cache before going CRITICAL.
     // This is contingent not only on the dynamic memory usage of the Coins
     // that we're adding (COIN_SIZE bytes per), but also on how much memory the
-    // cacheCoins (unordered_map) preallocates.
+    // cacheCoins (FlatNodeMap) preallocates.
     constexpr int COINS_UNTIL_CRITICAL{3};
 
     // no coin added, so we have plenty of space left.
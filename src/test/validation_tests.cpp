@@ -360,4 +360,26 @@ BOOST_AUTO_TEST_CASE(block_malleation)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(header_pow_check_queue, TestChain100Setup)
+{
+    const auto& consensus{m_node.chainman->GetConsensus()};
+    std::vector<CBlockHeader> headers;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex{m_node.chainman->ActiveTip()}; pindex->pprev; pindex = pindex->pprev) {
+            headers.push_back(pindex->GetBlockHeader(m_node.chainman->m_blockman));
+        }
+    }
+
+    CCheckQueue<CHeaderPoWCheck> queue{/*batch_size=*/1, /*worker_threads_num=*/3, "test"};
+    BOOST_CHECK(HasValidProofOfWork(headers, consensus));
+    BOOST_CHECK(HasValidProofOfWork(headers, consensus, &queue));
+    BOOST_CHECK(HasValidProofOfWork(headers, consensus, nullptr));
+
+    // A single header with a target far below its hash fails the whole batch.
+    headers[headers.size() / 2].nBits = 0x1d00ffff;
+    BOOST_CHECK(!HasValidProofOfWork(headers, consensus));
+    BOOST_CHECK(!HasValidProofOfWork(headers, consensus, &queue));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,15 +8,20 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <logging.h>
+#include <memusage.h>
 #include <primitives/transaction.h>
 #include <random.h>
 #include <serialize.h>
 #include <uint256.h>
+#include <util/hasher.h>
+#include <util/thread.h>
 #include <util/vector.h>
 
 #include <cassert>
 #include <cstdlib>
 #include <iterator>
+#include <stdexcept>
+#include <unordered_map>
 #include <utility>
 
 static constexpr uint8_t DB_COIN{'C'};
@@ -46,16 +51,60 @@ struct CoinEntry {
 
 } // namespace
 
+/** Dirty coins copied out of a cache by BatchWrite(), to be written by the writer thread. */
+struct CCoinsViewDB::PendingWrite {
+    uint256 hash_block;
+    //! Spent coins are to be erased.
+    std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> coins;
+    //! Memory used by coins, counted against the coins cache's budget.
+    size_t usage{0};
+};
+
 CCoinsViewDB::CCoinsViewDB(DBParams db_params, CoinsViewOptions options) :
     m_db_params{std::move(db_params)},
     m_options{std::move(options)},
-    m_db{std::make_unique<CDBWrapper>(m_db_params)} { }
+    m_db{std::make_unique<CDBWrapper>(m_db_params)}
+{
+    if (m_options.background_write) {
+        m_writer_thread = std::thread(&util::TraceThread, "coinsflush", [this] { ThreadWrite(); });
+    }
+}
+
+CCoinsViewDB::~CCoinsViewDB()
+{
+    if (m_writer_thread.joinable()) {
+        WaitForPendingWrite();
+        WITH_LOCK(m_pending_mutex, m_request_stop = true);
+        m_pending_cv.notify_all();
+        m_writer_thread.join();
+    }
+}
+
+std::shared_ptr<const CCoinsViewDB::PendingWrite> CCoinsViewDB::GetPending() const
+{
+    LOCK(m_pending_mutex);
+    return m_pending;
+}
+
+size_t CCoinsViewDB::PendingWriteUsage() const
+{
+    const auto pending{GetPending()};
+    return pending ? pending->usage : 0;
+}
+
+bool CCoinsViewDB::WaitForPendingWrite() const
+{
+    WAIT_LOCK(m_pending_mutex, lock);
+    m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return !m_pending || m_write_failed; });
+    return !m_write_failed;
+}
 
 void CCoinsViewDB::ResizeCache(size_t new_cache_size)
 {
     // We can't do this operation with an in-memory DB since we'll lose all the coins upon
     // reset.
     if (!m_db_params.memory_only) {
+        WaitForPendingWrite();
         // Have to do a reset first to get the original `m_db` state to release its
         // filesystem lock.
         m_db.reset();
@@ -66,14 +115,27 @@ void CCoinsViewDB::ResizeCache(size_t new_cache_size)
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (const auto pending{GetPending()}) {
+        if (const auto it{pending->coins.find(outpoint)}; it != pending->coins.end()) {
+            if (it->second.IsSpent()) return false;
+            coin = it->second;
+            return true;
+        }
+    }
     return m_db->Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (const auto pending{GetPending()}) {
+        if (const auto it{pending->coins.find(outpoint)}; it != pending->coins.end()) {
+            return !it->second.IsSpent();
+        }
+    }
     return m_db->Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    if (const auto pending{GetPending()}) return pending->hash_block;
     uint256 hashBestChain;
     if (!m_db->Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -81,6 +143,8 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    // A background write in progress is not a state to recover from.
+    WaitForPendingWrite();
     std::vector<uint256> vhashHeadBlocks;
     if (!m_db->Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
@@ -88,16 +152,19 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CoinsViewCacheCursor& cursor, const uint256 &hashBlock) {
+template <typename Callable>
+bool CCoinsViewDB::WriteCoins(const uint256& hashBlock, Callable&& for_each_coin)
+{
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
-    if (old_tip.IsNull()) {
+    uint256 old_tip;
+    if (!m_db->Read(DB_BEST_BLOCK, old_tip)) {
         // We may be in the middle of replaying.
-        std::vector<uint256> old_heads = GetHeadBlocks();
+        std::vector<uint256> old_heads;
+        m_db->Read(DB_HEAD_BLOCKS, old_heads);
         if (old_heads.size() == 2) {
             if (old_heads[0] != hashBlock) {
                 LogPrintLevel(BCLog::COINDB, BCLog::Level::Error, "The coins database detected an inconsistent state, likely due to a previous crash or shutdown. You will need to restart lyncoind with the -reindex-chainstate or -reindex configuration option.\n");
@@ -114,17 +181,16 @@ bool CCoinsViewDB::BatchWrite(CoinsViewCacheCursor& cursor, const uint256 &hashB
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
-    for (auto it{cursor.Begin()}; it != cursor.End();) {
-        if (it->second.IsDirty()) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
+    for_each_coin([&](const COutPoint& outpoint, const Coin* coin) {
+        if (coin) {
+            CoinEntry entry(&outpoint);
+            if (coin->IsSpent())
                 batch.Erase(entry);
             else
-                batch.Write(entry, it->second.coin);
+                batch.Write(entry, *coin);
             changed++;
         }
         count++;
-        it = cursor.NextAndMaybeErase(*it);
         if (batch.SizeEstimate() > m_options.batch_write_bytes) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -137,7 +203,7 @@ bool CCoinsViewDB::BatchWrite(CoinsViewCacheCursor& cursor, const uint256 &hashB
                 }
             }
         }
-    }
+    });
 
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
@@ -149,6 +215,76 @@ bool CCoinsViewDB::BatchWrite(CoinsViewCacheCursor& cursor, const uint256 &hashB
     return ret;
 }
 
+bool CCoinsViewDB::BatchWrite(CoinsViewCacheCursor& cursor, const uint256 &hashBlock) {
+    if (!m_options.background_write) {
+        ++m_write_sequence;
+        bool ret = WriteCoins(hashBlock, [&](const auto& write) {
+            for (auto it{cursor.Begin()}; it != cursor.End();) {
+                write(it->first, it->second.IsDirty() ? &it->second.coin : nullptr);
+                it = cursor.NextAndMaybeErase(*it);
+            }
+        });
+        ++m_write_sequence;
+        return ret;
+    }
+
+    // Only one snapshot is written at a time.
+    if (!WaitForPendingWrite()) return false;
+    assert(!hashBlock.IsNull());
+    auto pending{std::make_shared<PendingWrite>()};
+    pending->hash_block = hashBlock;
+    for (auto it{cursor.Begin()}; it != cursor.End(); it = cursor.NextAndMaybeErase(*it)) {
+        if (!it->second.IsDirty()) continue;
+        pending->usage += it->second.coin.DynamicMemoryUsage();
+        if (cursor.WillErase(*it)) {
+            pending->coins.insert_or_assign(it->first, std::move(it->second.coin));
+        } else {
+            pending->coins.insert_or_assign(it->first, it->second.coin);
+        }
+    }
+    pending->usage += memusage::DynamicUsage(pending->coins);
+    LogPrint(BCLog::COINDB, "Writing %u changed transaction outputs to coin database in the background\n", pending->coins.size());
+    {
+        LOCK(m_pending_mutex);
+        m_pending = std::move(pending);
+        m_pending_queued = true;
+        m_write_sequence += 2;
+    }
+    m_pending_cv.notify_all();
+    return true;
+}
+
+void CCoinsViewDB::ThreadWrite()
+{
+    WAIT_LOCK(m_pending_mutex, lock);
+    while (true) {
+        m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return m_request_stop || m_pending_queued; });
+        if (!m_pending_queued) return;
+        m_pending_queued = false;
+        const std::shared_ptr<const PendingWrite> pending{m_pending};
+        bool ok{false};
+        {
+            REVERSE_LOCK(lock);
+            try {
+                ok = WriteCoins(pending->hash_block, [&](const auto& write) {
+                    for (const auto& [outpoint, coin] : pending->coins) {
+                        write(outpoint, &coin);
+                    }
+                });
+            } catch (const std::runtime_error& e) {
+                LogError("Failed to write coins to disk in the background: %s\n", e.what());
+            }
+        }
+        if (ok) {
+            m_pending.reset();
+        } else {
+            // Keep serving the coins from memory. The next BatchWrite() fails.
+            m_write_failed = true;
+        }
+        m_pending_cv.notify_all();
+    }
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return m_db->EstimateSize(DB_COIN, uint8_t(DB_COIN + 1));
@@ -179,6 +315,8 @@ private:
 
 std::unique_ptr<CCoinsViewCursor> CCoinsViewDB::Cursor() const
 {
+    // The cursor iterates over the database itself.
+    WaitForPendingWrite();
     auto i = std::make_unique<CCoinsViewDBCursor>(
         const_cast<CDBWrapper&>(*m_db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
@@ -12,10 +12,13 @@
 #include <sync.h>
 #include <util/fs.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <thread>
 #include <vector>
 
 class COutPoint;
@@ -39,6 +42,8 @@ static const int64_t nMaxTxIndexCache = 1024;
 static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 
 //! User-controlled performance and debug options.
 struct CoinsViewOptions {
@@ -47,17 +52,52 @@ struct CoinsViewOptions {
     //! If non-zero, randomly exit when the database is flushed with (1/ratio)
     //! probability.
     int simulate_crash_ratio = 0;
+    //! Write the coins passed to BatchWrite() on a background thread, instead
+    //! of before returning.
+    bool background_write = false;
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** CCoinsView backed by the coin database (chainstate/)
+ *
+ * With CoinsViewOptions::background_write, BatchWrite() only copies the dirty
+ * coins into a snapshot, and a writer thread writes the snapshot to the
+ * database in batches. Until it is done, reads are served from the snapshot
+ * first, so the view always reflects the last BatchWrite(). A BatchWrite()
+ * waits for the previous snapshot to be written first.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
+    struct PendingWrite;
+
     DBParams m_db_params;
     CoinsViewOptions m_options;
     std::unique_ptr<CDBWrapper> m_db;
+    //! Incremented when a write starts and when it is done. A snapshot handed
+    //! to the writer thread adds 2, as it is never observed half-written.
+    std::atomic<uint64_t> m_write_sequence{0};
+
+    mutable Mutex m_pending_mutex;
+    //! Signals a new snapshot to the writer thread, and a finished one to waiters.
+    mutable std::condition_variable m_pending_cv;
+    //! Snapshot that is not completely written yet. Reads check it before m_db.
+    std::shared_ptr<const PendingWrite> m_pending GUARDED_BY(m_pending_mutex);
+    //! Whether the writer thread has yet to pick up m_pending.
+    bool m_pending_queued GUARDED_BY(m_pending_mutex){false};
+    //! Whether a background write failed. The database is left inconsistent.
+    bool m_write_failed GUARDED_BY(m_pending_mutex){false};
+    bool m_request_stop GUARDED_BY(m_pending_mutex){false};
+    std::thread m_writer_thread;
+
+    std::shared_ptr<const PendingWrite> GetPending() const EXCLUSIVE_LOCKS_REQUIRED(!m_pending_mutex);
+    /** Write coins in batches of at most batch_write_bytes, marking the database as being in transition to hashBlock until the last one. */
+    template <typename Callable>
+    bool WriteCoins(const uint256& hashBlock, Callable&& for_each_coin);
+    void ThreadWrite() EXCLUSIVE_LOCKS_REQUIRED(!m_pending_mutex);
+
 public:
     explicit CCoinsViewDB(DBParams db_params, CoinsViewOptions options);
+    ~CCoinsViewDB() override;
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -71,7 +111,19 @@ public:
     size_t EstimateSize() const override;
 
     //! Dynamically alter the underlying leveldb cache size.
-    void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main, !m_pending_mutex);
+
+    //! @returns the memory used by coins BatchWrite() copied that are still
+    //!          being written in the background.
+    size_t PendingWriteUsage() const EXCLUSIVE_LOCKS_REQUIRED(!m_pending_mutex);
+
+    //! Wait until the coins of all previous BatchWrite() calls are in the database.
+    //! @returns false if a background write failed.
+    bool WaitForPendingWrite() const EXCLUSIVE_LOCKS_REQUIRED(!m_pending_mutex);
+
+    //! @returns a number that changes whenever the coins change, and is odd
+    //!          while a write that reads may see half-done is in progress.
+    uint64_t GetWriteSequence() const { return m_write_sequence.load(); }
 
     //! @returns filesystem path to on-disk storage or std::nullopt if in memory.
     std::optional<fs::path> StoragePath() { return m_db->StoragePath(); }
@@ -0,0 +1,327 @@
+// Copyright (c) The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_FLATNODEMAP_H
+#define BITCOIN_UTIL_FLATNODEMAP_H
+
+#include <util/check.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Hash map largely mimicking std::unordered_map, but indexing its nodes with an open addressing table.
+ *
+ * - Elements live in nodes of their own, allocated with the given allocator, so pointers and references
+ *   to them stay valid until they are erased, like for std::unordered_map.
+ * - The nodes are found through a flat, linearly probed table instead of per-bucket linked lists. Per
+ *   slot, it holds one control byte with 7 bits of the hash, and a pointer to the node. Lookups scan
+ *   the control bytes, and only compare keys of nodes whose hash bits match.
+ * - Nodes have no bucket list pointer and the hash is not stored, so they are exactly
+ *   sizeof(value_type) large.
+ * - Iterators are invalidated by insertions that grow the table, and follow the table order.
+ * - Supports the subset of the std::unordered_map interface that is used, plus capacity().
+ */
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename Allocator>
+class FlatNodeMap
+{
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using allocator_type = Allocator;
+
+private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    /** Control byte of a slot that never held a node. Probing stops here. */
+    static constexpr uint8_t EMPTY{0x80};
+    /** Control byte of a slot whose node was erased. Probing continues past it. */
+    static constexpr uint8_t DELETED{0xfe};
+    /** Slots with a node have the high bit clear, and the low 7 bits of the hash in their control byte. */
+    static constexpr bool IsFull(uint8_t ctrl) noexcept { return !(ctrl & 0x80); }
+    static constexpr uint8_t HashBits(size_t hash) noexcept { return hash & 0x7f; }
+    /** Smallest table allocated. */
+    static constexpr size_t MIN_CAPACITY{16};
+    /** Whether capacity slots can hold used (full or deleted) slots, keeping the load at most 7/8. */
+    static constexpr bool Fits(size_t used, size_t capacity) noexcept { return used <= capacity - capacity / 8; }
+
+    Hash m_hash;
+    KeyEqual m_equal;
+    NodeAllocator m_alloc;
+    /** Control bytes, one per slot. Its size is the capacity, a power of two or 0. */
+    std::vector<uint8_t> m_ctrl;
+    /** Node of each slot, if any. */
+    std::vector<value_type*> m_slots;
+    /** Number of nodes. */
+    size_t m_size{0};
+    /** Number of DELETED slots. */
+    size_t m_deleted{0};
+
+    size_t Mask() const noexcept { return m_ctrl.size() - 1; }
+
+    /** Position of the node with the given key, or the capacity if there is none. */
+    size_t Find(const Key& key, size_t hash) const
+    {
+        if (m_ctrl.empty()) return 0;
+        const uint8_t bits{HashBits(hash)};
+        for (size_t pos{(hash >> 7) & Mask()};; pos = (pos + 1) & Mask()) {
+            const uint8_t ctrl{m_ctrl[pos]};
+            if (ctrl == EMPTY) return m_ctrl.size();
+            if (ctrl == bits && m_equal(m_slots[pos]->first, key)) return pos;
+        }
+    }
+
+    /** Put a node into the first free slot of its probe sequence. The table must have room for it. */
+    size_t Place(value_type* node, size_t hash) noexcept
+    {
+        size_t pos{(hash >> 7) & Mask()};
+        while (IsFull(m_ctrl[pos])) pos = (pos + 1) & Mask();
+        if (m_ctrl[pos] == DELETED) --m_deleted;
+        m_ctrl[pos] = HashBits(hash);
+        m_slots[pos] = node;
+        ++m_size;
+        return pos;
+    }
+
+    /** Rebuild the table with the given capacity, dropping all DELETED slots. */
+    void Rehash(size_t capacity)
+    {
+        Assume(capacity >= MIN_CAPACITY && (capacity & (capacity - 1)) == 0 && Fits(m_size, capacity));
+        std::vector<uint8_t> old_ctrl(capacity, EMPTY);
+        std::vector<value_type*> old_slots(capacity);
+        m_ctrl.swap(old_ctrl);
+        m_slots.swap(old_slots);
+        m_size = 0;
+        m_deleted = 0;
+        for (size_t pos{0}; pos < old_ctrl.size(); ++pos) {
+            if (IsFull(old_ctrl[pos])) Place(old_slots[pos], m_hash(old_slots[pos]->first));
+        }
+    }
+
+    /** Make room for one more node, growing the table if half of the used slots are nodes. */
+    void ReserveOne()
+    {
+        if (m_ctrl.empty()) return Rehash(MIN_CAPACITY);
+        if (Fits(m_size + m_deleted + 1, m_ctrl.size())) return;
+        Rehash(m_size + 1 > (m_size + m_deleted) / 2 ? m_ctrl.size() * 2 : m_ctrl.size());
+    }
+
+    template <typename... Args>
+    value_type* NewNode(Args&&... args)
+    {
+        value_type* node{NodeTraits::allocate(m_alloc, 1)};
+        try {
+            NodeTraits::construct(m_alloc, node, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(m_alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    void DeleteNode(value_type* node) noexcept
+    {
+        NodeTraits::destroy(m_alloc, node);
+        NodeTraits::deallocate(m_alloc, node, 1);
+    }
+
+    /** Add a node that is not in the map yet, taking ownership of it. */
+    size_t Insert(value_type* node, size_t hash)
+    {
+        try {
+            ReserveOne();
+        } catch (...) {
+            DeleteNode(node);
+            throw;
+        }
+        return Place(node, hash);
+    }
+
+    void Erase(size_t pos) noexcept
+    {
+        DeleteNode(m_slots[pos]);
+        m_slots[pos] = nullptr;
+        --m_size;
+        // No probe sequence continues past an EMPTY slot, so if the next slot is
+        // EMPTY, none needs to go through this one either.
+        if (m_ctrl[(pos + 1) & Mask()] == EMPTY) {
+            m_ctrl[pos] = EMPTY;
+        } else {
+            m_ctrl[pos] = DELETED;
+            ++m_deleted;
+        }
+    }
+
+public:
+    template <bool CONST>
+    class Iterator
+    {
+        friend class FlatNodeMap;
+        template <bool>
+        friend class Iterator;
+
+        const uint8_t* m_ctrl{nullptr};
+        const uint8_t* m_ctrl_end{nullptr};
+        std::pair<const Key, T>* const* m_slot{nullptr};
+
+        Iterator(const FlatNodeMap& map, size_t pos) noexcept
+            : m_ctrl{map.m_ctrl.data() + pos}, m_ctrl_end{map.m_ctrl.data() + map.m_ctrl.size()}, m_slot{map.m_slots.data() + pos} {}
+
+        void SkipFree() noexcept
+        {
+            while (m_ctrl != m_ctrl_end && !IsFull(*m_ctrl)) {
+                ++m_ctrl;
+                ++m_slot;
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FlatNodeMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<CONST, const value_type*, value_type*>;
+        using reference = std::conditional_t<CONST, const value_type&, value_type&>;
+
+        Iterator() noexcept = default;
+        template <bool OTHER_CONST>
+            requires(CONST && !OTHER_CONST)
+        Iterator(const Iterator<OTHER_CONST>& other) noexcept
+            : m_ctrl{other.m_ctrl}, m_ctrl_end{other.m_ctrl_end}, m_slot{other.m_slot} {}
+
+        reference operator*() const noexcept { return **m_slot; }
+        pointer operator->() const noexcept { return *m_slot; }
+        Iterator& operator++() noexcept
+        {
+            ++m_ctrl;
+            ++m_slot;
+            SkipFree();
+            return *this;
+        }
+        Iterator operator++(int) noexcept
+        {
+            Iterator ret{*this};
+            ++*this;
+            return ret;
+        }
+        template <bool OTHER_CONST>
+        bool operator==(const Iterator<OTHER_CONST>& other) const noexcept { return m_slot == other.m_slot; }
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    /** Construct a map with room for at least capacity elements. */
+    FlatNodeMap(size_type capacity, const hasher& hash, const key_equal& equal, const allocator_type& alloc)
+        : m_hash{hash}, m_equal{equal}, m_alloc{alloc}
+    {
+        reserve(capacity);
+    }
+
+    ~FlatNodeMap() { clear(); }
+
+    FlatNodeMap(const FlatNodeMap&) = delete;
+    FlatNodeMap& operator=(const FlatNodeMap&) = delete;
+
+    allocator_type get_allocator() const noexcept { return allocator_type{m_alloc}; }
+
+    size_type size() const noexcept { return m_size; }
+    bool empty() const noexcept { return m_size == 0; }
+    /** Number of slots of the table. */
+    size_type capacity() const noexcept { return m_ctrl.size(); }
+
+    iterator begin() noexcept
+    {
+        iterator it{*this, 0};
+        it.SkipFree();
+        return it;
+    }
+    const_iterator begin() const noexcept
+    {
+        const_iterator it{*this, 0};
+        it.SkipFree();
+        return it;
+    }
+    iterator end() noexcept { return {*this, m_ctrl.size()}; }
+    const_iterator end() const noexcept { return {*this, m_ctrl.size()}; }
+
+    iterator find(const key_type& key) { return {*this, Find(key, m_hash(key))}; }
+    const_iterator find(const key_type& key) const { return {*this, Find(key, m_hash(key))}; }
+
+    /** Insert an element with the given key if there is none, constructing the mapped value from args. */
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+    {
+        const size_t hash{m_hash(key)};
+        const size_t pos{Find(key, hash)};
+        if (pos != m_ctrl.size()) return {iterator{*this, pos}, false};
+        value_type* node{NewNode(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...))};
+        return {iterator{*this, Insert(node, hash)}, true};
+    }
+
+    /** Construct an element from args, and insert it unless there is one with the same key. */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        value_type* node{NewNode(std::forward<Args>(args)...)};
+        const size_t hash{m_hash(node->first)};
+        const size_t pos{Find(node->first, hash)};
+        if (pos != m_ctrl.size()) {
+            DeleteNode(node);
+            return {iterator{*this, pos}, false};
+        }
+        return {iterator{*this, Insert(node, hash)}, true};
+    }
+
+    mapped_type& operator[](const key_type& key) { return try_emplace(key).first->second; }
+
+    iterator erase(const_iterator it) noexcept
+    {
+        const size_t pos = it.m_slot - m_slots.data();
+        Erase(pos);
+        iterator next{*this, pos};
+        ++next;
+        return next;
+    }
+
+    size_type erase(const key_type& key)
+    {
+        const size_t pos{Find(key, m_hash(key))};
+        if (pos == m_ctrl.size()) return 0;
+        Erase(pos);
+        return 1;
+    }
+
+    /** Erase all elements, keeping the table allocated. */
+    void clear() noexcept
+    {
+        for (size_t pos{0}; pos < m_ctrl.size(); ++pos) {
+            if (IsFull(m_ctrl[pos])) DeleteNode(m_slots[pos]);
+            m_ctrl[pos] = EMPTY;
+        }
+        m_size = 0;
+        m_deleted = 0;
+    }
+
+    /** Make sure count elements fit without growing the table. */
+    void reserve(size_type count)
+    {
+        if (count == 0 || Fits(count + m_deleted, m_ctrl.size())) return;
+        size_t capacity{std::max(MIN_CAPACITY, m_ctrl.size())};
+        while (!Fits(count, capacity)) capacity *= 2;
+        Rehash(capacity);
+    }
+};
+
+#endif // BITCOIN_UTIL_FLATNODEMAP_H
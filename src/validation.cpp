@@ -18,6 +18,7 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/flex/flex.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
@@ -91,6 +92,8 @@ using node::SnapshotMetadata;
 static constexpr std::chrono::hours DATABASE_WRITE_INTERVAL{1};
 /** Time to wait between flushing chainstate to disk. */
 static constexpr std::chrono::hours DATABASE_FLUSH_INTERVAL{24};
+/** Percentage of the coins cache size kept, as the most recently used coins, when it has grown too large. */
+static constexpr size_t COINS_CACHE_KEEP_PERCENT{50};
 /** Maximum age of our tip for us to be considered current for fee estimation */
 static constexpr std::chrono::hours MAX_FEE_ESTIMATION_TIP_AGE{3};
 const std::vector<std::string> CHECKLEVEL_DOC {
@@ -1922,7 +1925,8 @@ PackageMempoolAcceptResult ProcessNewPackage(Chainstate& active_chainstate, CTxM
 // CBlock and CBlockIndex
 //
 
-util::Result<bool> CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+/** The checks of CheckProofOfWork() that do not hash the block: chain ID, version and auxpow merkle branches. */
+static util::Result<bool> CheckProofOfWorkCommitments(const CBlockHeader& block, const Consensus::Params& params)
 {
     /* Except for legacy blocks with full version 1, ensure that
        the chain ID is correct.  Legacy blocks are not allowed since
@@ -1935,30 +1939,43 @@ util::Result<bool> CheckProofOfWork(const CBlockHeader& block, const Consensus::
                      __func__, block.GetChainId(),
                      params.nAuxpowChainId, block.nVersion)};
 
-    /* If there is no auxpow, just check the block hash.  */
     if (!block.auxpow)
     {
         if (block.IsAuxpow())
             return util::Error{strprintf(Untranslated("%s : no auxpow on block with auxpow version"), __func__)};
-
-        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
-            return util::Error{strprintf(Untranslated("%s : non-AUX proof of work failed"), __func__)};
-
         return true;
     }
 
-    /* We have auxpow.  Check it.  */
     if (!block.IsAuxpow())
         return util::Error{strprintf(Untranslated("%s : auxpow on block with non-auxpow version"), __func__)};
+    if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
+        return util::Error{strprintf(Untranslated("%s : AUX POW is not valid"), __func__)};
+
+    return true;
+}
+
+/** Check the PoW hash of the block, or of the auxpow parent block, against nBits. */
+static util::Result<bool> CheckProofOfWorkHash(const CBlockHeader& block, const Consensus::Params& params)
+{
+    if (!block.auxpow) {
+        if (!CheckProofOfWork(block.GetPoWHash(), block.nBits, params))
+            return util::Error{strprintf(Untranslated("%s : non-AUX proof of work failed"), __func__)};
+        return true;
+    }
 
     if (!CheckProofOfWork(block.auxpow->getParentBlock().GetPoWHash(block.nVersion), block.nBits, params))
         return util::Error{strprintf(Untranslated("%s : AUX proof of work failed"), __func__)};
-    if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
-        return util::Error{strprintf(Untranslated("%s : AUX POW is not valid"), __func__)};
 
     return true;
 }
 
+util::Result<bool> CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+{
+    // The merkle branches are cheap next to a Flex hash, so check them first.
+    if (auto result{CheckProofOfWorkCommitments(block, params)}; !result) return result;
+    return CheckProofOfWorkHash(block, params);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     if(nHeight == 0) return 0;
@@ -1997,9 +2014,14 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
     return nSubsidy;
 }
 
-CoinsViews::CoinsViews(DBParams db_params, CoinsViewOptions options)
+CoinsViews::CoinsViews(DBParams db_params, CoinsViewOptions options, int prefetch_threads)
     : m_dbview{std::move(db_params), std::move(options)},
-      m_catcherview(&m_dbview) {}
+      m_catcherview(&m_dbview)
+{
+    if (prefetch_threads > 0) {
+        m_prefetcher = std::make_unique<CoinsPrefetcher>(m_dbview, prefetch_threads);
+    }
+}
 
 void CoinsViews::InitCache()
 {
@@ -2042,7 +2064,18 @@ void Chainstate::InitCoinsDB(
             .wipe_data = should_wipe,
             .obfuscate = true,
             .options = m_chainman.m_options.coins_db},
-        m_chainman.m_options.coins_view);
+        m_chainman.m_options.coins_view,
+        m_chainman.m_options.coins_prefetch_threads);
+}
+
+void Chainstate::PrefetchCoins(const CBlock& block, const CBlockIndex& pindex)
+{
+    AssertLockHeld(::cs_main);
+    if (!m_coins_views || !m_coins_views->m_prefetcher || !m_coins_views->m_cacheview) return;
+    // Only blocks this chainstate is going to connect next.
+    const CBlockIndex* tip{m_chain.Tip()};
+    if (!tip || pindex.nHeight <= tip->nHeight || pindex.GetAncestor(tip->nHeight) != tip) return;
+    m_coins_views->m_prefetcher->Prefetch(block, CoinsTip());
 }
 
 void Chainstate::InitCoinsCache(size_t cache_size_bytes)
@@ -2862,7 +2895,8 @@ CoinsCacheSizeState Chainstate::GetCoinsCacheSizeState(
 {
     AssertLockHeld(::cs_main);
     const int64_t nMempoolUsage = m_mempool ? m_mempool->DynamicMemoryUsage() : 0;
-    int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+    // Coins still being written in the background hold a copy of their own.
+    int64_t cacheSize = CoinsTip().DynamicMemoryUsage() - CoinsTip().ReusableMemoryUsage() + CoinsDB().PendingWriteUsage();
     int64_t nTotalSpace =
         max_coins_cache_size_bytes + std::max<int64_t>(int64_t(max_mempool_size_bytes) - nMempoolUsage, 0);
 
@@ -3006,10 +3040,26 @@ bool Chainstate::FlushStateToDisk(
                 return FatalError(m_chainman.GetNotifications(), state, _("Disk space is too low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
-            const auto empty_cache{(mode == FlushStateMode::ALWAYS) || fCacheLarge || fCacheCritical};
+            const auto empty_cache{mode == FlushStateMode::ALWAYS};
             if (empty_cache ? !CoinsTip().Flush() : !CoinsTip().Sync()) {
                 return FatalError(m_chainman.GetNotifications(), state, _("Failed to write to coin database."));
             }
+            // Rather than emptying a cache that grew too large, only evict the
+            // coins that were not used lately, so that it stays warm. Leave
+            // room for the copy of the coins that is written in the background.
+            if (fCacheLarge || fCacheCritical) {
+                LOG_TIME_MILLIS_WITH_CATEGORY("evict coins from cache", BCLog::BENCH);
+                const size_t pending_usage{std::min(CoinsDB().PendingWriteUsage(), m_coinstip_cache_size_bytes)};
+                const size_t keep_bytes{std::min(m_coinstip_cache_size_bytes * COINS_CACHE_KEEP_PERCENT / 100, m_coinstip_cache_size_bytes - pending_usage)};
+                const size_t evicted{CoinsTip().Evict(keep_bytes)};
+                LogDebug(BCLog::COINDB, "Evicted %d coins from cache, %d left\n", evicted, CoinsTip().GetCacheSize());
+            }
+            // The coins may still be written in the background. The blocks
+            // pruned above could be needed to replay an unfinished write, so
+            // wait for it, as if it had been written right away.
+            if (fFlushForPrune && !CoinsDB().WaitForPendingWrite()) {
+                return FatalError(m_chainman.GetNotifications(), state, _("Failed to write to coin database."));
+            }
             m_last_flush = nNow;
             full_flush_completed = true;
             TRACE5(utxocache, flush,
@@ -3022,6 +3072,9 @@ bool Chainstate::FlushStateToDisk(
     }
     if (full_flush_completed && m_chainman.m_options.signals) {
         // Update best block in wallet (so we can detect restored wallets).
+        // The coins may not be durable yet when written in the background.
+        // After a crash the chainstate replays the blocks up to this tip
+        // again, so the locator is still one the node gets back to.
         m_chainman.m_options.signals->ChainStateFlushed(this->GetRole(), m_chain.GetLocator());
     }
     } catch (const std::runtime_error& e) {
@@ -3246,6 +3299,7 @@ bool Chainstate::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew,
     assert(pindexNew->pprev == m_chain.Tip());
     // Read block from disk.
     const auto time_1{SteadyClock::now()};
+    const BlockHashMemoStats memo_before{GetBlockHashMemoStats()};
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
@@ -3265,6 +3319,12 @@ bool Chainstate::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew,
     // num_blocks_total may be zero until the ConnectBlock() call below.
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms\n",
              Ticks<MillisecondsDouble>(time_2 - time_1));
+    if (m_coins_views->m_prefetcher) {
+        // Read the coins of a block loaded from disk in parallel now, and add
+        // those read since the block was received to the cache.
+        PrefetchCoins(blockConnecting, *pindexNew);
+        m_coins_views->m_prefetcher->Apply(pindexNew->GetBlockHash(), CoinsTip());
+    }
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view);
@@ -3323,6 +3383,11 @@ bool Chainstate::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew,
              Ticks<MillisecondsDouble>(time_6 - time_1),
              Ticks<SecondsDouble>(m_chainman.time_total),
              Ticks<MillisecondsDouble>(m_chainman.time_total) / m_chainman.num_blocks_total);
+    // The counters are per thread, so this only covers the hashes of this block's connection.
+    const BlockHashMemoStats memo_stats{GetBlockHashMemoStats()};
+    LogPrint(BCLog::BENCH, "- Block hash memo: %u hashes saved, %u computed\n",
+             memo_stats.hits - memo_before.hits,
+             memo_stats.computed - memo_before.computed);
 
     // If we are the background validation chainstate, check to see if we are done
     // validating the snapshot (i.e. our tip has reached the snapshot's base block).
@@ -3946,7 +4011,7 @@ void Chainstate::TryAddBlockIndexCandidate(CBlockIndex* pindex)
 }
 
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
-void ChainstateManager::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos)
+void ChainstateManager::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, std::optional<uint32_t> checksum)
 {
     AssertLockHeld(cs_main);
     pindexNew->nTx = block.vtx.size();
@@ -3965,6 +4030,7 @@ void ChainstateManager::ReceivedBlockTransactions(const CBlock& block, CBlockInd
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
+    pindexNew->nDataChecksum = checksum;
     pindexNew->nStatus |= BLOCK_HAVE_DATA;
     if (DeploymentActiveAt(*pindexNew, *this, Consensus::DEPLOYMENT_SEGWIT)) {
         pindexNew->nStatus |= BLOCK_OPT_WITNESS;
@@ -4216,10 +4282,78 @@ std::vector<unsigned char> ChainstateManager::GenerateCoinbaseCommitment(CBlock&
     return commitment;
 }
 
+/** Compute the PoW hashes of the given headers together, so that checking them hits the cache. */
+static void CacheHeaderPoWHashes(Span<const CBlockHeader> headers)
+{
+    std::vector<std::pair<const CPureBlockHeader*, int32_t>> pow_headers;
+    pow_headers.reserve(headers.size());
+    for (const CBlockHeader& header : headers) {
+        if (header.auxpow) {
+            pow_headers.emplace_back(&header.auxpow->getParentBlock(), header.nVersion);
+        } else {
+            pow_headers.emplace_back(&header, header.nVersion);
+        }
+    }
+    CPureBlockHeader::CachePoWHashes(pow_headers);
+}
+
+static bool HasValidProofOfWork(Span<const CBlockHeader> headers, CHeaderPoWCheck::Stage stage, const Consensus::Params& consensusParams)
+{
+    if (stage == CHeaderPoWCheck::Stage::COMMITMENTS) {
+        return std::all_of(headers.begin(), headers.end(),
+                [&](const auto& header) { return CheckProofOfWorkCommitments(header, consensusParams); });
+    }
+    CacheHeaderPoWHashes(headers);
+    return std::all_of(headers.begin(), headers.end(),
+            [&](const auto& header) { return CheckProofOfWorkHash(header, consensusParams); });
+}
+
+/** Split headers into chunks of up to FLEX_MAX_LANES, whose Flex hashes are computed together. */
+static std::vector<Span<const CBlockHeader>> SplitHeaders(const std::vector<CBlockHeader>& headers)
+{
+    std::vector<Span<const CBlockHeader>> chunks;
+    chunks.reserve((headers.size() + FLEX_MAX_LANES - 1) / FLEX_MAX_LANES);
+    for (size_t i = 0; i < headers.size(); i += FLEX_MAX_LANES) {
+        chunks.push_back(Span{headers}.subspan(i, std::min(FLEX_MAX_LANES, headers.size() - i)));
+    }
+    return chunks;
+}
+
 bool HasValidProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams)
 {
-    return std::all_of(headers.cbegin(), headers.cend(),
-            [&](const auto& header) { return CheckProofOfWork(header, consensusParams);});
+    // Reject invalid auxpow anywhere in the batch before any Flex hash is computed.
+    if (!HasValidProofOfWork(headers, CHeaderPoWCheck::Stage::COMMITMENTS, consensusParams)) return false;
+    for (const auto& chunk : SplitHeaders(headers)) {
+        if (!HasValidProofOfWork(chunk, CHeaderPoWCheck::Stage::HASHES, consensusParams)) return false;
+    }
+    return true;
+}
+
+bool CHeaderPoWCheck::operator()()
+{
+    return HasValidProofOfWork(m_headers, m_stage, *m_params);
+}
+
+bool HasValidProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, CCheckQueue<CHeaderPoWCheck>* check_queue)
+{
+    if (check_queue == nullptr || !check_queue->HasThreads() || headers.size() <= FLEX_MAX_LANES) {
+        return HasValidProofOfWork(headers, consensusParams);
+    }
+
+    const auto chunks{SplitHeaders(headers)};
+    // All commitments are checked in a first round, so that no worker
+    // starts on Flex hashes while a later header's auxpow is invalid.
+    for (const auto stage : {CHeaderPoWCheck::Stage::COMMITMENTS, CHeaderPoWCheck::Stage::HASHES}) {
+        std::vector<CHeaderPoWCheck> checks;
+        checks.reserve(chunks.size());
+        for (const auto& chunk : chunks) {
+            checks.emplace_back(chunk, stage, consensusParams);
+        }
+        CCheckQueueControl<CHeaderPoWCheck> control(check_queue);
+        control.Add(std::move(checks));
+        if (!control.Wait()) return false;
+    }
+    return true;
 }
 
 bool IsBlockMutated(const CBlock& block, bool check_witness_root)
@@ -4286,7 +4420,7 @@ static bool ContextualCheckBlockHeader(const CBlockHeader& block, BlockValidatio
                              "legacy block after auxpow start");
 
     // Check proof of work
-    if (block.nBits != GetNextWorkRequired(pindexPrev, &block, consensusParams))
+    if (block.nBits != GetNextWorkRequiredCached(pindexPrev, &block, consensusParams))
         return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "bad-diffbits", "incorrect proof of work");
 
     // Check against checkpoints
@@ -4486,6 +4620,12 @@ bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValida
         return state.Invalid(BlockValidationResult::BLOCK_HEADER_LOW_WORK, "too-little-chainwork");
     }
     CBlockIndex* pindex{m_blockman.AddToBlockIndex(block, m_best_header)};
+    // CheckBlockHeader() above verified the proof of work (the genesis block
+    // is hard-coded), record that so block reads can skip recomputing it.
+    if (!(pindex->nStatus & BLOCK_POW_VERIFIED)) {
+        pindex->nStatus |= BLOCK_POW_VERIFIED;
+        m_blockman.m_dirty_blockindex.insert(pindex);
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -4516,14 +4656,22 @@ bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>&
     AssertLockNotHeld(cs_main);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        // Check the nBits of the headers in one pass up front, and hand the
+        // results to the per-header checks through the block index.
+        const CBlockIndex* pindexPrev{headers.empty() ? nullptr : m_blockman.LookupBlockIndex(headers.front().hashPrevBlock)};
+        const size_t bits_checked{pindexPrev ? CheckNextWorkRequired(pindexPrev, headers, GetConsensus()) : 0};
+        for (size_t i = 0; i < headers.size(); ++i) {
+            if (i < bits_checked) {
+                SetNextWorkRequired(*pindexPrev, headers[i].nBits, GetConsensus());
+            }
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted{AcceptBlockHeader(header, state, &pindex, min_pow_checked)};
+            bool accepted{AcceptBlockHeader(headers[i], state, &pindex, min_pow_checked)};
             CheckBlockIndex();
 
             if (!accepted) {
                 return false;
             }
+            pindexPrev = pindex;
             if (ppindex) {
                 *ppindex = pindex;
             }
@@ -4639,17 +4787,18 @@ bool ChainstateManager::AcceptBlock(const std::shared_ptr<const CBlock>& pblock,
     if (fNewBlock) *fNewBlock = true;
     try {
         FlatFilePos blockPos{};
+        std::optional<uint32_t> checksum;
         if (dbp) {
             blockPos = *dbp;
             m_blockman.UpdateBlockInfo(block, pindex->nHeight, blockPos);
         } else {
-            blockPos = m_blockman.SaveBlockToDisk(block, pindex->nHeight);
+            blockPos = m_blockman.SaveBlockToDisk(block, pindex->nHeight, &checksum);
             if (blockPos.IsNull()) {
                 state.Error(strprintf("%s: Failed to find position to write new block to disk", __func__));
                 return false;
             }
         }
-        ReceivedBlockTransactions(block, pindex, blockPos);
+        ReceivedBlockTransactions(block, pindex, blockPos, checksum);
     } catch (const std::runtime_error& e) {
         return FatalError(GetNotifications(), state, strprintf(_("System error while saving block to disk: %s"), e.what()));
     }
@@ -4691,6 +4840,9 @@ bool ChainstateManager::ProcessNewBlock(const std::shared_ptr<const CBlock>& blo
             // Store to disk
             ret = AcceptBlock(block, state, &pindex, force_processing, nullptr, new_block, min_pow_checked);
         }
+        if (ret && pindex) {
+            ActiveChainstate().PrefetchCoins(*block, *pindex);
+        }
         if (!ret) {
             if (m_options.signals) {
                 m_options.signals->BlockChecked(*block, state);
@@ -5134,13 +5286,14 @@ bool Chainstate::LoadGenesisBlock()
 
     try {
         const CBlock& block = params.GenesisBlock();
-        FlatFilePos blockPos{m_blockman.SaveBlockToDisk(block, 0)};
+        std::optional<uint32_t> checksum;
+        FlatFilePos blockPos{m_blockman.SaveBlockToDisk(block, 0, &checksum)};
         if (blockPos.IsNull()) {
             LogError("%s: writing genesis block to disk failed\n", __func__);
             return false;
         }
         CBlockIndex* pindex = m_blockman.AddToBlockIndex(block, m_chainman.m_best_header);
-        m_chainman.ReceivedBlockTransactions(block, pindex, blockPos);
+        m_chainman.ReceivedBlockTransactions(block, pindex, blockPos, checksum);
     } catch (const std::runtime_error& e) {
         LogError("%s: failed to write genesis block: %s\n", __func__, e.what());
         return false;
@@ -5666,6 +5819,8 @@ bool Chainstate::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    // The database is reopened, which must not happen under reads in progress.
+    if (m_coins_views->m_prefetcher) m_coins_views->m_prefetcher->Cancel();
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n",
@@ -6379,6 +6534,7 @@ static ChainstateManager::Options&& Flatten(ChainstateManager::Options&& opts)
 
 ChainstateManager::ChainstateManager(const util::SignalInterrupt& interrupt, Options options, node::BlockManager::Options blockman_options)
     : m_script_check_queue{/*batch_size=*/128, options.worker_threads_num},
+      m_header_pow_check_queue{/*batch_size=*/1, options.header_pow_threads_num, "headerpow"},
       m_interrupt{interrupt},
       m_options{Flatten(std::move(options))},
       m_blockman{interrupt, std::move(blockman_options)},
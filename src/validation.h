@@ -10,6 +10,7 @@
 #include <attributes.h>
 #include <chain.h>
 #include <checkqueue.h>
+#include <coinsprefetch.h>
 #include <consensus/amount.h>
 #include <cuckoocache.h>
 #include <deploymentstatus.h>
@@ -23,6 +24,7 @@
 #include <policy/policy.h>
 #include <script/script_error.h>
 #include <script/sigcache.h>
+#include <span.h>
 #include <sync.h>
 #include <txdb.h>
 #include <txmempool.h> // For CTxMemPool::cs
@@ -400,9 +402,41 @@ bool TestBlockValidity(BlockValidationState& state,
                        bool fCheckPOW = true,
                        bool fCheckMerkleRoot = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Closure representing the proof-of-work check of a few consecutive block
+ * headers, so that the headers of a HEADERS message can be verified by worker
+ * threads. Each closure covers up to FLEX_MAX_LANES headers, whose Flex hashes
+ * are computed together.
+ */
+class CHeaderPoWCheck
+{
+public:
+    /** A batch is checked in two rounds, so that invalid auxpow is rejected before any Flex hash is computed. */
+    enum class Stage {
+        COMMITMENTS, //!< chain ID, version and auxpow merkle branches
+        HASHES,      //!< PoW hash of the header or auxpow parent block against nBits
+    };
+
+private:
+    Span<const CBlockHeader> m_headers;
+    Stage m_stage;
+    const Consensus::Params* m_params;
+
+public:
+    CHeaderPoWCheck(Span<const CBlockHeader> headers, Stage stage, const Consensus::Params& params) : m_headers(headers), m_stage(stage), m_params(&params) {}
+
+    bool operator()();
+};
+
 /** Check with the proof of work on each blockheader matches the value in nBits */
 bool HasValidProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams);
 
+/**
+ * Like HasValidProofOfWork(), but spread the checks over the worker threads of
+ * check_queue. Remaining checks are skipped once one of them has failed.
+ */
+bool HasValidProofOfWork(const std::vector<CBlockHeader>& headers, const Consensus::Params& consensusParams, CCheckQueue<CHeaderPoWCheck>* check_queue);
+
 /** Check if a block has been mutated (with respect to its merkle root and witness commitments). */
 bool IsBlockMutated(const CBlock& block, bool check_witness_root);
 
@@ -482,13 +516,17 @@ public:
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
 
+    //! Reads coins from m_dbview ahead of ConnectBlock(), to be added to m_cacheview. Null if
+    //! disabled. Declared last, so that its threads are stopped before the views go away.
+    std::unique_ptr<CoinsPrefetcher> m_prefetcher;
+
     //! This constructor initializes CCoinsViewDB and CCoinsViewErrorCatcher instances, but it
     //! *does not* create a CCoinsViewCache instance by default. This is done separately because the
     //! presence of the cache has implications on whether or not we're allowed to flush the cache's
     //! state to disk, which should not be done until the health of the database is verified.
     //!
-    //! All arguments forwarded onto CCoinsViewDB.
-    CoinsViews(DBParams db_params, CoinsViewOptions options);
+    //! The first two arguments are forwarded onto CCoinsViewDB.
+    CoinsViews(DBParams db_params, CoinsViewOptions options, int prefetch_threads = 0);
 
     //! Initialize the CCoinsViewCache member.
     void InitCache() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
@@ -652,6 +690,10 @@ public:
         return Assert(m_coins_views)->m_catcherview;
     }
 
+    //! Start reading the coins a block on top of the tip spends from disk, ahead
+    //! of connecting it.
+    void PrefetchCoins(const CBlock& block, const CBlockIndex& pindex) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
     //! Destructs all objects related to accessing the UTXO set.
     void ResetCoinsViews() { m_coins_views.reset(); }
 
@@ -962,6 +1004,10 @@ private:
     //! A queue for script verifications that have to be performed by worker threads.
     CCheckQueue<CScriptCheck> m_script_check_queue;
 
+    //! A queue for header proof-of-work verifications that have to be performed by worker threads.
+    //! It has its own threads (-parheaders), separate from the script check queue.
+    CCheckQueue<CHeaderPoWCheck> m_header_pow_check_queue;
+
     //! Timers and counters used for benchmarking validation in both background
     //! and active chainstates.
     SteadyClock::duration GUARDED_BY(::cs_main) time_check{};
@@ -1253,7 +1299,8 @@ public:
      */
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock, bool min_pow_checked) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-    void ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** checksum is the crc32c of the block data at pos, if it was recorded when the block was written. */
+    void ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, std::optional<uint32_t> checksum) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     /**
      * Try to add a transaction to the memory pool.
@@ -1329,6 +1376,7 @@ public:
     std::optional<int> GetSnapshotBaseHeight() const EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
     CCheckQueue<CScriptCheck>& GetCheckQueue() { return m_script_check_queue; }
+    CCheckQueue<CHeaderPoWCheck>& GetHeaderPoWCheckQueue() { return m_header_pow_check_queue; }
 
     ~ChainstateManager();
 };
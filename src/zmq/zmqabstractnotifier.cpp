@@ -42,3 +42,8 @@ bool CZMQAbstractNotifier::NotifyTransactionRemoval(const CTransaction &/*transa
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyAuxBlock(const CScript& /*script_pub_key*/, const uint256& /*hash*/, const uint256& /*target*/, int32_t /*chain_id*/)
+{
+    return true;
+}
@@ -11,8 +11,10 @@
 #include <string>
 
 class CBlockIndex;
+class CScript;
 class CTransaction;
 class CZMQAbstractNotifier;
+class uint256;
 
 using CZMQNotifierFactory = std::function<std::unique_ptr<CZMQAbstractNotifier>()>;
 
@@ -56,6 +58,8 @@ public:
     virtual bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t mempool_sequence);
     // Notifies of transactions added to mempool or appearing in blocks
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    // Notifies of new merge-mining work
+    virtual bool NotifyAuxBlock(const CScript& script_pub_key, const uint256& hash, const uint256& target, int32_t chain_id);
 
 protected:
     void* psocket{nullptr};
@@ -11,6 +11,7 @@
 #include <netbase.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <uint256.h>
 #include <validationinterface.h>
 #include <zmq/zmqabstractnotifier.h>
 #include <zmq/zmqpublishnotifier.h>
@@ -50,6 +51,7 @@ std::unique_ptr<CZMQNotificationInterface> CZMQNotificationInterface::Create(std
     };
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
+    factories["pubhashauxblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashAuxBlockNotifier>;
 
     std::list<std::unique_ptr<CZMQAbstractNotifier>> notifiers;
     for (const auto& entry : factories)
@@ -209,4 +211,11 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
     });
 }
 
+void CZMQNotificationInterface::NotifyAuxBlock(const CScript& script_pub_key, const uint256& hash, const uint256& target, int32_t chain_id)
+{
+    TryForEachAndRemoveFailed(notifiers, [&script_pub_key, &hash, &target, chain_id](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyAuxBlock(script_pub_key, hash, target, chain_id);
+    });
+}
+
 std::unique_ptr<CZMQNotificationInterface> g_zmq_notification_interface;
@@ -16,7 +16,9 @@
 
 class CBlock;
 class CBlockIndex;
+class CScript;
 class CZMQAbstractNotifier;
+class uint256;
 struct NewMempoolTransactionInfo;
 
 class CZMQNotificationInterface final : public CValidationInterface
@@ -28,6 +30,9 @@ public:
 
     static std::unique_ptr<CZMQNotificationInterface> Create(std::function<bool(std::vector<uint8_t>&, const CBlockIndex&)> get_block_by_index);
 
+    // Publishes new merge-mining work; called from the validation interface queue
+    void NotifyAuxBlock(const CScript& script_pub_key, const uint256& hash, const uint256& target, int32_t chain_id);
+
 protected:
     bool Initialize();
     void Shutdown();
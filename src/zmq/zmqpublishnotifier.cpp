@@ -15,6 +15,7 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
+#include <script/script.h>
 #include <serialize.h>
 #include <streams.h>
 #include <sync.h>
@@ -23,6 +24,7 @@
 
 #include <zmq.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <cstddef>
@@ -45,6 +47,7 @@ static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_SEQUENCE  = "sequence";
+static const char *MSG_HASHAUXBLOCK = "hashauxblock";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -301,3 +304,18 @@ bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &t
     LogPrint(BCLog::ZMQ, "Publish hashtx mempool removal %s to %s\n", hash.GetHex(), this->address);
     return SendSequenceMsg(*this, hash, /* Mempool (R)emoval */ 'R', mempool_sequence);
 }
+
+bool CZMQPublishHashAuxBlockNotifier::NotifyAuxBlock(const CScript& script_pub_key, const uint256& hash, const uint256& target, int32_t chain_id)
+{
+    LogPrint(BCLog::ZMQ, "Publish hashauxblock %s to %s\n", hash.GetHex(), this->address);
+    /* Hash and target in the byte order of createauxblock's "hash" and
+       "_target", followed by the chain ID and the payout script. */
+    std::vector<uint8_t> data(68 + script_pub_key.size());
+    for (unsigned int i = 0; i < 32; i++) {
+        data[31 - i] = hash.begin()[i];
+    }
+    std::copy(target.begin(), target.end(), data.begin() + 32);
+    WriteLE32(data.data() + 64, chain_id);
+    std::copy(script_pub_key.begin(), script_pub_key.end(), data.begin() + 68);
+    return SendZmqMessage(MSG_HASHAUXBLOCK, data.data(), data.size());
+}
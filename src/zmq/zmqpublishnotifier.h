@@ -63,6 +63,12 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+class CZMQPublishHashAuxBlockNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyAuxBlock(const CScript& script_pub_key, const uint256& hash, const uint256& target, int32_t chain_id) override;
+};
+
 class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
 {
 public:
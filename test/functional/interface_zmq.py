@@ -26,6 +26,7 @@ from test_framework.messages import (
 )
 from test_framework.util import (
     assert_equal,
+    assert_raises,
     assert_raises_rpc_error,
     p2p_port,
 )
@@ -130,6 +131,7 @@ class ZMQTest (BitcoinTestFramework):
             self.test_reorg()
             self.test_multiple_interfaces()
             self.test_ipv6()
+            self.test_hashauxblock()
         finally:
             # Destroy the ZMQ context.
             self.log.debug("Destroying ZMQ context")
@@ -595,6 +597,71 @@ class ZMQTest (BitcoinTestFramework):
         # Should receive the same block hash
         assert_equal(self.nodes[0].getbestblockhash(), subscribers[0].receive().hex())
 
+    def test_hashauxblock(self):
+        self.log.info("Testing 'hashauxblock' publisher")
+        address = f"tcp://127.0.0.1:{self.zmq_port_base}"
+        self.restart_node(0, [f"-zmqpubhashauxblock={address}"])
+        socket = self.ctx.socket(zmq.SUB)
+        sub = ZMQSubscriber(socket, b"hashauxblock")
+        socket.connect(address)
+
+        node = self.nodes[0]
+        addr1 = ADDRESS_BCRT1_UNSPENDABLE
+        addr2 = ADDRESS_BCRT1_P2WSH_OP_TRUE
+        script1 = bytes.fromhex(node.validateaddress(addr1)["scriptPubKey"])
+        script2 = bytes.fromhex(node.validateaddress(addr2)["scriptPubKey"])
+
+        def receive_work():
+            body = sub.receive()
+            return {
+                "hash": body[:32].hex(),
+                "_target": body[32:64].hex(),
+                "chainid": struct.unpack("<i", body[64:68])[0],
+                "script": body[68:],
+            }
+
+        # Nothing is published before createauxblock was called. New work is
+        # built after a new block, but the subscription may only be ready
+        # after a few tries.
+        node.createauxblock(addr1)
+        socket.set(zmq.RCVTIMEO, 3000)
+        while True:
+            self.generatetoaddress(node, 1, ADDRESS_BCRT1_UNSPENDABLE, sync_fun=self.no_op)
+            try:
+                receive_work()
+                break
+            except zmq.error.Again:
+                self.log.debug("Didn't receive hashauxblock notification, trying again.")
+        # Drop the work of earlier tries.
+        socket.set(zmq.RCVTIMEO, 2000)
+        try:
+            while True:
+                receive_work()
+        except zmq.error.Again:
+            pass
+        socket.set(zmq.RCVTIMEO, 60000)
+
+        # The work matches what createauxblock returns, in the same byte order.
+        node.createauxblock(addr2)
+        self.generatetoaddress(node, 1, ADDRESS_BCRT1_UNSPENDABLE, sync_fun=self.no_op)
+        work1 = receive_work()
+        work2 = receive_work()
+        assert_equal(work1["script"], script1)
+        assert_equal(work2["script"], script2)
+        for work, addr in [(work1, addr1), (work2, addr2)]:
+            auxblock = node.createauxblock(addr)
+            assert_equal(work["hash"], auxblock["hash"])
+            assert_equal(work["_target"], auxblock["_target"])
+            assert_equal(work["chainid"], auxblock["chainid"])
+        assert work1["hash"] != work2["hash"]
+
+        # Unchanged work is not published again.
+        socket.set(zmq.RCVTIMEO, 3000)
+        assert_raises(zmq.error.Again, sub.receive)
+
+        self.restart_node(0)
+        socket.close()
+
 
 if __name__ == '__main__':
     ZMQTest(__file__).main()